@@ -448,7 +448,7 @@ int InviteDialog::getInviteVersion(bool compatibilityMode)
 	// and only then being told that the version is outdated and figuring things
 	// out from there themselves.
 	// 0 => dp:4.24.0 (Drawpile 2.2)
-	// 1 => dp:4.25.1 (Drawpile 2.3)
+	// 1 => dp:4.25.1, dp:4.25.2 (Drawpile 2.3)
 
 #ifdef DP_PROTOCOL_COMPAT_VERSION
 	static_assert(
@@ -464,7 +464,7 @@ int InviteDialog::getInviteVersion(bool compatibilityMode)
 
 	static_assert(
 		DP_PROTOCOL_VERSION_SERVER == 4 && DP_PROTOCOL_VERSION_MAJOR == 25 &&
-			DP_PROTOCOL_VERSION_MINOR == 1,
+			DP_PROTOCOL_VERSION_MINOR == 2,
 		"Update invite link version");
 	constexpr int CURRENT_VERSION = 1;
 	return CURRENT_VERSION;
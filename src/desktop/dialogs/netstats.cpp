@@ -3,6 +3,7 @@
 extern "C" {
 #include <dpcommon/memory_pool.h>
 #include <dpengine/tile.h>
+#include <dpmsg/message.h>
 }
 
 #include "desktop/dialogs/netstats.h"
@@ -52,6 +53,18 @@ void NetStats::updateMemoryUsage()
 	m_ui->contextMemoryLabel->setText(QStringLiteral("%1 / %2").arg(
 		formatDataSize(dpcs.bytesUsed), formatDataSize(dpcs.bytesTotal)));
 
+	size_t messageBytesTotal = 0;
+	size_t messageBytesUsed = 0;
+	for(int i = 0; i < DP_MESSAGE_POOL_CLASS_COUNT; ++i) {
+		DP_MessagePoolStatistics mpst = DP_message_pool_statistics(i);
+		messageBytesTotal +=
+			mpst.buckets * mpst.bucket_el_count * mpst.el_size;
+		messageBytesUsed +=
+			size_t(mpst.allocations - mpst.frees) * mpst.el_size;
+	}
+	m_ui->messageMemoryLabel->setText(QStringLiteral("%1 / %2").arg(
+		formatDataSize(messageBytesUsed), formatDataSize(messageBytesTotal)));
+
 	if(!m_updateMemoryTimer->isActive()) {
 		m_updateMemoryTimer->start();
 	}
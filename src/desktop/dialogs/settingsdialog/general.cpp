@@ -160,6 +160,16 @@ void General::initPerformance(
 		nullptr,
 		utils::formNote(tr(
 			"Enabling these options may impact performance on some systems.")));
+
+	utils::addFormSpacer(form);
+
+	auto *fastSampling =
+		new QCheckBox(tr("Approximate colors picked up by large brushes"));
+	fastSampling->setToolTip(
+		tr("Speeds up smudging with large brushes by sampling the canvas at a "
+		   "lower resolution. The picked up colors may differ slightly."));
+	settings.bindFastColorSampling(fastSampling);
+	form->addRow(tr("Smudging:"), fastSampling);
 }
 
 void General::initSnapshots(
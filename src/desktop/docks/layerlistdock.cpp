@@ -308,6 +308,9 @@ void LayerList::setCanvas(canvas::CanvasModel *canvas)
 	connect(
 		canvas->layerlist(), &canvas::LayerListModel::modelReset, this,
 		&LayerList::afterLayerReset);
+	connect(
+		canvas->layerlist(), &canvas::LayerListModel::layersUpdated, this,
+		&LayerList::afterLayerUpdate);
 	connect(
 		canvas->layerlist(), &canvas::LayerListModel::layerCheckStateToggled,
 		this, &LayerList::updateActionLabels);
@@ -1704,21 +1707,25 @@ dialogs::LayerProperties *LayerList::makeLayerPropertiesDialog(
 		connect(
 			dlg, &dialogs::LayerProperties::sketchModeChanged, this,
 			&LayerList::setLayerSketch);
+		auto updateDialog = [this, dlg]() {
+			QModelIndex newIndex =
+				m_canvas->layerlist()->layerIndex(dlg->layerId());
+			if(newIndex.isValid()) {
+				dlg->updateLayerItem(
+					newIndex.data().value<canvas::LayerListItem>(),
+					layerCreatorName(dlg->layerId()),
+					newIndex.data(canvas::LayerListModel::IsDefaultRole)
+						.toBool());
+			} else {
+				dlg->deleteLater();
+			}
+		};
 		connect(
 			m_canvas->layerlist(), &canvas::LayerListModel::modelReset, dlg,
-			[this, dlg]() {
-				QModelIndex newIndex =
-					m_canvas->layerlist()->layerIndex(dlg->layerId());
-				if(newIndex.isValid()) {
-					dlg->updateLayerItem(
-						newIndex.data().value<canvas::LayerListItem>(),
-						layerCreatorName(dlg->layerId()),
-						newIndex.data(canvas::LayerListModel::IsDefaultRole)
-							.toBool());
-				} else {
-					dlg->deleteLater();
-				}
-			});
+			updateDialog);
+		connect(
+			m_canvas->layerlist(), &canvas::LayerListModel::layersUpdated, dlg,
+			updateDialog);
 	} else {
 		isOwnLayer = true;
 		connect(
@@ -1884,6 +1891,19 @@ void LayerList::afterLayerReset()
 	}
 }
 
+void LayerList::afterLayerUpdate()
+{
+	// The layers stayed the same, but the current one's properties may have
+	// changed, so the controls need to reflect that.
+	if(currentSelection().isValid()) {
+		updateUiFromCurrent();
+	} else {
+		updateActionLabels();
+		updateLockedControls();
+		updateCheckActions();
+	}
+}
+
 bool LayerList::isGroupSelected() const
 {
 	QModelIndex idx = currentSelection();
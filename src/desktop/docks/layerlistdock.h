@@ -125,6 +125,7 @@ signals:
 private:
 	void beforeLayerReset();
 	void afterLayerReset();
+	void afterLayerUpdate();
 
 	void onFeatureAccessChange(DP_Feature feature, bool canuse);
 
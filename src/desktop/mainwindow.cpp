@@ -1273,6 +1273,7 @@ void MainWindow::readSettings(bool windowpos)
 	// Customize shortcuts
 	settings.bindShortcuts(this, &MainWindow::loadShortcuts);
 	settings.bindBrushSlotCount(this, &MainWindow::setBrushSlotCount);
+	settings.bindNavigatorShowCursors(this, &MainWindow::updateInterest);
 
 #ifndef __EMSCRIPTEN__
 	// Restore recent files
@@ -3627,6 +3628,7 @@ void MainWindow::onServerLogin(bool join, const QString &joinPassword)
 	if(!join && dpApp().settings().showInviteDialogOnHost()) {
 		invite();
 	}
+	updateInterest();
 }
 
 // clang-format on
@@ -3832,6 +3834,19 @@ void MainWindow::setShowLaserTrails(bool show)
 	m_canvasView->setShowLaserTrails(show);
 	m_dockToolSettings->laserPointerSettings()->setLaserTrailsShown(show);
 	updateLockWidget();
+	updateInterest();
+}
+
+// Tells the server to skip cursor and laser messages that nothing displays.
+void MainWindow::updateInterest()
+{
+	net::Client *client = m_doc->client();
+	if(client->isConnected()) {
+		client->sendInterest(
+			getAction("showusermarkers")->isChecked() ||
+				dpApp().settings().navigatorShowCursors(),
+			getAction("showlasers")->isChecked());
+	}
 }
 // clang-format off
 
@@ -5791,6 +5806,7 @@ void MainWindow::setupActions()
 
 	connect(showannotations, &QAction::toggled, this, &MainWindow::setShowAnnotations);
 	connect(showlasers, &QAction::toggled, this, &MainWindow::setShowLaserTrails);
+	connect(showusermarkers, &QAction::toggled, this, &MainWindow::updateInterest);
 
 	m_viewstatus->setActions(viewflip, viewmirror, rotateorig, {zoomorig, zoomfit, zoomfitwidth, zoomfitheight});
 
@@ -228,6 +228,7 @@ private slots:
 
 	void updateLockWidget();
 	void updateLockWidgetOnSelectionChange();
+	void updateInterest();
 	void setRecorderStatus(bool on);
 
 	void loadShortcuts(const QVariantMap &shortcuts);
@@ -11,6 +11,7 @@ namespace drawingboard {
 SelectionItem::SelectionItem(
 	bool ignored, bool showMask, qreal zoom, QGraphicsItem *parent)
 	: BaseObject(parent)
+	, m_outlineCache(new SelectionOutlineCache)
 	, m_zoom(zoom)
 	, m_ignored(ignored)
 	, m_showMask(showMask)
@@ -37,7 +38,7 @@ void SelectionItem::setModel(const QSharedPointer<canvas::SelectionMask> &mask)
 		m_mask = mask;
 	} else {
 		m_mask.clear();
-		generateOutline(mask->image());
+		generateOutline(mask);
 	}
 }
 
@@ -62,7 +63,7 @@ void SelectionItem::setShowMask(bool showMask)
 	if(m_showMask != showMask) {
 		m_showMask = showMask;
 		if(!showMask && m_mask) {
-			generateOutline(m_mask->image());
+			generateOutline(m_mask);
 			m_mask.clear();
 		}
 		refresh();
@@ -129,10 +130,11 @@ void SelectionItem::paint(
 	}
 }
 
-void SelectionItem::generateOutline(const QImage &mask)
+void SelectionItem::generateOutline(
+	const QSharedPointer<canvas::SelectionMask> &mask)
 {
-	SelectionOutlineGenerator *gen =
-		new SelectionOutlineGenerator(m_executionId, mask, false, 0, 0);
+	SelectionOutlineGenerator *gen = new SelectionOutlineGenerator(
+		m_executionId, m_outlineCache, mask->content(), mask->bounds());
 	connect(
 		this, &SelectionItem::outlineRegenerating, gen,
 		&SelectionOutlineGenerator::cancel, Qt::DirectConnection);
@@ -6,6 +6,7 @@
 #include <QImage>
 #include <QPainterPath>
 
+class SelectionOutlineCache;
 struct SelectionOutlinePath;
 
 namespace drawdance {
@@ -46,13 +47,14 @@ protected:
 		QWidget *widget) override;
 
 private:
-	void generateOutline(const QImage &mask);
+	void generateOutline(const QSharedPointer<canvas::SelectionMask> &mask);
 	void setOutline(unsigned int executionId, const SelectionOutlinePath &path);
 	void updateBoundingRectFromBounds();
 
 	QRectF m_boundingRect;
 	QRect m_bounds;
 	QSharedPointer<canvas::SelectionMask> m_mask;
+	QSharedPointer<SelectionOutlineCache> m_outlineCache;
 	QPainterPath m_path;
 	qreal m_zoom;
 	qreal m_marchingAnts = 0.0;
@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #include "desktop/widgets/brushpreview.h"
+#include "libshared/util/functionrunnable.h"
 #include <QEvent>
 #include <QIcon>
 #include <QPaintEvent>
@@ -10,8 +11,10 @@ namespace widgets {
 
 BrushPreview::BrushPreview(QWidget *parent, Qt::WindowFlags f)
 	: QFrame(parent, f)
+	, m_previewCache(CACHE_SIZE_KB)
 	, m_debounce(1000 / 60, this)
 {
+	m_threadPool.setMaxThreadCount(1);
 	setMinimumSize(32, 32);
 	updateBackground();
 	setCursor(Qt::PointingHandCursor);
@@ -21,6 +24,12 @@ BrushPreview::BrushPreview(QWidget *parent, Qt::WindowFlags f)
 		&BrushPreview::triggerPreviewUpdate);
 }
 
+BrushPreview::~BrushPreview()
+{
+	m_pendingRender.reset();
+	m_threadPool.waitForDone();
+}
+
 void BrushPreview::setPreviewShape(DP_BrushPreviewShape shape)
 {
 	if(m_shape != shape) {
@@ -37,7 +46,7 @@ void BrushPreview::setBrush(const brushes::ActiveBrush &brush)
 
 void BrushPreview::setBrushSizeLimit(int brushSizeLimit)
 {
-	m_brushPreview.setSizeLimit(brushSizeLimit);
+	m_brushSizeLimit = brushSizeLimit;
 	triggerPreviewUpdate();
 }
 
@@ -137,7 +146,9 @@ void BrushPreview::paintEvent(QPaintEvent *event)
 			painter.drawPixmap(changeRect, m_changeIconCache);
 		}
 	}
-	painter.drawPixmap(previewRect(), m_brushPreview.pixmap());
+	if(!m_preview.isNull()) {
+		painter.drawPixmap(previewRect(), m_preview);
+	}
 
 	if(!isEnabled()) {
 		QColor color = palette().color(QPalette::Window);
@@ -157,22 +168,38 @@ void BrushPreview::updateBackground()
 {
 	int w = 16;
 	bool dark = palette().color(QPalette::Window).lightness() < 128;
-	m_background = QPixmap(w * 2, w * 2);
+	m_background = QImage(w * 2, w * 2, QImage::Format_ARGB32_Premultiplied);
 	m_background.fill(dark ? QColor(153, 153, 153) : QColor(204, 204, 204));
 	QColor alt = dark ? QColor(102, 102, 102) : Qt::white;
 	QPainter p(&m_background);
 	p.fillRect(0, 0, w, w, alt);
 	p.fillRect(w, w, w, w, alt);
+	// Cached previews have the old background baked in.
+	m_previewCache.clear();
+	m_previewKey.clear();
 }
 
 void BrushPreview::updatePreview(qreal dpr)
 {
 	QSize size = previewRect().size() * dpr;
-	m_brushPreview.reset(size);
-	m_brush.renderPreview(m_brushPreview, m_shape);
-	m_brushPreview.paint(m_background);
 	m_needUpdate = false;
 	m_lastDpr = dpr;
+
+	QByteArray key = previewKey(size);
+	if(key != m_previewKey) {
+		m_previewKey = key;
+		if(size.isEmpty()) {
+			m_preview = QPixmap();
+			m_pendingRender.reset();
+		} else if(const QPixmap *cached = m_previewCache.object(key)) {
+			m_preview = *cached;
+			m_pendingRender.reset();
+		} else {
+			// Keep showing the previous preview until this one is done.
+			startRender(
+				{key, m_brush, m_shape, size, m_brushSizeLimit, m_background});
+		}
+	}
 }
 
 void BrushPreview::updatePreset(qreal dpr)
@@ -189,6 +216,60 @@ void BrushPreview::updatePreset(qreal dpr)
 	}
 }
 
+QByteArray BrushPreview::previewKey(const QSize &size) const
+{
+	return QByteArray::number(size.width()) + 'x' +
+		   QByteArray::number(size.height()) + ':' +
+		   QByteArray::number(int(m_shape)) + ':' +
+		   QByteArray::number(m_brushSizeLimit) + ':' + m_brush.toJson(true);
+}
+
+void BrushPreview::startRender(RenderRequest &&request)
+{
+	if(m_rendering) {
+		m_pendingRender = std::move(request);
+		return;
+	}
+
+	m_rendering = true;
+	m_threadPool.start(new utils::FunctionRunnable([this, request] {
+		m_brushPreview.setSizeLimit(request.sizeLimit);
+		m_brushPreview.reset(request.size);
+		request.brush.renderPreview(m_brushPreview, request.shape);
+		QImage img = m_brushPreview.toImage(request.background);
+		QMetaObject::invokeMethod(
+			this,
+			[this, key = request.key, img] {
+				finishRender(key, img);
+			},
+			Qt::QueuedConnection);
+	}));
+}
+
+void BrushPreview::finishRender(const QByteArray &key, const QImage &img)
+{
+	m_rendering = false;
+
+	QPixmap pixmap = QPixmap::fromImage(img);
+	int cost = qMax(1, img.width() * img.height() * 4 / 1024);
+	m_previewCache.insert(key, new QPixmap(pixmap), cost);
+	if(key == m_previewKey) {
+		m_preview = pixmap;
+		update();
+	}
+
+	// Anything requested in the meantime that's been superseded again or
+	// that got rendered by now gets dropped instead of rendered.
+	if(m_pendingRender.has_value()) {
+		RenderRequest request = std::move(m_pendingRender.value());
+		m_pendingRender.reset();
+		if(request.key == m_previewKey &&
+		   !m_previewCache.contains(request.key)) {
+			startRender(std::move(request));
+		}
+	}
+}
+
 QRect BrushPreview::previewRect() const
 {
 	QRect r = contentsRect();
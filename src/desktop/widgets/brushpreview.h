@@ -4,7 +4,12 @@
 #include "libclient/brushes/brush.h"
 #include "libclient/drawdance/brushpreview.h"
 #include "libclient/utils/debouncetimer.h"
+#include <QByteArray>
+#include <QCache>
 #include <QFrame>
+#include <QImage>
+#include <QThreadPool>
+#include <optional>
 
 namespace widgets {
 
@@ -14,6 +19,8 @@ public:
 	explicit BrushPreview(
 		QWidget *parent = nullptr, Qt::WindowFlags f = Qt::WindowFlags());
 
+	~BrushPreview() override;
+
 	void setPreviewShape(DP_BrushPreviewShape shape);
 	DP_BrushPreviewShape previewShape() const { return m_shape; }
 
@@ -37,20 +44,47 @@ protected:
 	void paintEvent(QPaintEvent *event) override;
 
 private:
+	// Rendered previews are kept around by brush, shape and size, so that
+	// flipping between brushes or settings doesn't render them all again.
+	static constexpr int CACHE_SIZE_KB = 16 * 1024;
+
+	struct RenderRequest {
+		QByteArray key;
+		brushes::ActiveBrush brush;
+		DP_BrushPreviewShape shape;
+		QSize size;
+		int sizeLimit;
+		QImage background;
+	};
+
 	void triggerPreviewUpdate();
 
 	void updateBackground();
 	void updatePreview(qreal dpr);
 	void updatePreset(qreal dpr);
 
+	QByteArray previewKey(const QSize &size) const;
+	void startRender(RenderRequest &&request);
+	void finishRender(const QByteArray &key, const QImage &img);
+
 	QRect previewRect() const;
 	QRect presetRect() const;
 	QRect changeIconRect() const;
 
-	QPixmap m_background;
+	QImage m_background;
 	brushes::ActiveBrush m_brush;
-	drawdance::BrushPreview m_brushPreview;
+	int m_brushSizeLimit = -1;
 	DP_BrushPreviewShape m_shape = DP_BRUSH_PREVIEW_STROKE;
+	QPixmap m_preview;
+	QByteArray m_previewKey;
+	QCache<QByteArray, QPixmap> m_previewCache;
+	// Renders happen on a single background thread, which is the only one
+	// that touches m_brushPreview. While one is running, further requests
+	// replace each other, so only the latest settings get rendered next.
+	QThreadPool m_threadPool;
+	drawdance::BrushPreview m_brushPreview;
+	bool m_rendering = false;
+	std::optional<RenderRequest> m_pendingRender;
 	QPixmap m_presetThumbnail;
 	QPixmap m_presetCache;
 	QPixmap m_changeIconCache;
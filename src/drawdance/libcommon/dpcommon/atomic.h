@@ -46,6 +46,8 @@ DP_INLINE bool DP_atomic_compare_exchange(DP_Atomic *x, int expected,
 typedef void *volatile DP_AtomicPtr;
 
 #    define DP_ATOMIC_PTR_INIT(X) X
+#    define DP_atomic_ptr_get(X) \
+        InterlockedCompareExchangePointer((X), NULL, NULL)
 #    define DP_atomic_ptr_set(X, VALUE) \
         ((void)InterlockedExchangePointer((X), (VALUE)))
 #    define DP_atomic_ptr_xch(X, VALUE) InterlockedExchangePointer((X), (VALUE))
@@ -74,6 +76,7 @@ DP_INLINE bool DP_atomic_compare_exchange(DP_Atomic *x, int expected,
 typedef _Atomic(void *) DP_AtomicPtr;
 
 #    define DP_ATOMIC_PTR_INIT(X)       X
+#    define DP_atomic_ptr_get(X)        atomic_load((X))
 #    define DP_atomic_ptr_set(X, VALUE) atomic_store((X), (VALUE))
 #    define DP_atomic_ptr_xch(X, VALUE) atomic_exchange((X), (VALUE))
 
@@ -28,6 +28,12 @@
 
 #ifdef DP_QT_IO
 #    include "input_qt.h"
+#elif !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#    define DP_INPUT_MMAP
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
 #endif
 
 
@@ -83,6 +89,24 @@ size_t DP_input_read(DP_Input *input, void *buffer, size_t size,
     }
 }
 
+const void *DP_input_read_direct(DP_Input *input, size_t size,
+                                 size_t *out_read, bool *out_error)
+{
+    DP_ASSERT(input);
+    DP_ASSERT(out_read);
+    const void *(*read_direct)(void *, size_t, size_t *, bool *) =
+        input->methods->read_direct;
+    bool error = false;
+    *out_read = 0;
+    const void *result =
+        read_direct ? read_direct(input->internal, size, out_read, &error)
+                    : NULL;
+    if (out_error) {
+        *out_error = error;
+    }
+    return result;
+}
+
 size_t DP_input_length(DP_Input *input, bool *out_error)
 {
     DP_ASSERT(input);
@@ -282,6 +306,7 @@ static void file_input_dispose(void *internal)
 
 static const DP_InputMethods file_input_methods = {
     file_input_read,
+    NULL,
     file_input_length,
     file_input_rewind,
     file_input_rewind_by,
@@ -325,6 +350,61 @@ DP_Input *DP_file_input_new_from_path(const char *path)
 #endif
 }
 
+#ifdef DP_INPUT_MMAP
+static void mapped_input_unmap(void *buffer, size_t size,
+                               DP_UNUSED void *free_arg)
+{
+    if (munmap(buffer, size) != 0) {
+        DP_warn("Error unmapping input: %s", strerror(errno));
+    }
+}
+
+static DP_Input *mapped_input_new(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return NULL;
+    }
+
+    struct stat st;
+    void *buffer = MAP_FAILED;
+    size_t size = 0;
+    // Sizes past SIZE_MAX can happen with large files on 32 bit systems, the
+    // buffered path will deal with them.
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0
+        && (unsigned long long)st.st_size <= (unsigned long long)SIZE_MAX) {
+        size = (size_t)st.st_size;
+        buffer = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+
+    if (buffer == MAP_FAILED) {
+        return NULL;
+    }
+    else {
+        posix_madvise(buffer, size, POSIX_MADV_SEQUENTIAL);
+        return DP_mem_input_new(buffer, size, mapped_input_unmap, NULL);
+    }
+}
+#endif
+
+DP_Input *DP_file_input_new_mapped_from_path(const char *path)
+{
+    DP_ASSERT(path);
+#ifdef DP_QT_IO
+    return DP_qfile_input_new_mapped_from_path(path, DP_input_new);
+#else
+#    ifdef DP_INPUT_MMAP
+    DP_Input *input = mapped_input_new(path);
+    if (input) {
+        return input;
+    }
+#    endif
+    return DP_file_input_new_from_path(path);
+#endif
+}
+
 
 typedef struct DP_MemInputState {
     void *buffer;
@@ -346,6 +426,21 @@ static size_t mem_input_read(void *internal, void *buffer, size_t size,
     return read;
 }
 
+static const void *mem_input_read_direct(void *internal, size_t size,
+                                         size_t *out_read,
+                                         DP_UNUSED bool *out_error)
+{
+    DP_MemInputState *state = internal;
+    DP_ASSERT(state->pos <= state->size);
+    size_t left = state->size - state->pos;
+    size_t read = size <= left ? size : left;
+    const unsigned char *result =
+        (const unsigned char *)state->buffer + state->pos;
+    state->pos += read;
+    *out_read = read;
+    return result;
+}
+
 static size_t mem_input_length(void *internal, DP_UNUSED bool *out_error)
 {
     DP_MemInputState *state = internal;
@@ -376,7 +471,7 @@ static bool mem_input_rewind_by(void *internal, size_t size)
 static bool mem_input_seek(void *internal, size_t offset)
 {
     DP_MemInputState *state = internal;
-    if (offset < state->size) {
+    if (offset <= state->size) {
         state->pos = offset;
         return true;
     }
@@ -404,6 +499,7 @@ static void mem_input_dispose(void *internal)
 
 static const DP_InputMethods mem_input_methods = {
     mem_input_read,
+    mem_input_read_direct,
     mem_input_length,
     mem_input_rewind,
     mem_input_rewind_by,
@@ -446,7 +542,7 @@ DP_Input *DP_mem_input_new_keep_on_close(const void *buffer, size_t size)
 DP_BufferedInput DP_buffered_input_init(DP_Input *input)
 {
     DP_ASSERT(input);
-    return (DP_BufferedInput){input, NULL, 0};
+    return (DP_BufferedInput){input, NULL, NULL, 0};
 }
 
 void DP_buffered_input_dispose(DP_BufferedInput *bi)
@@ -460,10 +556,18 @@ size_t DP_buffered_input_read(DP_BufferedInput *bi, size_t size,
                               bool *out_error)
 {
     DP_ASSERT(bi);
+    size_t read;
+    const void *data = DP_input_read_direct(bi->inner, size, &read, out_error);
+    if (data) {
+        bi->data = data;
+        return read;
+    }
+
     if (size > bi->capacity) {
         bi->buffer = DP_realloc(bi->buffer, size);
         bi->capacity = size;
     }
+    bi->data = bi->buffer;
     return DP_input_read(bi->inner, bi->buffer, size, out_error);
 }
 
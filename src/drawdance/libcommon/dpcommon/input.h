@@ -35,6 +35,8 @@ typedef struct DP_Input DP_Input;
 
 typedef struct DP_InputMethods {
     size_t (*read)(void *internal, void *buffer, size_t size, bool *out_errror);
+    const void *(*read_direct)(void *internal, size_t size, size_t *out_read,
+                               bool *out_error);
     size_t (*length)(void *internal, bool *out_error);
     bool (*rewind)(void *internal);
     bool (*rewind_by)(void *internal, size_t size);
@@ -53,6 +55,14 @@ void DP_input_free(DP_Input *input);
 size_t DP_input_read(DP_Input *input, void *buffer, size_t size,
                      bool *out_error);
 
+// Reads without copying, for inputs that have their contents in memory. On
+// success, returns a pointer to the bytes read, which points into the input's
+// memory and stays valid until the input is freed. Returns NULL if the input
+// doesn't support this, in which case nothing was read and DP_input_read
+// must be used instead.
+const void *DP_input_read_direct(DP_Input *input, size_t size,
+                                 size_t *out_read, bool *out_error);
+
 size_t DP_input_length(DP_Input *input, bool *out_error);
 
 bool DP_input_rewind(DP_Input *input);
@@ -74,6 +84,14 @@ DP_Input *DP_file_input_new_from_stdin(bool close);
 
 DP_Input *DP_file_input_new_from_path(const char *path);
 
+// Maps the file into memory if possible, hinting that it will be read from
+// front to back, which makes direct reads available. Falls back to regular
+// file input if mapping doesn't work. The file is mapped at the size it has
+// when it's opened, anything appended afterwards just doesn't get read, like
+// with recordings that are still being written to. If the file gets truncated
+// while it's mapped though, reading from it crashes the program with SIGBUS.
+DP_Input *DP_file_input_new_mapped_from_path(const char *path);
+
 
 typedef void (*DP_MemInputFreeFn)(void *buffer, size_t size, void *free_arg);
 
@@ -88,11 +106,14 @@ DP_Input *DP_mem_input_new_keep_on_close(const void *buffer, size_t size);
 #define DP_BUFFERED_INPUT_NULL \
     (DP_BufferedInput)        \
     {                         \
-        NULL, NULL, 0         \
+        NULL, NULL, NULL, 0   \
     }
 
+// The data read last is at the data pointer. It either points into the
+// buffer or, if the input supports direct reads, directly into the input.
 typedef struct DP_BufferedInput {
     DP_Input *inner;
+    const unsigned char *data;
     unsigned char *buffer;
     size_t capacity;
 } DP_BufferedInput;
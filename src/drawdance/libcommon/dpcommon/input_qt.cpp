@@ -9,6 +9,8 @@ extern "C" {
 struct DP_QFileInputState {
     QFile *file;
     bool close;
+    uchar *map;
+    qint64 map_size;
 };
 
 QFile *get_file(void *internal)
@@ -32,6 +34,31 @@ static size_t qfile_input_read(void *internal, void *buffer, size_t size,
     }
 }
 
+static const void *qfile_input_read_direct(void *internal, size_t size,
+                                           size_t *out_read, bool *out_error)
+{
+    DP_QFileInputState *state = static_cast<DP_QFileInputState *>(internal);
+    uchar *map = state->map;
+    if (!map) {
+        return nullptr;
+    }
+
+    // Keep the file position in sync, since it's also used to seek.
+    QFile *file = state->file;
+    qint64 pos = file->pos();
+    qint64 left = pos < state->map_size ? state->map_size - pos : 0;
+    qint64 read = qint64(size) <= left ? qint64(size) : left;
+    if (pos < 0 || !file->seek(pos + read)) {
+        *out_error = true;
+        DP_error_set("QFile input direct read error: %s",
+                     qUtf8Printable(file->errorString()));
+        return nullptr;
+    }
+
+    *out_read = size_t(read);
+    return map + pos;
+}
+
 static size_t qfile_input_length(void *internal, bool *out_error)
 {
     QFile *file = get_file(internal);
@@ -110,6 +137,9 @@ static QIODevice *qfile_input_qiodevice(void *internal)
 static void qfile_input_dispose(void *internal)
 {
     DP_QFileInputState *state = static_cast<DP_QFileInputState *>(internal);
+    if (state->map) {
+        state->file->unmap(state->map);
+    }
     if (state->close) {
         QFile *file = state->file;
         file->close();
@@ -118,9 +148,9 @@ static void qfile_input_dispose(void *internal)
 }
 
 static const DP_InputMethods qfile_input_methods = {
-    qfile_input_read,      qfile_input_length,  qfile_input_rewind,
-    qfile_input_rewind_by, qfile_input_seek,    qfile_input_seek_by,
-    qfile_input_qiodevice, qfile_input_dispose,
+    qfile_input_read,      qfile_input_read_direct, qfile_input_length,
+    qfile_input_rewind,    qfile_input_rewind_by,   qfile_input_seek,
+    qfile_input_seek_by,   qfile_input_qiodevice,   qfile_input_dispose,
 };
 
 const DP_InputMethods *qfile_input_init(void *internal, void *arg)
@@ -133,7 +163,7 @@ const DP_InputMethods *qfile_input_init(void *internal, void *arg)
 extern "C" DP_Input *DP_qfile_input_new(QFile *file, bool close,
                                         DP_InputQtNewFn new_fn)
 {
-    DP_QFileInputState state = {file, close};
+    DP_QFileInputState state = {file, close, nullptr, 0};
     return new_fn(qfile_input_init, &state, sizeof(DP_QFileInputState));
 }
 
@@ -151,3 +181,24 @@ extern "C" DP_Input *DP_qfile_input_new_from_path(const char *path,
         return nullptr;
     }
 }
+
+extern "C" DP_Input *DP_qfile_input_new_mapped_from_path(const char *path,
+                                                         DP_InputQtNewFn new_fn)
+{
+    QFile *file = new QFile{QString::fromUtf8(path)};
+    if (file->open(QIODevice::ReadOnly)) {
+        // If mapping fails, this is just a regular file input.
+        qint64 size = file->size();
+        // Sizes past SIZE_MAX can happen with large files on 32 bit systems.
+        bool mappable = size > 0 && quint64(size) <= quint64(SIZE_MAX);
+        uchar *map = mappable ? file->map(0, size) : nullptr;
+        DP_QFileInputState state = {file, true, map, map ? size : 0};
+        return new_fn(qfile_input_init, &state, sizeof(DP_QFileInputState));
+    }
+    else {
+        DP_error_set("Can't open '%s': %s", path,
+                     qUtf8Printable(file->errorString()));
+        delete file;
+        return nullptr;
+    }
+}
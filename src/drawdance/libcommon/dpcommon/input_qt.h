@@ -20,5 +20,8 @@ DP_Input *DP_qfile_input_new(QFile *file, bool close, DP_InputQtNewFn new_fn);
 DP_Input *DP_qfile_input_new_from_path(const char *path,
                                        DP_InputQtNewFn new_fn);
 
+DP_Input *DP_qfile_input_new_mapped_from_path(const char *path,
+                                              DP_InputQtNewFn new_fn);
+
 
 #endif
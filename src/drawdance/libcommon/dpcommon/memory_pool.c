@@ -20,6 +20,7 @@
  * SOFTWARE.
  */
 #include "memory_pool.h"
+#include <stdlib.h>
 #include <string.h>
 
 
@@ -112,6 +113,100 @@ void DP_memory_pool_free_el(DP_MemoryPool *pool, void *el_voidptr)
     pool->free_list = el;
 }
 
+typedef struct DP_MemoryPoolTrimEntry {
+    char *elements;
+    size_t free_count;
+    bool release;
+} DP_MemoryPoolTrimEntry;
+
+static int compare_trim_entries(const void *a, const void *b)
+{
+    const char *ea = ((const DP_MemoryPoolTrimEntry *)a)->elements;
+    const char *eb = ((const DP_MemoryPoolTrimEntry *)b)->elements;
+    return ea < eb ? -1 : ea > eb ? 1 : 0;
+}
+
+static DP_MemoryPoolTrimEntry *
+DP_memory_pool_find_trim_entry(DP_MemoryPool *pool,
+                               DP_MemoryPoolTrimEntry *entries, void *el)
+{
+    size_t bucket_size = pool->el_size * pool->bucket_el_count;
+    size_t lo = 0;
+    size_t hi = pool->buckets_len;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        DP_MemoryPoolTrimEntry *entry = &entries[mid];
+        if ((char *)el < entry->elements) {
+            hi = mid;
+        }
+        else if ((char *)el >= entry->elements + bucket_size) {
+            lo = mid + 1;
+        }
+        else {
+            return entry;
+        }
+    }
+    DP_UNREACHABLE();
+}
+
+size_t DP_memory_pool_trim(DP_MemoryPool *pool, size_t keep_buckets)
+{
+    DP_ASSERT(pool);
+    size_t buckets_len = pool->buckets_len;
+    if (buckets_len <= keep_buckets) {
+        return 0;
+    }
+
+    DP_MemoryPoolTrimEntry *entries =
+        DP_malloc(sizeof(*entries) * buckets_len);
+    for (size_t i = 0; i < buckets_len; ++i) {
+        entries[i] = (DP_MemoryPoolTrimEntry){pool->buckets[i].elements, 0,
+                                              false};
+    }
+    qsort(entries, buckets_len, sizeof(*entries), compare_trim_entries);
+
+    for (DP_MemoryPoolFreeNode *n = pool->free_list; n; n = n->next) {
+        ++DP_memory_pool_find_trim_entry(pool, entries, n)->free_count;
+    }
+
+    size_t released = 0;
+    size_t max_released = buckets_len - keep_buckets;
+    for (size_t i = 0; i < buckets_len && released < max_released; ++i) {
+        if (entries[i].free_count == pool->bucket_el_count) {
+            entries[i].release = true;
+            ++released;
+        }
+    }
+
+    if (released != 0) {
+        // Unlink the elements of released buckets from the free list.
+        DP_MemoryPoolFreeNode **link = &pool->free_list;
+        while (*link) {
+            if (DP_memory_pool_find_trim_entry(pool, entries, *link)
+                    ->release) {
+                *link = (*link)->next;
+            }
+            else {
+                link = &(*link)->next;
+            }
+        }
+
+        size_t kept = 0;
+        for (size_t i = 0; i < buckets_len; ++i) {
+            if (entries[i].release) {
+                DP_free_simd(entries[i].elements);
+            }
+            else {
+                pool->buckets[kept++].elements = entries[i].elements;
+            }
+        }
+        pool->buckets_len = kept;
+    }
+
+    DP_free(entries);
+    return released;
+}
+
 DP_MemoryPoolStatistics DP_memory_pool_statistics(DP_MemoryPool *pool)
 {
     DP_ASSERT(pool);
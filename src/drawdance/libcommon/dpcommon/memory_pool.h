@@ -56,6 +56,11 @@ void DP_memory_pool_reset(DP_MemoryPool *pool);
 void *DP_memory_pool_alloc_el(DP_MemoryPool *pool);
 void DP_memory_pool_free_el(DP_MemoryPool *pool, void *el);
 
+// Releases buckets whose elements are all free, keeping at least keep_buckets
+// buckets around. This walks the entire free list, so don't call it on every
+// free. Returns how many buckets were released.
+size_t DP_memory_pool_trim(DP_MemoryPool *pool, size_t keep_buckets);
+
 DP_MemoryPoolStatistics DP_memory_pool_statistics(DP_MemoryPool *pool);
 
 #endif
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2024 askmeaboutloom
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#include <dpcommon/common.h>
+#include <dpcommon/input.h>
+#include <dptest.h>
+#include <stdio.h>
+#include <string.h>
+
+#define CONTENT      "The quick brown fox jumps over the lazy dog"
+#define CONTENT_SIZE (sizeof(CONTENT) - 1)
+
+
+static const char *write_test_file(TEST_PARAMS, const char *path)
+{
+    FILE *fp = fopen(path, "wb");
+    FATAL(NOT_NULL_OK(fp, "open %s for writing", path));
+    FATAL(OK(fwrite(CONTENT, 1, CONTENT_SIZE, fp) == CONTENT_SIZE,
+             "write %s", path));
+    FATAL(OK(fclose(fp) == 0, "close %s", path));
+    return path;
+}
+
+static void mapped_read_direct(TEST_PARAMS)
+{
+    const char *path = write_test_file(TEST_ARGS, "test/tmp/input_mapped");
+    DP_Input *input = DP_file_input_new_mapped_from_path(path);
+    FATAL(NOT_NULL_OK(input, "open mapped input"));
+
+    bool error;
+    UINT_EQ_OK(DP_input_length(input, &error), CONTENT_SIZE, "length");
+
+    size_t read;
+    const char *data = DP_input_read_direct(input, 9, &read, &error);
+    NOT_NULL_OK(data, "direct read from start");
+    UINT_EQ_OK(read, 9, "direct read size from start");
+    STR_LEN_EQ_OK(data, read, CONTENT, 9, "direct read content from start");
+
+    OK(DP_input_seek_by(input, 6), "seek by");
+    data = DP_input_read_direct(input, 3, &read, &error);
+    STR_LEN_EQ_OK(data, read, CONTENT + 15, 3, "direct read after seek by");
+
+    const char *last = DP_input_read_direct(input, 999, &read, &error);
+    NOK(error, "no error reading past end");
+    UINT_EQ_OK(read, CONTENT_SIZE - 18, "direct read stops at end");
+    STR_LEN_EQ_OK(last, read, CONTENT + 18, CONTENT_SIZE - 18,
+                  "direct read content at end");
+    STR_LEN_EQ_OK(data, 3, CONTENT + 15, 3,
+                  "earlier direct read still valid");
+
+    OK(DP_input_seek(input, CONTENT_SIZE), "seek to end");
+    DP_input_read_direct(input, 1, &read, &error);
+    UINT_EQ_OK(read, 0, "nothing read at end");
+
+    DP_input_free(input);
+}
+
+static void buffered_read(TEST_PARAMS)
+{
+    const char *path = write_test_file(TEST_ARGS, "test/tmp/input_buffered");
+    DP_Input *inputs[] = {DP_file_input_new_from_path(path),
+                          DP_file_input_new_mapped_from_path(path)};
+    for (int i = 0; i < 2; ++i) {
+        FATAL(NOT_NULL_OK(inputs[i], "open input %d", i));
+        DP_BufferedInput bi = DP_buffered_input_init(inputs[i]);
+        bool error;
+        UINT_EQ_OK(DP_buffered_input_read(&bi, 5, &error), 5,
+                   "buffered read %d", i);
+        STR_LEN_EQ_OK((const char *)bi.data, 5, CONTENT, 5,
+                      "buffered read content %d", i);
+        OK(DP_buffered_input_seek(&bi, 40), "buffered seek %d", i);
+        UINT_EQ_OK(DP_buffered_input_read(&bi, 5, &error), 3,
+                   "buffered read at end %d", i);
+        STR_LEN_EQ_OK((const char *)bi.data, 3, "dog", 3,
+                      "buffered read content at end %d", i);
+        DP_buffered_input_dispose(&bi);
+    }
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(mapped_read_direct);
+    REGISTER_TEST(buffered_read);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
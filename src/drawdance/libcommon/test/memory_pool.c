@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/memory_pool.h>
+#include <dptest.h>
+
+#define EL_SIZE         32
+#define BUCKET_EL_COUNT 16
+#define BUCKET_COUNT    8
+#define EL_COUNT        (BUCKET_EL_COUNT * BUCKET_COUNT)
+
+
+static void alloc_all(DP_MemoryPool *pool, void **els)
+{
+    for (int i = 0; i < EL_COUNT; ++i) {
+        els[i] = DP_memory_pool_alloc_el(pool);
+        memset(els[i], i, EL_SIZE);
+    }
+}
+
+static void trim_empty_pool(TEST_PARAMS)
+{
+    DP_MemoryPool pool = DP_memory_pool_new(EL_SIZE, BUCKET_EL_COUNT);
+    void *els[EL_COUNT];
+    alloc_all(&pool, els);
+    UINT_EQ_OK(pool.buckets_len, BUCKET_COUNT, "pool grew");
+
+    UINT_EQ_OK(DP_memory_pool_trim(&pool, 1), 0,
+               "nothing to trim while everything is in use");
+
+    for (int i = 0; i < EL_COUNT; ++i) {
+        DP_memory_pool_free_el(&pool, els[i]);
+    }
+    UINT_EQ_OK(DP_memory_pool_trim(&pool, 2), BUCKET_COUNT - 2,
+               "released all but the kept buckets");
+    UINT_EQ_OK(pool.buckets_len, 2, "two buckets left");
+    UINT_EQ_OK(DP_memory_pool_statistics(&pool).el_free, BUCKET_EL_COUNT * 2,
+               "free list only holds elements of kept buckets");
+
+    // The kept buckets must still be usable, growing again when they're full.
+    alloc_all(&pool, els);
+    UINT_EQ_OK(pool.buckets_len, BUCKET_COUNT, "pool grew again");
+    for (int i = 0; i < EL_COUNT; ++i) {
+        DP_memory_pool_free_el(&pool, els[i]);
+    }
+    DP_memory_pool_free(&pool);
+}
+
+static void trim_fragmented_pool(TEST_PARAMS)
+{
+    DP_MemoryPool pool = DP_memory_pool_new(EL_SIZE, BUCKET_EL_COUNT);
+    void *els[EL_COUNT];
+    alloc_all(&pool, els);
+
+    // Keep one element alive in every other bucket.
+    int kept = 0;
+    for (int i = 0; i < EL_COUNT; ++i) {
+        if ((i / BUCKET_EL_COUNT) % 2 == 0 && i % BUCKET_EL_COUNT == 0) {
+            ++kept;
+        }
+        else {
+            DP_memory_pool_free_el(&pool, els[i]);
+            els[i] = NULL;
+        }
+    }
+
+    UINT_EQ_OK(DP_memory_pool_trim(&pool, 0), BUCKET_COUNT / 2,
+               "released the entirely free buckets");
+    UINT_EQ_OK(pool.buckets_len, BUCKET_COUNT / 2, "partial buckets left");
+    UINT_EQ_OK(DP_memory_pool_statistics(&pool).el_free,
+               BUCKET_EL_COUNT * BUCKET_COUNT / 2 - DP_int_to_size(kept),
+               "free list holds the rest of the partial buckets");
+
+    bool intact = true;
+    for (int i = 0; i < EL_COUNT; ++i) {
+        if (els[i]) {
+            unsigned char *el = els[i];
+            for (int j = 0; j < EL_SIZE; ++j) {
+                if (el[j] != (unsigned char)i) {
+                    intact = false;
+                }
+            }
+            DP_memory_pool_free_el(&pool, els[i]);
+        }
+    }
+    OK(intact, "live elements untouched by trim");
+    DP_memory_pool_free(&pool);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(trim_empty_pool);
+    REGISTER_TEST(trim_fragmented_pool);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
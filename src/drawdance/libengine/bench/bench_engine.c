@@ -0,0 +1,1031 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/cpu.h>
+#include <dpcommon/perf.h>
+#include <dpcommon/threading.h>
+#include <dpcommon/worker.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/compress.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/flood_fill.h>
+#include <dpengine/image.h>
+#include <dpengine/layer_content.h>
+#include <dpengine/layer_list.h>
+#include <dpengine/layer_props.h>
+#include <dpengine/layer_props_list.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
+#include <dpengine/view_mode.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/message.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Benchmarks for dpengine hot paths. Each benchmark is warmed up, then timed
+// over a number of samples, each of which runs as many iterations as fit into
+// the sample time. Results are written as one JSON object per line, so they
+// can be collected and compared across builds.
+//
+// Running `dpengine-bench dabcost` instead generates the dab_cost.c table,
+// using the same parameters as generate_dab_cost.py.
+
+
+#define LAYER_ID            1
+#define CANVAS_WIDTH        1000
+#define CANVAS_HEIGHT       1000
+#define FLATTEN_LAYER_COUNT 8
+#define WORKER_JOB_COUNT    10000
+
+#define DEFAULT_SAMPLES   20
+#define DEFAULT_SAMPLE_MS 50
+#define WARMUP_NS         100000000ULL
+#define DAB_COST_RUNS     50
+
+typedef struct BenchOptions {
+    const char *filter;
+    int samples;
+    unsigned long long sample_ns;
+    bool list_only;
+} BenchOptions;
+
+typedef void (*BenchFn)(void *user);
+
+typedef struct BenchStatistics {
+    long long iterations;
+    double median_ns;
+    double mean_ns;
+    double stddev_ns;
+    double min_ns;
+    double max_ns;
+} BenchStatistics;
+
+
+static bool bench_selected(const BenchOptions *opts, const char *group,
+                           const char *name)
+{
+    const char *filter = opts->filter;
+    if (!filter) {
+        return true;
+    }
+    else {
+        char *full_name = DP_format("%s/%s", group, name);
+        bool selected = strstr(full_name, filter) != NULL;
+        DP_free(full_name);
+        return selected;
+    }
+}
+
+static unsigned long long bench_time(BenchFn fn, void *user,
+                                     long long iterations)
+{
+    unsigned long long start = DP_perf_time();
+    for (long long i = 0; i < iterations; ++i) {
+        fn(user);
+    }
+    return DP_perf_time() - start;
+}
+
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static double median_of(int count, double *values)
+{
+    qsort(values, DP_int_to_size(count), sizeof(*values), compare_doubles);
+    int half = count / 2;
+    return count % 2 == 0 ? (values[half - 1] + values[half]) / 2.0
+                          : values[half];
+}
+
+static BenchStatistics bench_measure(const BenchOptions *opts, BenchFn fn,
+                                     void *user)
+{
+    // Warm up and figure out how many iterations fit into one sample.
+    long long iterations = 1;
+    unsigned long long warmup_start = DP_perf_time();
+    while (true) {
+        unsigned long long elapsed = bench_time(fn, user, iterations);
+        if (elapsed >= opts->sample_ns
+            || DP_perf_time() - warmup_start >= WARMUP_NS) {
+            double per_iteration =
+                DP_ullong_to_double(elapsed) / (double)iterations;
+            double fitting =
+                DP_ullong_to_double(opts->sample_ns) / per_iteration;
+            iterations = fitting < 1.0 ? 1LL : (long long)fitting;
+            break;
+        }
+        iterations *= 2LL;
+    }
+
+    int samples = opts->samples;
+    double *values = DP_malloc(sizeof(*values) * DP_int_to_size(samples));
+    double sum = 0.0;
+    double min = INFINITY;
+    double max = 0.0;
+    for (int i = 0; i < samples; ++i) {
+        double value =
+            DP_ullong_to_double(bench_time(fn, user, iterations))
+            / (double)iterations;
+        values[i] = value;
+        sum += value;
+        min = DP_min_double(min, value);
+        max = DP_max_double(max, value);
+    }
+
+    double mean = sum / (double)samples;
+    double variance = 0.0;
+    for (int i = 0; i < samples; ++i) {
+        double d = values[i] - mean;
+        variance += d * d;
+    }
+    variance /= (double)DP_max_int(1, samples - 1);
+
+    double median = median_of(samples, values);
+    DP_free(values);
+    return (BenchStatistics){iterations, median, mean, sqrt(variance), min,
+                             max};
+}
+
+static void print_json_string(const char *s)
+{
+    putchar('"');
+    for (const char *c = s; *c != '\0'; ++c) {
+        if (*c == '"' || *c == '\\') {
+            putchar('\\');
+        }
+        putchar(*c);
+    }
+    putchar('"');
+}
+
+static void bench_run(const BenchOptions *opts, const char *group,
+                      const char *name, long long items, BenchFn fn,
+                      void *user)
+{
+    if (!bench_selected(opts, group, name)) {
+        return;
+    }
+
+    if (opts->list_only) {
+        printf("%s/%s\n", group, name);
+        return;
+    }
+
+    BenchStatistics stats = bench_measure(opts, fn, user);
+    printf("{\"group\":");
+    print_json_string(group);
+    printf(",\"name\":");
+    print_json_string(name);
+    printf(",\"items\":%lld,\"samples\":%d,\"iterations\":%lld"
+           ",\"median_ns\":%.1f,\"mean_ns\":%.1f,\"stddev_ns\":%.1f"
+           ",\"min_ns\":%.1f,\"max_ns\":%.1f}\n",
+           items, opts->samples, stats.iterations, stats.median_ns,
+           stats.mean_ns, stats.stddev_ns, stats.min_ns, stats.max_ns);
+    fflush(stdout);
+}
+
+
+static uint16_t noise15(uint32_t *state)
+{
+    // xorshift, just needs to be deterministic and not too compressible.
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return DP_uint32_to_uint16(x % (DP_BIT15 + 1));
+}
+
+static void init_pixels(DP_Pixel15 *pixels, uint32_t seed)
+{
+    uint32_t state = seed;
+    for (int i = 0; i < DP_TILE_LENGTH; ++i) {
+        uint16_t a = noise15(&state);
+        pixels[i] = (DP_Pixel15){
+            DP_uint32_to_uint16(noise15(&state) * (uint32_t)a / DP_BIT15),
+            DP_uint32_to_uint16(noise15(&state) * (uint32_t)a / DP_BIT15),
+            DP_uint32_to_uint16(noise15(&state) * (uint32_t)a / DP_BIT15),
+            a,
+        };
+    }
+}
+
+
+// Allocated with SIMD alignment, the pixel buffers must stay at the front.
+typedef struct BlendBench {
+    DP_Pixel15 dst[DP_TILE_LENGTH];
+    DP_Pixel15 base[DP_TILE_LENGTH];
+    DP_Pixel15 src[DP_TILE_LENGTH];
+    uint16_t mask[DP_TILE_LENGTH];
+    int blend_mode;
+} BlendBench;
+
+static void bench_blend_mask_fn(void *user)
+{
+    BlendBench *bb = user;
+    memcpy(bb->dst, bb->base, sizeof(bb->dst));
+    DP_UPixel15 color = {8000, 16000, 24000, DP_BIT15};
+    DP_blend_mask(bb->dst, color, bb->blend_mode, bb->mask, DP_BIT15,
+                  DP_TILE_SIZE, DP_TILE_SIZE, 0, 0);
+}
+
+static void bench_blend_tile_fn(void *user)
+{
+    BlendBench *bb = user;
+    memcpy(bb->dst, bb->base, sizeof(bb->dst));
+    DP_blend_tile(bb->dst, bb->src, DP_BIT15, bb->blend_mode);
+}
+
+static void bench_blend(const BenchOptions *opts)
+{
+    BlendBench *bb = DP_malloc_simd(sizeof(*bb));
+    init_pixels(bb->base, 1);
+    init_pixels(bb->src, 2);
+    for (int y = 0; y < DP_TILE_SIZE; ++y) {
+        for (int x = 0; x < DP_TILE_SIZE; ++x) {
+            double dx = x - DP_TILE_SIZE / 2.0;
+            double dy = y - DP_TILE_SIZE / 2.0;
+            double d = sqrt(dx * dx + dy * dy) / (DP_TILE_SIZE / 2.0);
+            bb->mask[y * DP_TILE_SIZE + x] =
+                DP_double_to_uint16(DP_max_double(0.0, 1.0 - d) * DP_BIT15);
+        }
+    }
+
+    for (int i = 0; i < DP_BLEND_MODE_COUNT; ++i) {
+        if (DP_blend_mode_valid_for_brush(i)) {
+            bb->blend_mode = i;
+            bench_run(opts, "blend_mask", DP_blend_mode_dptxt_name(i),
+                      DP_TILE_LENGTH, bench_blend_mask_fn, bb);
+        }
+    }
+
+    for (int i = 0; i < DP_BLEND_MODE_COUNT; ++i) {
+        if (DP_blend_mode_valid_for_layer(i)) {
+            bb->blend_mode = i;
+            bench_run(opts, "blend_tile", DP_blend_mode_dptxt_name(i),
+                      DP_TILE_LENGTH, bench_blend_tile_fn, bb);
+        }
+    }
+
+    DP_free_simd(bb);
+}
+
+
+typedef struct DabParams {
+    DP_MessageType type;
+    int layer_id;
+    int total_dabs;
+    int dabs_per_message;
+    uint8_t color_alpha;
+    int blend_mode;
+    uint32_t size;
+    uint8_t opacity;
+    uint8_t hardness;
+    uint8_t lock_alpha;
+    uint8_t colorize;
+    uint8_t posterize;
+    uint8_t posterize_num;
+    bool scatter;
+} DabParams;
+
+static void set_pixel_dabs(int count, DP_PixelDab *pds, void *user)
+{
+    const DabParams *params = user;
+    for (int i = 0; i < count; ++i) {
+        DP_pixel_dab_init(pds, i, 0, 0, DP_uint32_to_uint16(params->size),
+                          params->opacity);
+    }
+}
+
+static void set_classic_dabs(int count, DP_ClassicDab *cds, void *user)
+{
+    const DabParams *params = user;
+    for (int i = 0; i < count; ++i) {
+        DP_classic_dab_init(cds, i, 0, 0, params->size, params->hardness,
+                            params->opacity);
+    }
+}
+
+static void set_mypaint_dabs(int count, DP_MyPaintDab *mpds, void *user)
+{
+    const DabParams *params = user;
+    for (int i = 0; i < count; ++i) {
+        DP_mypaint_dab_init(mpds, i, 0, 0, params->size, params->hardness,
+                            params->opacity, 0, 0);
+    }
+}
+
+static void set_mypaint_blend_dabs(int count, DP_MyPaintBlendDab *mpbds,
+                                   void *user)
+{
+    const DabParams *params = user;
+    for (int i = 0; i < count; ++i) {
+        DP_mypaint_blend_dab_init(mpbds, i, 0, 0, params->size,
+                                  params->hardness, params->opacity, 0, 0);
+    }
+}
+
+static uint8_t get_dab_flags(DP_UPixel8 p)
+{
+    return p.a == 0 ? (uint8_t)DP_PAINT_MODE_DIRECT
+                    : (uint8_t)DP_PAINT_MODE_INDIRECT_WASH;
+}
+
+static DP_Message **generate_dab_messages(const DabParams *params,
+                                          int *out_count)
+{
+    int total_dabs = params->total_dabs;
+    int dabs_per_message = params->dabs_per_message;
+    int count = total_dabs / dabs_per_message;
+    if (total_dabs % dabs_per_message != 0) {
+        ++count;
+    }
+
+    uint8_t blend_mode = DP_int_to_uint8(params->blend_mode);
+    DP_Message **msgs = DP_malloc(sizeof(*msgs) * DP_int_to_size(count));
+    int dabs_done = 0;
+    for (int i = 0; i < count; ++i) {
+        int dab_count = DP_min_int(dabs_per_message, total_dabs - dabs_done);
+        DP_UPixel8 pixel = {.b = DP_int_to_uint8(rand() % UINT8_MAX),
+                            .g = DP_int_to_uint8(rand() % UINT8_MAX),
+                            .r = DP_int_to_uint8(rand() % UINT8_MAX),
+                            .a = params->color_alpha};
+        int x = params->scatter ? rand() % CANVAS_WIDTH : CANVAS_WIDTH / 2;
+        int y = params->scatter ? rand() % CANVAS_HEIGHT : CANVAS_HEIGHT / 2;
+        uint8_t flags = get_dab_flags(pixel);
+        void *user = (void *)params;
+
+        switch (params->type) {
+        case DP_MSG_DRAW_DABS_PIXEL:
+            msgs[i] = DP_msg_draw_dabs_pixel_new(
+                1, flags, DP_int_to_uint32(params->layer_id), x, y,
+                pixel.color, blend_mode, set_pixel_dabs, dab_count, user);
+            break;
+        case DP_MSG_DRAW_DABS_PIXEL_SQUARE:
+            msgs[i] = DP_msg_draw_dabs_pixel_square_new(
+                1, flags, DP_int_to_uint32(params->layer_id), x, y,
+                pixel.color, blend_mode, set_pixel_dabs, dab_count, user);
+            break;
+        case DP_MSG_DRAW_DABS_CLASSIC:
+            msgs[i] = DP_msg_draw_dabs_classic_new(
+                1, flags, DP_int_to_uint32(params->layer_id), x * 4, y * 4,
+                pixel.color, blend_mode, set_classic_dabs, dab_count, user);
+            break;
+        case DP_MSG_DRAW_DABS_MYPAINT:
+            msgs[i] = DP_msg_draw_dabs_mypaint_new(
+                1, flags, DP_int_to_uint32(params->layer_id), x * 4, y * 4,
+                pixel.color, params->lock_alpha, params->colorize,
+                params->posterize, params->posterize_num, set_mypaint_dabs,
+                dab_count, user);
+            break;
+        case DP_MSG_DRAW_DABS_MYPAINT_BLEND:
+            msgs[i] = DP_msg_draw_dabs_mypaint_blend_new(
+                1, flags, DP_int_to_uint32(params->layer_id), x * 4, y * 4,
+                pixel.color, blend_mode, set_mypaint_blend_dabs, dab_count,
+                user);
+            break;
+        default:
+            DP_UNREACHABLE();
+        }
+
+        dabs_done += dab_count;
+    }
+
+    *out_count = count;
+    return msgs;
+}
+
+static void free_messages(int count, DP_Message **msgs)
+{
+    for (int i = 0; i < count; ++i) {
+        DP_message_decref(msgs[i]);
+    }
+    DP_free(msgs);
+}
+
+
+static DP_CanvasState *init_canvas_state(DP_DrawContext *dc, int layer_count)
+{
+    DP_TransientCanvasState *tcs = DP_transient_canvas_state_new_init();
+    DP_transient_canvas_state_width_set(tcs, CANVAS_WIDTH);
+    DP_transient_canvas_state_height_set(tcs, CANVAS_HEIGHT);
+
+    DP_TransientLayerList *tll =
+        DP_transient_canvas_state_transient_layers(tcs, layer_count);
+    DP_TransientLayerPropsList *tlpl =
+        DP_transient_canvas_state_transient_layer_props(tcs, layer_count);
+
+    DP_Tile *t = DP_tile_new_from_bgra(0, 0xffffffff);
+    for (int i = 0; i < layer_count; ++i) {
+        DP_TransientLayerContent *tlc = DP_transient_layer_content_new_init(
+            CANVAS_WIDTH, CANVAS_HEIGHT, i == 0 ? t : NULL);
+
+        DP_TransientLayerProps *tlp =
+            DP_transient_layer_props_new_init(LAYER_ID + i, false);
+        char *title = DP_format("Layer %d", i + 1);
+        DP_transient_layer_props_title_set(tlp, title, strlen(title));
+        DP_free(title);
+
+        DP_transient_layer_list_insert_transient_content_noinc(tll, tlc, i);
+        DP_transient_layer_props_list_insert_transient_noinc(tlpl, tlp, i);
+    }
+    DP_tile_decref(t);
+
+    DP_transient_canvas_state_layer_routes_reindex(tcs, dc);
+    return DP_transient_canvas_state_persist(tcs);
+}
+
+typedef struct DabBench {
+    DP_DrawContext *dc;
+    DP_CanvasState *cs;
+    int count;
+    DP_Message **msgs;
+} DabBench;
+
+static void dab_bench_init(DabBench *db, DP_DrawContext *dc,
+                           const DabParams *params)
+{
+    srand(0);
+    db->dc = dc;
+    db->cs = init_canvas_state(dc, 1);
+    db->msgs = generate_dab_messages(params, &db->count);
+}
+
+static void dab_bench_dispose(DabBench *db)
+{
+    free_messages(db->count, db->msgs);
+    DP_canvas_state_decref(db->cs);
+}
+
+static void bench_dabs_fn(void *user)
+{
+    DabBench *db = user;
+    DP_CanvasState *next_cs = DP_canvas_state_handle_multidab(
+        db->cs, db->dc, NULL, db->count, db->msgs);
+    DP_canvas_state_decref(next_cs);
+}
+
+static void bench_dabs_with(const BenchOptions *opts, DP_DrawContext *dc,
+                            const char *name, const DabParams *params)
+{
+    if (bench_selected(opts, "paint_draw_dabs", name)) {
+        DabBench db;
+        dab_bench_init(&db, dc, params);
+        bench_run(opts, "paint_draw_dabs", name, params->total_dabs,
+                  bench_dabs_fn, &db);
+        dab_bench_dispose(&db);
+    }
+}
+
+static void bench_dabs(const BenchOptions *opts, DP_DrawContext *dc)
+{
+    struct {
+        const char *name;
+        DP_MessageType type;
+        uint32_t size;
+    } brushes[] = {
+        {"pixelround", DP_MSG_DRAW_DABS_PIXEL, 32},
+        {"pixelsquare", DP_MSG_DRAW_DABS_PIXEL_SQUARE, 32},
+        {"classic", DP_MSG_DRAW_DABS_CLASSIC, 32 * 256},
+        {"mypaint", DP_MSG_DRAW_DABS_MYPAINT, 32 * 256},
+        {"mypaintblend", DP_MSG_DRAW_DABS_MYPAINT_BLEND, 32 * 256},
+    };
+
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(brushes); ++i) {
+        for (int indirect = 0; indirect < 2; ++indirect) {
+            DabParams params = {
+                brushes[i].type,
+                LAYER_ID,
+                1000,
+                100,
+                indirect ? 255 : 0,
+                DP_BLEND_MODE_NORMAL,
+                brushes[i].size,
+                255,
+                127,
+                0,
+                0,
+                0,
+                indirect ? 129 : 0,
+                true,
+            };
+            char *name = DP_format("%s:%s", brushes[i].name,
+                                   indirect ? "indirect" : "direct");
+            bench_dabs_with(opts, dc, name, &params);
+            DP_free(name);
+        }
+    }
+}
+
+
+typedef struct CompressBench {
+    DP_DrawContext *dc;
+    DP_Tile *t;
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+    size_t capacity;
+    unsigned char *buffer;
+    size_t deflate_size;
+    unsigned char *deflate_buffer;
+    size_t zstd_size;
+    unsigned char *zstd_buffer;
+    size_t mask_size;
+    unsigned char *mask_buffer;
+} CompressBench;
+
+static unsigned char *get_compress_buffer(size_t size, void *user)
+{
+    CompressBench *cb = user;
+    if (cb->capacity < size) {
+        cb->buffer = DP_realloc(cb->buffer, size);
+        cb->capacity = size;
+    }
+    return cb->buffer;
+}
+
+static unsigned char *copy_compress_buffer(CompressBench *cb, size_t size)
+{
+    unsigned char *copy = DP_malloc(size);
+    memcpy(copy, cb->buffer, size);
+    return copy;
+}
+
+static size_t compress_deflate(CompressBench *cb)
+{
+    return DP_tile_compress_deflate(cb->t, DP_draw_context_tile8_buffer(cb->dc),
+                                    get_compress_buffer, cb);
+}
+
+static size_t compress_zstd(CompressBench *cb)
+{
+    return DP_tile_compress_split_delta_zstd8le(
+        cb->t, &cb->cctx, DP_draw_context_split_tile8_buffer(cb->dc),
+        get_compress_buffer, cb);
+}
+
+static size_t compress_mask(CompressBench *cb)
+{
+    return DP_tile_compress_mask_delta_zstd8le(
+        cb->t, &cb->cctx, (uint8_t *)DP_draw_context_tile8_buffer(cb->dc),
+        get_compress_buffer, cb);
+}
+
+static void bench_compress_deflate_fn(void *user)
+{
+    compress_deflate(user);
+}
+
+static void bench_compress_zstd_fn(void *user)
+{
+    compress_zstd(user);
+}
+
+static void bench_compress_mask_fn(void *user)
+{
+    compress_mask(user);
+}
+
+static void bench_decompress_deflate_fn(void *user)
+{
+    CompressBench *cb = user;
+    DP_tile_decref(DP_tile_new_from_deflate(cb->dc, 1, cb->deflate_buffer,
+                                            cb->deflate_size));
+}
+
+static void bench_decompress_zstd_fn(void *user)
+{
+    CompressBench *cb = user;
+    DP_tile_decref(DP_tile_new_from_split_delta_zstd8le_with(
+        &cb->dctx, DP_draw_context_split_tile8_buffer(cb->dc), 1,
+        cb->zstd_buffer, cb->zstd_size));
+}
+
+static void bench_decompress_mask_fn(void *user)
+{
+    CompressBench *cb = user;
+    DP_tile_decref(DP_tile_new_mask_from_delta_zstd8le(
+        cb->dc, 1, cb->mask_buffer, cb->mask_size));
+}
+
+static void bench_compress(const BenchOptions *opts, DP_DrawContext *dc)
+{
+    DP_Pixel15 *pixels = DP_malloc(DP_TILE_BYTES);
+    init_pixels(pixels, 3);
+    // Smooth out the noise a bit, real tiles aren't white noise.
+    for (int i = 1; i < DP_TILE_LENGTH; ++i) {
+        if (i % 4 != 0) {
+            pixels[i] = pixels[i - 1];
+        }
+    }
+    DP_Pixel8 *pixels8 = DP_malloc(DP_TILE_COMPRESSED_BYTES);
+    for (int i = 0; i < DP_TILE_LENGTH; ++i) {
+        pixels8[i] = DP_pixel15_to_8(pixels[i]);
+    }
+
+    CompressBench cb = {dc,   DP_tile_new_from_pixels8(1, pixels8),
+                        NULL, NULL,
+                        0,    NULL,
+                        0,    NULL,
+                        0,    NULL,
+                        0,    NULL};
+    DP_free(pixels8);
+    DP_free(pixels);
+
+    cb.deflate_size = compress_deflate(&cb);
+    cb.deflate_buffer = copy_compress_buffer(&cb, cb.deflate_size);
+    cb.zstd_size = compress_zstd(&cb);
+    cb.zstd_buffer = copy_compress_buffer(&cb, cb.zstd_size);
+    cb.mask_size = compress_mask(&cb);
+    cb.mask_buffer = copy_compress_buffer(&cb, cb.mask_size);
+
+    bench_run(opts, "tile_compress", "deflate", DP_TILE_LENGTH,
+              bench_compress_deflate_fn, &cb);
+    bench_run(opts, "tile_compress", "split_delta_zstd8le", DP_TILE_LENGTH,
+              bench_compress_zstd_fn, &cb);
+    bench_run(opts, "tile_compress", "mask_delta_zstd8le", DP_TILE_LENGTH,
+              bench_compress_mask_fn, &cb);
+    bench_run(opts, "tile_decompress", "deflate", DP_TILE_LENGTH,
+              bench_decompress_deflate_fn, &cb);
+    bench_run(opts, "tile_decompress", "split_delta_zstd8le", DP_TILE_LENGTH,
+              bench_decompress_zstd_fn, &cb);
+    bench_run(opts, "tile_decompress", "mask_delta_zstd8le", DP_TILE_LENGTH,
+              bench_decompress_mask_fn, &cb);
+
+    DP_free(cb.mask_buffer);
+    DP_free(cb.zstd_buffer);
+    DP_free(cb.deflate_buffer);
+    DP_free(cb.buffer);
+    DP_decompress_zstd_free(&cb.dctx);
+    DP_compress_zstd_free(&cb.cctx);
+    DP_tile_decref(cb.t);
+}
+
+
+static DP_CanvasState *init_painted_canvas_state(DP_DrawContext *dc)
+{
+    DP_CanvasState *cs = init_canvas_state(dc, FLATTEN_LAYER_COUNT);
+    srand(0);
+    for (int i = 0; i < FLATTEN_LAYER_COUNT; ++i) {
+        DabParams params = {
+            DP_MSG_DRAW_DABS_CLASSIC,
+            LAYER_ID + i,
+            2000,
+            20,
+            0,
+            i % 2 == 0 ? DP_BLEND_MODE_NORMAL : DP_BLEND_MODE_MULTIPLY,
+            64 * 256,
+            255,
+            200,
+            0,
+            0,
+            0,
+            0,
+            true,
+        };
+        int count;
+        DP_Message **msgs = generate_dab_messages(&params, &count);
+        DP_CanvasState *next_cs =
+            DP_canvas_state_handle_multidab(cs, dc, NULL, count, msgs);
+        free_messages(count, msgs);
+        DP_canvas_state_decref(cs);
+        cs = next_cs;
+    }
+    return cs;
+}
+
+static void bench_flatten_fn(void *user)
+{
+    DP_CanvasState *cs = user;
+    DP_image_free(DP_canvas_state_to_flat_image(
+        cs, DP_FLAT_IMAGE_RENDER_FLAGS, NULL, NULL));
+}
+
+static void bench_flood_fill_fn(void *user)
+{
+    DP_CanvasState *cs = user;
+    DP_Image *img;
+    int x, y;
+    DP_UPixelFloat color = {0.0f, 0.0f, 1.0f, 1.0f};
+    DP_FloodFillResult result = DP_flood_fill(
+        cs, 1, 0, CANVAS_WIDTH / 2, CANVAS_HEIGHT / 2, color, 0.1, 0, -1, 0, 0,
+        DP_FLOOD_FILL_KERNEL_ROUND, 0, false, false, false, DP_VIEW_MODE_NORMAL,
+        0, 0, &img, &x, &y, NULL, NULL);
+    if (result == DP_FLOOD_FILL_SUCCESS) {
+        DP_image_free(img);
+    }
+}
+
+static void bench_canvas(const BenchOptions *opts, DP_DrawContext *dc)
+{
+    if (bench_selected(opts, "flatten", "image")
+        || bench_selected(opts, "flood_fill", "merged")) {
+        DP_CanvasState *cs = init_painted_canvas_state(dc);
+        long long pixels = (long long)CANVAS_WIDTH * (long long)CANVAS_HEIGHT;
+        bench_run(opts, "flatten", "image", pixels, bench_flatten_fn, cs);
+        bench_run(opts, "flood_fill", "merged", pixels, bench_flood_fill_fn,
+                  cs);
+        DP_canvas_state_decref(cs);
+    }
+}
+
+
+typedef struct WorkerBench {
+    DP_Worker *worker;
+    DP_Semaphore *sem;
+} WorkerBench;
+
+static void worker_bench_job(void *element, DP_UNUSED int thread_index)
+{
+    DP_Semaphore *sem = *(DP_Semaphore **)element;
+    DP_SEMAPHORE_MUST_POST(sem);
+}
+
+static void bench_worker_fn(void *user)
+{
+    WorkerBench *wb = user;
+    for (int i = 0; i < WORKER_JOB_COUNT; ++i) {
+        DP_worker_push(wb->worker, &wb->sem);
+    }
+    DP_SEMAPHORE_MUST_WAIT_N(wb->sem, WORKER_JOB_COUNT);
+}
+
+static void bench_worker(const BenchOptions *opts)
+{
+    int thread_count = DP_worker_cpu_count(128);
+    char *name = DP_format("push_wait:%d", thread_count);
+    if (bench_selected(opts, "worker", name)) {
+        WorkerBench wb = {
+            DP_worker_new(1024, sizeof(DP_Semaphore *), thread_count,
+                          worker_bench_job),
+            DP_semaphore_new(0),
+        };
+        if (wb.worker && wb.sem) {
+            bench_run(opts, "worker", name, WORKER_JOB_COUNT, bench_worker_fn,
+                      &wb);
+        }
+        else {
+            DP_warn("Error initializing worker: %s", DP_error());
+        }
+        DP_worker_free_join(wb.worker);
+        DP_semaphore_free(wb.sem);
+    }
+    DP_free(name);
+}
+
+
+typedef struct DabCostContext {
+    DP_DrawContext *dc;
+    int runs;
+} DabCostContext;
+
+static double dab_cost_for(DabCostContext *dcc, const DabParams *params)
+{
+    DabBench db;
+    dab_bench_init(&db, dcc->dc, params);
+    int runs = dcc->runs;
+    double *values = DP_malloc(sizeof(*values) * DP_int_to_size(runs));
+    for (int i = 0; i < runs; ++i) {
+        values[i] = DP_ullong_to_double(bench_time(bench_dabs_fn, &db, 1));
+    }
+    dab_bench_dispose(&db);
+    double size = (double)params->size;
+    double cost =
+        median_of(runs, values) / (double)params->total_dabs / (size * size);
+    DP_free(values);
+    return cost;
+}
+
+static double dab_cost_blend(DabCostContext *dcc, DP_MessageType type,
+                             uint32_t size, bool indirect, int blend_mode)
+{
+    DabParams params = {
+        type,
+        LAYER_ID,
+        1000,
+        1,
+        indirect ? 255 : 0,
+        blend_mode,
+        size,
+        255,
+        127,
+        0,
+        0,
+        0,
+        0,
+        false,
+    };
+    return dab_cost_for(dcc, &params);
+}
+
+static double dab_cost_mypaint(DabCostContext *dcc, uint8_t lock_alpha,
+                               uint8_t colorize, uint8_t posterize,
+                               uint8_t posterize_num)
+{
+    DabParams params = {
+        DP_MSG_DRAW_DABS_MYPAINT,
+        LAYER_ID,
+        1000,
+        1,
+        255,
+        DP_BLEND_MODE_NORMAL,
+        65535,
+        255,
+        127,
+        lock_alpha,
+        colorize,
+        posterize,
+        posterize_num,
+        false,
+    };
+    return dab_cost_for(dcc, &params);
+}
+
+static int blend_mode_alias_for(int blend_mode)
+{
+    DP_BlendMode alpha_affecting, alpha_preserving;
+    if (DP_blend_mode_secondary_alias(blend_mode)
+        && DP_blend_mode_alpha_preserve_pair(blend_mode, &alpha_affecting,
+                                             &alpha_preserving)) {
+        return (int)alpha_affecting == blend_mode ? (int)alpha_preserving
+                                                  : (int)alpha_affecting;
+    }
+    else {
+        return -1;
+    }
+}
+
+static void generate_blend_dab_cost(DabCostContext *dcc, const char *name,
+                                    DP_MessageType type, uint32_t size)
+{
+    printf("double DP_dab_cost_%s(bool indirect, int blend_mode)\n{\n", name);
+    double indirect_cost =
+        dab_cost_blend(dcc, type, size, true, DP_BLEND_MODE_NORMAL);
+    printf("    if (indirect) {\n        return %.17g;\n    }\n",
+           indirect_cost);
+    printf("    else {\n        switch (blend_mode) {\n");
+
+    double max_cost = indirect_cost;
+    for (int i = 0; i < DP_BLEND_MODE_COUNT; ++i) {
+        if (DP_blend_mode_valid_for_brush(i) && blend_mode_alias_for(i) < 0) {
+            fprintf(stderr, "dabcost %s %s\n", name,
+                    DP_blend_mode_dptxt_name(i));
+            double cost = dab_cost_blend(dcc, type, size, false, i);
+            max_cost = DP_max_double(max_cost, cost);
+            printf("        case %s:\n", DP_blend_mode_enum_name(i));
+            for (int j = 0; j < DP_BLEND_MODE_COUNT; ++j) {
+                if (DP_blend_mode_valid_for_brush(j)
+                    && blend_mode_alias_for(j) == i) {
+                    printf("        case %s:\n", DP_blend_mode_enum_name(j));
+                }
+            }
+            printf("            return %.17g;\n", cost);
+        }
+    }
+
+    printf("        default:\n");
+    printf("            DP_debug(\"Unhandled blend mode %%d\", blend_mode);\n");
+    printf("            return %.17g;\n", max_cost);
+    printf("        }\n    }\n}\n\n");
+}
+
+static void generate_mypaint_dab_cost(DabCostContext *dcc)
+{
+    fprintf(stderr, "dabcost mypaint\n");
+    printf("double DP_dab_cost_mypaint(bool indirect, uint8_t lock_alpha, "
+           "uint8_t colorize,\n                           uint8_t posterize)\n"
+           "{\n");
+    printf("    if (indirect) {\n        return %.17g;\n    }\n",
+           dab_cost_mypaint(dcc, 0, 0, 0, 129));
+    printf("    else {\n        double cost = 0.0;\n");
+    printf("        if (lock_alpha != 0) {\n            cost += %.17g;\n"
+           "        }\n",
+           dab_cost_mypaint(dcc, 255, 0, 0, 0));
+    printf("        if (colorize != 0) {\n            cost += %.17g;\n"
+           "        }\n",
+           dab_cost_mypaint(dcc, 0, 255, 0, 0));
+    printf("        if (posterize != 0) {\n            cost += %.17g;\n"
+           "        }\n",
+           dab_cost_mypaint(dcc, 0, 0, 255, 127));
+    printf("        if (lock_alpha != UINT8_MAX && colorize != UINT8_MAX\n"
+           "            && posterize != UINT8_MAX) {\n"
+           "            cost += %.17g;\n        }\n",
+           dab_cost_mypaint(dcc, 0, 0, 0, 0));
+    printf("        return cost;\n    }\n}\n\n");
+}
+
+static void generate_dab_cost(DabCostContext *dcc)
+{
+    printf("// SPDX-License-Identifier: GPL-3.0-or-later\n");
+    printf("// Auto-generated by dpengine-bench dabcost\n");
+    printf("#include \"dab_cost.h\"\n");
+    printf("#include <dpcommon/common.h>\n");
+    printf("#include <dpmsg/blend_mode.h>\n\n");
+    generate_blend_dab_cost(dcc, "pixel", DP_MSG_DRAW_DABS_PIXEL, 255);
+    generate_blend_dab_cost(dcc, "pixel_square", DP_MSG_DRAW_DABS_PIXEL_SQUARE,
+                            255);
+    generate_blend_dab_cost(dcc, "classic", DP_MSG_DRAW_DABS_CLASSIC, 65535);
+    generate_mypaint_dab_cost(dcc);
+    generate_blend_dab_cost(dcc, "mypaint_blend",
+                            DP_MSG_DRAW_DABS_MYPAINT_BLEND, 65535);
+}
+
+
+static bool parse_int_option(const char *s, int min_inclusive, int *out_value)
+{
+    char *end;
+    long value = strtol(s, &end, 10);
+    if (*end != '\0' || value < min_inclusive || value > INT_MAX) {
+        DP_warn("Invalid value '%s'", s);
+        return false;
+    }
+    else {
+        *out_value = DP_long_to_int(value);
+        return true;
+    }
+}
+
+static void print_usage(const char *program)
+{
+    fprintf(stderr,
+            "Usage: %s [-f FILTER] [-s SAMPLES] [-t SAMPLE_MS] [-l]\n"
+            "       %s dabcost [RUNS] > dab_cost.c\n"
+            "\n"
+            "  -f FILTER     only run benchmarks whose group/name contains "
+            "FILTER\n"
+            "  -s SAMPLES    number of samples per benchmark (default %d)\n"
+            "  -t SAMPLE_MS  target time per sample in ms (default %d)\n"
+            "  -l            list benchmarks instead of running them\n"
+            "  RUNS          runs to take the median of (default %d)\n",
+            program, program, DEFAULT_SAMPLES, DEFAULT_SAMPLE_MS,
+            DAB_COST_RUNS);
+}
+
+static bool parse_options(int argc, char **argv, BenchOptions *opts)
+{
+    int sample_ms = DEFAULT_SAMPLE_MS;
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (DP_str_equal(arg, "-l")) {
+            opts->list_only = true;
+        }
+        else if (DP_str_equal(arg, "-f") && has_value) {
+            opts->filter = argv[++i];
+        }
+        else if (DP_str_equal(arg, "-s") && has_value) {
+            if (!parse_int_option(argv[++i], 1, &opts->samples)) {
+                return false;
+            }
+        }
+        else if (DP_str_equal(arg, "-t") && has_value) {
+            if (!parse_int_option(argv[++i], 1, &sample_ms)) {
+                return false;
+            }
+        }
+        else {
+            DP_warn("Invalid argument '%s'", arg);
+            return false;
+        }
+    }
+    opts->sample_ns = (unsigned long long)sample_ms * 1000000ULL;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    DP_cpu_support_init();
+
+    if (argc >= 2 && DP_str_equal(argv[1], "dabcost")) {
+        DabCostContext dcc = {NULL, DAB_COST_RUNS};
+        if (argc > 3
+            || (argc == 3 && !parse_int_option(argv[2], 1, &dcc.runs))) {
+            print_usage(argv[0]);
+            return 2;
+        }
+        dcc.dc = DP_draw_context_new();
+        generate_dab_cost(&dcc);
+        DP_draw_context_free(dcc.dc);
+        return 0;
+    }
+
+    BenchOptions opts = {NULL, DEFAULT_SAMPLES, 0, false};
+    if (!parse_options(argc, argv, &opts)) {
+        print_usage(argv[0]);
+        return 2;
+    }
+
+    DP_DrawContext *dc = DP_draw_context_new();
+    bench_blend(&opts);
+    bench_dabs(&opts, dc);
+    bench_compress(&opts, dc);
+    bench_canvas(&opts, dc);
+    bench_worker(&opts);
+    DP_draw_context_free(dc);
+    return 0;
+}
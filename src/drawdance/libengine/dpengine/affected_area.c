@@ -419,6 +419,15 @@ DP_AffectedArea DP_affected_area_make(DP_Message *msg,
                          DP_uint32_to_int(DP_msg_fill_rect_w(mfr)),
                          DP_uint32_to_int(DP_msg_fill_rect_h(mfr))));
     }
+    case DP_MSG_FILL_GRADIENT: {
+        DP_MsgFillGradient *mfg = DP_message_internal(msg);
+        return make_pixels(
+            DP_protocol_to_layer_id(DP_msg_fill_gradient_layer(mfg)),
+            DP_rect_make(DP_uint32_to_int(DP_msg_fill_gradient_x(mfg)),
+                         DP_uint32_to_int(DP_msg_fill_gradient_y(mfg)),
+                         DP_uint32_to_int(DP_msg_fill_gradient_w(mfg)),
+                         DP_uint32_to_int(DP_msg_fill_gradient_h(mfg))));
+    }
     case DP_MSG_ANNOTATION_CREATE:
         return make_annotations(
             DP_msg_annotation_create_id(DP_message_internal(msg)));
@@ -5,6 +5,7 @@
 #include "compress.h"
 #include "layer_content.h"
 #include "layer_routes.h"
+#include "sample_cache.h"
 #include "selection.h"
 #include "selection_set.h"
 #include "tile.h"
@@ -124,6 +125,7 @@ struct DP_BrushEngine {
     void *buffer;
     int layer_id;
     int last_diameter;
+    DP_SampleCache *sample_cache;
     DP_Atomic size_limit;
     DP_BrushEngineActiveType active;
     MyPaintBrush *mypaint_brush;
@@ -137,6 +139,7 @@ struct DP_BrushEngine {
         bool flip;
         bool in_progress;
         bool sync_samples;
+        bool fast_sampling;
         bool compatibility_mode;
         long long last_time_msec;
     } stroke;
@@ -979,6 +982,7 @@ static void push_selection_sync(DP_BrushEngine *be, int col, int row,
 {
     int selection_id = be->mask.current_selection_id;
     if (selection_id > 0) {
+        DP_ASSERT(selection_id <= DP_SELECTION_ID_LOCAL_MAX);
         unsigned int context_id = be->stroke.context_id;
         be->push_message(be->user,
                          DP_msg_sync_selection_tile_new(
@@ -1510,6 +1514,11 @@ static uint16_t *get_stamp_buffer(DP_BrushEngine *be)
     return allocate_buffer(be);
 }
 
+static DP_SampleCache *get_sample_cache(DP_BrushEngine *be)
+{
+    return be->stroke.fast_sampling ? be->sample_cache : NULL;
+}
+
 static bool is_pigment_mode(DP_BlendMode blend_mode)
 {
     return blend_mode == DP_BLEND_MODE_PIGMENT
@@ -1526,8 +1535,9 @@ static int get_color_mypaint_pigment(MyPaintSurface2 *self, float x, float y,
     bool in_bounds;
     if (lc) {
         int diameter = DP_min_int(DP_float_to_int(radius * 2.0f + 0.5f), 255);
-        DP_UPixelFloat color = DP_layer_content_sample_color_at(
-            lc, get_stamp_buffer(be), DP_float_to_int(x + 0.5f),
+        DP_UPixelFloat color = DP_layer_content_sample_color_at_cached(
+            lc, get_sample_cache(be), get_stamp_buffer(be),
+            DP_float_to_int(x + 0.5f),
             DP_float_to_int(y + 0.5f), diameter, false,
             is_pigment_mode(be->mypaint.blend_mode), &be->last_diameter,
             &in_bounds);
@@ -1658,6 +1668,7 @@ DP_brush_engine_new(DP_BrushEnginePushMessageFn push_message,
         NULL,
         0,
         -1,
+        NULL,
         DP_ATOMIC_INIT(-1),
         DP_BRUSH_ENGINE_ACTIVE_PIXEL,
         mypaint_brush_new_with_buckets(SMUDGE_BUCKET_COUNT),
@@ -1665,7 +1676,7 @@ DP_brush_engine_new(DP_BrushEnginePushMessageFn push_message,
          add_dab_mypaint_pigment,
          get_color_mypaint_pigment,
          NULL},
-        {0, 1.0f, 0.0f, false, false, false, false, false, false, 0},
+        {0, 1.0f, 0.0f, false, false, false, false, false, false, false, 0},
         {false, false, 0, 0, NULL, 0, NULL, NULL},
         {0},
         {0, 0, 0, 0, NULL},
@@ -1686,6 +1697,7 @@ void DP_brush_engine_free(DP_BrushEngine *be)
         DP_free(be->mask.map);
         DP_layer_content_decref_nullable(be->mask.lc);
         DP_canvas_state_decref_nullable(be->cs);
+        DP_sample_cache_free(be->sample_cache);
         DP_free(be->buffer);
         stroke_engine_dispose(&be->se);
         DP_free(be);
@@ -1703,8 +1715,12 @@ static void set_common_stroke_params(DP_BrushEngine *be,
 {
     be->layer_id = besp->layer_id;
     be->stroke.sync_samples = besp->sync_samples && be->sync;
+    be->stroke.fast_sampling = besp->fast_sampling;
+    if (besp->fast_sampling && !be->sample_cache) {
+        be->sample_cache = DP_sample_cache_new();
+    }
     DP_stroke_engine_params_set(&be->se, &besp->se);
-    DP_ASSERT(besp->selection_id < 32); // Only have 5 bits for the id.
+    DP_ASSERT(besp->selection_id <= DP_SELECTION_ID_LOCAL_MAX);
     be->mask.next_selection_id = besp->selection_id;
 }
 
@@ -2240,8 +2256,9 @@ static DP_UPixelFloat sample_classic_smudge(DP_BrushEngine *be,
 {
     int diameter =
         get_classic_smudge_diameter(cb, pressure, velocity, distance);
-    return DP_layer_content_sample_color_at(
-        lc, get_stamp_buffer(be), DP_float_to_int(x), DP_float_to_int(y),
+    return DP_layer_content_sample_color_at_cached(
+        lc, get_sample_cache(be), get_stamp_buffer(be), DP_float_to_int(x),
+        DP_float_to_int(y),
         diameter, !cb->smudge_alpha || be->stroke.compatibility_mode,
         is_pigment_mode(get_classic_brush_blend_mode(be, cb)),
         &be->last_diameter, NULL);
@@ -2667,6 +2684,7 @@ void DP_brush_engine_stroke_end(DP_BrushEngine *be, long long time_msec,
     DP_canvas_state_decref_nullable(be->cs);
     be->cs = NULL;
     be->lc_valid = false;
+    DP_sample_cache_clear(be->sample_cache);
 
     DP_brush_engine_dabs_flush(be);
 
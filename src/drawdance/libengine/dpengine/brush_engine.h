@@ -52,6 +52,9 @@ typedef struct DP_BrushEngineStrokeParams {
     int selection_id;
     bool layer_alpha_lock;
     bool sync_samples;
+    // Approximate color samples of large dabs, see sample_cache.h. Only
+    // affects smudging locally, the resulting dabs are sent as usual.
+    bool fast_sampling;
 } DP_BrushEngineStrokeParams;
 
 
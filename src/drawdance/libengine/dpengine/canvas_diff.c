@@ -106,6 +106,20 @@ void DP_canvas_diff_check(DP_CanvasDiff *diff, DP_CanvasDiffCheckFn fn,
     }
 }
 
+void DP_canvas_diff_check_index(DP_CanvasDiff *diff, DP_CanvasDiffCheckFn fn,
+                                void *data, int tile_index)
+{
+    DP_ASSERT(diff);
+    DP_ASSERT(fn);
+    DP_ASSERT(tile_index >= 0);
+    if (tile_index < diff->count) {
+        bool *tile_change = &diff->tile_changes[tile_index];
+        if (!*tile_change && fn(data, tile_index)) {
+            *tile_change = true;
+        }
+    }
+}
+
 void DP_canvas_diff_check_all(DP_CanvasDiff *diff)
 {
     DP_ASSERT(diff);
@@ -40,6 +40,11 @@ void DP_canvas_diff_begin(DP_CanvasDiff *diff, int old_width, int old_height,
 void DP_canvas_diff_check(DP_CanvasDiff *diff, DP_CanvasDiffCheckFn fn,
                           void *data);
 
+// Like DP_canvas_diff_check, but only for a single tile. Indexes beyond the
+// current canvas size are ignored.
+void DP_canvas_diff_check_index(DP_CanvasDiff *diff, DP_CanvasDiffCheckFn fn,
+                                void *data, int tile_index);
+
 void DP_canvas_diff_check_all(DP_CanvasDiff *diff);
 
 void DP_canvas_diff_each_index(DP_CanvasDiff *diff, DP_CanvasDiffEachIndexFn fn,
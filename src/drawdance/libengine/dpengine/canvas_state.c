@@ -25,6 +25,7 @@
 #include "canvas_diff.h"
 #include "document_metadata.h"
 #include "draw_context.h"
+#include "gradient.h"
 #include "image.h"
 #include "key_frame.h"
 #include "layer_content.h"
@@ -548,12 +549,63 @@ static DP_Image *decompress_image_deflate(DP_UNUSED DP_DrawContext *dc,
     return DP_image_new_from_deflate8be(width, height, image, image_size);
 }
 
+typedef struct DP_DecodedPutImage {
+    DP_MessageDecoded parent;
+    DP_Image *img;
+} DP_DecodedPutImage;
+
+typedef struct DP_DecodedPutTile {
+    DP_MessageDecoded parent;
+    DP_Tile *tile;
+} DP_DecodedPutTile;
+
+static void free_decoded_put_image(DP_MessageDecoded *decoded)
+{
+    DP_DecodedPutImage *dpi = (DP_DecodedPutImage *)decoded;
+    DP_image_free(dpi->img);
+    DP_free(dpi);
+}
+
+static void free_decoded_put_tile(DP_MessageDecoded *decoded)
+{
+    DP_DecodedPutTile *dpt = (DP_DecodedPutTile *)decoded;
+    DP_tile_decref(dpt->tile);
+    DP_free(dpt);
+}
+
+static DP_Image *take_decoded_image(DP_Message *msg)
+{
+    DP_DecodedPutImage *dpi =
+        (DP_DecodedPutImage *)DP_message_decoded_take(msg);
+    if (dpi) {
+        DP_Image *img = dpi->img;
+        DP_free(dpi);
+        return img;
+    }
+    else {
+        return NULL;
+    }
+}
+
+static DP_Tile *take_decoded_tile(DP_Message *msg)
+{
+    DP_DecodedPutTile *dpt = (DP_DecodedPutTile *)DP_message_decoded_take(msg);
+    if (dpt) {
+        DP_Tile *tile = dpt->tile;
+        DP_free(dpt);
+        return tile;
+    }
+    else {
+        return NULL;
+    }
+}
+
 static DP_CanvasState *
-handle_put_image(DP_CanvasState *cs, DP_DrawContext *dc,
-                 DP_UserCursors *ucs_or_null, unsigned int context_id,
-                 DP_MsgPutImage *mpi,
-                 DP_Image *(*decompress_fn)(DP_DrawContext *, int, int,
-                                            const unsigned char *, size_t))
+put_image(DP_CanvasState *cs, DP_DrawContext *dc, DP_UserCursors *ucs_or_null,
+          unsigned int context_id, DP_MsgPutImage *mpi,
+          DP_Image **inout_decoded_img,
+          DP_Image *(*decompress_fn)(DP_DrawContext *, int, int,
+                                     const unsigned char *, size_t))
 {
     int blend_mode = DP_msg_put_image_mode(mpi);
     if (blend_mode == DP_BLEND_MODE_COMPAT_LOCAL_MATCH) {
@@ -592,17 +644,41 @@ handle_put_image(DP_CanvasState *cs, DP_DrawContext *dc,
         return NULL;
     }
 
-    size_t image_size;
-    const unsigned char *image = DP_msg_put_image_image(mpi, &image_size);
-    DP_Image *img = decompress_fn(dc, width, height, image, image_size);
-    if (!img) {
-        return NULL;
+    DP_Image *img = *inout_decoded_img;
+    if (img) {
+        *inout_decoded_img = NULL;
+    }
+    else {
+        size_t image_size;
+        const unsigned char *image = DP_msg_put_image_image(mpi, &image_size);
+        img = decompress_fn(dc, width, height, image, image_size);
+        if (!img) {
+            return NULL;
+        }
     }
 
     return DP_ops_put_image(cs, ucs_or_null, context_id, layer_id, blend_mode,
                             x, y, img);
 }
 
+static DP_CanvasState *
+handle_put_image(DP_CanvasState *cs, DP_DrawContext *dc,
+                 DP_UserCursors *ucs_or_null, DP_Message *msg,
+                 DP_Image *(*decompress_fn)(DP_DrawContext *, int, int,
+                                            const unsigned char *, size_t))
+{
+    // Always take the decoded image, even if the message turns out to be
+    // invalid, so that it doesn't stick around in the history.
+    DP_Image *decoded_img = take_decoded_image(msg);
+    DP_CanvasState *next = put_image(
+        cs, dc, ucs_or_null, DP_message_context_id(msg),
+        DP_message_internal(msg), &decoded_img, decompress_fn);
+    if (decoded_img) {
+        DP_image_free(decoded_img);
+    }
+    return next;
+}
+
 static DP_CanvasState *handle_fill_rect(DP_CanvasState *cs,
                                         DP_UserCursors *ucs_or_null,
                                         unsigned int context_id,
@@ -643,10 +719,112 @@ static DP_CanvasState *handle_fill_rect(DP_CanvasState *cs,
                             left, top, right, bottom, pixel);
 }
 
+static bool fill_gradient_coordinate_valid(int32_t c)
+{
+    return c >= -DP_GRADIENT_COORDINATE_MAX && c <= DP_GRADIENT_COORDINATE_MAX;
+}
+
+static DP_CanvasState *handle_fill_gradient(DP_CanvasState *cs,
+                                            DP_UserCursors *ucs_or_null,
+                                            unsigned int context_id,
+                                            DP_MsgFillGradient *mfg)
+{
+    int layer_id = DP_protocol_to_layer_id(DP_msg_fill_gradient_layer(mfg));
+    if (!DP_layer_id_normal(layer_id)) {
+        DP_error_set("Fill gradient: invalid layer id %d", layer_id);
+        return NULL;
+    }
+
+    int blend_mode = DP_msg_fill_gradient_mode(mfg);
+    if (!DP_blend_mode_exists(blend_mode)) {
+        DP_error_set("Fill gradient: unknown blend mode %d", blend_mode);
+        return NULL;
+    }
+    else if (!DP_blend_mode_valid_for_brush(blend_mode)) {
+        DP_error_set("Fill gradient: blend mode %s not applicable to brushes",
+                     DP_blend_mode_enum_name_unprefixed(blend_mode));
+        return NULL;
+    }
+
+    int shape = DP_msg_fill_gradient_shape(mfg);
+    if (shape >= DP_MSG_FILL_GRADIENT_NUM_SHAPE) {
+        DP_error_set("Fill gradient: unknown shape %d", shape);
+        return NULL;
+    }
+
+    int spread = DP_msg_fill_gradient_spread(mfg);
+    if (spread >= DP_MSG_FILL_GRADIENT_NUM_SPREAD) {
+        DP_error_set("Fill gradient: unknown spread %d", spread);
+        return NULL;
+    }
+
+    int32_t x1 = DP_msg_fill_gradient_x1(mfg);
+    int32_t y1 = DP_msg_fill_gradient_y1(mfg);
+    int32_t x2 = DP_msg_fill_gradient_x2(mfg);
+    int32_t y2 = DP_msg_fill_gradient_y2(mfg);
+    if (!fill_gradient_coordinate_valid(x1)
+        || !fill_gradient_coordinate_valid(y1)
+        || !fill_gradient_coordinate_valid(x2)
+        || !fill_gradient_coordinate_valid(y2)) {
+        DP_error_set("Fill gradient: coordinates out of range");
+        return NULL;
+    }
+
+    uint32_t ux = DP_msg_fill_gradient_x(mfg);
+    uint32_t uy = DP_msg_fill_gradient_y(mfg);
+    uint32_t uw = DP_msg_fill_gradient_w(mfg);
+    uint32_t uh = DP_msg_fill_gradient_h(mfg);
+    if (ux > INT_MAX || uy > INT_MAX || uw > INT_MAX || uh > INT_MAX) {
+        DP_error_set("Fill gradient: invalid bounds");
+        return NULL;
+    }
+
+    int x = DP_uint32_to_int(ux);
+    int y = DP_uint32_to_int(uy);
+    int left = x;
+    int top = y;
+    int right = DP_min_int(DP_uint32_to_int(uw), cs->width - x) + x;
+    int bottom = DP_min_int(DP_uint32_to_int(uh), cs->height - y) + y;
+    if (left >= right || top >= bottom) {
+        DP_error_set("Fill gradient: effective area to fill is zero");
+        return NULL;
+    }
+
+    int selection_id = DP_msg_fill_gradient_selection_id(mfg);
+    DP_LayerContent *mask_lc;
+    if (selection_id == 0) {
+        mask_lc = NULL;
+    }
+    else if (DP_selection_id_local(selection_id)) {
+        DP_error_set("Fill gradient: invalid selection id %d", selection_id);
+        return NULL;
+    }
+    else {
+        DP_Selection *sel =
+            DP_canvas_state_selection_search_noinc(cs, context_id, selection_id);
+        if (!sel) {
+            DP_error_set("Fill gradient: selection id %d not found",
+                         selection_id);
+            return NULL;
+        }
+        mask_lc = DP_selection_content_noinc(sel);
+    }
+
+    DP_Gradient g;
+    DP_gradient_init(&g, (DP_GradientShape)shape, (DP_GradientSpread)spread,
+                     x1, y1, x2, y2, DP_msg_fill_gradient_focus(mfg),
+                     DP_msg_fill_gradient_color1(mfg),
+                     DP_msg_fill_gradient_color2(mfg));
+    return DP_ops_fill_gradient(cs, ucs_or_null, context_id, layer_id,
+                                blend_mode, left, top, right, bottom, &g,
+                                mask_lc);
+}
+
 static DP_CanvasState *
-handle_put_tile(DP_CanvasState *cs, DP_DrawContext *dc, DP_MsgPutTile *mpt,
-                DP_Tile *(*decompress_fn)(DP_DrawContext *, unsigned int,
-                                          const unsigned char *, size_t))
+put_tile(DP_CanvasState *cs, DP_DrawContext *dc, DP_MsgPutTile *mpt,
+         DP_Tile **inout_decoded_tile,
+         DP_Tile *(*decompress_fn)(DP_DrawContext *, unsigned int,
+                                   const unsigned char *, size_t))
 {
     int layer_id = DP_protocol_to_layer_id(DP_msg_put_tile_layer(mpt));
     if (!DP_layer_id_normal(layer_id)) {
@@ -665,12 +843,17 @@ handle_put_tile(DP_CanvasState *cs, DP_DrawContext *dc, DP_MsgPutTile *mpt,
         return NULL;
     }
 
-    size_t image_size;
-    const unsigned char *image = DP_msg_put_tile_image(mpt, &image_size);
-    DP_Tile *tile =
-        decompress_fn(dc, DP_msg_put_tile_user(mpt), image, image_size);
-    if (!tile) {
-        return NULL;
+    DP_Tile *tile = *inout_decoded_tile;
+    if (tile) {
+        *inout_decoded_tile = NULL;
+    }
+    else {
+        size_t image_size;
+        const unsigned char *image = DP_msg_put_tile_image(mpt, &image_size);
+        tile = decompress_fn(dc, DP_msg_put_tile_user(mpt), image, image_size);
+        if (!tile) {
+            return NULL;
+        }
     }
 
     DP_CanvasState *next =
@@ -681,6 +864,18 @@ handle_put_tile(DP_CanvasState *cs, DP_DrawContext *dc, DP_MsgPutTile *mpt,
     return next;
 }
 
+static DP_CanvasState *
+handle_put_tile(DP_CanvasState *cs, DP_DrawContext *dc, DP_Message *msg,
+                DP_Tile *(*decompress_fn)(DP_DrawContext *, unsigned int,
+                                          const unsigned char *, size_t))
+{
+    DP_Tile *decoded_tile = take_decoded_tile(msg);
+    DP_CanvasState *next = put_tile(cs, dc, DP_message_internal(msg),
+                                    &decoded_tile, decompress_fn);
+    DP_tile_decref_nullable(decoded_tile);
+    return next;
+}
+
 static DP_CanvasState *handle_canvas_background(
     DP_CanvasState *cs, DP_DrawContext *dc, unsigned int context_id,
     DP_MsgCanvasBackground *mcb,
@@ -1492,15 +1687,16 @@ static DP_CanvasState *handle(DP_CanvasState *cs, DP_DrawContext *dc,
     case DP_MSG_LAYER_RETITLE:
         return handle_layer_retitle(cs, DP_message_internal(msg));
     case DP_MSG_PUT_IMAGE:
-        return handle_put_image(cs, dc, ucs_or_null, DP_message_context_id(msg),
-                                DP_message_internal(msg),
+        return handle_put_image(cs, dc, ucs_or_null, msg,
                                 decompress_image_deflate);
     case DP_MSG_FILL_RECT:
         return handle_fill_rect(cs, ucs_or_null, DP_message_context_id(msg),
                                 DP_message_internal(msg));
+    case DP_MSG_FILL_GRADIENT:
+        return handle_fill_gradient(cs, ucs_or_null, DP_message_context_id(msg),
+                                    DP_message_internal(msg));
     case DP_MSG_PUT_TILE:
-        return handle_put_tile(cs, dc, DP_message_internal(msg),
-                               DP_tile_new_from_deflate);
+        return handle_put_tile(cs, dc, msg, DP_tile_new_from_deflate);
     case DP_MSG_CANVAS_BACKGROUND:
         return handle_canvas_background(cs, dc, DP_message_context_id(msg),
                                         DP_message_internal(msg),
@@ -1570,11 +1766,10 @@ static DP_CanvasState *handle(DP_CanvasState *cs, DP_DrawContext *dc,
     case DP_MSG_SYNC_SELECTION_TILE:
         return handle_sync_selection_tile(cs, dc, DP_message_internal(msg));
     case DP_MSG_PUT_IMAGE_ZSTD:
-        return handle_put_image(cs, dc, ucs_or_null, DP_message_context_id(msg),
-                                DP_message_internal(msg),
+        return handle_put_image(cs, dc, ucs_or_null, msg,
                                 DP_image_new_from_delta_zstd8le);
     case DP_MSG_PUT_TILE_ZSTD:
-        return handle_put_tile(cs, dc, DP_message_internal(msg),
+        return handle_put_tile(cs, dc, msg,
                                DP_tile_new_from_split_delta_zstd8le);
     case DP_MSG_CANVAS_BACKGROUND_ZSTD:
         return handle_canvas_background(cs, dc, DP_message_context_id(msg),
@@ -1610,6 +1805,89 @@ DP_CanvasState *DP_canvas_state_handle(DP_CanvasState *cs, DP_DrawContext *dc,
     return next_cs;
 }
 
+static void decode_put_image(DP_DrawContext *dc, DP_Message *msg,
+                             DP_Image *(*decompress_fn)(DP_DrawContext *, int,
+                                                        int,
+                                                        const unsigned char *,
+                                                        size_t))
+{
+    DP_MsgPutImage *mpi = DP_message_internal(msg);
+    uint32_t uw = DP_msg_put_image_w(mpi);
+    uint32_t uh = DP_msg_put_image_h(mpi);
+    // Invalid messages are left alone, handling them will report the error.
+    if (DP_msg_put_image_mode(mpi) != DP_BLEND_MODE_COMPAT_LOCAL_MATCH
+        && uw != 0 && uh != 0 && uw <= INT_MAX && uh <= INT_MAX) {
+        size_t image_size;
+        const unsigned char *image = DP_msg_put_image_image(mpi, &image_size);
+        DP_Image *img = decompress_fn(dc, DP_uint32_to_int(uw),
+                                      DP_uint32_to_int(uh), image, image_size);
+        if (img) {
+            DP_DecodedPutImage *dpi = DP_malloc(sizeof(*dpi));
+            *dpi = (DP_DecodedPutImage){{free_decoded_put_image}, img};
+            DP_message_decoded_set(msg, &dpi->parent);
+        }
+    }
+}
+
+static void decode_put_tile(DP_DrawContext *dc, DP_Message *msg,
+                            DP_Tile *(*decompress_fn)(DP_DrawContext *,
+                                                      unsigned int,
+                                                      const unsigned char *,
+                                                      size_t))
+{
+    DP_MsgPutTile *mpt = DP_message_internal(msg);
+    size_t image_size;
+    const unsigned char *image = DP_msg_put_tile_image(mpt, &image_size);
+    DP_Tile *tile =
+        decompress_fn(dc, DP_msg_put_tile_user(mpt), image, image_size);
+    if (tile) {
+        DP_DecodedPutTile *dpt = DP_malloc(sizeof(*dpt));
+        *dpt = (DP_DecodedPutTile){{free_decoded_put_tile}, tile};
+        DP_message_decoded_set(msg, &dpt->parent);
+    }
+}
+
+bool DP_canvas_state_message_decodable(DP_Message *msg)
+{
+    DP_ASSERT(msg);
+    switch (DP_message_type(msg)) {
+    case DP_MSG_PUT_IMAGE:
+    case DP_MSG_PUT_IMAGE_ZSTD:
+    case DP_MSG_PUT_TILE:
+    case DP_MSG_PUT_TILE_ZSTD:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void DP_canvas_state_message_decode(DP_DrawContext *dc, DP_Message *msg)
+{
+    DP_ASSERT(dc);
+    DP_ASSERT(msg);
+    if (DP_message_decoded_wanted(msg)) {
+        DP_MessageType type = DP_message_type(msg);
+        DP_PERF_BEGIN_DETAIL(fn, "decode", "type=%d", (int)type);
+        switch (type) {
+        case DP_MSG_PUT_IMAGE:
+            decode_put_image(dc, msg, decompress_image_deflate);
+            break;
+        case DP_MSG_PUT_IMAGE_ZSTD:
+            decode_put_image(dc, msg, DP_image_new_from_delta_zstd8le);
+            break;
+        case DP_MSG_PUT_TILE:
+            decode_put_tile(dc, msg, DP_tile_new_from_deflate);
+            break;
+        case DP_MSG_PUT_TILE_ZSTD:
+            decode_put_tile(dc, msg, DP_tile_new_from_split_delta_zstd8le);
+            break;
+        default:
+            break;
+        }
+        DP_PERF_END(fn);
+    }
+}
+
 DP_CanvasState *DP_canvas_state_handle_multidab(DP_CanvasState *cs,
                                                 DP_DrawContext *dc,
                                                 DP_UserCursors *ucs_or_null,
@@ -141,6 +141,14 @@ DP_CanvasState *DP_canvas_state_handle(DP_CanvasState *cs, DP_DrawContext *dc,
                                        DP_UserCursors *ucs_or_null,
                                        DP_Message *msg);
 
+// Put image and put tile messages carry compressed pixel data. Decoding it
+// ahead of time, on a background thread with a draw context of its own while
+// the message is still waiting in a queue, means that handling the message
+// afterwards only has to put the pixels in place.
+bool DP_canvas_state_message_decodable(DP_Message *msg);
+
+void DP_canvas_state_message_decode(DP_DrawContext *dc, DP_Message *msg);
+
 DP_CanvasState *DP_canvas_state_handle_multidab(DP_CanvasState *cs,
                                                 DP_DrawContext *dc,
                                                 DP_UserCursors *ucs_or_null,
@@ -88,12 +88,12 @@ static DP_DumpReaderResult handle_message(DP_DumpReader *dr)
         return DP_DUMP_READER_ERROR_INPUT;
     }
 
-    size_t size = DP_read_bigendian_uint32(dr->input.buffer);
+    size_t size = DP_read_bigendian_uint32(dr->input.data);
     if (!read_exactly(dr, size)) {
         return DP_DUMP_READER_ERROR_INPUT;
     }
 
-    DP_Message *msg = DP_message_deserialize(dr->input.buffer, size, true);
+    DP_Message *msg = DP_message_deserialize(dr->input.data, size, true);
     if (msg) {
         DP_VECTOR_PUSH_TYPE(&dr->messages, DP_Message *, msg);
         return DP_DUMP_READER_SUCCESS;
@@ -109,7 +109,7 @@ static DP_DumpReaderResult handle_multidab(DP_DumpReader *dr)
         return DP_DUMP_READER_ERROR_INPUT;
     }
 
-    uint32_t count = DP_read_bigendian_uint32(dr->input.buffer);
+    uint32_t count = DP_read_bigendian_uint32(dr->input.data);
     for (uint32_t i = 0; i < count; ++i) {
         DP_DumpReaderResult result = handle_message(dr);
         if (result != DP_DUMP_READER_SUCCESS) {
@@ -131,7 +131,7 @@ static DP_DumpReaderResult handle_undo_depth_limit(DP_DumpReader *dr)
     if (!read_exactly(dr, sizeof(uint8_t))) {
         return DP_DUMP_READER_ERROR_INPUT;
     }
-    uint8_t undo_depth_limit = DP_read_bigendian_uint8(dr->input.buffer);
+    uint8_t undo_depth_limit = DP_read_bigendian_uint8(dr->input.data);
     DP_Message *msg = DP_msg_undo_depth_new(0, undo_depth_limit);
     DP_VECTOR_PUSH_TYPE(&dr->messages, DP_Message *, msg);
     return DP_DUMP_READER_SUCCESS;
@@ -176,7 +176,7 @@ DP_DumpReaderResult DP_dump_reader_read(DP_DumpReader *dr,
     }
 
     DP_VECTOR_CLEAR_TYPE(&dr->messages, DP_Message *, dispose_message);
-    int type = DP_read_bigendian_uint8(dr->input.buffer);
+    int type = DP_read_bigendian_uint8(dr->input.data);
     DP_DumpReaderResult result = read_type(dr, type);
     ++dr->position;
     ++dr->offset;
@@ -37,10 +37,13 @@
 #include "selection.h"
 #include "tile.h"
 #include "tile_iterator.h"
+#include <dpcommon/atomic.h>
 #include <dpcommon/common.h>
 #include <dpcommon/conversions.h>
 #include <dpcommon/geom.h>
 #include <dpcommon/queue.h>
+#include <dpcommon/threading.h>
+#include <dpcommon/worker.h>
 #include <math.h>
 #include <helpers.h> // M_PI
 
@@ -67,6 +70,14 @@ typedef enum DP_FloodFillContextType {
     DP_FLOOD_FILL_SOURCE_MERGED,
 } DP_FloodFillContextType;
 
+// Threads for the band passes, started when the first pass needs them and
+// then reused for the rest of the fill.
+typedef struct DP_FillBandWorker {
+    DP_Worker *worker;
+    DP_Semaphore *sem;
+    bool failed;
+} DP_FillBandWorker;
+
 typedef struct DP_FillContext {
     int width, height;
     DP_Rect area;
@@ -75,6 +86,7 @@ typedef struct DP_FillContext {
     bool cancelled;
     DP_FloodFillShouldCancelFn should_cancel;
     void *user;
+    DP_FillBandWorker band_worker;
 } DP_FillContext;
 
 typedef struct DP_FloodFillContext {
@@ -145,6 +157,117 @@ static bool is_cancelled(DP_FillContext *c)
     }
 }
 
+// Altering selections on large canvases means going over masks with hundreds
+// of millions of pixels, so those passes get split into bands of rows that
+// are worked on in parallel. Small masks aren't worth starting threads for.
+#define BAND_MIN_PIXELS  (512 * 512)
+#define BAND_MAX_THREADS 64
+#define BANDS_PER_THREAD 4
+
+typedef struct DP_FillBands DP_FillBands;
+
+typedef void (*DP_FillBandFn)(DP_FillBands *b, void *user, int start, int end);
+
+struct DP_FillBands {
+    DP_FillContext *c;
+    DP_FillBandFn fn;
+    void *user;
+    DP_Atomic cancelled;
+};
+
+typedef struct DP_FillBandJob {
+    DP_FillBands *b;
+    int start, end;
+} DP_FillBandJob;
+
+// Bands may run on multiple threads at once, so they don't touch the fill
+// context's cancellation flag, that gets updated once they're all done.
+static bool is_band_cancelled(DP_FillBands *b)
+{
+    if (DP_atomic_get(&b->cancelled)) {
+        return true;
+    }
+    else if (b->c->should_cancel && b->c->should_cancel(b->c->user)) {
+        DP_atomic_set(&b->cancelled, 1);
+        return true;
+    }
+    else {
+        return false;
+    }
+}
+
+static void band_job(void *element, DP_UNUSED int thread_index)
+{
+    DP_FillBandJob *job = element;
+    DP_FillBands *b = job->b;
+    b->fn(b, b->user, job->start, job->end);
+    DP_SEMAPHORE_MUST_POST(b->c->band_worker.sem);
+}
+
+static DP_Worker *get_band_worker(DP_FillContext *c)
+{
+    DP_FillBandWorker *bw = &c->band_worker;
+    if (!bw->worker && !bw->failed) {
+        int thread_count = DP_worker_cpu_count(BAND_MAX_THREADS);
+        if (thread_count > 1) {
+            bw->sem = DP_semaphore_new(0);
+            if (bw->sem) {
+                bw->worker = DP_worker_new(
+                    DP_int_to_size(thread_count * BANDS_PER_THREAD),
+                    sizeof(DP_FillBandJob), thread_count, band_job);
+                if (!bw->worker) {
+                    DP_semaphore_free(bw->sem);
+                    bw->sem = NULL;
+                }
+            }
+            if (!bw->worker) {
+                DP_warn("Fill failed to create worker: %s", DP_error());
+            }
+        }
+        bw->failed = !bw->worker;
+    }
+    return bw->worker;
+}
+
+static void dispose_band_worker(DP_FillContext *c)
+{
+    DP_FillBandWorker *bw = &c->band_worker;
+    if (bw->worker) {
+        DP_worker_free_join(bw->worker);
+        DP_semaphore_free(bw->sem);
+    }
+    *bw = (DP_FillBandWorker){NULL, NULL, false};
+}
+
+static void run_bands(DP_FillContext *c, int count, int width, DP_FillBandFn fn,
+                      void *user)
+{
+    if (count <= 0 || is_cancelled(c)) {
+        return;
+    }
+
+    DP_FillBands b = {c, fn, user, DP_ATOMIC_INIT(0)};
+    size_t pixels = DP_int_to_size(count) * DP_int_to_size(width);
+    DP_Worker *worker = pixels < BAND_MIN_PIXELS ? NULL : get_band_worker(c);
+    if (worker) {
+        int band_count = DP_min_int(
+            count, DP_worker_thread_count(worker) * BANDS_PER_THREAD);
+        for (int i = 0; i < band_count; ++i) {
+            DP_FillBandJob job = {&b, count * i / band_count,
+                                  count * (i + 1) / band_count};
+            DP_worker_push(worker, &job);
+        }
+        DP_SEMAPHORE_MUST_WAIT_N(c->band_worker.sem, band_count);
+    }
+    else {
+        fn(&b, user, 0, count);
+    }
+
+    if (DP_atomic_get(&b.cancelled)) {
+        c->cancelled = true;
+    }
+}
+
 
 static bool source_is_merged(DP_FloodFillContext *c, int tile_index)
 {
@@ -871,89 +994,334 @@ static int get_kernel_diameter(int radius)
     return radius * 2 + 1;
 }
 
-static unsigned char *generate_expansion_kernel(DP_FloodFillKernel kernel_shape,
-                                                int expand)
+// Half-widths of the rows of a round kernel. The kernel is symmetric, so
+// that's enough to describe it and lets the rows be filled in one go.
+static int *generate_round_kernel_spans(int radius)
 {
-    if (kernel_shape == DP_FLOOD_FILL_KERNEL_SQUARE) {
-        return NULL;
+    int diameter = get_kernel_diameter(radius);
+    int *spans = DP_malloc(DP_int_to_size(diameter) * sizeof(*spans));
+    int rr = DP_square_int(radius);
+    for (int y = 0; y < diameter; ++y) {
+        int yy = DP_square_int(y - radius);
+        int half_width = 0;
+        while (half_width < radius
+               && DP_square_int(half_width + 1) + yy <= rr) {
+            ++half_width;
+        }
+        spans[y] = half_width;
     }
-    else {
-        int diameter = get_kernel_diameter(expand);
-        size_t kernel_size = DP_square_size(DP_int_to_size(diameter));
-        unsigned char *kernel = DP_malloc(kernel_size);
-        int rr = DP_square_int(expand);
-        for (int y = 0; y < diameter; ++y) {
-            for (int x = 0; x < diameter; ++x) {
-                kernel[y * diameter + x] =
-                    DP_square_int(x - expand) + DP_square_int(y - expand) <= rr;
+    return spans;
+}
+
+static float max_float_vec(float a, float b)
+{
+    // Written out rather than calling a function so that the loops using it
+    // get vectorized.
+    return a < b ? b : a;
+}
+
+static float min_float_vec(float a, float b)
+{
+    return b < a ? b : a;
+}
+
+typedef struct DP_FillDilateParams {
+    const float *src;
+    int src_width, src_height;
+    float *mask;
+    int mask_width;
+    float *tmp;
+    const int *spans;
+    int expand, feather_radius;
+    int offset_x, offset_y;
+    int dst_width, dst_height;
+} DP_FillDilateParams;
+
+static void dilate_square_horizontally(DP_FillBands *b, void *user, int start,
+                                       int end)
+{
+    DP_FillDilateParams *p = user;
+    int src_width = p->src_width;
+    int dst_width = p->dst_width;
+    int expand = p->expand;
+    int offset_x = p->offset_x;
+    for (int y = start; y < end && !is_band_cancelled(b); ++y) {
+        const float *src_row = p->src + y * src_width;
+        float *tmp_row = p->tmp + y * dst_width;
+        for (int x = 0; x < dst_width; ++x) {
+            tmp_row[x] = 0.0f;
+        }
+        for (int k = -expand; k <= expand; ++k) {
+            int shift = offset_x - k;
+            int x_start = DP_max_int(shift, 0);
+            int x_end = DP_min_int(shift + src_width, dst_width);
+            for (int x = x_start; x < x_end; ++x) {
+                tmp_row[x] = max_float_vec(tmp_row[x], src_row[x - shift]);
             }
         }
-        return kernel;
-    }
-}
-
-static void apply_expansion_kernel(float *mask, int mask_width, float value,
-                                   const unsigned char *kernel, int width,
-                                   int height, int expand, int feather_radius,
-                                   int expand_min_x, int expand_min_y, int x0,
-                                   int y0)
-{
-    int start_x0 = x0 - expand;
-    int start_y0 = y0 - expand;
-    int start_x = DP_max_int(start_x0, 0);
-    int start_y = DP_max_int(start_y0, 0);
-    int end_x = DP_min_int(x0 + expand, width - 1);
-    int end_y = DP_min_int(y0 + expand, height - 1);
-    int diameter = kernel ? get_kernel_diameter(expand) : 0;
-    for (int y = start_y; y <= end_y; ++y) {
-        for (int x = start_x; x <= end_x; ++x) {
-            if (!kernel || kernel[(y - start_y0) * diameter + (x - start_x0)]) {
-                int mx = x - expand_min_x + feather_radius;
-                int my = y - expand_min_y + feather_radius;
-                int index = my * mask_width + mx;
-                if (value == 1.0f || mask[index] < value) {
-                    mask[index] = value;
+    }
+}
+
+static void dilate_square_vertically(DP_FillBands *b, void *user, int start,
+                                     int end)
+{
+    DP_FillDilateParams *p = user;
+    int dst_width = p->dst_width;
+    int expand = p->expand;
+    int feather_radius = p->feather_radius;
+    for (int y = start; y < end && !is_band_cancelled(b); ++y) {
+        float *mask_row =
+            p->mask + (y + feather_radius) * p->mask_width + feather_radius;
+        int src_y = y - p->offset_y;
+        int top = DP_max_int(src_y - expand, 0);
+        int bottom = DP_min_int(src_y + expand, p->src_height - 1);
+        for (int ty = top; ty <= bottom; ++ty) {
+            const float *tmp_row = p->tmp + ty * dst_width;
+            for (int x = 0; x < dst_width; ++x) {
+                mask_row[x] = max_float_vec(mask_row[x], tmp_row[x]);
+            }
+        }
+    }
+}
+
+// If a pixel's neighbors all have at least its value, their kernels together
+// already cover its own, except for the pixel itself. That means only pixels
+// along the edges of the selection need to stamp the whole kernel.
+static bool dilate_covered_by_neighbors(const float *src, int src_width,
+                                        int src_height, int x, int y,
+                                        float value)
+{
+    if (x > 0 && y > 0 && x < src_width - 1 && y < src_height - 1) {
+        const float *center = src + y * src_width + x;
+        return center[-1] >= value && center[1] >= value
+            && center[-src_width] >= value && center[src_width] >= value;
+    }
+    else {
+        return false;
+    }
+}
+
+static void dilate_round(DP_FillBands *b, void *user, int start, int end)
+{
+    // The kernel isn't separable, so source pixels get stamped onto the mask
+    // instead, restricted to the rows of this band.
+    DP_FillDilateParams *p = user;
+    int src_width = p->src_width;
+    int src_height = p->src_height;
+    int expand = p->expand;
+    int feather_radius = p->feather_radius;
+    int src_y_start = DP_max_int(start - expand - p->offset_y, 0);
+    int src_y_end = DP_min_int(end + expand - p->offset_y, src_height);
+    for (int src_y = src_y_start; src_y < src_y_end && !is_band_cancelled(b);
+         ++src_y) {
+        int y0 = src_y + p->offset_y;
+        int y_start = DP_max_int(y0 - expand, start);
+        int y_end = DP_min_int(y0 + expand + 1, end);
+        for (int src_x = 0; src_x < src_width; ++src_x) {
+            float value = p->src[src_y * src_width + src_x];
+            if (value > 0.0f) {
+                int x0 = src_x + p->offset_x;
+                if (dilate_covered_by_neighbors(p->src, src_width, src_height,
+                                                src_x, src_y, value)) {
+                    if (y0 >= start && y0 < end) {
+                        float *m = p->mask
+                                 + (y0 + feather_radius) * p->mask_width
+                                 + feather_radius + x0;
+                        *m = max_float_vec(*m, value);
+                    }
+                    continue;
+                }
+
+                for (int y = y_start; y < y_end; ++y) {
+                    int half_width = p->spans[y - y0 + expand];
+                    int x_start = DP_max_int(x0 - half_width, 0);
+                    int x_end = DP_min_int(x0 + half_width + 1, p->dst_width);
+                    float *mask_row = p->mask
+                                    + (y + feather_radius) * p->mask_width
+                                    + feather_radius;
+                    for (int x = x_start; x < x_end; ++x) {
+                        mask_row[x] = max_float_vec(mask_row[x], value);
+                    }
                 }
             }
         }
     }
 }
 
-static float erode_mask_pixel(const float *in_mask, int mask_width,
-                              const unsigned char *kernel, int shrink,
-                              int diameter, int x0, int y0)
+static void dilate_mask(DP_FillContext *c, const float *src, int src_width,
+                        int src_height, float *mask, int mask_width,
+                        DP_FloodFillKernel kernel_shape, int expand,
+                        int feather_radius, int offset_x, int offset_y,
+                        int dst_width, int dst_height)
 {
-    int start_x = x0 - shrink;
-    int start_y = y0 - shrink;
-    int end_x = x0 + shrink;
-    int end_y = y0 + shrink;
-    float value = 1.0f;
-    for (int y = start_y; y <= end_y; ++y) {
-        for (int x = start_x; x <= end_x; ++x) {
-            if (!kernel || kernel[(y - start_y) * diameter + (x - start_x)]) {
-                value = DP_min_float(value, in_mask[y * mask_width + x]);
-                if (value == 0.0f) {
-                    return 0.0f;
+    DP_FillDilateParams p = {
+        src,    src_width,      src_height, mask,     mask_width, NULL, NULL,
+        expand, feather_radius, offset_x,   offset_y, dst_width,  dst_height,
+    };
+    if (kernel_shape == DP_FLOOD_FILL_KERNEL_SQUARE) {
+        // A square kernel is the same as a horizontal and a vertical line.
+        p.tmp = DP_malloc(DP_int_to_size(dst_width) * DP_int_to_size(src_height)
+                          * sizeof(*p.tmp));
+        run_bands(c, src_height, dst_width, dilate_square_horizontally, &p);
+        run_bands(c, dst_height, dst_width, dilate_square_vertically, &p);
+        DP_free(p.tmp);
+    }
+    else {
+        int *spans = generate_round_kernel_spans(expand);
+        p.spans = spans;
+        run_bands(c, dst_height, dst_width, dilate_round, &p);
+        DP_free(spans);
+    }
+}
+
+typedef struct DP_FillErodeParams {
+    const float *in_mask;
+    int in_width;
+    float *out_mask;
+    int out_width;
+    float *tmp;
+    const int *spans;
+    int in_height;
+    int shrink, feather_radius;
+    int width;
+} DP_FillErodeParams;
+
+// Same as with dilation, but the other way round: pixels whose neighbors all
+// have at most their value don't need to stamp their kernel.
+static bool erode_covered_by_neighbors(const float *in_mask, int in_width,
+                                       int in_height, int x, int y,
+                                       float value)
+{
+    if (x > 0 && y > 0 && x < in_width - 1 && y < in_height - 1) {
+        const float *center = in_mask + y * in_width + x;
+        return center[-1] <= value && center[1] <= value
+            && center[-in_width] <= value && center[in_width] <= value;
+    }
+    else {
+        return false;
+    }
+}
+
+static void erode_round(DP_FillBands *b, void *user, int start, int end)
+{
+    DP_FillErodeParams *p = user;
+    int in_width = p->in_width;
+    int in_height = p->in_height;
+    int width = p->width;
+    int shrink = p->shrink;
+    int feather_radius = p->feather_radius;
+    for (int y = start; y < end; ++y) {
+        float *out_row =
+            p->out_mask + (y + feather_radius) * p->out_width + feather_radius;
+        for (int x = 0; x < width; ++x) {
+            out_row[x] = 1.0f;
+        }
+    }
+
+    // Each input pixel is the center of a kernel, the output is offset from
+    // the input by the size of that kernel. Its left and top edge are only
+    // there to be looked at, they're not part of the output.
+    int in_y_end = DP_min_int(end + shrink * 2, in_height);
+    for (int in_y = start; in_y < in_y_end && !is_band_cancelled(b); ++in_y) {
+        int y0 = in_y - shrink;
+        int y_start = DP_max_int(y0 - shrink, start);
+        int y_end = DP_min_int(y0 + shrink + 1, end);
+        for (int in_x = 0; in_x < in_width; ++in_x) {
+            float value = p->in_mask[in_y * in_width + in_x];
+            if (value < 1.0f) {
+                int x0 = in_x - shrink;
+                if (erode_covered_by_neighbors(p->in_mask, in_width, in_height,
+                                               in_x, in_y, value)) {
+                    if (y0 >= start && y0 < end && x0 >= 0 && x0 < width) {
+                        float *o = p->out_mask
+                                 + (y0 + feather_radius) * p->out_width
+                                 + feather_radius + x0;
+                        *o = min_float_vec(*o, value);
+                    }
+                    continue;
+                }
+
+                for (int y = y_start; y < y_end; ++y) {
+                    int half_width = p->spans[y - y0 + shrink];
+                    int x_start = DP_max_int(x0 - half_width, 0);
+                    int x_end = DP_min_int(x0 + half_width + 1, width);
+                    float *out_row = p->out_mask
+                                   + (y + feather_radius) * p->out_width
+                                   + feather_radius;
+                    for (int x = x_start; x < x_end; ++x) {
+                        out_row[x] = min_float_vec(out_row[x], value);
+                    }
                 }
             }
         }
     }
-    return value;
+}
+
+static void erode_square_horizontally(DP_FillBands *b, void *user, int start,
+                                      int end)
+{
+    DP_FillErodeParams *p = user;
+    int width = p->width;
+    int diameter = get_kernel_diameter(p->shrink);
+    for (int y = start; y < end && !is_band_cancelled(b); ++y) {
+        const float *in_row = p->in_mask + y * p->in_width;
+        float *tmp_row = p->tmp + y * width;
+        for (int x = 0; x < width; ++x) {
+            tmp_row[x] = 1.0f;
+        }
+        for (int k = 0; k < diameter; ++k) {
+            for (int x = 0; x < width; ++x) {
+                tmp_row[x] = min_float_vec(tmp_row[x], in_row[x + k]);
+            }
+        }
+    }
+}
+
+static void erode_square_vertically(DP_FillBands *b, void *user, int start,
+                                    int end)
+{
+    DP_FillErodeParams *p = user;
+    int width = p->width;
+    int diameter = get_kernel_diameter(p->shrink);
+    int feather_radius = p->feather_radius;
+    for (int y = start; y < end && !is_band_cancelled(b); ++y) {
+        float *out_row =
+            p->out_mask + (y + feather_radius) * p->out_width + feather_radius;
+        for (int x = 0; x < width; ++x) {
+            out_row[x] = 1.0f;
+        }
+        for (int k = 0; k < diameter; ++k) {
+            const float *tmp_row = p->tmp + (y + k) * width;
+            for (int x = 0; x < width; ++x) {
+                out_row[x] = min_float_vec(out_row[x], tmp_row[x]);
+            }
+        }
+    }
 }
 
 static void erode_mask(DP_FillContext *c, const float *in_mask, int in_width,
                        int in_height, float *out_mask, int out_width,
                        int feather_radius, int shrink,
-                       const unsigned char *kernel)
-{
-    int diameter = kernel ? get_kernel_diameter(shrink) : 0;
-    for (int y = shrink; y < in_height - shrink && !is_cancelled(c); ++y) {
-        int out_y = y - shrink + feather_radius;
-        for (int x = shrink; x < in_width - shrink; ++x) {
-            int out_x = x - shrink + feather_radius;
-            out_mask[out_y * out_width + out_x] = erode_mask_pixel(
-                in_mask, in_width, kernel, shrink, diameter, x, y);
-        }
+                       DP_FloodFillKernel kernel_shape)
+{
+    int width = in_width - shrink * 2;
+    int height = in_height - shrink * 2;
+    DP_FillErodeParams p = {
+        in_mask, in_width,  out_mask, out_width,      NULL,
+        NULL,    in_height, shrink,   feather_radius, width,
+    };
+    if (kernel_shape == DP_FLOOD_FILL_KERNEL_SQUARE) {
+        p.tmp = DP_malloc(DP_int_to_size(width) * DP_int_to_size(in_height)
+                          * sizeof(*p.tmp));
+        run_bands(c, in_height, width, erode_square_horizontally, &p);
+        run_bands(c, height, width, erode_square_vertically, &p);
+        DP_free(p.tmp);
+    }
+    else {
+        int *spans = generate_round_kernel_spans(shrink);
+        p.spans = spans;
+        run_bands(c, height, width, erode_round, &p);
+        DP_free(spans);
     }
 }
 
@@ -1082,29 +1450,55 @@ static float *generate_gaussian_kernel(int radius)
     return kernel;
 }
 
-static void blur_horizontally(float *dst, const float *src, int x0, int y0,
-                              int width, const float *kernel, int radius)
-{
-    int left = DP_max_int(x0 - radius, 0);
-    int right = DP_min_int(x0 + radius, width - 1);
-    float result = 0.0f;
-    for (int x = left; x <= right; ++x) {
-        result += src[y0 * width + x] * kernel[x - x0 + radius];
+typedef struct DP_FillFeatherParams {
+    float *mask;
+    float *tmp;
+    const float *kernel;
+    int width, height, radius;
+} DP_FillFeatherParams;
+
+static void blur_horizontally(DP_FillBands *b, void *user, int start, int end)
+{
+    DP_FillFeatherParams *p = user;
+    int width = p->width;
+    int radius = p->radius;
+    for (int y = start; y < end && !is_band_cancelled(b); ++y) {
+        const float *src_row = p->mask + y * width;
+        float *dst_row = p->tmp + y * width;
+        for (int x0 = 0; x0 < width; ++x0) {
+            int left = DP_max_int(x0 - radius, 0);
+            int right = DP_min_int(x0 + radius, width - 1);
+            float result = 0.0f;
+            for (int x = left; x <= right; ++x) {
+                result += src_row[x] * p->kernel[x - x0 + radius];
+            }
+            dst_row[x0] = result;
+        }
     }
-    dst[y0 * width + x0] = result;
 }
 
-static void blur_vertically(float *dst, const float *src, int x0, int y0,
-                            int width, int height, const float *kernel,
-                            int radius)
+static void blur_vertically(DP_FillBands *b, void *user, int start, int end)
 {
-    int top = DP_max_int(y0 - radius, 0);
-    int bottom = DP_min_int(y0 + radius, height - 1);
-    float result = 0.0f;
-    for (int y = top; y <= bottom; ++y) {
-        result += src[y * width + x0] * kernel[y - y0 + radius];
+    // Accumulates whole rows at a time, rather than going down each column,
+    // so that the memory is accessed in order and the loop is vectorized.
+    DP_FillFeatherParams *p = user;
+    int width = p->width;
+    int radius = p->radius;
+    for (int y0 = start; y0 < end && !is_band_cancelled(b); ++y0) {
+        float *dst_row = p->mask + y0 * width;
+        for (int x = 0; x < width; ++x) {
+            dst_row[x] = 0.0f;
+        }
+        int top = DP_max_int(y0 - radius, 0);
+        int bottom = DP_min_int(y0 + radius, p->height - 1);
+        for (int y = top; y <= bottom; ++y) {
+            const float *src_row = p->tmp + y * width;
+            float k = p->kernel[y - y0 + radius];
+            for (int x = 0; x < width; ++x) {
+                dst_row[x] += src_row[x] * k;
+            }
+        }
     }
-    dst[y0 * width + x0] = result;
 }
 
 static void feather_mask(DP_FillContext *c, float *mask, float *tmp, int width,
@@ -1114,32 +1508,35 @@ static void feather_mask(DP_FillContext *c, float *mask, float *tmp, int width,
     // gaussian kernel, then blur once horizontally to a temporary buffer and
     // then vertically back into the original image.
     float *kernel = generate_gaussian_kernel(radius);
-    for (int y = 0; y < height; ++y) {
-        if (is_cancelled(c)) {
-            DP_free(kernel);
-            return;
-        }
-        for (int x = 0; x < width; ++x) {
-            blur_horizontally(tmp, mask, x, y, width, kernel, radius);
-        }
-    }
-    for (int y = 0; y < height; ++y) {
-        if (is_cancelled(c)) {
-            DP_free(kernel);
-            return;
-        }
+    DP_FillFeatherParams p = {mask, tmp, kernel, width, height, radius};
+    run_bands(c, height, width, blur_horizontally, &p);
+    run_bands(c, height, width, blur_vertically, &p);
+    DP_free(kernel);
+}
+
+// Writes the values of the area to fill into the given buffer, with the
+// top-left of the area at (offset, offset). Zero values are skipped, the
+// buffer is already zeroed out.
+typedef void (*DP_FillReadSourceFn)(DP_FillContext *c, float *dst,
+                                    int dst_width, int offset);
+
+static void read_everything(DP_FillContext *c, float *dst, int dst_width,
+                            int offset)
+{
+    int width = c->max_x - c->min_x + 1;
+    for (int y = c->min_y; y <= c->max_y && !is_cancelled(c); ++y) {
+        float *dst_row = dst + (y - c->min_y + offset) * dst_width + offset;
         for (int x = 0; x < width; ++x) {
-            blur_vertically(mask, tmp, x, y, width, height, kernel, radius);
+            dst_row[x] = 1.0f;
         }
     }
-    DP_free(kernel);
 }
 
-static float *make_mask(DP_FillContext *c,
-                        float (*get_output)(void *, int, int), int expand,
-                        DP_FloodFillKernel kernel_shape, int feather_radius,
-                        bool from_edge, int *out_img_x, int *out_img_y,
-                        int *out_img_width, int *out_img_height)
+static float *make_mask(DP_FillContext *c, DP_FillReadSourceFn read_source,
+                        int expand, DP_FloodFillKernel kernel_shape,
+                        int feather_radius, bool from_edge, int *out_img_x,
+                        int *out_img_y, int *out_img_width,
+                        int *out_img_height)
 {
     int min_x = c->min_x, min_y = c->min_y;
     int max_x = c->max_x, max_y = c->max_y;
@@ -1159,38 +1556,23 @@ static float *make_mask(DP_FillContext *c,
     *out_img_height = img_height;
 
     if (expand == 0) {
-        for (int y = min_y; y <= max_y; ++y) {
-            if (is_cancelled(c)) {
-                return mask;
-            }
-            for (int x = min_x; x <= max_x; ++x) {
-                float value = get_output ? get_output(c, x, y) : 1.0f;
-                if (value > 0.0f) {
-                    int mx = x - min_x + feather_radius;
-                    int my = y - min_y + feather_radius;
-                    mask[my * img_width + mx] = value;
-                }
-            }
-        }
+        read_source(c, mask, img_width, feather_radius);
     }
     else if (expand > 0) {
-        unsigned char *kernel = generate_expansion_kernel(kernel_shape, expand);
-        for (int y = min_y; y <= max_y; ++y) {
-            if (is_cancelled(c)) {
-                DP_free(kernel);
-                return mask;
-            }
-            for (int x = min_x; x <= max_x; ++x) {
-                float value = get_output ? get_output(c, x, y) : 1.0f;
-                if (value > 0.0f) {
-                    apply_expansion_kernel(mask, img_width, value, kernel,
-                                           c->width, c->height, expand,
-                                           feather_radius, expand_min_x,
-                                           expand_min_y, x, y);
-                }
-            }
+        int src_width = max_x - min_x + 1;
+        int src_height = max_y - min_y + 1;
+        size_t src_size =
+            DP_int_to_size(src_width) * DP_int_to_size(src_height);
+        float *src = DP_malloc_zeroed(src_size * sizeof(float));
+        read_source(c, src, src_width, 0);
+        if (!is_cancelled(c)) {
+            dilate_mask(c, src, src_width, src_height, mask, img_width,
+                        kernel_shape, expand, feather_radius,
+                        min_x - expand_min_x, min_y - expand_min_y,
+                        expand_max_x - expand_min_x + 1,
+                        expand_max_y - expand_min_y + 1);
         }
-        DP_free(kernel);
+        DP_free(src);
     }
     else {
         int shrink = -expand;
@@ -1199,32 +1581,17 @@ static float *make_mask(DP_FillContext *c,
         size_t tmp_size =
             DP_int_to_size(tmp_width) * DP_int_to_size(tmp_height);
         float *tmp = DP_malloc_zeroed(tmp_size * sizeof(float));
+        read_source(c, tmp, tmp_width, shrink);
 
-        for (int y = min_y; y <= max_y; ++y) {
-            if (is_cancelled(c)) {
-                DP_free(tmp);
-                return mask;
-            }
-            for (int x = min_x; x <= max_x; ++x) {
-                float value = get_output ? get_output(c, x, y) : 1.0f;
-                if (value > 0.0f) {
-                    int mx = x - min_x + shrink;
-                    int my = y - min_y + shrink;
-                    tmp[my * tmp_width + mx] = value;
-                }
+        if (!is_cancelled(c)) {
+            if (!from_edge) {
+                expand_edges(c->width, c->height, expand_min_x, expand_min_y,
+                             expand_max_x, expand_max_y, shrink, tmp,
+                             tmp_width, tmp_height);
             }
+            erode_mask(c, tmp, tmp_width, tmp_height, mask, img_width,
+                       feather_radius, shrink, kernel_shape);
         }
-
-        if (!from_edge) {
-            expand_edges(c->width, c->height, expand_min_x, expand_min_y,
-                         expand_max_x, expand_max_y, shrink, tmp, tmp_width,
-                         tmp_height);
-        }
-
-        unsigned char *kernel = generate_expansion_kernel(kernel_shape, shrink);
-        erode_mask(c, tmp, tmp_width, tmp_height, mask, img_width,
-                   feather_radius, shrink, kernel);
-        DP_free(kernel);
         DP_free(tmp);
     }
 
@@ -1239,14 +1606,23 @@ static float *make_mask(DP_FillContext *c,
         DP_free(tmp);
     }
 
+    dispose_band_worker(c);
     return mask;
 }
 
-static float get_flood_mask_value(void *user, int x, int y)
+static void read_flood_output(DP_FillContext *c, float *dst, int dst_width,
+                              int offset)
 {
-    DP_FloodFillContext *c = user;
-    unsigned char *output = c->output;
-    return buffer_get(output, c->parent.area, x, y) == 0 ? 0.0f : 1.0f;
+    DP_FloodFillContext *ffc = (DP_FloodFillContext *)c;
+    const unsigned char *output = ffc->output;
+    for (int y = c->min_y; y <= c->max_y && !is_cancelled(c); ++y) {
+        float *dst_row = dst + (y - c->min_y + offset) * dst_width + offset;
+        for (int x = c->min_x; x <= c->max_x; ++x) {
+            if (buffer_get(output, c->area, x, y) != 0) {
+                dst_row[x - c->min_x] = 1.0f;
+            }
+        }
+    }
 }
 
 static void merge_mask_with_selection(float *mask, int img_x, int img_y,
@@ -1254,23 +1630,68 @@ static void merge_mask_with_selection(float *mask, int img_x, int img_y,
                                       DP_Selection *sel)
 {
     DP_LayerContent *lc = DP_selection_content_noinc(sel);
-    int layer_width = DP_layer_content_width(lc);
-    int layer_height = DP_layer_content_height(lc);
-    for (int y = 0; y < img_height; ++y) {
-        for (int x = 0; x < img_width; ++x) {
-            int index = y * img_width + x;
-            float value = mask[index];
-            if (value > 0.0f) {
-                int layer_x = x + img_x;
-                int layer_y = y + img_y;
-                if (layer_x >= 0 && layer_x < layer_width && layer_y >= 0
-                    && layer_y < layer_height) {
-                    DP_Pixel15 pixel =
-                        DP_layer_content_pixel_at(lc, x + img_x, y + img_y);
-                    mask[index] = value * DP_channel15_to_float(pixel.a);
+    DP_TileIterator ti = DP_tile_iterator_make(
+        DP_layer_content_width(lc), DP_layer_content_height(lc),
+        DP_rect_make(img_x, img_y, img_width, img_height));
+
+    // Everything outside of the selection's bounds is unselected.
+    if (DP_rect_valid(ti.area)) {
+        int left = DP_rect_left(ti.area) - img_x;
+        int top = DP_rect_top(ti.area) - img_y;
+        int right = DP_rect_right(ti.area) - img_x;
+        int bottom = DP_rect_bottom(ti.area) - img_y;
+        for (int y = 0; y < img_height; ++y) {
+            float *row = mask + y * img_width;
+            if (y < top || y > bottom) {
+                for (int x = 0; x < img_width; ++x) {
+                    row[x] = 0.0f;
+                }
+            }
+            else {
+                for (int x = 0; x < left; ++x) {
+                    row[x] = 0.0f;
+                }
+                for (int x = right + 1; x < img_width; ++x) {
+                    row[x] = 0.0f;
+                }
+            }
+        }
+    }
+    else {
+        memset(mask, 0, DP_int_to_size(img_width) * DP_int_to_size(img_height)
+                            * sizeof(*mask));
+    }
+
+    // Selection contents are masks, which store blank tiles as null and fully
+    // selected tiles as the opaque tile, so those don't need to look at their
+    // pixels. Everything else gets multiplied by the selection's alpha.
+    while (DP_tile_iterator_next(&ti)) {
+        DP_Tile *t = DP_layer_content_tile_at_noinc(lc, ti.col, ti.row);
+        if (!t || !DP_tile_opaque_ident(t)) {
+            const DP_Pixel15 *pixels = t ? DP_tile_pixels(t) : NULL;
+            DP_TileIntoDstIterator tidi = DP_tile_into_dst_iterator_make(&ti);
+            int tile_x = DP_rect_left(tidi.tile_bounds);
+            int dst_x = DP_rect_left(tidi.dst_bounds);
+            int width = DP_rect_width(tidi.dst_bounds);
+            int tile_y = DP_rect_top(tidi.tile_bounds);
+            int height = DP_rect_height(tidi.dst_bounds);
+            for (int i = 0; i < height; ++i) {
+                float *row =
+                    mask + (DP_rect_top(tidi.dst_bounds) + i) * img_width
+                    + dst_x;
+                if (pixels) {
+                    const DP_Pixel15 *src =
+                        pixels + (tile_y + i) * DP_TILE_SIZE + tile_x;
+                    for (int x = 0; x < width; ++x) {
+                        if (row[x] > 0.0f) {
+                            row[x] *= DP_channel15_to_float(src[x].a);
+                        }
+                    }
                 }
                 else {
-                    mask[index] = 0.0f;
+                    for (int x = 0; x < width; ++x) {
+                        row[x] = 0.0f;
+                    }
                 }
             }
         }
@@ -1369,6 +1790,7 @@ DP_flood_fill(DP_CanvasState *cs, unsigned int context_id, int selection_id,
             false,
             should_cancel,
             user,
+            {NULL, NULL, false},
         },
         (DP_FloodFillContextType)0,
         0,
@@ -1436,17 +1858,17 @@ DP_flood_fill(DP_CanvasState *cs, unsigned int context_id, int selection_id,
         return DP_FLOOD_FILL_CANCELLED;
     }
 
-    float (*get_output)(void *, int, int);
+    DP_FillReadSourceFn read_source;
     if (c.type == DP_FLOOD_FILL_SOURCE_BLANK) {
         source_dispose(&c);
-        get_output = NULL;
+        read_source = read_everything;
         c.parent.min_x = c.parent.area.x1;
         c.parent.max_x = c.parent.area.x2;
         c.parent.min_y = c.parent.area.y1;
         c.parent.max_y = c.parent.area.y2;
     }
     else {
-        get_output = get_flood_mask_value;
+        read_source = read_flood_output;
         if (continuous) {
             c.output = DP_malloc_zeroed(source_map_size(&c));
             DP_queue_init(&c.queue, 1024, sizeof(DP_FillSeed));
@@ -1474,7 +1896,7 @@ DP_flood_fill(DP_CanvasState *cs, unsigned int context_id, int selection_id,
     }
 
     int img_x, img_y, img_width, img_height;
-    float *mask = make_mask(&c.parent, get_output, expand, kernel_shape,
+    float *mask = make_mask(&c.parent, read_source, expand, kernel_shape,
                             DP_max_int(feather_radius, 0), from_edge, &img_x,
                             &img_y, &img_width, &img_height);
     DP_free(c.output);
@@ -1551,12 +1973,45 @@ static bool selection_fill_get_bounds(DP_FillContext *c, DP_CanvasState *cs,
     return true;
 }
 
-static float get_selection_mask_value(void *user, int x, int y)
+static void read_selection_content(DP_FillContext *c, float *dst,
+                                   int dst_width, int offset)
 {
-    DP_FillContext *c = user;
+    // Blank selection tiles are null, so they're skipped entirely, and fully
+    // selected ones are the opaque tile, which doesn't need its pixels read.
     DP_LayerContent *lc = DP_selection_content_noinc(c->sel);
-    DP_Pixel15 pixel = DP_layer_content_pixel_at(lc, x, y);
-    return DP_channel15_to_float(pixel.a);
+    DP_TileIterator ti = DP_tile_iterator_make(
+        DP_layer_content_width(lc), DP_layer_content_height(lc),
+        DP_rect_make(c->min_x, c->min_y, c->max_x - c->min_x + 1,
+                     c->max_y - c->min_y + 1));
+    while (DP_tile_iterator_next(&ti) && !is_cancelled(c)) {
+        DP_Tile *t = DP_layer_content_tile_at_noinc(lc, ti.col, ti.row);
+        if (t) {
+            bool opaque = DP_tile_opaque_ident(t);
+            const DP_Pixel15 *pixels = DP_tile_pixels(t);
+            DP_TileIntoDstIterator tidi = DP_tile_into_dst_iterator_make(&ti);
+            int tile_x = DP_rect_left(tidi.tile_bounds);
+            int tile_y = DP_rect_top(tidi.tile_bounds);
+            int dst_x = DP_rect_left(tidi.dst_bounds) + offset;
+            int dst_y = DP_rect_top(tidi.dst_bounds) + offset;
+            int width = DP_rect_width(tidi.dst_bounds);
+            int height = DP_rect_height(tidi.dst_bounds);
+            for (int i = 0; i < height; ++i) {
+                float *row = dst + (dst_y + i) * dst_width + dst_x;
+                if (opaque) {
+                    for (int x = 0; x < width; ++x) {
+                        row[x] = 1.0f;
+                    }
+                }
+                else {
+                    const DP_Pixel15 *src =
+                        pixels + (tile_y + i) * DP_TILE_SIZE + tile_x;
+                    for (int x = 0; x < width; ++x) {
+                        row[x] = DP_channel15_to_float(src[x].a);
+                    }
+                }
+            }
+        }
+    }
 }
 
 DP_FloodFillResult
@@ -1571,6 +2026,7 @@ DP_selection_fill(DP_CanvasState *cs, unsigned int context_id, int selection_id,
     DP_FillContext c = {
         0,       0,    {0, 0, 0, 0}, INT_MAX,       INT_MAX, INT_MIN,
         INT_MIN, NULL, false,        should_cancel, user,
+        {NULL, NULL, false},
     };
     if (is_cancelled(&c)) {
         return DP_FLOOD_FILL_CANCELLED;
@@ -1581,7 +2037,7 @@ DP_selection_fill(DP_CanvasState *cs, unsigned int context_id, int selection_id,
     }
 
     int img_x, img_y, img_width, img_height;
-    float *mask = make_mask(&c, get_selection_mask_value, expand, kernel_shape,
+    float *mask = make_mask(&c, read_selection_content, expand, kernel_shape,
                             DP_max_int(feather_radius, 0), from_edge, &img_x,
                             &img_y, &img_width, &img_height);
     if (is_cancelled(&c)) {
@@ -41,6 +41,8 @@ typedef enum DP_FloodFillResult {
     DP_FLOOD_FILL_CANCELLED,
 } DP_FloodFillResult;
 
+// Expanding, shrinking and feathering large areas is split across multiple
+// threads, so this may be called from several of them at the same time.
 typedef bool (*DP_FloodFillShouldCancelFn)(void *user);
 
 DP_FloodFillResult
@@ -0,0 +1,224 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include "gradient.h"
+#include "pixels.h"
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <math.h>
+
+// A fused multiply-add rounds differently than a separate multiply and add,
+// so letting the compiler contract the radial gradient math would make the
+// floored color index differ between platforms. GCC ignores this pragma, so
+// the build additionally passes -ffp-contract=off for this file.
+#if defined(__clang__)
+#    pragma STDC FP_CONTRACT OFF
+#elif defined(_MSC_VER)
+#    pragma fp_contract(off)
+#endif
+
+// Keep the focal point just inside of the circle, otherwise the gradient
+// degenerates into a cone with an infinitely sharp edge.
+#define FOCUS_MAX 0.998
+
+
+static uint16_t interpolate_channel(uint16_t a, uint16_t b, int i)
+{
+    int steps = DP_GRADIENT_STEPS;
+    return DP_int_to_uint16(
+        (DP_uint16_to_int(a) * (steps - i) + DP_uint16_to_int(b) * i
+         + steps / 2)
+        / steps);
+}
+
+static void init_colors(DP_Gradient *g, uint32_t color1, uint32_t color2)
+{
+    DP_UPixel15 c1 = DP_upixel15_from_color(color1);
+    DP_UPixel15 c2 = DP_upixel15_from_color(color2);
+    for (int i = 0; i <= DP_GRADIENT_STEPS; ++i) {
+        DP_UPixel15 c = {
+            .b = interpolate_channel(c1.b, c2.b, i),
+            .g = interpolate_channel(c1.g, c2.g, i),
+            .r = interpolate_channel(c1.r, c2.r, i),
+            .a = interpolate_channel(c1.a, c2.a, i),
+        };
+        g->colors[i] = DP_pixel15_to_8(DP_pixel15_premultiply(c));
+    }
+}
+
+static bool init_linear(DP_Gradient *g, int x1, int y1, int x2, int y2)
+{
+    long long dx = (long long)x2 - (long long)x1;
+    long long dy = (long long)y2 - (long long)y1;
+    g->linear.x1 = x1;
+    g->linear.y1 = y1;
+    g->linear.dx = dx;
+    g->linear.dy = dy;
+    g->linear.length_squared = dx * dx + dy * dy;
+    return g->linear.length_squared != 0;
+}
+
+static bool init_radial(DP_Gradient *g, int x1, int y1, int x2, int y2,
+                        uint16_t focus)
+{
+    double dx = (double)x2 - (double)x1;
+    double dy = (double)y2 - (double)y1;
+    double r2 = dx * dx + dy * dy;
+    if (r2 == 0.0) {
+        return false;
+    }
+    else {
+        double f = (double)focus / (double)UINT16_MAX * FOCUS_MAX;
+        double fx = (double)x1 + dx * f;
+        double fy = (double)y1 + dy * f;
+        double cfx = (double)x1 - fx;
+        double cfy = (double)y1 - fy;
+        g->radial.fx = fx;
+        g->radial.fy = fy;
+        g->radial.cfx = cfx;
+        g->radial.cfy = cfy;
+        g->radial.a = r2 - (cfx * cfx + cfy * cfy);
+        return true;
+    }
+}
+
+void DP_gradient_init(DP_Gradient *g, DP_GradientShape shape,
+                      DP_GradientSpread spread, int x1, int y1, int x2, int y2,
+                      uint16_t focus, uint32_t color1, uint32_t color2)
+{
+    DP_ASSERT(g);
+    DP_ASSERT(x1 >= -DP_GRADIENT_COORDINATE_MAX);
+    DP_ASSERT(x1 <= DP_GRADIENT_COORDINATE_MAX);
+    DP_ASSERT(y1 >= -DP_GRADIENT_COORDINATE_MAX);
+    DP_ASSERT(y1 <= DP_GRADIENT_COORDINATE_MAX);
+    DP_ASSERT(x2 >= -DP_GRADIENT_COORDINATE_MAX);
+    DP_ASSERT(x2 <= DP_GRADIENT_COORDINATE_MAX);
+    DP_ASSERT(y2 >= -DP_GRADIENT_COORDINATE_MAX);
+    DP_ASSERT(y2 <= DP_GRADIENT_COORDINATE_MAX);
+    g->shape = shape;
+    g->spread = spread;
+    init_colors(g, color1, color2);
+
+    bool valid;
+    switch (shape) {
+    case DP_GRADIENT_SHAPE_LINEAR:
+        valid = init_linear(g, x1, y1, x2, y2);
+        break;
+    case DP_GRADIENT_SHAPE_RADIAL:
+        valid = init_radial(g, x1, y1, x2, y2, focus);
+        break;
+    default:
+        DP_UNREACHABLE();
+    }
+
+    // A gradient with no extent is just the end color everywhere.
+    if (!valid) {
+        g->colors[0] = g->colors[DP_GRADIENT_STEPS];
+    }
+    g->solid = !valid || color1 == color2;
+}
+
+
+static int spread_index(DP_GradientSpread spread, long long k)
+{
+    long long steps = DP_GRADIENT_STEPS;
+    switch (spread) {
+    case DP_GRADIENT_SPREAD_REPEAT: {
+        long long m = k % steps;
+        return (int)(m < 0 ? m + steps : m);
+    }
+    case DP_GRADIENT_SPREAD_REFLECT: {
+        long long period = steps * 2;
+        long long m = k % period;
+        if (m < 0) {
+            m += period;
+        }
+        return (int)(m > steps ? period - m : m);
+    }
+    default:
+        return (int)(k < 0 ? 0 : k > steps ? steps : k);
+    }
+}
+
+static long long floor_div(long long n, long long d)
+{
+    DP_ASSERT(d > 0);
+    long long q = n / d;
+    return n < 0 && q * d != n ? q - 1 : q;
+}
+
+// Pixel centers in quarter pixels, where the gradient gets sampled.
+static long long pixel_center(int p)
+{
+    return (long long)p * 4LL + 2LL;
+}
+
+static void render_linear(const DP_Gradient *g, int left, int top, int width,
+                          int height, DP_Pixel8 *out_pixels)
+{
+    // All integer math, so the result is exact on every platform. The
+    // coordinate limits keep the products well within 64 bits.
+    long long dx = g->linear.dx;
+    long long dy = g->linear.dy;
+    long long d = g->linear.length_squared;
+    long long step = 4LL * dx * DP_GRADIENT_STEPS;
+    long long row_x = (pixel_center(left) - g->linear.x1) * dx;
+    for (int y = 0; y < height; ++y) {
+        long long n =
+            (row_x + (pixel_center(top + y) - g->linear.y1) * dy)
+            * DP_GRADIENT_STEPS;
+        DP_Pixel8 *dst = out_pixels + y * width;
+        for (int x = 0; x < width; ++x) {
+            dst[x] = g->colors[spread_index(g->spread, floor_div(n, d))];
+            n += step;
+        }
+    }
+}
+
+static void render_radial(const DP_Gradient *g, int left, int top, int width,
+                          int height, DP_Pixel8 *out_pixels)
+{
+    double cfx = g->radial.cfx;
+    double cfy = g->radial.cfy;
+    double a = g->radial.a;
+    double period = (double)(DP_GRADIENT_STEPS * 2);
+    for (int y = 0; y < height; ++y) {
+        double ey = (double)pixel_center(top + y) - g->radial.fy;
+        DP_Pixel8 *dst = out_pixels + y * width;
+        for (int x = 0; x < width; ++x) {
+            double ex = (double)pixel_center(left + x) - g->radial.fx;
+            // Solve for the circle of the gradient, interpolated between the
+            // focal point and the outer circle, that the pixel lies on.
+            double b = ex * cfx + ey * cfy;
+            double c = ex * ex + ey * ey;
+            double t = (sqrt(b * b + a * c) - b) / a;
+            // With the focus close to the edge, far-out values can get
+            // large. Wrap them around by the period to keep them in range.
+            double k = floor(t * (double)DP_GRADIENT_STEPS);
+            if (k > 1e15) {
+                k = fmod(k, period) + period;
+            }
+            dst[x] = g->colors[spread_index(g->spread, (long long)k)];
+        }
+    }
+}
+
+void DP_gradient_render(const DP_Gradient *g, int left, int top, int width,
+                        int height, DP_Pixel8 *out_pixels)
+{
+    DP_ASSERT(g);
+    DP_ASSERT(width >= 0);
+    DP_ASSERT(height >= 0);
+    DP_ASSERT(out_pixels);
+    if (g->solid) {
+        DP_Pixel8 pixel = g->colors[0];
+        int count = width * height;
+        for (int i = 0; i < count; ++i) {
+            out_pixels[i] = pixel;
+        }
+    }
+    else if (g->shape == DP_GRADIENT_SHAPE_LINEAR) {
+        render_linear(g, left, top, width, height, out_pixels);
+    }
+    else {
+        render_radial(g, left, top, width, height, out_pixels);
+    }
+}
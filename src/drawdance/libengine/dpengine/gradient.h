@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#ifndef DPENGINE_GRADIENT_H
+#define DPENGINE_GRADIENT_H
+#include "pixels.h"
+#include <dpcommon/common.h>
+
+// Number of steps between the two gradient colors. The color table has one
+// more entry than this, since both ends are included.
+#define DP_GRADIENT_STEPS 1024
+
+// Gradient coordinates are in quarter pixels and their magnitude is limited
+// so that the linear gradient math can't overflow.
+#define DP_GRADIENT_COORDINATE_MAX (1 << 24)
+
+typedef enum DP_GradientShape {
+    DP_GRADIENT_SHAPE_LINEAR,
+    DP_GRADIENT_SHAPE_RADIAL,
+} DP_GradientShape;
+
+typedef enum DP_GradientSpread {
+    DP_GRADIENT_SPREAD_PAD,
+    DP_GRADIENT_SPREAD_REPEAT,
+    DP_GRADIENT_SPREAD_REFLECT,
+} DP_GradientSpread;
+
+typedef struct DP_Gradient {
+    DP_GradientShape shape;
+    DP_GradientSpread spread;
+    struct {
+        long long x1, y1, dx, dy, length_squared;
+    } linear;
+    struct {
+        double fx, fy, cfx, cfy, a;
+    } radial;
+    bool solid;
+    DP_Pixel8 colors[DP_GRADIENT_STEPS + 1];
+} DP_Gradient;
+
+// Sets up a gradient from (x1, y1) to (x2, y2), given in quarter pixels. For
+// radial gradients, the first point is the center and the second one lies on
+// the edge. The focus goes from 0 at the center to 65535 at the edge. Colors
+// are non-premultiplied ARGB and get interpolated as such.
+void DP_gradient_init(DP_Gradient *g, DP_GradientShape shape,
+                      DP_GradientSpread spread, int x1, int y1, int x2, int y2,
+                      uint16_t focus, uint32_t color1, uint32_t color2);
+
+// Renders the given area of the gradient into a buffer of width * height
+// premultiplied pixels. The output only depends on the parameters, not on
+// the area it's rendered in, so rendering in pieces gives the same result.
+void DP_gradient_render(const DP_Gradient *g, int left, int top, int width,
+                        int height, DP_Pixel8 *out_pixels);
+
+#endif
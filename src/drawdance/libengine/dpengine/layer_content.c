@@ -22,11 +22,13 @@
 #include "layer_content.h"
 #include "canvas_diff.h"
 #include "draw_context.h"
+#include "gradient.h"
 #include "image.h"
 #include "layer_list.h"
 #include "layer_props.h"
 #include "layer_props_list.h"
 #include "paint.h"
+#include "sample_cache.h"
 #include "tile.h"
 #include "tile_iterator.h"
 #include "view_mode.h"
@@ -36,6 +38,34 @@
 #include <dpcommon/geom.h>
 #include <dpmsg/blend_mode.h>
 
+// Beyond this many changed tiles, looking at all populated ones is cheap
+// enough in comparison, so change records don't get any longer than this.
+#define MAX_CHANGES 512
+
+// Indexes of the tiles that aren't null, in ascending order. Only persistent
+// layer contents have this, it's built when they're persisted. Most layers on
+// large canvases are largely empty, so this lets diffing, saving and such
+// skip over those parts without looking at every tile in them.
+typedef struct DP_LayerContentPopulated {
+    int count;
+    int *indexes;
+} DP_LayerContentPopulated;
+
+// Which tiles have been touched since an earlier version of the same layer
+// content. Each time a transient content is made from a persistent one and
+// then persisted, it continues its lineage and becomes the next generation,
+// recording the tiles that it replaced. Only the first such continuation
+// stays in the lineage, since otherwise they'd branch off and generations
+// wouldn't be ordered anymore. The indexes accumulate across generations
+// until there's too many of them, so that diffing against a content several
+// generations back still only has to look at the few tiles changed since.
+typedef struct DP_LayerContentChanges {
+    int lineage; // 0 if the content hasn't been persisted yet.
+    int generation;
+    int base_generation; // Indexes cover everything since this generation.
+    int count;
+    int *indexes;
+} DP_LayerContentChanges;
 
 #ifdef DP_NO_STRICT_ALIASING
 
@@ -48,6 +78,10 @@ struct DP_LayerContent {
         DP_LayerList *contents;
         DP_LayerPropsList *props;
     } sub;
+    DP_LayerContentPopulated populated;
+    DP_LayerContentChanges changes;
+    DP_Atomic continued;
+    DP_LayerContent *base;
     union {
         DP_Tile *const tile;
     } elements[];
@@ -71,6 +105,10 @@ struct DP_TransientLayerContent {
             DP_TransientLayerPropsList *transient_props;
         };
     } sub;
+    DP_LayerContentPopulated populated;
+    DP_LayerContentChanges changes;
+    DP_Atomic continued;
+    DP_LayerContent *base;
     union {
         DP_Tile *tile;
         DP_TransientTile *transient_tile;
@@ -97,6 +135,10 @@ struct DP_LayerContent {
             DP_TransientLayerPropsList *transient_props;
         };
     } sub;
+    DP_LayerContentPopulated populated;
+    DP_LayerContentChanges changes;
+    DP_Atomic continued;
+    DP_LayerContent *base;
     union {
         DP_Tile *tile;
         DP_TransientTile *transient_tile;
@@ -106,6 +148,30 @@ struct DP_LayerContent {
 #endif
 
 
+static int next_populated_tile(DP_LayerContent *lc, int *in_out_cursor)
+{
+    int cursor = *in_out_cursor;
+    if (lc->transient) {
+        int count = DP_tile_total_round(lc->width, lc->height);
+        for (int i = cursor; i < count; ++i) {
+            if (lc->elements[i].tile) {
+                *in_out_cursor = i + 1;
+                return i;
+            }
+        }
+        *in_out_cursor = count;
+        return -1;
+    }
+    else if (cursor < lc->populated.count) {
+        *in_out_cursor = cursor + 1;
+        return lc->populated.indexes[cursor];
+    }
+    else {
+        return -1;
+    }
+}
+
+
 DP_LayerContent *DP_layer_content_incref(DP_LayerContent *lc)
 {
     DP_ASSERT(lc);
@@ -124,10 +190,14 @@ void DP_layer_content_decref(DP_LayerContent *lc)
     DP_ASSERT(lc);
     DP_ASSERT(DP_atomic_get(&lc->refcount) > 0);
     if (DP_atomic_dec(&lc->refcount)) {
-        int count = DP_tile_total_round(lc->width, lc->height);
-        for (int i = 0; i < count; ++i) {
-            DP_tile_decref_nullable(lc->elements[i].tile);
-        }
+        int cursor = 0;
+        int i;
+        while ((i = next_populated_tile(lc, &cursor)) != -1) {
+            DP_tile_decref(lc->elements[i].tile);
+        }
+        DP_free(lc->populated.indexes);
+        DP_free(lc->changes.indexes);
+        DP_layer_content_decref_nullable(lc->base);
         DP_layer_props_list_decref(lc->sub.props);
         DP_layer_list_decref(lc->sub.contents);
         DP_layer_content_decref_nullable(lc->mask);
@@ -156,6 +226,79 @@ bool DP_layer_content_transient(DP_LayerContent *lc)
     return lc->transient;
 }
 
+int DP_layer_content_next_populated_tile(DP_LayerContent *lc,
+                                         int *in_out_cursor)
+{
+    DP_ASSERT(lc);
+    DP_ASSERT(DP_atomic_get(&lc->refcount) > 0);
+    DP_ASSERT(in_out_cursor);
+    DP_ASSERT(*in_out_cursor >= 0);
+    return next_populated_tile(lc, in_out_cursor);
+}
+
+
+// Tiles that are null in both layer contents can't differ, so only the ones
+// populated in either of them need to be checked.
+static void diff_check_populated(DP_CanvasDiff *diff, DP_CanvasDiffCheckFn fn,
+                                 void *data, DP_LayerContent *a,
+                                 DP_LayerContent *b_or_null)
+{
+    int cursor_a = 0;
+    int cursor_b = 0;
+    int next_a = next_populated_tile(a, &cursor_a);
+    int next_b = b_or_null ? next_populated_tile(b_or_null, &cursor_b) : -1;
+    while (next_a != -1 || next_b != -1) {
+        int tile_index;
+        if (next_b == -1 || (next_a != -1 && next_a < next_b)) {
+            tile_index = next_a;
+            next_a = next_populated_tile(a, &cursor_a);
+        }
+        else if (next_a == -1 || next_b < next_a) {
+            tile_index = next_b;
+            next_b = next_populated_tile(b_or_null, &cursor_b);
+        }
+        else {
+            tile_index = next_a;
+            next_a = next_populated_tile(a, &cursor_a);
+            next_b = next_populated_tile(b_or_null, &cursor_b);
+        }
+        DP_canvas_diff_check_index(diff, fn, data, tile_index);
+    }
+}
+
+// If one of the layer contents descends from the other and recorded its
+// changes far enough back, only those tiles can differ between them.
+static const DP_LayerContentChanges *
+changes_between(DP_LayerContent *a, DP_LayerContent *b)
+{
+    const DP_LayerContentChanges *ca = &a->changes;
+    const DP_LayerContentChanges *cb = &b->changes;
+    if (ca->lineage != 0 && ca->lineage == cb->lineage) {
+        bool a_newer = ca->generation > cb->generation;
+        const DP_LayerContentChanges *newer = a_newer ? ca : cb;
+        const DP_LayerContentChanges *older = a_newer ? cb : ca;
+        if (newer->base_generation <= older->generation) {
+            return newer;
+        }
+    }
+    return NULL;
+}
+
+static void diff_check_changed(DP_CanvasDiff *diff, DP_CanvasDiffCheckFn fn,
+                               void *data, DP_LayerContent *a,
+                               DP_LayerContent *b)
+{
+    const DP_LayerContentChanges *changes = changes_between(a, b);
+    if (changes) {
+        int count = changes->count;
+        for (int i = 0; i < count; ++i) {
+            DP_canvas_diff_check_index(diff, fn, data, changes->indexes[i]);
+        }
+    }
+    else {
+        diff_check_populated(diff, fn, data, a, b);
+    }
+}
 
 static bool mark_both(void *data, int tile_index)
 {
@@ -179,7 +322,8 @@ static void layer_content_diff_mark_both(DP_LayerContent *lc,
     DP_ASSERT(DP_atomic_get(&prev_lc->refcount) > 0);
     DP_ASSERT(lc->width == prev_lc->width);   // Different sizes could be
     DP_ASSERT(lc->height == prev_lc->height); // supported, but aren't yet.
-    DP_canvas_diff_check(diff, mark_both, (DP_LayerContent *[]){lc, prev_lc});
+    diff_check_populated(diff, mark_both, (DP_LayerContent *[]){lc, prev_lc},
+                         lc, prev_lc);
     DP_layer_list_diff_mark(lc->sub.contents, diff);
     DP_layer_list_diff_mark(prev_lc->sub.contents, diff);
 }
@@ -220,14 +364,14 @@ static void layer_content_diff(DP_LayerContent *lc, bool censored,
     DP_ASSERT(lc->width == prev_lc->width);   // Different sizes could be
     DP_ASSERT(lc->height == prev_lc->height); // supported, but aren't yet.
     if (!censored && !prev_censored) {
-        DP_canvas_diff_check(diff, diff_tile,
-                             (DP_LayerContent *[]){lc, prev_lc});
+        diff_check_changed(diff, diff_tile, (DP_LayerContent *[]){lc, prev_lc},
+                           lc, prev_lc);
         DP_layer_list_diff(lc->sub.contents, lc->sub.props,
                            prev_lc->sub.contents, prev_lc->sub.props, diff, 0);
     }
     else if (censored && prev_censored) {
-        DP_canvas_diff_check(diff, diff_tile_both_censored,
-                             (DP_LayerContent *[]){lc, prev_lc});
+        diff_check_changed(diff, diff_tile_both_censored,
+                           (DP_LayerContent *[]){lc, prev_lc}, lc, prev_lc);
         DP_layer_list_diff(lc->sub.contents, lc->sub.props,
                            prev_lc->sub.contents, prev_lc->sub.props, diff, 0);
     }
@@ -299,7 +443,7 @@ static void layer_content_diff_mark(DP_LayerContent *lc, DP_CanvasDiff *diff)
     DP_ASSERT(lc);
     DP_ASSERT(diff);
     DP_ASSERT(DP_atomic_get(&lc->refcount) > 0);
-    DP_canvas_diff_check(diff, mark, lc);
+    diff_check_populated(diff, mark, lc, lc, NULL);
 }
 
 void DP_layer_content_diff_mark(DP_LayerContent *lc, DP_CanvasDiff *diff)
@@ -392,8 +536,10 @@ bool DP_layer_content_pick_at(DP_LayerContent *lc, int x, int y,
     return false;
 }
 
-static DP_UPixelFloat sample_dab_color(DP_LayerContent *lc, DP_BrushStamp stamp,
-                                       bool opaque, bool pigment)
+static DP_UPixelFloat sample_dab_color(DP_LayerContent *lc,
+                                       DP_SampleCache *cache_or_null,
+                                       DP_BrushStamp stamp, bool opaque,
+                                       bool pigment)
 {
     uint16_t *weights = stamp.data;
     int diameter = stamp.diameter;
@@ -405,6 +551,11 @@ static DP_UPixelFloat sample_dab_color(DP_LayerContent *lc, DP_BrushStamp stamp,
     int x0 = DP_max_int(0, stamp.left);
     int xb0 = stamp.left < 0 ? -stamp.left : 0;
     int xtiles = DP_tile_count_round(lc->width);
+    int tile_count = xtiles * DP_tile_count_round(lc->height);
+    DP_SampleCache *cache = cache_or_null
+                             && DP_sample_cache_applies(diameter, pigment)
+                              ? cache_or_null
+                              : NULL;
 
     float weight = 0.0;
     float red = 0.0;
@@ -431,7 +582,13 @@ static DP_UPixelFloat sample_dab_color(DP_LayerContent *lc, DP_BrushStamp stamp,
                              : DP_TILE_SIZE - xt;
             const int i = xtiles * yindex + xindex;
 
-            if (pigment) {
+            if (cache) {
+                DP_sample_cache_sample(
+                    cache, lc->elements[i].tile, i, tile_count,
+                    weights + yb * diameter + xb, diameter, xt, yt, wb, hb,
+                    diameter, opaque, &weight, &red, &green, &blue, &alpha);
+            }
+            else if (pigment) {
                 DP_tile_sample_pigment(
                     lc->elements[i].tile, weights + yb * diameter + xb, xt, yt,
                     wb, hb, diameter - wb, opaque, sample_interval, sample_rate,
@@ -458,6 +615,16 @@ static DP_UPixelFloat sample_dab_color(DP_LayerContent *lc, DP_BrushStamp stamp,
 DP_UPixelFloat DP_layer_content_sample_color_at(
     DP_LayerContent *lc, uint16_t *stamp_buffer, int x, int y, int diameter,
     bool opaque, bool pigment, int *in_out_last_diameter, bool *out_in_bounds)
+{
+    return DP_layer_content_sample_color_at_cached(
+        lc, NULL, stamp_buffer, x, y, diameter, opaque, pigment,
+        in_out_last_diameter, out_in_bounds);
+}
+
+DP_UPixelFloat DP_layer_content_sample_color_at_cached(
+    DP_LayerContent *lc, DP_SampleCache *cache_or_null, uint16_t *stamp_buffer,
+    int x, int y, int diameter, bool opaque, bool pigment,
+    int *in_out_last_diameter, bool *out_in_bounds)
 {
     int radius = diameter < 2 ? 0 : diameter / 2;
     bool in_bounds = x + radius >= 0 && y + radius >= 0
@@ -482,7 +649,8 @@ DP_UPixelFloat DP_layer_content_sample_color_at(
             }
             DP_BrushStamp stamp = DP_paint_color_sampling_stamp_make(
                 stamp_buffer, diameter, x, y, last_diameter);
-            return sample_dab_color(lc, stamp, opaque, pigment);
+            return sample_dab_color(lc, cache_or_null, stamp, opaque,
+                                    pigment);
         }
     }
     else {
@@ -553,17 +721,17 @@ bool DP_layer_content_has_content(DP_LayerContent *lc)
 {
     DP_ASSERT(lc);
     DP_ASSERT(DP_atomic_get(&lc->refcount) > 0);
-    int count = DP_tile_total_round(lc->width, lc->height);
-    for (int i = 0; i < count; ++i) {
-        DP_Tile *tile = lc->elements[i].tile;
-        if (tile && !DP_tile_blank(tile)) {
+    int cursor = 0;
+    int i;
+    while ((i = next_populated_tile(lc, &cursor)) != -1) {
+        if (!DP_tile_blank(lc->elements[i].tile)) {
             return true;
         }
     }
 
     DP_LayerList *sub_ll = lc->sub.contents;
     int sub_count = DP_layer_list_count(lc->sub.contents);
-    for (int i = 0; i < sub_count; ++i) {
+    for (i = 0; i < sub_count; ++i) {
         DP_LayerContent *sub_lc = DP_layer_list_content_at_noinc(sub_ll, i);
         if (DP_layer_content_has_content(sub_lc)) {
             return true;
@@ -583,22 +751,23 @@ static bool layer_content_tile_bounds(DP_LayerContent *lc, int *out_left,
     int right = 0;
     int bottom = 0;
 
-    for (int y = 0; y < tile_counts.y; ++y) {
-        for (int x = 0; x < tile_counts.x; ++x) {
-            DP_Tile *t = DP_layer_content_tile_at_noinc(lc, x, y);
-            if (t && !DP_tile_blank(t)) {
-                if (x < left) {
-                    left = x;
-                }
-                if (x > right) {
-                    right = x;
-                }
-                if (y < top) {
-                    top = y;
-                }
-                if (y > bottom) {
-                    bottom = y;
-                }
+    int cursor = 0;
+    int i;
+    while ((i = next_populated_tile(lc, &cursor)) != -1) {
+        if (!DP_tile_blank(lc->elements[i].tile)) {
+            int x = i % tile_counts.x;
+            int y = i / tile_counts.x;
+            if (x < left) {
+                left = x;
+            }
+            if (x > right) {
+                right = x;
+            }
+            if (y < top) {
+                top = y;
+            }
+            if (y > bottom) {
+                bottom = y;
             }
         }
     }
@@ -902,11 +1071,13 @@ DP_Image *DP_layer_content_to_image(DP_LayerContent *lc)
     DP_Image *img = DP_image_new(width, height);
     DP_TileCounts tile_counts = DP_tile_counts_round(width, height);
     DP_debug("Layer to image %dx%d tiles", tile_counts.x, tile_counts.y);
-    for (int y = 0; y < tile_counts.y; ++y) {
-        for (int x = 0; x < tile_counts.x; ++x) {
-            DP_tile_copy_to_image(lc->elements[y * tile_counts.x + x].tile, img,
-                                  x * DP_TILE_SIZE, y * DP_TILE_SIZE);
-        }
+    // The image starts out blank, so null tiles don't need to be copied.
+    int cursor = 0;
+    int i;
+    while ((i = next_populated_tile(lc, &cursor)) != -1) {
+        DP_tile_copy_to_image(lc->elements[i].tile, img,
+                              (i % tile_counts.x) * DP_TILE_SIZE,
+                              (i / tile_counts.x) * DP_TILE_SIZE);
     }
     return img;
 }
@@ -1375,6 +1546,10 @@ static DP_TransientLayerContent *alloc_layer_content(int width, int height)
     tlc->width = width;
     tlc->height = height;
     tlc->mask = NULL;
+    tlc->populated = (DP_LayerContentPopulated){0, NULL};
+    tlc->changes = (DP_LayerContentChanges){0, 0, 0, 0, NULL};
+    DP_atomic_set(&tlc->continued, 0);
+    tlc->base = NULL;
     return tlc;
 }
 
@@ -1471,17 +1646,17 @@ resize_layer_content_aligned(DP_LayerContent *lc, int top, int left, int width,
     DP_TileCounts new_counts = DP_tile_counts_round(width, height);
     DP_TileCounts old_counts = DP_tile_counts_round(lc->width, lc->height);
     DP_TileCounts offsets = DP_tile_counts_round(-left, -top);
-    for (int y = 0; y < new_counts.y; ++y) {
-        for (int x = 0; x < new_counts.x; ++x) {
-            int old_x = offsets.x + x;
-            int old_y = offsets.y + y;
-            bool out_of_bounds = old_x < 0 || old_x >= old_counts.x || old_y < 0
-                              || old_y >= old_counts.y;
-            DP_Tile *tile = out_of_bounds
-                              ? NULL
-                              : lc->elements[old_y * old_counts.x + old_x].tile;
+    memset(tlc->elements, 0,
+           DP_int_to_size(new_counts.x) * DP_int_to_size(new_counts.y)
+               * sizeof(*tlc->elements));
+    int cursor = 0;
+    int i;
+    while ((i = next_populated_tile(lc, &cursor)) != -1) {
+        int x = i % old_counts.x - offsets.x;
+        int y = i / old_counts.x - offsets.y;
+        if (x >= 0 && x < new_counts.x && y >= 0 && y < new_counts.y) {
             tlc->elements[y * new_counts.x + x].tile =
-                DP_tile_incref_nullable(tile);
+                DP_tile_incref(lc->elements[i].tile);
         }
     }
     tlc->sub.contents = DP_layer_list_new();
@@ -1489,51 +1664,73 @@ resize_layer_content_aligned(DP_LayerContent *lc, int top, int left, int width,
     return tlc;
 }
 
-static void calculate_resize_offsets(int offset, int *out_pos, int *out_crop)
-{
-    if (offset < 0) {
-        *out_pos = 0;
-        *out_crop = -offset;
-    }
-    else {
-        *out_pos = offset;
-        *out_crop = 0;
+static void copy_shifted_rect(DP_TransientLayerContent *tlc,
+                              unsigned int context_id, int columns,
+                              const DP_Pixel15 *src, int src_left,
+                              int src_top, int left, int top, int right,
+                              int bottom)
+{
+    for (int ty = top / DP_TILE_SIZE; ty <= (bottom - 1) / DP_TILE_SIZE;
+         ++ty) {
+        int y0 = DP_max_int(top, ty * DP_TILE_SIZE);
+        int y1 = DP_min_int(bottom, (ty + 1) * DP_TILE_SIZE);
+        for (int tx = left / DP_TILE_SIZE; tx <= (right - 1) / DP_TILE_SIZE;
+             ++tx) {
+            int x0 = DP_max_int(left, tx * DP_TILE_SIZE);
+            int x1 = DP_min_int(right, (tx + 1) * DP_TILE_SIZE);
+            DP_Pixel15 *dst = DP_transient_tile_pixels(
+                get_or_create_transient_tile(tlc, context_id,
+                                             ty * columns + tx));
+            size_t row_size = DP_int_to_size(x1 - x0) * sizeof(*dst);
+            for (int y = y0; y < y1; ++y) {
+                memcpy(dst + (y - ty * DP_TILE_SIZE) * DP_TILE_SIZE
+                           + (x0 - tx * DP_TILE_SIZE),
+                       src + (y - src_top) * DP_TILE_SIZE + (x0 - src_left),
+                       row_size);
+            }
+        }
     }
 }
 
+// Moves pixels by an offset that isn't a multiple of the tile size. Every
+// populated tile gets split across the up to four tiles it ends up
+// overlapping, copying rows directly between tiles. Blank areas are never
+// touched, so this costs about as much as the layer has content.
 static DP_TransientLayerContent *
-resize_layer_content_copy(DP_LayerContent *lc, unsigned int context_id, int top,
-                          int left, int width, int height)
+resize_layer_content_shifted(DP_LayerContent *lc, unsigned int context_id,
+                             int top, int left, int width, int height)
 {
-    // TODO: This operation is super expensive and obliterates change
-    // information. It could be solved by storing an x and y pixel offset in the
-    // layer instead. Need more functionality to test that out though.
-    DP_Image *img = DP_layer_content_to_image(lc);
-
-    int x, y, crop_x, crop_y;
-    calculate_resize_offsets(left, &x, &crop_x);
-    calculate_resize_offsets(top, &y, &crop_y);
-    if (crop_x != 0 || crop_y != 0) {
-        int img_width = DP_image_width(img);
-        int img_height = DP_image_height(img);
-        if (crop_x < img_width && crop_y < img_height) {
-            DP_Image *tmp = DP_image_new_subimage(
-                img, crop_x, crop_y, img_width - crop_x, img_height - crop_y);
-            DP_image_free(img);
-            img = tmp;
-        }
-        else { // Nothing to do, resulting image is out of bounds.
-            DP_image_free(img);
-            return DP_transient_layer_content_new_init(width, height, NULL);
+    DP_TransientLayerContent *tlc = alloc_layer_content(width, height);
+    DP_TileCounts new_counts = DP_tile_counts_round(width, height);
+    DP_TileCounts old_counts = DP_tile_counts_round(lc->width, lc->height);
+    memset(tlc->elements, 0,
+           DP_int_to_size(new_counts.x) * DP_int_to_size(new_counts.y)
+               * sizeof(*tlc->elements));
+    int cursor = 0;
+    int i;
+    while ((i = next_populated_tile(lc, &cursor)) != -1) {
+        int old_x = (i % old_counts.x) * DP_TILE_SIZE;
+        int old_y = (i / old_counts.x) * DP_TILE_SIZE;
+        // Tiles along the right and bottom edge may hang over the canvas,
+        // those pixels aren't part of the image and don't get moved.
+        int src_left = old_x + left;
+        int src_top = old_y + top;
+        int src_right = src_left + DP_min_int(DP_TILE_SIZE, lc->width - old_x);
+        int src_bottom =
+            src_top + DP_min_int(DP_TILE_SIZE, lc->height - old_y);
+        int dst_left = DP_max_int(src_left, 0);
+        int dst_top = DP_max_int(src_top, 0);
+        int dst_right = DP_min_int(src_right, width);
+        int dst_bottom = DP_min_int(src_bottom, height);
+        if (dst_left < dst_right && dst_top < dst_bottom) {
+            copy_shifted_rect(tlc, context_id, new_counts.x,
+                              DP_tile_pixels(lc->elements[i].tile), src_left,
+                              src_top, dst_left, dst_top, dst_right,
+                              dst_bottom);
         }
     }
-
-    DP_TransientLayerContent *tlc =
-        DP_transient_layer_content_new_init(width, height, NULL);
-    DP_transient_layer_content_put_image(tlc, context_id, DP_BLEND_MODE_REPLACE,
-                                         x, y, img);
-    DP_image_free(img);
-
+    tlc->sub.contents = DP_layer_list_new();
+    tlc->sub.props = DP_layer_props_list_new();
     return tlc;
 }
 
@@ -1547,9 +1744,9 @@ static DP_TransientLayerContent *resize_layer_content(DP_LayerContent *lc,
         return resize_layer_content_aligned(lc, top, left, width, height);
     }
     else {
-        DP_debug("Resize: layer must be copied");
-        return resize_layer_content_copy(lc, context_id, top, left, width,
-                                         height);
+        DP_debug("Resize: layer must be shifted");
+        return resize_layer_content_shifted(lc, context_id, top, left, width,
+                                            height);
     }
 }
 
@@ -1632,12 +1829,19 @@ DP_TransientLayerContent *DP_transient_layer_content_new(DP_LayerContent *lc)
     int height = lc->height;
     DP_TransientLayerContent *tlc = alloc_layer_content(width, height);
     int count = DP_tile_total_round(width, height);
-    for (int i = 0; i < count; ++i) {
-        tlc->elements[i].tile = DP_tile_incref_nullable(lc->elements[i].tile);
+    memset(tlc->elements, 0, DP_int_to_size(count) * sizeof(*tlc->elements));
+    int cursor = 0;
+    int i;
+    while ((i = next_populated_tile(lc, &cursor)) != -1) {
+        tlc->elements[i].tile = DP_tile_incref(lc->elements[i].tile);
     }
     tlc->mask = DP_layer_content_incref_nullable(lc->mask);
     tlc->sub.contents = DP_layer_list_incref(lc->sub.contents);
     tlc->sub.props = DP_layer_props_list_incref(lc->sub.props);
+    // Hang onto the original to figure out which tiles changed on persist.
+    if (DP_atomic_xch(&lc->continued, 1) == 0) {
+        tlc->base = DP_layer_content_incref(lc);
+    }
     return tlc;
 }
 
@@ -1725,10 +1929,106 @@ int DP_transient_layer_content_refcount(DP_TransientLayerContent *tlc)
     return DP_layer_content_refcount((DP_LayerContent *)tlc);
 }
 
+static void index_populated_tiles(DP_TransientLayerContent *tlc, int count,
+                                  int populated_count)
+{
+    int *indexes =
+        populated_count == 0
+            ? NULL
+            : DP_malloc(DP_int_to_size(populated_count) * sizeof(*indexes));
+    int j = 0;
+    for (int i = 0; i < count && j < populated_count; ++i) {
+        if (tlc->elements[i].tile) {
+            indexes[j++] = i;
+        }
+    }
+    DP_ASSERT(j == populated_count);
+    tlc->populated = (DP_LayerContentPopulated){populated_count, indexes};
+}
+
+static int next_lineage(void)
+{
+    static DP_Atomic lineage_counter;
+    int prev, next;
+    do {
+        prev = DP_atomic_get(&lineage_counter);
+        next = prev == INT_MAX ? 1 : prev + 1;
+    } while (!DP_atomic_compare_exchange(&lineage_counter, prev, next));
+    return next;
+}
+
+static int *merge_changes(const DP_LayerContentChanges *prev,
+                          const int *indexes, int count, int *out_count)
+{
+    int max = prev->count + count;
+    if (max > MAX_CHANGES) {
+        // Could be less than that if indexes overlap, but the lists are
+        // probably not worth keeping around if they get to be this long.
+        return NULL;
+    }
+
+    int *merged = DP_malloc(DP_int_to_size(max) * sizeof(*merged));
+    int i = 0, j = 0, k = 0;
+    while (i < prev->count || j < count) {
+        if (j == count || (i < prev->count && prev->indexes[i] < indexes[j])) {
+            merged[k++] = prev->indexes[i++];
+        }
+        else if (i == prev->count || indexes[j] < prev->indexes[i]) {
+            merged[k++] = indexes[j++];
+        }
+        else {
+            merged[k++] = indexes[j++];
+            ++i;
+        }
+    }
+    *out_count = k;
+    return merged;
+}
+
+static void record_changes(DP_TransientLayerContent *tlc, int *indexes,
+                           int count)
+{
+    DP_LayerContent *base = tlc->base;
+    if (!base) {
+        tlc->changes = (DP_LayerContentChanges){next_lineage(), 0, 0, 0, NULL};
+        DP_free(indexes);
+        return;
+    }
+
+    const DP_LayerContentChanges *prev = &base->changes;
+    int generation = prev->generation + 1;
+    if (count < 0) {
+        tlc->changes = (DP_LayerContentChanges){prev->lineage, generation,
+                                                generation, 0, NULL};
+        DP_free(indexes);
+    }
+    else {
+        int merged_count;
+        int *merged = merge_changes(prev, indexes, count, &merged_count);
+        if (merged) {
+            tlc->changes = (DP_LayerContentChanges){
+                prev->lineage, generation, prev->base_generation,
+                merged_count, merged};
+            DP_free(indexes);
+        }
+        else {
+            tlc->changes = (DP_LayerContentChanges){
+                prev->lineage, generation, prev->generation, count, indexes};
+        }
+    }
+
+    tlc->base = NULL;
+    DP_layer_content_decref(base);
+}
+
 static DP_LayerContent *persist_with(DP_TransientLayerContent *tlc, bool mask)
 {
     tlc->transient = false;
     int count = DP_tile_total_round(tlc->width, tlc->height);
+    int populated_count = 0;
+    DP_LayerContent *base = tlc->base;
+    int *changed = NULL;
+    int changed_count = base ? 0 : -1;
     for (int i = 0; i < count; ++i) {
         DP_Tile *tile = tlc->elements[i].tile;
         if (tile && DP_tile_transient(tile)) {
@@ -1736,16 +2036,38 @@ static DP_LayerContent *persist_with(DP_TransientLayerContent *tlc, bool mask)
             if (DP_transient_tile_blank(tt)) {
                 DP_transient_tile_decref(tt);
                 tlc->elements[i].transient_tile = NULL;
+                tile = NULL;
             }
             else if (mask && DP_transient_tile_opaque(tt)) {
                 DP_transient_tile_decref(tt);
-                tlc->elements[i].tile = DP_tile_opaque_inc();
+                tile = tlc->elements[i].tile = DP_tile_opaque_inc();
             }
             else {
                 DP_transient_tile_persist(tt);
             }
         }
+
+        if (tile) {
+            ++populated_count;
+        }
+
+        if (changed_count >= 0 && tile != base->elements[i].tile) {
+            if (changed_count == MAX_CHANGES) {
+                DP_free(changed);
+                changed = NULL;
+                changed_count = -1;
+            }
+            else {
+                if (changed_count % 64 == 0) {
+                    size_t capacity = DP_int_to_size(changed_count + 64);
+                    changed = DP_realloc(changed, capacity * sizeof(*changed));
+                }
+                changed[changed_count++] = i;
+            }
+        }
     }
+    record_changes(tlc, changed, changed_count);
+    index_populated_tiles(tlc, count, populated_count);
     if (tlc->mask && DP_layer_content_transient(tlc->mask)) {
         persist_with(tlc->transient_mask, true);
     }
@@ -1965,15 +2287,16 @@ void DP_transient_layer_content_merge(DP_TransientLayerContent *tlc,
     DP_ASSERT(DP_atomic_get(&lc->refcount) > 0);
     DP_ASSERT(tlc->width == lc->width);
     DP_ASSERT(tlc->height == lc->height);
-    int count = DP_tile_total_round(lc->width, lc->height);
     bool blend_blank = can_blend_blank(blend_mode, opacity);
     DP_Tile *censor_tile = censored ? DP_tile_censored_noinc() : NULL;
     DP_LayerContent *mask = lc->mask;
     DP_TransientTile *tmp_tt = NULL;
-    for (int i = 0; i < count; ++i) {
+    int cursor = 0;
+    int i;
+    while ((i = next_populated_tile(lc, &cursor)) != -1) {
         DP_Tile *t = lc->elements[i].tile;
         DP_Tile *mt;
-        if (t && get_mask_tile(mask, i, &mt)) {
+        if (get_mask_tile(mask, i, &mt)) {
             if (tlc->elements[i].tile) {
                 DP_TransientTile *tt = get_transient_tile(tlc, context_id, i);
                 DP_ASSERT((void *)tt != (void *)t);
@@ -2273,6 +2596,107 @@ void DP_transient_layer_content_fill_rect(DP_TransientLayerContent *tlc,
     }
 }
 
+// Multiplies the mask into the pixels, returns if they all got masked out.
+static bool fill_gradient_mask_tile(DP_Pixel8 *pixels, DP_Tile *mask_tile,
+                                    DP_Rect tile_bounds)
+{
+    if (DP_tile_opaque_ident(mask_tile)) {
+        return false;
+    }
+
+    const DP_Pixel15 *mask_pixels = DP_tile_pixels(mask_tile);
+    DP_Pixel8 *pixel = pixels;
+    bool blank = true;
+    for (int y = DP_rect_top(tile_bounds); y <= DP_rect_bottom(tile_bounds);
+         ++y) {
+        for (int x = DP_rect_left(tile_bounds);
+             x <= DP_rect_right(tile_bounds); ++x, ++pixel) {
+            uint8_t a = DP_channel15_to_8(mask_pixels[y * DP_TILE_SIZE + x].a);
+            if (a == 0) {
+                *pixel = (DP_Pixel8){0};
+            }
+            else {
+                blank = false;
+                if (a != 255) {
+                    pixel->b = DP_pixel8_mul(pixel->b, a);
+                    pixel->g = DP_pixel8_mul(pixel->g, a);
+                    pixel->r = DP_pixel8_mul(pixel->r, a);
+                    pixel->a = DP_pixel8_mul(pixel->a, a);
+                }
+            }
+        }
+    }
+    return blank;
+}
+
+void DP_transient_layer_content_fill_gradient(DP_TransientLayerContent *tlc,
+                                              unsigned int context_id,
+                                              int blend_mode, int left, int top,
+                                              int right, int bottom,
+                                              const DP_Gradient *g,
+                                              DP_LayerContent *mask_or_null)
+{
+    DP_ASSERT(tlc);
+    DP_ASSERT(DP_atomic_get(&tlc->refcount) > 0);
+    DP_ASSERT(tlc->transient);
+    DP_ASSERT(g);
+    // Masked-out pixels are transparent, which only makes a difference when
+    // they replace what's there. Otherwise they can be skipped entirely.
+    bool put_blank = blend_mode == DP_BLEND_MODE_REPLACE
+                  || blend_mode == DP_BLEND_MODE_NORMAL_AND_ERASER;
+    bool blend_blank = DP_blend_mode_blend_blank(blend_mode);
+    int wt = DP_tile_count_round(tlc->width);
+    DP_TileIterator ti = DP_tile_iterator_make(
+        tlc->width, tlc->height,
+        DP_rect_make(left, top, right - left, bottom - top));
+
+    // Rendered one tile at a time, which keeps the buffer small and lets
+    // us skip tiles that the mask or the blend mode leave untouched.
+    DP_Pixel8 pixels[DP_TILE_LENGTH];
+    while (DP_tile_iterator_next(&ti)) {
+        if (!tlc->elements[ti.row * wt + ti.col].tile && !blend_blank) {
+            continue;
+        }
+
+        DP_Rect tile_rect = DP_rect_make(ti.col * DP_TILE_SIZE,
+                                         ti.row * DP_TILE_SIZE, DP_TILE_SIZE,
+                                         DP_TILE_SIZE);
+        DP_Rect bounds = DP_rect_intersection(ti.area, tile_rect);
+        int x = DP_rect_x(bounds);
+        int y = DP_rect_y(bounds);
+        int width = DP_rect_width(bounds);
+        int height = DP_rect_height(bounds);
+
+        DP_Tile *mask_tile =
+            mask_or_null
+                ? DP_layer_content_tile_at_noinc(mask_or_null, ti.col, ti.row)
+                : NULL;
+        if (mask_or_null && !mask_tile) {
+            if (put_blank) {
+                memset(pixels, 0, sizeof(*pixels) * DP_int_to_size(width)
+                                      * DP_int_to_size(height));
+            }
+            else {
+                continue;
+            }
+        }
+        else {
+            DP_gradient_render(g, x, y, width, height, pixels);
+            if (mask_tile
+                && fill_gradient_mask_tile(
+                    pixels, mask_tile,
+                    DP_rect_translate(bounds, -DP_rect_x(tile_rect),
+                                      -DP_rect_y(tile_rect)))
+                && !put_blank) {
+                continue;
+            }
+        }
+
+        DP_transient_layer_content_put_pixels(tlc, context_id, blend_mode, x, y,
+                                              width, height, pixels);
+    }
+}
+
 void DP_transient_layer_content_tile_set_noinc(DP_TransientLayerContent *tlc,
                                                DP_Tile *t, int i)
 {
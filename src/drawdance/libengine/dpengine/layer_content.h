@@ -27,8 +27,10 @@
 typedef struct DP_BrushStamp DP_BrushStamp;
 typedef struct DP_CanvasDiff DP_CanvasDiff;
 typedef struct DP_CanvasState DP_CanvasState;
+typedef struct DP_Gradient DP_Gradient;
 typedef struct DP_Image DP_Image;
 typedef struct DP_Rect DP_Rect;
+typedef struct DP_SampleCache DP_SampleCache;
 typedef struct DP_Tile DP_Tile;
 typedef struct DP_ViewModeFilter DP_ViewModeFilter;
 
@@ -67,6 +69,13 @@ int DP_layer_content_refcount(DP_LayerContent *lc);
 
 bool DP_layer_content_transient(DP_LayerContent *lc);
 
+// Returns the index of the next tile that isn't null, or -1 if there's none
+// left. The cursor must start out as 0. Persistent layer contents keep track
+// of their populated tiles, so empty parts of the layer cost nothing to skip.
+// Transient ones don't, so they get scanned.
+int DP_layer_content_next_populated_tile(DP_LayerContent *lc,
+                                         int *in_out_cursor);
+
 void DP_layer_content_diff(DP_LayerContent *lc, DP_LayerProps *lp,
                            DP_LayerContent *prev_lc, DP_LayerProps *prev_lp,
                            DP_CanvasDiff *diff, int only_layer_id);
@@ -94,6 +103,14 @@ DP_UPixelFloat DP_layer_content_sample_color_at(
     DP_LayerContent *lc, uint16_t *stamp_buffer, int x, int y, int diameter,
     bool opaque, bool pigment, int *in_out_last_diameter, bool *out_in_bounds);
 
+// Same as above, but large non-pigment samples are approximated from tile
+// summaries held in the given cache, see sample_cache.h. Passing a NULL cache
+// gives the exact result.
+DP_UPixelFloat DP_layer_content_sample_color_at_cached(
+    DP_LayerContent *lc, DP_SampleCache *cache_or_null, uint16_t *stamp_buffer,
+    int x, int y, int diameter, bool opaque, bool pigment,
+    int *in_out_last_diameter, bool *out_in_bounds);
+
 DP_LayerList *DP_layer_content_sub_contents_noinc(DP_LayerContent *lc);
 
 DP_LayerPropsList *DP_layer_content_sub_props_noinc(DP_LayerContent *lc);
@@ -264,6 +281,15 @@ void DP_transient_layer_content_fill_rect(DP_TransientLayerContent *tlc,
                                           int right, int bottom,
                                           DP_UPixel15 pixel);
 
+// Fills the area with the gradient. If a mask is given, its alpha is
+// multiplied into the gradient, parts outside of it are transparent.
+void DP_transient_layer_content_fill_gradient(DP_TransientLayerContent *tlc,
+                                              unsigned int context_id,
+                                              int blend_mode, int left, int top,
+                                              int right, int bottom,
+                                              const DP_Gradient *g,
+                                              DP_LayerContent *mask_or_null);
+
 void DP_transient_layer_content_tile_set_noinc(DP_TransientLayerContent *tlc,
                                                DP_Tile *t, int i);
 
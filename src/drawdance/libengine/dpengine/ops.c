@@ -939,6 +939,40 @@ DP_CanvasState *DP_ops_fill_rect(DP_CanvasState *cs,
     return DP_transient_canvas_state_persist(tcs);
 }
 
+DP_CanvasState *DP_ops_fill_gradient(DP_CanvasState *cs,
+                                     DP_UserCursors *ucs_or_null,
+                                     unsigned int context_id, int layer_id,
+                                     int blend_mode, int left, int top,
+                                     int right, int bottom,
+                                     const DP_Gradient *g,
+                                     DP_LayerContent *mask_or_null)
+{
+    DP_LayerRoutes *lr = DP_canvas_state_layer_routes_noinc(cs);
+    DP_LayerRoutesEntry *lre = DP_layer_routes_search(lr, layer_id);
+    if (!lre) {
+        DP_error_set("Fill gradient: id %d not found", layer_id);
+        return NULL;
+    }
+    else if (DP_layer_routes_entry_is_group(lre)) {
+        DP_error_set("Fill gradient: id %d is a group", layer_id);
+        return NULL;
+    }
+
+    if (ucs_or_null) {
+        DP_user_cursors_activate(ucs_or_null, context_id);
+        DP_user_cursors_move(ucs_or_null, context_id, layer_id,
+                             (left + right) / 2, (top + bottom) / 2);
+    }
+
+    DP_TransientCanvasState *tcs = DP_transient_canvas_state_new(cs);
+    DP_TransientLayerContent *tlc =
+        DP_layer_routes_entry_transient_content(lre, tcs);
+    DP_transient_layer_content_fill_gradient(tlc, context_id, blend_mode, left,
+                                             top, right, bottom, g,
+                                             mask_or_null);
+    return DP_transient_canvas_state_persist(tcs);
+}
+
 
 DP_CanvasState *DP_ops_put_tile(DP_CanvasState *cs, DP_Tile *tile, int layer_id,
                                 int sublayer_id, int x, int y, int repeat)
@@ -26,8 +26,10 @@
 
 typedef struct DP_CanvasState DP_CanvasState;
 typedef struct DP_DrawContext DP_DrawContext;
+typedef struct DP_Gradient DP_Gradient;
 typedef struct DP_Image DP_Image;
 typedef struct DP_KeyFrameLayer DP_KeyFrameLayer;
+typedef struct DP_LayerContent DP_LayerContent;
 typedef struct DP_PaintDrawDabsParams DP_PaintDrawDabsParams;
 typedef struct DP_Quad DP_Quad;
 typedef struct DP_Rect DP_Rect;
@@ -93,6 +95,14 @@ DP_CanvasState *DP_ops_fill_rect(DP_CanvasState *cs,
                                  int blend_mode, int left, int top, int right,
                                  int bottom, DP_UPixel15 pixel);
 
+DP_CanvasState *DP_ops_fill_gradient(DP_CanvasState *cs,
+                                     DP_UserCursors *ucs_or_null,
+                                     unsigned int context_id, int layer_id,
+                                     int blend_mode, int left, int top,
+                                     int right, int bottom,
+                                     const DP_Gradient *g,
+                                     DP_LayerContent *mask_or_null);
+
 DP_CanvasState *DP_ops_put_tile(DP_CanvasState *cs, DP_Tile *tile, int layer_id,
                                 int sublayer_id, int x, int y, int repeat);
 
@@ -61,7 +61,10 @@
 static uint16_t *generate_classic_lut(int index)
 {
     DP_debug("Generating classic dab lookup table for index %d", index);
-    uint16_t *cl = DP_malloc(sizeof(*cl) * CLASSIC_LUT_SIZE);
+    // One extra zero element at the end, since the AVX2 mask generation
+    // gathers two entries at a time and may read one past the last index.
+    uint16_t *cl = DP_malloc(sizeof(*cl) * (CLASSIC_LUT_SIZE + 1));
+    cl[CLASSIC_LUT_SIZE] = 0;
     double h = 1.0 - (index / 100.0);
     double exponent = h < 0.0000004 ? 1000000.0 : 0.4 / h;
     double radius = CLASSIC_LUT_RADIUS;
@@ -113,15 +116,45 @@ static void get_stamp_buffer_pair(DP_DrawContext *dc, size_t diameter_squared,
     *out_mask2 = (void *)(buffer + mask_size + padding);
 }
 
+// Offset masks of small classic stamps are cached for each of the 16 subpixel
+// positions, since consecutive dabs usually share their size and hardness and
+// only the position changes. Larger stamps aren't offset unless they're at full
+// hardness, so they don't get the cache to avoid huge buffers.
+#define CLASSIC_OFFSET_CACHE_MAX_DIAMETER 64
+#define CLASSIC_OFFSET_CACHE_COUNT        16
+
+typedef struct DP_ClassicOffsetCache {
+    uint16_t *masks; // NULL if the stamps are too large to cache.
+    size_t stride;
+    unsigned int valid; // Bit set of which masks are currently generated.
+} DP_ClassicOffsetCache;
+
 static void get_classic_stamp_buffers(DP_DrawContext *dc, uint32_t max_size,
                                       uint16_t **out_mask,
-                                      uint16_t **out_offset_mask)
+                                      uint16_t **out_offset_mask,
+                                      DP_ClassicOffsetCache *out_cache)
 {
     float diameter =
         DP_uint32_to_float(clamp_subpixel_dab_size(max_size)) / 256.0f;
-    size_t diameter_squared =
-        DP_square_size(DP_float_to_size(floorf(diameter + 4.0f)));
-    get_stamp_buffer_pair(dc, diameter_squared, out_mask, out_offset_mask);
+    size_t stamp_diameter = DP_float_to_size(floorf(diameter + 4.0f));
+    size_t diameter_squared = DP_square_size(stamp_diameter);
+    if (stamp_diameter <= CLASSIC_OFFSET_CACHE_MAX_DIAMETER) {
+        size_t mask_size = diameter_squared * sizeof(**out_mask);
+        size_t alignment = DP_SIMD_ALIGNMENT;
+        size_t padding = (alignment - (mask_size % alignment)) % alignment;
+        size_t stride = mask_size + padding;
+
+        unsigned char *buffer = DP_draw_context_pool_require(
+            dc, stride * (2 + CLASSIC_OFFSET_CACHE_COUNT));
+        *out_mask = (void *)buffer;
+        *out_offset_mask = (void *)(buffer + stride);
+        *out_cache = (DP_ClassicOffsetCache){
+            (void *)(buffer + stride * 2), stride / sizeof(**out_mask), 0};
+    }
+    else {
+        get_stamp_buffer_pair(dc, diameter_squared, out_mask, out_offset_mask);
+        *out_cache = (DP_ClassicOffsetCache){NULL, 0, 0};
+    }
 }
 
 static void prepare_stamp(DP_BrushStamp *stamp, int scaled_hardness,
@@ -138,6 +171,108 @@ static void prepare_stamp(DP_BrushStamp *stamp, int scaled_hardness,
     *out_lut_scale = DP_square_float((CLASSIC_LUT_RADIUS - 1.0f) / radius);
 }
 
+static void get_mask_row(uint16_t *d, const uint16_t *lut, int start_x,
+                         int count, float r, float offset, float yy,
+                         float fudge, float lut_scale)
+{
+    for (int x = start_x; x < start_x + count; ++x) {
+        float dist = (DP_square_float(DP_int_to_float(x) - r + offset) + yy)
+                   * fudge * lut_scale;
+        int i = DP_float_to_int(dist);
+        d[x] = i < CLASSIC_LUT_SIZE ? lut[i] : 0;
+    }
+}
+
+#ifdef DP_CPU_X64
+static void get_mask_row_sse(uint16_t *d, const uint16_t *lut, int start_x,
+                             int count, float r_float, float offset_float,
+                             float yy_float, float fudge_float,
+                             float lut_scale_float)
+{
+    DP_ASSERT(count % 4 == 0);
+
+    // Refer to get_mask_row for the formulas. The operations must happen in
+    // the same order so that the result matches exactly.
+
+    __m128 r = _mm_set1_ps(r_float);
+    __m128 offset = _mm_set1_ps(offset_float);
+    __m128 yy = _mm_set1_ps(yy_float);
+    __m128 fudge = _mm_set1_ps(fudge_float);
+    __m128 lut_scale = _mm_set1_ps(lut_scale_float);
+
+    __m128 xp = _mm_add_ps(_mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f),
+                           _mm_set1_ps((float)start_x));
+
+    for (int x = start_x; x < start_x + count; x += 4) {
+        __m128 xx = _mm_add_ps(_mm_sub_ps(xp, r), offset);
+        __m128 dist = _mm_mul_ps(
+            _mm_mul_ps(_mm_add_ps(_mm_mul_ps(xx, xx), yy), fudge), lut_scale);
+
+        // There's no gather instruction before AVX2, so look up the values
+        // from the table one by one.
+        int32_t indexes[4];
+        _mm_storeu_si128((__m128i *)indexes, _mm_cvttps_epi32(dist));
+        for (int j = 0; j < 4; ++j) {
+            int i = indexes[j];
+            d[x + j] = i < CLASSIC_LUT_SIZE ? lut[i] : 0;
+        }
+
+        xp = _mm_add_ps(xp, _mm_set1_ps(4.0f));
+    }
+}
+
+DP_TARGET_BEGIN("avx2")
+static __m256i gather_classic_lut_avx2(const uint16_t *lut, __m256i indexes)
+{
+    // Gathers 32 bits at each index and masks off the upper half. Indexes past
+    // the end of the table are left at zero. The last valid index reads into
+    // the padding element at the end of the lookup table.
+    __m256i in_range =
+        _mm256_cmpgt_epi32(_mm256_set1_epi32(CLASSIC_LUT_SIZE), indexes);
+    __m256i values = _mm256_mask_i32gather_epi32(
+        _mm256_setzero_si256(), (const int *)lut, indexes, in_range, 2);
+    return _mm256_and_si256(values, _mm256_set1_epi32(0xffff));
+}
+
+static void get_mask_row_avx2(uint16_t *d, const uint16_t *lut, int start_x,
+                              int count, float r_float, float offset_float,
+                              float yy_float, float fudge_float,
+                              float lut_scale_float)
+{
+    DP_ASSERT(count % 8 == 0);
+
+    // Refer to get_mask_row for the formulas. The operations must happen in
+    // the same order so that the result matches exactly.
+
+    __m256 r = _mm256_set1_ps(r_float);
+    __m256 offset = _mm256_set1_ps(offset_float);
+    __m256 yy = _mm256_set1_ps(yy_float);
+    __m256 fudge = _mm256_set1_ps(fudge_float);
+    __m256 lut_scale = _mm256_set1_ps(lut_scale_float);
+
+    __m256 xp = _mm256_add_ps(
+        _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f),
+        _mm256_set1_ps((float)start_x));
+
+    for (int x = start_x; x < start_x + count; x += 8) {
+        __m256 xx = _mm256_add_ps(_mm256_sub_ps(xp, r), offset);
+        __m256 dist = _mm256_mul_ps(
+            _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(xx, xx), yy), fudge),
+            lut_scale);
+
+        __m256i values =
+            gather_classic_lut_avx2(lut, _mm256_cvttps_epi32(dist));
+        _mm_storeu_si128((__m128i *)&d[x],
+                         _mm_packus_epi32(_mm256_castsi256_si128(values),
+                                          _mm256_extracti128_si256(values, 1)));
+
+        xp = _mm256_add_ps(xp, _mm256_set1_ps(8.0f));
+    }
+    _mm256_zeroupper();
+}
+DP_TARGET_END
+#endif
+
 static void get_mask(DP_BrushStamp *stamp, float radius, int scaled_hardness)
 {
     float r = radius / 2.0f;
@@ -172,22 +307,170 @@ static void get_mask(DP_BrushStamp *stamp, float radius, int scaled_hardness)
         const uint16_t *lut;
         float lut_scale;
         prepare_stamp(stamp, scaled_hardness, r, diameter, &lut, &lut_scale);
-        uint16_t *d = stamp->data;
 
         for (int y = 0; y < diameter; ++y) {
+            uint16_t *d = stamp->data + y * diameter;
             float yy = DP_square_float(DP_int_to_float(y) - r + offset);
-            for (int x = 0; x < diameter; ++x) {
-                float dist =
-                    (DP_square_float(DP_int_to_float(x) - r + offset) + yy)
-                    * fudge * lut_scale;
-                int i = DP_float_to_int(dist);
-                *d = i < CLASSIC_LUT_SIZE ? lut[i] : 0;
-                ++d;
+            int x = 0;
+            int remaining = diameter;
+#ifdef DP_CPU_X64
+            if (DP_cpu_support >= DP_CPU_SUPPORT_AVX2) {
+                int avx_width = remaining - remaining % 8;
+                get_mask_row_avx2(d, lut, x, avx_width, r, offset, yy, fudge,
+                                  lut_scale);
+                remaining -= avx_width;
+                x += avx_width;
             }
+
+            int sse_width = remaining - remaining % 4;
+            get_mask_row_sse(d, lut, x, sse_width, r, offset, yy, fudge,
+                             lut_scale);
+            remaining -= sse_width;
+            x += sse_width;
+#endif
+            get_mask_row(d, lut, x, remaining, r, offset, yy, fudge,
+                         lut_scale);
         }
     }
 }
 
+static void get_high_res_mask_row(uint16_t *ptr, const uint16_t *lut,
+                                  int start_x, int count, float radius,
+                                  float offset, float yy0, float yy1,
+                                  float lut_scale)
+{
+    for (int x = start_x; x < start_x + count; ++x) {
+        float x2 = DP_int_to_float(x * 2);
+        float xx0 = DP_square_float(x2 - radius + offset);
+        float xx1 = DP_square_float(x2 + 1.0f - radius + offset);
+
+        int dist00 = DP_float_to_int((xx0 + yy0) * lut_scale);
+        int dist01 = DP_float_to_int((xx0 + yy1) * lut_scale);
+        int dist10 = DP_float_to_int((xx1 + yy0) * lut_scale);
+        int dist11 = DP_float_to_int((xx1 + yy1) * lut_scale);
+
+        uint32_t acc = (dist00 < CLASSIC_LUT_SIZE ? (uint32_t)lut[dist00] : 0)
+                     + (dist01 < CLASSIC_LUT_SIZE ? (uint32_t)lut[dist01] : 0)
+                     + (dist10 < CLASSIC_LUT_SIZE ? (uint32_t)lut[dist10] : 0)
+                     + (dist11 < CLASSIC_LUT_SIZE ? (uint32_t)lut[dist11] : 0);
+        ptr[x] = DP_uint32_to_uint16(acc / 4);
+    }
+}
+
+#ifdef DP_CPU_X64
+static void get_high_res_mask_row_sse(uint16_t *ptr, const uint16_t *lut,
+                                      int start_x, int count,
+                                      float radius_float, float offset_float,
+                                      float yy0_float, float yy1_float,
+                                      float lut_scale_float)
+{
+    DP_ASSERT(count % 4 == 0);
+
+    // Refer to get_high_res_mask_row for the formulas. The operations must
+    // happen in the same order so that the result matches exactly.
+
+    __m128 radius = _mm_set1_ps(radius_float);
+    __m128 offset = _mm_set1_ps(offset_float);
+    __m128 yy0 = _mm_set1_ps(yy0_float);
+    __m128 yy1 = _mm_set1_ps(yy1_float);
+    __m128 lut_scale = _mm_set1_ps(lut_scale_float);
+    __m128 one = _mm_set1_ps(1.0f);
+
+    __m128 x2 = _mm_add_ps(_mm_setr_ps(0.0f, 2.0f, 4.0f, 6.0f),
+                           _mm_set1_ps((float)(start_x * 2)));
+
+    for (int x = start_x; x < start_x + count; x += 4) {
+        __m128 xx0 = _mm_add_ps(_mm_sub_ps(x2, radius), offset);
+        xx0 = _mm_mul_ps(xx0, xx0);
+        __m128 xx1 =
+            _mm_add_ps(_mm_sub_ps(_mm_add_ps(x2, one), radius), offset);
+        xx1 = _mm_mul_ps(xx1, xx1);
+
+        int32_t indexes[4][4];
+        _mm_storeu_si128((__m128i *)indexes[0],
+                        _mm_cvttps_epi32(
+                            _mm_mul_ps(_mm_add_ps(xx0, yy0), lut_scale)));
+        _mm_storeu_si128((__m128i *)indexes[1],
+                        _mm_cvttps_epi32(
+                            _mm_mul_ps(_mm_add_ps(xx0, yy1), lut_scale)));
+        _mm_storeu_si128((__m128i *)indexes[2],
+                        _mm_cvttps_epi32(
+                            _mm_mul_ps(_mm_add_ps(xx1, yy0), lut_scale)));
+        _mm_storeu_si128((__m128i *)indexes[3],
+                        _mm_cvttps_epi32(
+                            _mm_mul_ps(_mm_add_ps(xx1, yy1), lut_scale)));
+
+        for (int j = 0; j < 4; ++j) {
+            uint32_t acc = 0;
+            for (int k = 0; k < 4; ++k) {
+                int i = indexes[k][j];
+                acc += i < CLASSIC_LUT_SIZE ? (uint32_t)lut[i] : 0;
+            }
+            ptr[x + j] = DP_uint32_to_uint16(acc / 4);
+        }
+
+        x2 = _mm_add_ps(x2, _mm_set1_ps(8.0f));
+    }
+}
+
+DP_TARGET_BEGIN("avx2")
+static void get_high_res_mask_row_avx2(uint16_t *ptr, const uint16_t *lut,
+                                       int start_x, int count,
+                                       float radius_float, float offset_float,
+                                       float yy0_float, float yy1_float,
+                                       float lut_scale_float)
+{
+    DP_ASSERT(count % 8 == 0);
+
+    // Refer to get_high_res_mask_row for the formulas. The operations must
+    // happen in the same order so that the result matches exactly.
+
+    __m256 radius = _mm256_set1_ps(radius_float);
+    __m256 offset = _mm256_set1_ps(offset_float);
+    __m256 yy0 = _mm256_set1_ps(yy0_float);
+    __m256 yy1 = _mm256_set1_ps(yy1_float);
+    __m256 lut_scale = _mm256_set1_ps(lut_scale_float);
+    __m256 one = _mm256_set1_ps(1.0f);
+
+    __m256 x2 = _mm256_add_ps(
+        _mm256_setr_ps(0.0f, 2.0f, 4.0f, 6.0f, 8.0f, 10.0f, 12.0f, 14.0f),
+        _mm256_set1_ps((float)(start_x * 2)));
+
+    for (int x = start_x; x < start_x + count; x += 8) {
+        __m256 xx0 = _mm256_add_ps(_mm256_sub_ps(x2, radius), offset);
+        xx0 = _mm256_mul_ps(xx0, xx0);
+        __m256 xx1 = _mm256_add_ps(
+            _mm256_sub_ps(_mm256_add_ps(x2, one), radius), offset);
+        xx1 = _mm256_mul_ps(xx1, xx1);
+
+        __m256i acc = _mm256_add_epi32(
+            _mm256_add_epi32(
+                gather_classic_lut_avx2(
+                    lut, _mm256_cvttps_epi32(_mm256_mul_ps(
+                             _mm256_add_ps(xx0, yy0), lut_scale))),
+                gather_classic_lut_avx2(
+                    lut, _mm256_cvttps_epi32(_mm256_mul_ps(
+                             _mm256_add_ps(xx0, yy1), lut_scale)))),
+            _mm256_add_epi32(
+                gather_classic_lut_avx2(
+                    lut, _mm256_cvttps_epi32(_mm256_mul_ps(
+                             _mm256_add_ps(xx1, yy0), lut_scale))),
+                gather_classic_lut_avx2(
+                    lut, _mm256_cvttps_epi32(_mm256_mul_ps(
+                             _mm256_add_ps(xx1, yy1), lut_scale)))));
+        acc = _mm256_srli_epi32(acc, 2);
+
+        _mm_storeu_si128((__m128i *)&ptr[x],
+                         _mm_packus_epi32(_mm256_castsi256_si128(acc),
+                                          _mm256_extracti128_si256(acc, 1)));
+
+        x2 = _mm256_add_ps(x2, _mm256_set1_ps(16.0f));
+    }
+    _mm256_zeroupper();
+}
+DP_TARGET_END
+#endif
+
 static void get_high_res_mask(DP_BrushStamp *stamp, float radius,
                               int scaled_hardness)
 {
@@ -208,32 +491,137 @@ static void get_high_res_mask(DP_BrushStamp *stamp, float radius,
     const uint16_t *lut;
     float lut_scale;
     prepare_stamp(stamp, scaled_hardness, radius, diameter, &lut, &lut_scale);
-    uint16_t *ptr = stamp->data;
 
     for (int y = 0; y < diameter; ++y) {
+        uint16_t *ptr = stamp->data + y * diameter;
         float y2 = DP_int_to_float(y * 2);
         float yy0 = DP_square_float(y2 - radius + offset);
         float yy1 = DP_square_float(y2 + 1.0f - radius + offset);
-
-        for (int x = 0; x < diameter; ++x) {
-            float x2 = DP_int_to_float(x * 2);
-            float xx0 = DP_square_float(x2 - radius + offset);
-            float xx1 = DP_square_float(x2 + 1.0f - radius + offset);
-
-            int dist00 = DP_float_to_int((xx0 + yy0) * lut_scale);
-            int dist01 = DP_float_to_int((xx0 + yy1) * lut_scale);
-            int dist10 = DP_float_to_int((xx1 + yy0) * lut_scale);
-            int dist11 = DP_float_to_int((xx1 + yy1) * lut_scale);
-
-            uint32_t acc =
-                (dist00 < CLASSIC_LUT_SIZE ? (uint32_t)lut[dist00] : 0)
-                + (dist01 < CLASSIC_LUT_SIZE ? (uint32_t)lut[dist01] : 0)
-                + (dist10 < CLASSIC_LUT_SIZE ? (uint32_t)lut[dist10] : 0)
-                + (dist11 < CLASSIC_LUT_SIZE ? (uint32_t)lut[dist11] : 0);
-            *(ptr++) = DP_uint32_to_uint16(acc / 4);
+        int x = 0;
+        int remaining = diameter;
+#ifdef DP_CPU_X64
+        if (DP_cpu_support >= DP_CPU_SUPPORT_AVX2) {
+            int avx_width = remaining - remaining % 8;
+            get_high_res_mask_row_avx2(ptr, lut, x, avx_width, radius, offset,
+                                       yy0, yy1, lut_scale);
+            remaining -= avx_width;
+            x += avx_width;
         }
+
+        int sse_width = remaining - remaining % 4;
+        get_high_res_mask_row_sse(ptr, lut, x, sse_width, radius, offset, yy0,
+                                  yy1, lut_scale);
+        remaining -= sse_width;
+        x += sse_width;
+#endif
+        get_high_res_mask_row(ptr, lut, x, remaining, radius, offset, yy0, yy1,
+                              lut_scale);
+    }
+}
+
+static void generate_offset_mask_row(uint16_t *dst, const uint16_t *src0,
+                                     const uint16_t *src1, int start_x,
+                                     int count, uint32_t k0, uint32_t k1,
+                                     uint32_t k2, uint32_t k3)
+{
+    for (int x = start_x; x < start_x + count; ++x) {
+        dst[x] = DP_uint32_to_uint16(((src0[x] * k0) + (src0[x + 1] * k1)
+                                      + (src1[x] * k2) + (src1[x + 1] * k3))
+                                     / 16);
+    }
+}
+
+#ifdef DP_CPU_X64
+DP_TARGET_BEGIN("sse4.2")
+static void generate_offset_mask_row_sse42(uint16_t *dst, const uint16_t *src0,
+                                           const uint16_t *src1, int start_x,
+                                           int count, uint32_t k0_uint,
+                                           uint32_t k1_uint, uint32_t k2_uint,
+                                           uint32_t k3_uint)
+{
+    DP_ASSERT(count % 8 == 0);
+
+    // Mask values go up to 2^15 and the weights sum up to 16, so the weighted
+    // sum needs 32 bits. Unpacking and packing both work on the lower and
+    // upper halves of the registers, so the order comes out the same again.
+
+    __m128i k0 = _mm_set1_epi32(DP_uint32_to_int(k0_uint));
+    __m128i k1 = _mm_set1_epi32(DP_uint32_to_int(k1_uint));
+    __m128i k2 = _mm_set1_epi32(DP_uint32_to_int(k2_uint));
+    __m128i k3 = _mm_set1_epi32(DP_uint32_to_int(k3_uint));
+    __m128i zero = _mm_setzero_si128();
+
+    for (int x = start_x; x < start_x + count; x += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)&src0[x]);
+        __m128i b = _mm_loadu_si128((const __m128i *)&src0[x + 1]);
+        __m128i c = _mm_loadu_si128((const __m128i *)&src1[x]);
+        __m128i d = _mm_loadu_si128((const __m128i *)&src1[x + 1]);
+
+        __m128i lo = _mm_add_epi32(
+            _mm_add_epi32(_mm_mullo_epi32(_mm_unpacklo_epi16(a, zero), k0),
+                          _mm_mullo_epi32(_mm_unpacklo_epi16(b, zero), k1)),
+            _mm_add_epi32(_mm_mullo_epi32(_mm_unpacklo_epi16(c, zero), k2),
+                          _mm_mullo_epi32(_mm_unpacklo_epi16(d, zero), k3)));
+        __m128i hi = _mm_add_epi32(
+            _mm_add_epi32(_mm_mullo_epi32(_mm_unpackhi_epi16(a, zero), k0),
+                          _mm_mullo_epi32(_mm_unpackhi_epi16(b, zero), k1)),
+            _mm_add_epi32(_mm_mullo_epi32(_mm_unpackhi_epi16(c, zero), k2),
+                          _mm_mullo_epi32(_mm_unpackhi_epi16(d, zero), k3)));
+
+        _mm_storeu_si128((__m128i *)&dst[x],
+                         _mm_packus_epi32(_mm_srli_epi32(lo, 4),
+                                          _mm_srli_epi32(hi, 4)));
+    }
+}
+DP_TARGET_END
+
+DP_TARGET_BEGIN("avx2")
+static void generate_offset_mask_row_avx2(uint16_t *dst, const uint16_t *src0,
+                                          const uint16_t *src1, int start_x,
+                                          int count, uint32_t k0_uint,
+                                          uint32_t k1_uint, uint32_t k2_uint,
+                                          uint32_t k3_uint)
+{
+    DP_ASSERT(count % 16 == 0);
+
+    // Refer to generate_offset_mask_row_sse42 for an explanation. Unpacking
+    // and packing also stay within each 128 bit lane here.
+
+    __m256i k0 = _mm256_set1_epi32(DP_uint32_to_int(k0_uint));
+    __m256i k1 = _mm256_set1_epi32(DP_uint32_to_int(k1_uint));
+    __m256i k2 = _mm256_set1_epi32(DP_uint32_to_int(k2_uint));
+    __m256i k3 = _mm256_set1_epi32(DP_uint32_to_int(k3_uint));
+    __m256i zero = _mm256_setzero_si256();
+
+    for (int x = start_x; x < start_x + count; x += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)&src0[x]);
+        __m256i b = _mm256_loadu_si256((const __m256i *)&src0[x + 1]);
+        __m256i c = _mm256_loadu_si256((const __m256i *)&src1[x]);
+        __m256i d = _mm256_loadu_si256((const __m256i *)&src1[x + 1]);
+
+        __m256i lo = _mm256_add_epi32(
+            _mm256_add_epi32(
+                _mm256_mullo_epi32(_mm256_unpacklo_epi16(a, zero), k0),
+                _mm256_mullo_epi32(_mm256_unpacklo_epi16(b, zero), k1)),
+            _mm256_add_epi32(
+                _mm256_mullo_epi32(_mm256_unpacklo_epi16(c, zero), k2),
+                _mm256_mullo_epi32(_mm256_unpacklo_epi16(d, zero), k3)));
+        __m256i hi = _mm256_add_epi32(
+            _mm256_add_epi32(
+                _mm256_mullo_epi32(_mm256_unpackhi_epi16(a, zero), k0),
+                _mm256_mullo_epi32(_mm256_unpackhi_epi16(b, zero), k1)),
+            _mm256_add_epi32(
+                _mm256_mullo_epi32(_mm256_unpackhi_epi16(c, zero), k2),
+                _mm256_mullo_epi32(_mm256_unpackhi_epi16(d, zero), k3)));
+
+        _mm256_storeu_si256((__m256i *)&dst[x],
+                            _mm256_packus_epi32(_mm256_srli_epi32(lo, 4),
+                                                _mm256_srli_epi32(hi, 4)));
     }
+    _mm256_zeroupper();
 }
+DP_TARGET_END
+#endif
 
 static void generate_offset_mask(uint16_t *dst, const uint16_t *src,
                                  int diameter, uint32_t xfrac, uint32_t yfrac)
@@ -252,13 +640,31 @@ static void generate_offset_mask(uint16_t *dst, const uint16_t *src,
         int yd = y * diameter;
         *(dst++) = DP_uint32_to_uint16(
             ((src[yd] * k1) + (src[yd + diameter] * k3)) / 16);
-        for (int x = 0; x < diameter - 1; ++x) {
-            *(dst++) =
-                DP_uint32_to_uint16(((src[yd + x] * k0) + (src[yd + x + 1] * k1)
-                                     + (src[yd + diameter + x] * k2)
-                                     + (src[yd + diameter + x + 1] * k3))
-                                    / 16);
+
+        const uint16_t *src0 = src + yd;
+        const uint16_t *src1 = src0 + diameter;
+        int x = 0;
+        int remaining = diameter - 1;
+#ifdef DP_CPU_X64
+        if (DP_cpu_support >= DP_CPU_SUPPORT_AVX2) {
+            int avx_width = remaining - remaining % 16;
+            generate_offset_mask_row_avx2(dst, src0, src1, x, avx_width, k0,
+                                          k1, k2, k3);
+            remaining -= avx_width;
+            x += avx_width;
+        }
+
+        if (DP_cpu_support >= DP_CPU_SUPPORT_SSE42) {
+            int sse_width = remaining - remaining % 8;
+            generate_offset_mask_row_sse42(dst, src0, src1, x, sse_width, k0,
+                                           k1, k2, k3);
+            remaining -= sse_width;
+            x += sse_width;
         }
+#endif
+        generate_offset_mask_row(dst, src0, src1, x, remaining, k0, k1, k2,
+                                 k3);
+        dst += diameter - 1;
     }
 }
 
@@ -365,9 +771,31 @@ static void apply_mask_lc_into(int top, int left, int diameter,
     }
 }
 
+static uint16_t *get_classic_offset_mask(DP_ClassicOffsetCache *cache,
+                                         uint16_t *offset_mask,
+                                         const uint16_t *mask, int diameter,
+                                         uint32_t xfrac, uint32_t yfrac)
+{
+    if (cache->masks) {
+        unsigned int index = yfrac * 4 + xfrac;
+        unsigned int bit = 1u << index;
+        uint16_t *cached_mask = cache->masks + cache->stride * index;
+        if (!(cache->valid & bit)) {
+            generate_offset_mask(cached_mask, mask, diameter, xfrac, yfrac);
+            cache->valid |= bit;
+        }
+        return cached_mask;
+    }
+    else {
+        generate_offset_mask(offset_mask, mask, diameter, xfrac, yfrac);
+        return offset_mask;
+    }
+}
+
 static DP_BrushStamp get_classic_offset_stamp(DP_BrushStamp *mask_stamp,
-                                              uint16_t *offset_mask, int x,
-                                              int y, int scaled_hardness,
+                                              uint16_t *offset_mask,
+                                              DP_ClassicOffsetCache *cache,
+                                              int x, int y, int scaled_hardness,
                                               DP_LayerContent *mask_lc_or_null)
 {
     int left = mask_stamp->left + x / 4;
@@ -379,6 +807,7 @@ static DP_BrushStamp get_classic_offset_stamp(DP_BrushStamp *mask_stamp,
     // Exception: at 100% hardness we'd get a pixely outline instead
     // of an alternatingly pixely and slightly smooth outline, so we
     // do generate an offset mask there to keep up the appearance.
+    uint16_t *src;
     if (scaled_hardness == 100 || diameter < 48) {
         uint32_t xfrac = x & 3;
         uint32_t yfrac = y & 3;
@@ -399,19 +828,27 @@ static DP_BrushStamp get_classic_offset_stamp(DP_BrushStamp *mask_stamp,
             yfrac -= 2;
         }
 
-        generate_offset_mask(offset_mask, mask, diameter, xfrac, yfrac);
-        if (needs_mask_lc(top, left, diameter, mask_lc_or_null)) {
+        src = get_classic_offset_mask(cache, offset_mask, mask, diameter, xfrac,
+                                      yfrac);
+    }
+    else {
+        src = mask;
+    }
+
+    // The base and cached masks get reused by later dabs, so the selection
+    // mask must go into the separate offset mask buffer.
+    if (needs_mask_lc(top, left, diameter, mask_lc_or_null)) {
+        if (src == offset_mask) {
             apply_mask_lc(top, left, diameter, offset_mask, mask_lc_or_null);
         }
-        return (DP_BrushStamp){top, left, diameter, offset_mask};
-    }
-    else if (needs_mask_lc(top, left, diameter, mask_lc_or_null)) {
-        apply_mask_lc_into(top, left, diameter, mask, offset_mask,
-                           mask_lc_or_null);
+        else {
+            apply_mask_lc_into(top, left, diameter, src, offset_mask,
+                               mask_lc_or_null);
+        }
         return (DP_BrushStamp){top, left, diameter, offset_mask};
     }
     else {
-        return (DP_BrushStamp){top, left, diameter, mask};
+        return (DP_BrushStamp){top, left, diameter, src};
     }
 }
 
@@ -436,7 +873,8 @@ static void draw_dabs_classic(DP_DrawContext *dc, DP_UserCursors *ucs_or_null,
     if (max_size > 0) {
         uint16_t *mask;
         uint16_t *offset_mask;
-        get_classic_stamp_buffers(dc, max_size, &mask, &offset_mask);
+        DP_ClassicOffsetCache cache;
+        get_classic_stamp_buffers(dc, max_size, &mask, &offset_mask, &cache);
 
         unsigned int context_id = params->context_id;
         DP_UPixel15 pixel = DP_upixel15_from_color(params->color);
@@ -467,11 +905,12 @@ static void draw_dabs_classic(DP_DrawContext *dc, DP_UserCursors *ucs_or_null,
                     last_scaled_hardness = scaled_hardness;
                     get_classic_mask_stamp(&mask_stamp, radius,
                                            scaled_hardness);
+                    cache.valid = 0;
                 }
 
-                DP_BrushStamp offset_stamp =
-                    get_classic_offset_stamp(&mask_stamp, offset_mask, x, y,
-                                             scaled_hardness, mask_lc_or_null);
+                DP_BrushStamp offset_stamp = get_classic_offset_stamp(
+                    &mask_stamp, offset_mask, &cache, x, y, scaled_hardness,
+                    mask_lc_or_null);
                 DP_transient_layer_content_brush_stamp_apply(
                     tlc, context_id, pixel, DP_channel8_to_15(opacity),
                     blend_mode, &offset_stamp);
@@ -72,6 +72,15 @@
 #define RECORDER_STARTED   1
 #define RECORDER_STOPPED   2
 
+// Decoding runs alongside rendering, so it doesn't get too many threads.
+#define MAX_DECODE_THREADS 4
+// Upper bound on messages handed to the decode worker that the paint thread
+// hasn't gotten to yet. Decoded payloads are a lot bigger than the compressed
+// messages, so when catching up on a session, decoding everything in the
+// queue ahead of time would use up a ton of memory. Messages past this limit
+// wait their turn and get handed over as the paint thread makes progress.
+#define MAX_DECODE_AHEAD 128
+
 #define NO_PUSH               0
 #define PUSH_MESSAGE          1
 #define PUSH_CLEAR_LOCAL_FORK 2
@@ -139,6 +148,13 @@ struct DP_PaintEngine {
     bool reset_locked;
     DP_Thread *paint_thread;
     DP_Renderer *renderer;
+    struct {
+        DP_Worker *worker;
+        int thread_count;
+        DP_DrawContext **dcs;
+        DP_Queue queue;
+        size_t ahead;
+    } decode;
     struct {
         uint8_t acl_change_flags;
         DP_Vector cursor_changes;
@@ -160,6 +176,100 @@ struct DP_PaintEngine {
 };
 
 
+typedef struct DP_PaintEngineDecodeJob {
+    DP_PaintEngine *pe;
+    DP_Message *msg;
+} DP_PaintEngineDecodeJob;
+
+static void decode_job(void *element, int thread_index)
+{
+    DP_PaintEngineDecodeJob *job = element;
+    DP_canvas_state_message_decode(job->pe->decode.dcs[thread_index],
+                                   job->msg);
+    DP_message_decref(job->msg);
+}
+
+static void init_decode(DP_PaintEngine *pe)
+{
+    DP_message_queue_init(&pe->decode.queue, INITIAL_QUEUE_CAPACITY);
+    pe->decode.ahead = 0;
+    DP_Worker *worker =
+        DP_worker_new(64, sizeof(DP_PaintEngineDecodeJob),
+                      DP_worker_cpu_count(MAX_DECODE_THREADS), decode_job);
+    if (worker) {
+        int thread_count = DP_worker_thread_count(worker);
+        pe->decode.worker = worker;
+        pe->decode.thread_count = thread_count;
+        pe->decode.dcs =
+            DP_malloc(sizeof(*pe->decode.dcs) * DP_int_to_size(thread_count));
+        for (int i = 0; i < thread_count; ++i) {
+            pe->decode.dcs[i] = DP_draw_context_new();
+        }
+    }
+    else {
+        // Not fatal, messages just get decoded on the paint thread instead.
+        DP_warn("Error creating decode worker: %s", DP_error());
+        pe->decode.worker = NULL;
+        pe->decode.thread_count = 0;
+        pe->decode.dcs = NULL;
+    }
+}
+
+static void dispose_decode(DP_PaintEngine *pe)
+{
+    DP_worker_free_join(pe->decode.worker);
+    int thread_count = pe->decode.thread_count;
+    for (int i = 0; i < thread_count; ++i) {
+        DP_draw_context_free(pe->decode.dcs[i]);
+    }
+    DP_free(pe->decode.dcs);
+    DP_message_queue_dispose(&pe->decode.queue);
+}
+
+// Hands waiting messages to the decode worker until the limit is reached. The
+// decode queue holds the remote decodable messages in the same order as the
+// remote queue, the first `ahead` of which have already been handed over.
+// Must be called with the queue mutex held.
+static void dispatch_decode_ahead(DP_PaintEngine *pe)
+{
+    size_t used = pe->decode.queue.used;
+    while (pe->decode.ahead < used && pe->decode.ahead < MAX_DECODE_AHEAD) {
+        DP_Message **pp = DP_queue_at(&pe->decode.queue, sizeof(*pp),
+                                      pe->decode.ahead++);
+        DP_PaintEngineDecodeJob job = {pe, DP_message_incref(*pp)};
+        DP_worker_push(pe->decode.worker, &job);
+    }
+}
+
+// Put image and put tile messages from remote users can be large and usually
+// arrive in bulk when joining a session. Decompressing them while they wait in
+// the queue takes that work off the paint thread.
+static void push_message_inc(DP_PaintEngine *pe, DP_Queue *queue,
+                             DP_Message *msg)
+{
+    DP_message_queue_push_inc(queue, msg);
+    if (pe->decode.worker && queue == &pe->remote_queue
+        && DP_canvas_state_message_decodable(msg)) {
+        DP_message_queue_push_inc(&pe->decode.queue, msg);
+        dispatch_decode_ahead(pe);
+    }
+}
+
+// Called with remote messages as they get shifted off the queue, with the
+// queue mutex held. Drops the message from the decode queue and lets the
+// worker start on the next waiting one. Messages that the paint thread gets
+// to before the worker does just get decoded inline.
+static void finish_decode_ahead(DP_PaintEngine *pe, DP_Message *msg)
+{
+    if (DP_message_queue_peek(&pe->decode.queue) == msg) {
+        DP_message_decref(DP_message_queue_shift(&pe->decode.queue));
+        if (pe->decode.ahead != 0) {
+            --pe->decode.ahead;
+        }
+        dispatch_decode_ahead(pe);
+    }
+}
+
 static void push_cleanup_message(void *user, DP_Message *msg)
 {
     DP_PaintEngine *pe = user;
@@ -609,6 +719,9 @@ static void handle_message(DP_PaintEngine *pe, DP_DrawContext *dc,
     DP_Message *first = msgs[0];
     DP_MessageType type = DP_message_type(first);
     int count = maybe_shift_more_messages(pe, local, type, msgs);
+    if (!local) {
+        finish_decode_ahead(pe, first);
+    }
     DP_MUTEX_MUST_UNLOCK(pe->queue_mutex);
 
     DP_ASSERT(count > 0);
@@ -767,6 +880,7 @@ DP_PaintEngine *DP_paint_engine_new_inc(
     DP_atomic_set(&pe->just_reset, false);
     pe->catching_up = false;
     pe->reset_locked = false;
+    init_decode(pe);
     pe->paint_thread = DP_thread_new(run_paint_engine, pe);
     pe->renderer = DP_renderer_new(
         DP_worker_cpu_count(128), renderer_checker,
@@ -800,6 +914,7 @@ void DP_paint_engine_free_join(DP_PaintEngine *pe)
         DP_atomic_set(&pe->running, false);
         DP_SEMAPHORE_MUST_POST(pe->queue_sem);
         DP_thread_free_join(pe->paint_thread);
+        dispose_decode(pe);
         DP_player_free(pe->playback.player);
         DP_semaphore_free(pe->record.start_sem);
         DP_vector_dispose(&pe->meta.cursor_changes);
@@ -1317,7 +1432,7 @@ static int push_more_messages(DP_PaintEngine *pe, DP_Queue *queue,
         case NO_PUSH:
             break;
         case PUSH_MESSAGE:
-            DP_message_queue_push_inc(queue, msg);
+            push_message_inc(pe, queue, msg);
             ++pushed;
             break;
         case PUSH_CLEAR_LOCAL_FORK:
@@ -1341,7 +1456,7 @@ static int push_messages(DP_PaintEngine *pe, DP_Queue *queue,
     DP_MUTEX_MUST_LOCK(pe->queue_mutex);
     // First message is the one that triggered the call to this function,
     // push it unconditionally. Then keep checking the rest again.
-    DP_message_queue_push_inc(queue, msgs[0]);
+    push_message_inc(pe, queue, msgs[0]);
     int pushed =
         push_more_messages(pe, queue, override_acls, count, msgs, should_push);
     DP_MUTEX_MUST_UNLOCK(pe->queue_mutex);
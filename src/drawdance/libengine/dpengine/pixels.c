@@ -49,6 +49,7 @@
  * details.
  */
 #include "pixels.h"
+#include <dpcommon/atomic.h>
 #include <dpcommon/common.h>
 #include <dpcommon/conversions.h>
 #include <dpcommon/cpu.h>
@@ -2740,25 +2741,119 @@ static void rgb_to_spectral_scalar(float b, float g, float r, float *out)
     aligned_out[9] = SPECTRAL_B9 * b + SPECTRAL_G9 * g + SPECTRAL_R9 * r;
 }
 
+#ifdef DP_CPU_X64
+DP_TARGET_BEGIN("sse4.2")
+// These do the same operations in the same order as their scalar equivalents
+// for up to four values at once, so that the results stay exactly the same.
+
+static __m128 srgb_to_linear_sse42(__m128 x)
+{
+    __m128 small = _mm_div_ps(x, _mm_set1_ps(12.92f));
+    __m128 powed =
+        vfastpow(_mm_div_ps(_mm_add_ps(x, _mm_set1_ps(0.055f)),
+                            _mm_set1_ps(1.055f)),
+                 _mm_set1_ps(2.4f));
+    return _mm_blendv_ps(powed, small, _mm_cmplt_ps(x, _mm_set1_ps(0.04045f)));
+}
+
+static __m128 linear_to_srgb_sse42(__m128 x)
+{
+    __m128 small = _mm_mul_ps(x, _mm_set1_ps(12.92f));
+    __m128 powed =
+        _mm_sub_ps(_mm_mul_ps(vfastpow(x, _mm_set1_ps(1.0f / 2.4f)),
+                              _mm_set1_ps(1.055f)),
+                   _mm_set1_ps(0.055f));
+    return _mm_blendv_ps(powed, small,
+                         _mm_cmplt_ps(x, _mm_set1_ps(0.0031308f)));
+}
+
+static __m128 clampf_sse42(__m128 x)
+{
+    __m128 zero = _mm_setzero_ps();
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 clamped = _mm_blendv_ps(x, one, _mm_cmpgt_ps(x, one));
+    return _mm_blendv_ps(clamped, zero, _mm_cmplt_ps(x, zero));
+}
+
+static BGRf srgb_to_wgm_sse42(BGRf bgr)
+{
+    __m128 linear =
+        srgb_to_linear_sse42(_mm_setr_ps(bgr.b, bgr.g, bgr.r, 0.0f));
+    DP_ALIGNAS_SIMD float out[4];
+    _mm_store_ps(out, _mm_add_ps(_mm_mul_ps(linear, _mm_set1_ps(WGM_OFFSET)),
+                                 _mm_set1_ps(WGM_EPSILON)));
+    return (BGRf){out[0], out[1], out[2]};
+}
+
+static BGRf spectral_to_rgb_sse42(const float *spectral)
+{
+    // Each lane sums up one channel's dot product, in the same order as the
+    // scalar version does.
+    static const float t_matrix[10][4] = {
+        {T_MATRIX_B0, T_MATRIX_G0, T_MATRIX_R0, 0.0f},
+        {T_MATRIX_B1, T_MATRIX_G1, T_MATRIX_R1, 0.0f},
+        {T_MATRIX_B2, T_MATRIX_G2, T_MATRIX_R2, 0.0f},
+        {T_MATRIX_B3, T_MATRIX_G3, T_MATRIX_R3, 0.0f},
+        {T_MATRIX_B4, T_MATRIX_G4, T_MATRIX_R4, 0.0f},
+        {T_MATRIX_B5, T_MATRIX_G5, T_MATRIX_R5, 0.0f},
+        {T_MATRIX_B6, T_MATRIX_G6, T_MATRIX_R6, 0.0f},
+        {T_MATRIX_B7, T_MATRIX_G7, T_MATRIX_R7, 0.0f},
+        {T_MATRIX_B8, T_MATRIX_G8, T_MATRIX_R8, 0.0f},
+        {T_MATRIX_B9, T_MATRIX_G9, T_MATRIX_R9, 0.0f},
+    };
+    __m128 bgr =
+        _mm_mul_ps(_mm_loadu_ps(t_matrix[0]), _mm_set1_ps(spectral[0]));
+    for (int i = 1; i < 10; ++i) {
+        bgr = _mm_add_ps(bgr, _mm_mul_ps(_mm_loadu_ps(t_matrix[i]),
+                                         _mm_set1_ps(spectral[i])));
+    }
+
+    DP_ALIGNAS_SIMD float out[4];
+    _mm_store_ps(out, clampf_sse42(linear_to_srgb_sse42(
+                          _mm_div_ps(_mm_sub_ps(bgr, _mm_set1_ps(WGM_EPSILON)),
+                                     _mm_set1_ps(WGM_OFFSET)))));
+    return (BGRf){out[0], out[1], out[2]};
+}
+
+static void mix_spectral_channels_log2_sse42(const float *log2_a, float *b,
+                                             float fac_a, float fac_b)
+{
+    // Only the first eight channels, the last two are left to the caller.
+    __m128 fa = _mm_set1_ps(fac_a);
+    __m128 fb = _mm_set1_ps(fac_b);
+    for (int i = 0; i < 8; i += 4) {
+        __m128 pa = vfastpow2(_mm_mul_ps(fa, _mm_load_ps(log2_a + i)));
+        __m128 pb = vfastpow(_mm_load_ps(b + i), fb);
+        _mm_store_ps(b + i, _mm_mul_ps(pa, pb));
+    }
+}
+DP_TARGET_END
+#endif
+
 static DP_Spectral rgb_to_spectral(BGRf bgr)
 {
-    float b = srgb_to_linear(bgr.b) * WGM_OFFSET + WGM_EPSILON;
-    float g = srgb_to_linear(bgr.g) * WGM_OFFSET + WGM_EPSILON;
-    float r = srgb_to_linear(bgr.r) * WGM_OFFSET + WGM_EPSILON;
     DP_Spectral out;
     switch (DP_cpu_support) {
 #ifdef DP_CPU_X64
-    case DP_CPU_SUPPORT_AVX2:
-        rgb_to_spectral_avx2(b, g, r, out.channels);
+    case DP_CPU_SUPPORT_AVX2: {
+        BGRf wgm = srgb_to_wgm_sse42(bgr);
+        rgb_to_spectral_avx2(wgm.b, wgm.g, wgm.r, out.channels);
         break;
-    case DP_CPU_SUPPORT_SSE42:
-        rgb_to_spectral_sse42(b, g, r, out.channels);
+    }
+    case DP_CPU_SUPPORT_SSE42: {
+        BGRf wgm = srgb_to_wgm_sse42(bgr);
+        rgb_to_spectral_sse42(wgm.b, wgm.g, wgm.r, out.channels);
         break;
+    }
 #endif
-    default:
+    default: {
+        float b = srgb_to_linear(bgr.b) * WGM_OFFSET + WGM_EPSILON;
+        float g = srgb_to_linear(bgr.g) * WGM_OFFSET + WGM_EPSILON;
+        float r = srgb_to_linear(bgr.r) * WGM_OFFSET + WGM_EPSILON;
         rgb_to_spectral_scalar(b, g, r, out.channels);
         break;
     }
+    }
     return out;
 }
 
@@ -2777,6 +2872,11 @@ static float clampf(float x)
 static BGRf spectral_to_rgb(const float *spectral)
 {
     const float *aligned = DP_ASSUME_SIMD_ALIGNED(spectral);
+#ifdef DP_CPU_X64
+    if (DP_cpu_support >= DP_CPU_SUPPORT_SSE42) {
+        return spectral_to_rgb_sse42(aligned);
+    }
+#endif
     float b = T_MATRIX_B0 * aligned[0] + T_MATRIX_B1 * aligned[1]
             + T_MATRIX_B2 * aligned[2] + T_MATRIX_B3 * aligned[3]
             + T_MATRIX_B4 * aligned[4] + T_MATRIX_B5 * aligned[5]
@@ -2799,37 +2899,54 @@ static BGRf spectral_to_rgb(const float *spectral)
     };
 }
 
-static void mix_spectral_channels(const float *a, float *b, float fac_a,
-                                  float fac_b)
+// Weighted geometric mean mixing works by raising the channels to a power.
+// Since fastpow(x, p) is fastpow2(p * fastlog2(x)), the logarithms of the
+// brush color's channels can be taken just once instead of for every pixel.
+static DP_Spectral spectral_log2(const float *spectral)
+{
+    const float *aligned = DP_ASSUME_SIMD_ALIGNED(spectral);
+    DP_Spectral out;
+    for (int i = 0; i < 10; ++i) {
+        out.channels[i] = fastlog2(aligned[i]);
+    }
+    return out;
+}
+
+static void mix_spectral_channels_log2(const float *log2_a, float *b,
+                                       float fac_a, float fac_b)
 {
-    const float *aligned_a = DP_ASSUME_SIMD_ALIGNED(a);
+    const float *aligned_log2_a = DP_ASSUME_SIMD_ALIGNED(log2_a);
     float *aligned_b = DP_ASSUME_SIMD_ALIGNED(b);
-    aligned_b[0] = fastpow(aligned_a[0], fac_a) * fastpow(aligned_b[0], fac_b);
-    aligned_b[1] = fastpow(aligned_a[1], fac_a) * fastpow(aligned_b[1], fac_b);
-    aligned_b[2] = fastpow(aligned_a[2], fac_a) * fastpow(aligned_b[2], fac_b);
-    aligned_b[3] = fastpow(aligned_a[3], fac_a) * fastpow(aligned_b[3], fac_b);
-    aligned_b[4] = fastpow(aligned_a[4], fac_a) * fastpow(aligned_b[4], fac_b);
-    aligned_b[5] = fastpow(aligned_a[5], fac_a) * fastpow(aligned_b[5], fac_b);
-    aligned_b[6] = fastpow(aligned_a[6], fac_a) * fastpow(aligned_b[6], fac_b);
-    aligned_b[7] = fastpow(aligned_a[7], fac_a) * fastpow(aligned_b[7], fac_b);
-    aligned_b[8] = fastpow(aligned_a[8], fac_a) * fastpow(aligned_b[8], fac_b);
-    aligned_b[9] = fastpow(aligned_a[9], fac_a) * fastpow(aligned_b[9], fac_b);
-}
-
-static DP_Spectral mix_spectral(DP_Pixel15 dp, const float *channels_a,
+    int i = 0;
+#ifdef DP_CPU_X64
+    if (DP_cpu_support >= DP_CPU_SUPPORT_SSE42) {
+        mix_spectral_channels_log2_sse42(aligned_log2_a, aligned_b, fac_a,
+                                         fac_b);
+        i = 8;
+    }
+#endif
+    for (; i < 10; ++i) {
+        aligned_b[i] = fastpow2(fac_a * aligned_log2_a[i])
+                     * fastpow(aligned_b[i], fac_b);
+    }
+}
+
+static DP_Spectral mix_spectral(DP_Pixel15 dp, const float *log2_channels_a,
                                 Fix15 ab, Fix15 aso)
 {
     float fac_a = (float)aso / (float)(aso + (DP_BIT15 - aso) * ab / BIT15_FIX);
     float fac_b = 1.0f - fac_a;
     DP_Spectral spectral_b = pixel15_to_spectral(dp);
-    mix_spectral_channels(channels_a, spectral_b.channels, fac_a, fac_b);
+    mix_spectral_channels_log2(log2_channels_a, spectral_b.channels, fac_a,
+                               fac_b);
     return spectral_b;
 }
 
-static BGRf blend_pigment_mask(DP_Pixel15 dp, const float *spectral_b_channels,
-                               Fix15 ab, Fix15 aso)
+static BGRf blend_pigment_mask(DP_Pixel15 dp,
+                               const float *log2_spectral_b_channels, Fix15 ab,
+                               Fix15 aso)
 {
-    DP_Spectral spectral = mix_spectral(dp, spectral_b_channels, ab, aso);
+    DP_Spectral spectral = mix_spectral(dp, log2_spectral_b_channels, ab, aso);
     return spectral_to_rgb(spectral.channels);
 }
 
@@ -2879,9 +2996,10 @@ static void blend_mask_pigment(DP_Pixel15 *dst, DP_UPixel15 src,
     DP_Spectral spectral_b = rgb_to_spectral(
         (BGRf){(float)src.b / BIT15_FLOAT, (float)src.g / BIT15_FLOAT,
                (float)src.r / BIT15_FLOAT});
+    DP_Spectral log2_spectral_b = spectral_log2(spectral_b.channels);
     FOR_MASK_PIXEL_M(dst, mask, opacity, w, h, mask_skip, base_skip, x, y, as, {
         BLEND_MASK_SPACE_FLOAT_PRESERVE(blend_pigment_mask,
-                                        spectral_b.channels);
+                                        log2_spectral_b.channels);
     });
 }
 
@@ -2923,15 +3041,60 @@ static void blend_mask_pigment_alpha(DP_Pixel15 *dst, DP_UPixel15 src,
     DP_Spectral spectral_b = rgb_to_spectral(
         (BGRf){(float)src.b / BIT15_FLOAT, (float)src.g / BIT15_FLOAT,
                (float)src.r / BIT15_FLOAT});
+    DP_Spectral log2_spectral_b = spectral_log2(spectral_b.channels);
     FOR_MASK_PIXEL_M(dst, mask, opacity, w, h, mask_skip, base_skip, x, y, as, {
-        BLEND_MASK_SPACE_FLOAT_ALPHA(blend_pigment_mask, spectral_b.channels);
+        BLEND_MASK_SPACE_FLOAT_ALPHA(blend_pigment_mask,
+                                     log2_spectral_b.channels);
     });
 }
 // SPDX-SnippetEnd
 
+// Linear values of every 15 bit sRGB channel value. OKLab blending converts
+// every destination pixel, so this saves a bunch of power approximations. The
+// table is filled using srgb_to_linear, so the results are exactly the same.
+#define SRGB_TO_LINEAR_LUT_SIZE (DP_BIT15 + 1)
+
+static float *generate_srgb_to_linear_lut(void)
+{
+    DP_debug("Generating sRGB to linear lookup table");
+    float *lut = DP_malloc(sizeof(*lut) * SRGB_TO_LINEAR_LUT_SIZE);
+    for (int i = 0; i < SRGB_TO_LINEAR_LUT_SIZE; ++i) {
+        lut[i] = srgb_to_linear((float)i / BIT15_FLOAT);
+    }
+    return lut;
+}
+
+static const float *get_srgb_to_linear_lut(void)
+{
+    DP_ATOMIC_DECLARE_STATIC_SPIN_LOCK(lock);
+    static float *srgb_to_linear_lut;
+    float *lut = srgb_to_linear_lut;
+    if (lut) {
+        return lut;
+    }
+    else {
+        DP_atomic_lock(&lock);
+        lut = srgb_to_linear_lut;
+        if (!lut) {
+            lut = generate_srgb_to_linear_lut();
+            srgb_to_linear_lut = lut;
+        }
+        DP_atomic_unlock(&lock);
+        return lut;
+    }
+}
+
+static float channel_to_linear(Fix15 c)
+{
+    // Out-of-range values don't happen with valid pixels, but don't explode.
+    return c < SRGB_TO_LINEAR_LUT_SIZE
+             ? get_srgb_to_linear_lut()[c]
+             : srgb_to_linear((float)c / BIT15_FLOAT);
+}
+
 static float channel_unpremultiply_to_linear(Fix15 c, Fix15 a)
 {
-    return srgb_to_linear((float)(c * BIT15_FIX / a) / BIT15_FLOAT);
+    return channel_to_linear(c * BIT15_FIX / a);
 }
 
 static BGRf pixel_unpremultiply_to_linear(DP_Pixel15 p, Fix15 a)
@@ -2952,6 +3115,15 @@ static BGRf bgra_unpremultiply_to_linear(BGRA15 bgra)
     };
 }
 
+static Lab upixel15_to_oklab(DP_UPixel15 src)
+{
+    return linear_srgb_to_oklab((BGRf){
+        channel_to_linear(to_fix(src.b)),
+        channel_to_linear(to_fix(src.g)),
+        channel_to_linear(to_fix(src.r)),
+    });
+}
+
 static BGRf mix_oklab(Lab dst_okl, Lab src_okl, Fix15 ab, Fix15 aso)
 {
     float dst_a = (float)ab / BIT15_FLOAT;
@@ -2979,16 +3151,10 @@ static BGRf blend_oklab_mask(DP_Pixel15 dp, Lab src_okl, Fix15 ab, Fix15 aso)
 }
 
 static void blend_mask_pixels_oklab(DP_Pixel15 *dst, DP_UPixel15 src,
-                                     const uint16_t *mask, Fix15 opacity,
-                                     int count)
+                                     Lab src_okl, const uint16_t *mask,
+                                     Fix15 opacity, int count)
 {
     BGR15 cs = to_ubgr(src);
-    Lab src_okl = linear_srgb_to_oklab(
-        (BGRf){srgb_to_linear((float)cs.b / BIT15_FLOAT),
-               srgb_to_linear((float)cs.g / BIT15_FLOAT),
-               srgb_to_linear((float)cs.r / BIT15_FLOAT)});
-
-    
     for (int x = 0; x < count; ++x, ++dst, ++mask) {
         Fix15 as = *mask;
         BLEND_MASK_SPACE_FLOAT_ALPHA(blend_oklab_mask, src_okl);        
@@ -2996,17 +3162,10 @@ static void blend_mask_pixels_oklab(DP_Pixel15 *dst, DP_UPixel15 src,
 }
 
 static void blend_mask_pixels_oklab_recolor(DP_Pixel15 *dst, DP_UPixel15 src,
-                                     const uint16_t *mask, Fix15 opacity,
-                                     int count)
+                                     Lab src_okl, const uint16_t *mask,
+                                     Fix15 opacity, int count)
 {
-
     BGR15 cs = to_ubgr(src);
-    Lab src_okl = linear_srgb_to_oklab(
-        (BGRf){srgb_to_linear((float)cs.b / BIT15_FLOAT),
-               srgb_to_linear((float)cs.g / BIT15_FLOAT),
-               srgb_to_linear((float)cs.r / BIT15_FLOAT)});
-
-    
     for (int x = 0; x < count; ++x, ++dst, ++mask) {
         Fix15 as = *mask;
         BLEND_MASK_SPACE_FLOAT_PRESERVE(blend_oklab_mask, src_okl);        
@@ -3015,15 +3174,11 @@ static void blend_mask_pixels_oklab_recolor(DP_Pixel15 *dst, DP_UPixel15 src,
 
 
 static void blend_mask_pixels_oklab_normal_and_eraser(DP_Pixel15 *dst, DP_UPixel15 src,
-                                     const uint16_t *mask, Fix15 opacity,
-                                     int count)
+                                     Lab src_okl, const uint16_t *mask,
+                                     Fix15 opacity, int count)
 {
     Fix15 erase_alpha = from_fix(src.a);
     BGR15 cs = to_ubgr(src);
-    Lab src_okl = linear_srgb_to_oklab(
-        (BGRf){srgb_to_linear((float)src.b / BIT15_FLOAT),
-               srgb_to_linear((float)src.g / BIT15_FLOAT),
-               srgb_to_linear((float)src.r / BIT15_FLOAT)});
 
     for (int x = 0; x < count; ++x, ++dst, ++mask) {
     // FOR_MASK_PIXEL_M(dst, mask, opacity, w, h, mask_skip, base_skip, x, y, as, {
@@ -3163,7 +3318,19 @@ static void mix_oklab_sse42(
     *out_a = _mm_max_ps(_mm_min_ps(mix_a, one), zero);
 }
 
-static void blend_mask_pixels_oklab_sse42(DP_Pixel15 *dst, DP_UPixel15 src,
+// The brush color gets converted once per blend call rather than once per row.
+// The SIMD variants don't round exactly like the scalar code, so they each
+// convert it with their own routine to match their per-pixel conversions.
+static Lab upixel15_to_oklab_sse42(DP_UPixel15 src)
+{
+    __m128 okl, oka, okb, a;
+    pixels_to_oklaba_sse42(_mm_set1_epi32(src.b), _mm_set1_epi32(src.g),
+                           _mm_set1_epi32(src.r), _mm_set1_epi32(DP_BIT15),
+                           &okl, &oka, &okb, &a);
+    return (Lab){_mm_cvtss_f32(okl), _mm_cvtss_f32(oka), _mm_cvtss_f32(okb)};
+}
+
+static void blend_mask_pixels_oklab_sse42(DP_Pixel15 *dst, Lab src_oklab,
                                           const uint16_t *mask_int,
                                           Fix15 opacity_int, int count)
 {
@@ -3171,17 +3338,10 @@ static void blend_mask_pixels_oklab_sse42(DP_Pixel15 *dst, DP_UPixel15 src,
     DP_ASSERT(count % 4 == 0);
     const __m128 bit15 = _mm_set1_ps( BIT15_FLOAT);
 
-    // Do in parent function ?
-    __m128i srcB = _mm_set1_epi32(src.b);
-    __m128i srcG = _mm_set1_epi32(src.g);
-    __m128i srcR = _mm_set1_epi32(src.r);
-    __m128i srcA = _mm_set1_epi32(DP_BIT15);
-
-    __m128 src_okl, src_oka, src_okb, src_a;
-    pixels_to_oklaba_sse42(
-        srcB, srcG, srcR, srcA,
-        &src_okl, &src_oka, &src_okb, &src_a
-    );
+    __m128 src_okl = _mm_set1_ps(src_oklab.L);
+    __m128 src_oka = _mm_set1_ps(src_oklab.a);
+    __m128 src_okb = _mm_set1_ps(src_oklab.b);
+    __m128 src_a = _mm_set1_ps(1.0f);
     
     __m128i opacity = _mm_set1_epi32((int)opacity_int);
 
@@ -3221,7 +3381,7 @@ static void blend_mask_pixels_oklab_sse42(DP_Pixel15 *dst, DP_UPixel15 src,
 }
 
 
-static void blend_mask_pixels_oklab_recolor_sse42(DP_Pixel15 *dst, DP_UPixel15 src,
+static void blend_mask_pixels_oklab_recolor_sse42(DP_Pixel15 *dst, Lab src_oklab,
                                           const uint16_t *mask_int,
                                           Fix15 opacity_int, int count)
 {
@@ -3229,17 +3389,10 @@ static void blend_mask_pixels_oklab_recolor_sse42(DP_Pixel15 *dst, DP_UPixel15 s
     DP_ASSERT(count % 4 == 0);
     const __m128 bit15 = _mm_set1_ps( BIT15_FLOAT);
 
-    // Do in parent function ?
-    __m128i srcB = _mm_set1_epi32(src.b);
-    __m128i srcG = _mm_set1_epi32(src.g);
-    __m128i srcR = _mm_set1_epi32(src.r);
-    __m128i srcA = _mm_set1_epi32(DP_BIT15);
-
-    __m128 src_okl, src_oka, src_okb, src_a;
-    pixels_to_oklaba_sse42(
-        srcB, srcG, srcR, srcA,
-        &src_okl, &src_oka, &src_okb, &src_a
-    );
+    __m128 src_okl = _mm_set1_ps(src_oklab.L);
+    __m128 src_oka = _mm_set1_ps(src_oklab.a);
+    __m128 src_okb = _mm_set1_ps(src_oklab.b);
+    __m128 src_a = _mm_set1_ps(1.0f);
     
     __m128i opacity = _mm_set1_epi32((int)opacity_int);
 
@@ -3279,21 +3432,17 @@ static void blend_mask_pixels_oklab_recolor_sse42(DP_Pixel15 *dst, DP_UPixel15 s
 }
 
 static void blend_mask_pixels_oklab_normal_and_eraser_sse42(DP_Pixel15 *dst, DP_UPixel15 src,
+                                                            Lab src_oklab,
                                                             const uint16_t *mask_int, Fix15 opacity_int,
                                                             int count)
 {
     DP_ASSERT(count % 4 == 0);
     const __m128 bit15f = _mm_set1_ps(BIT15_FLOAT);
 
-    __m128i srcB = _mm_set1_epi32(src.b);
-    __m128i srcG = _mm_set1_epi32(src.g);
-    __m128i srcR = _mm_set1_epi32(src.r);
-    __m128i srcA = _mm_set1_epi32(DP_BIT15);
-
-    __m128 src_okl, src_oka, src_okb, src_a;
-    pixels_to_oklaba_sse42(
-        srcB, srcG, srcR, srcA,
-        &src_okl, &src_oka, &src_okb, &src_a);
+    __m128 src_okl = _mm_set1_ps(src_oklab.L);
+    __m128 src_oka = _mm_set1_ps(src_oklab.a);
+    __m128 src_okb = _mm_set1_ps(src_oklab.b);
+    __m128 src_a = _mm_set1_ps(1.0f);
 
     __m128i erase_alpha = _mm_set1_epi32(src.a);
     __m128i opacity = _mm_set1_epi32((int)opacity_int);
@@ -3451,7 +3600,17 @@ static void mix_oklab_avx2(
     }
 
 
-static void blend_mask_pixels_oklab_avx2(DP_Pixel15 *dst, DP_UPixel15 src,
+static Lab upixel15_to_oklab_avx2(DP_UPixel15 src)
+{
+    __m256 okl, oka, okb, a;
+    pixels_to_oklaba_avx2(_mm256_set1_epi32(src.b), _mm256_set1_epi32(src.g),
+                          _mm256_set1_epi32(src.r), _mm256_set1_epi32(DP_BIT15),
+                          &okl, &oka, &okb, &a);
+    return (Lab){_mm256_cvtss_f32(okl), _mm256_cvtss_f32(oka),
+                 _mm256_cvtss_f32(okb)};
+}
+
+static void blend_mask_pixels_oklab_avx2(DP_Pixel15 *dst, Lab src_oklab,
                                           const uint16_t *mask_int,
                                           Fix15 opacity_int, int count)
 {
@@ -3459,17 +3618,10 @@ static void blend_mask_pixels_oklab_avx2(DP_Pixel15 *dst, DP_UPixel15 src,
     DP_ASSERT(count % 8 == 0);
     const __m256 bit15 = _mm256_set1_ps( BIT15_FLOAT);
 
-    // Do in parent function ?
-    __m256i srcB = _mm256_set1_epi32(src.b);
-    __m256i srcG = _mm256_set1_epi32(src.g);
-    __m256i srcR = _mm256_set1_epi32(src.r);
-    __m256i srcA = _mm256_set1_epi32(DP_BIT15);
-
-    __m256 src_okl, src_oka, src_okb, src_a;
-    pixels_to_oklaba_avx2(
-        srcB, srcG, srcR, srcA,
-        &src_okl, &src_oka, &src_okb, &src_a
-    );
+    __m256 src_okl = _mm256_set1_ps(src_oklab.L);
+    __m256 src_oka = _mm256_set1_ps(src_oklab.a);
+    __m256 src_okb = _mm256_set1_ps(src_oklab.b);
+    __m256 src_a = _mm256_set1_ps(1.0f);
     
     __m256i opacity = _mm256_set1_epi32((int)opacity_int);
 
@@ -3514,7 +3666,7 @@ static void blend_mask_pixels_oklab_avx2(DP_Pixel15 *dst, DP_UPixel15 src,
     // clang-format on
 }
 
-static void blend_mask_pixels_oklab_recolor_avx2(DP_Pixel15 *dst, DP_UPixel15 src,
+static void blend_mask_pixels_oklab_recolor_avx2(DP_Pixel15 *dst, Lab src_oklab,
                                           const uint16_t *mask_int,
                                           Fix15 opacity_int, int count)
 {
@@ -3522,17 +3674,10 @@ static void blend_mask_pixels_oklab_recolor_avx2(DP_Pixel15 *dst, DP_UPixel15 sr
     DP_ASSERT(count % 8 == 0);
     const __m256 bit15 = _mm256_set1_ps( BIT15_FLOAT);
 
-    // Do in parent function ?
-    __m256i srcB = _mm256_set1_epi32(src.b);
-    __m256i srcG = _mm256_set1_epi32(src.g);
-    __m256i srcR = _mm256_set1_epi32(src.r);
-    __m256i srcA = _mm256_set1_epi32(DP_BIT15);
-
-    __m256 src_okl, src_oka, src_okb, src_a;
-    pixels_to_oklaba_avx2(
-        srcB, srcG, srcR, srcA,
-        &src_okl, &src_oka, &src_okb, &src_a
-    );
+    __m256 src_okl = _mm256_set1_ps(src_oklab.L);
+    __m256 src_oka = _mm256_set1_ps(src_oklab.a);
+    __m256 src_okb = _mm256_set1_ps(src_oklab.b);
+    __m256 src_a = _mm256_set1_ps(1.0f);
     
     __m256i opacity = _mm256_set1_epi32((int)opacity_int);
 
@@ -3574,21 +3719,17 @@ static void blend_mask_pixels_oklab_recolor_avx2(DP_Pixel15 *dst, DP_UPixel15 sr
 }
 
 static void blend_mask_pixels_oklab_normal_and_eraser_avx2(DP_Pixel15 *dst, DP_UPixel15 src,
+                                                            Lab src_oklab,
                                                             const uint16_t *mask_int, Fix15 opacity_int,
                                                             int count)
 {
     DP_ASSERT(count % 8 == 0);
     const __m256 bit15f = _mm256_set1_ps(BIT15_FLOAT);
 
-    __m256i srcB = _mm256_set1_epi32(src.b);
-    __m256i srcG = _mm256_set1_epi32(src.g);
-    __m256i srcR = _mm256_set1_epi32(src.r);
-    __m256i srcA = _mm256_set1_epi32(DP_BIT15);
-
-    __m256 src_okl, src_oka, src_okb, src_a;
-    pixels_to_oklaba_avx2(
-        srcB, srcG, srcR, srcA,
-        &src_okl, &src_oka, &src_okb, &src_a);
+    __m256 src_okl = _mm256_set1_ps(src_oklab.L);
+    __m256 src_oka = _mm256_set1_ps(src_oklab.a);
+    __m256 src_okb = _mm256_set1_ps(src_oklab.b);
+    __m256 src_a = _mm256_set1_ps(1.0f);
 
     __m256i erase_alpha = _mm256_set1_epi32(src.a);
     __m256i opacity = _mm256_set1_epi32((int)opacity_int);
@@ -3636,10 +3777,36 @@ DP_TARGET_END
 #endif
 
 
+// The brush color in OKLab for each code path, see upixel15_to_oklab_sse42.
+typedef struct OklabSource {
+    Lab scalar;
+#ifdef DP_CPU_X64
+    Lab sse42;
+    Lab avx2;
+#endif
+} OklabSource;
+
+static OklabSource oklab_source_make(DP_UPixel15 src)
+{
+    OklabSource os;
+    os.scalar = upixel15_to_oklab(src);
+#ifdef DP_CPU_X64
+    os.sse42 = DP_cpu_support >= DP_CPU_SUPPORT_SSE42
+                 ? upixel15_to_oklab_sse42(src)
+                 : os.scalar;
+    os.avx2 = DP_cpu_support >= DP_CPU_SUPPORT_AVX2
+                ? upixel15_to_oklab_avx2(src)
+                : os.sse42;
+#endif
+    return os;
+}
+
+
 static void blend_mask_oklab_normal(DP_Pixel15 *dst, DP_UPixel15 src,
                               const uint16_t *mask, Fix15 opacity, int w, int h,
                               int mask_skip, int base_skip)
 {
+    OklabSource os = oklab_source_make(src);
 #ifdef DP_CPU_X64
     for (int y = 0; y < h; ++y) {
         int remaining = w;
@@ -3648,7 +3815,7 @@ static void blend_mask_oklab_normal(DP_Pixel15 *dst, DP_UPixel15 src,
             int remaining_after_avx_width = remaining % 8;
             int avx_width = remaining - remaining_after_avx_width;
 
-            blend_mask_pixels_oklab_avx2(dst, src, mask, opacity, avx_width);
+            blend_mask_pixels_oklab_avx2(dst, os.avx2, mask, opacity, avx_width);
 
             remaining -= avx_width;
             dst += avx_width;
@@ -3659,14 +3826,14 @@ static void blend_mask_oklab_normal(DP_Pixel15 *dst, DP_UPixel15 src,
             int remaining_after_sse_width = remaining % 4;
             int sse_width = remaining - remaining_after_sse_width;
 
-            blend_mask_pixels_oklab_sse42(dst, src, mask, opacity, sse_width);
+            blend_mask_pixels_oklab_sse42(dst, os.sse42, mask, opacity, sse_width);
 
             remaining -= sse_width;
             dst += sse_width;
             mask += sse_width;
         }
 
-        blend_mask_pixels_oklab(dst, src, mask, opacity, remaining);
+        blend_mask_pixels_oklab(dst, src, os.scalar, mask, opacity, remaining);
         dst += remaining;
         mask += remaining;
 
@@ -3675,7 +3842,7 @@ static void blend_mask_oklab_normal(DP_Pixel15 *dst, DP_UPixel15 src,
     }
 #else
     for (int y = 0; y < h; ++y) {
-        blend_mask_pixels_oklab(dst, src, mask, opacity, w);
+        blend_mask_pixels_oklab(dst, src, os.scalar, mask, opacity, w);
 
         dst += w + base_skip;
         mask += w + mask_skip;
@@ -3688,6 +3855,7 @@ static void blend_mask_oklab_recolor(DP_Pixel15 *dst, DP_UPixel15 src,
                               const uint16_t *mask, Fix15 opacity, int w, int h,
                               int mask_skip, int base_skip)
 {
+    OklabSource os = oklab_source_make(src);
 #ifdef DP_CPU_X64
     for (int y = 0; y < h; ++y) {
         int remaining = w;
@@ -3696,7 +3864,7 @@ static void blend_mask_oklab_recolor(DP_Pixel15 *dst, DP_UPixel15 src,
             int remaining_after_avx_width = remaining % 8;
             int avx_width = remaining - remaining_after_avx_width;
 
-            blend_mask_pixels_oklab_recolor_avx2(dst, src, mask, opacity, avx_width);
+            blend_mask_pixels_oklab_recolor_avx2(dst, os.avx2, mask, opacity, avx_width);
 
             remaining -= avx_width;
             dst += avx_width;
@@ -3707,14 +3875,14 @@ static void blend_mask_oklab_recolor(DP_Pixel15 *dst, DP_UPixel15 src,
             int remaining_after_sse_width = remaining % 4;
             int sse_width = remaining - remaining_after_sse_width;
 
-            blend_mask_pixels_oklab_recolor_sse42(dst, src, mask, opacity, sse_width);
+            blend_mask_pixels_oklab_recolor_sse42(dst, os.sse42, mask, opacity, sse_width);
 
             remaining -= sse_width;
             dst += sse_width;
             mask += sse_width;
         }
 
-        blend_mask_pixels_oklab_recolor(dst, src, mask, opacity, remaining);
+        blend_mask_pixels_oklab_recolor(dst, src, os.scalar, mask, opacity, remaining);
         dst += remaining;
         mask += remaining;
 
@@ -3723,7 +3891,7 @@ static void blend_mask_oklab_recolor(DP_Pixel15 *dst, DP_UPixel15 src,
     }
 #else
     for (int y = 0; y < h; ++y) {
-        blend_mask_pixels_oklab_recolor(dst, src, mask, opacity, w);
+        blend_mask_pixels_oklab_recolor(dst, src, os.scalar, mask, opacity, w);
 
         dst += w + base_skip;
         mask += w + mask_skip;
@@ -4132,6 +4300,7 @@ static void blend_mask_pigment_and_eraser(DP_Pixel15 *dst, DP_UPixel15 src,
     DP_Spectral spectral_a = rgb_to_spectral(
         (BGRf){(float)src.b / BIT15_FLOAT, (float)src.g / BIT15_FLOAT,
                (float)src.r / BIT15_FLOAT});
+    DP_Spectral log2_spectral_a = spectral_log2(spectral_a.channels);
 
     // pigment-mode does not like very low opacity, probably due to rounding
     // errors with int->float->int round-trip.
@@ -4179,8 +4348,8 @@ static void blend_mask_pigment_and_eraser(DP_Pixel15 *dst, DP_UPixel15 src,
             float fac_b = 1.0f - fac_a;
 
             // Mix input and tile pixel colors using WGM (into spectral_b)
-            mix_spectral_channels(spectral_a.channels, spectral_b.channels,
-                                  fac_a, fac_b);
+            mix_spectral_channels_log2(log2_spectral_a.channels,
+                                       spectral_b.channels, fac_a, fac_b);
 
             // Convert back to RGB
             BGRf s = spectral_to_rgb(spectral_b.channels);
@@ -4210,6 +4379,7 @@ static void blend_mask_oklab_normal_and_eraser(DP_Pixel15 *dst, DP_UPixel15 src,
                                          int w, int h, int mask_skip,
                                          int base_skip)
 {
+    OklabSource os = oklab_source_make(src);
 #ifdef DP_CPU_X64
     for (int y = 0; y < h; ++y) {
         int remaining = w;
@@ -4218,7 +4388,7 @@ static void blend_mask_oklab_normal_and_eraser(DP_Pixel15 *dst, DP_UPixel15 src,
             int remaining_after_avx_width = remaining % 8;
             int avx_width = remaining - remaining_after_avx_width;
 
-            blend_mask_pixels_oklab_normal_and_eraser_avx2(dst, src, mask, opacity,
+            blend_mask_pixels_oklab_normal_and_eraser_avx2(dst, src, os.avx2, mask, opacity,
                                                      avx_width);
 
             remaining -= avx_width;
@@ -4230,7 +4400,7 @@ static void blend_mask_oklab_normal_and_eraser(DP_Pixel15 *dst, DP_UPixel15 src,
             int remaining_after_sse_width = remaining % 4;
             int sse_width = remaining - remaining_after_sse_width;
 
-            blend_mask_pixels_oklab_normal_and_eraser_sse42(dst, src, mask, opacity,
+            blend_mask_pixels_oklab_normal_and_eraser_sse42(dst, src, os.sse42, mask, opacity,
                                                       sse_width);
 
             remaining -= sse_width;
@@ -4238,7 +4408,7 @@ static void blend_mask_oklab_normal_and_eraser(DP_Pixel15 *dst, DP_UPixel15 src,
             mask += sse_width;
         }
 
-        blend_mask_pixels_oklab_normal_and_eraser(dst, src, mask, opacity, remaining);
+        blend_mask_pixels_oklab_normal_and_eraser(dst, src, os.scalar, mask, opacity, remaining);
         dst += remaining;
         mask += remaining;
 
@@ -4247,7 +4417,7 @@ static void blend_mask_oklab_normal_and_eraser(DP_Pixel15 *dst, DP_UPixel15 src,
     }
 #else
     for (int y = 0; y < h; ++y) {
-        blend_mask_pixels_oklab_normal_and_eraser(dst, src, mask, opacity, w);
+        blend_mask_pixels_oklab_normal_and_eraser(dst, src, os.scalar, mask, opacity, w);
 
         dst += w + base_skip;
         mask += w + mask_skip;
@@ -5251,7 +5421,9 @@ static BGRf blend_pigment_pixel(DP_Pixel15 dp, DP_Pixel15 sp, Fix15 ab,
                                 DP_UNUSED Fix15 as, Fix15 aso)
 {
     DP_Spectral spectral_a = pixel15_to_spectral(sp);
-    DP_Spectral spectral_b = mix_spectral(dp, spectral_a.channels, ab, aso);
+    DP_Spectral log2_spectral_a = spectral_log2(spectral_a.channels);
+    DP_Spectral spectral_b =
+        mix_spectral(dp, log2_spectral_a.channels, ab, aso);
     return spectral_to_rgb(spectral_b.channels);
 }
 // SPDX-SnippetEnd
@@ -70,9 +70,12 @@ struct DP_Player {
 static void player_index_dispose(DP_PlayerIndex *pi)
 {
     DP_ASSERT(pi);
+    if (pi->tile_worker_free) {
+        pi->tile_worker_free(pi->tile_worker);
+    }
     DP_free(pi->entries);
     DP_buffered_input_dispose(&pi->input);
-    *pi = (DP_PlayerIndex){DP_BUFFERED_INPUT_NULL, 0, NULL, 0};
+    *pi = (DP_PlayerIndex){DP_BUFFERED_INPUT_NULL, 0, NULL, 0, NULL, NULL};
 }
 
 
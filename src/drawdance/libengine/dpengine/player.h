@@ -79,6 +79,10 @@ typedef struct DP_PlayerIndex {
     unsigned int message_count;
     DP_PlayerIndexEntry *entries;
     size_t entry_count;
+    // Threads for decompressing snapshot tiles, created by the index loader on
+    // first use and kept around for subsequent loads. Freed with the index.
+    void *tile_worker;
+    void (*tile_worker_free)(void *tile_worker);
 } DP_PlayerIndex;
 
 
@@ -539,7 +539,7 @@ static int preview_dabs_blend_mode(DP_Message *msg)
 static int preview_dabs_selection_id(int selection_id)
 {
     if (selection_id == 0 || selection_id < DP_SELECTION_ID_FIRST_REMOTE
-        || selection_id > UINT8_MAX) {
+        || selection_id > DP_SELECTION_ID_LAST_REMOTE) {
         return 0;
     }
     else {
@@ -0,0 +1,286 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include "sample_cache.h"
+#include "pixels.h"
+#include "tile.h"
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+
+#define MIN_DIAMETER   32
+#define LARGE_DIAMETER 96
+
+#define SMALL_BLOCK_SIZE  4
+#define SMALL_BLOCK_COUNT (DP_TILE_SIZE / SMALL_BLOCK_SIZE)
+#define LARGE_BLOCK_SIZE  8
+#define LARGE_BLOCK_COUNT (DP_TILE_SIZE / LARGE_BLOCK_SIZE)
+
+// A summary is about 11.5 KB, so this caps the cache at around 6 MB. A stroke
+// covering more tiles than this starts over with an empty cache.
+#define MAX_SUMMARIES 512
+
+// Same cutoff as the exact sampling uses, low alpha values are disregarded
+// in opaque mode because their unpremultiplied colors are too inaccurate.
+#define OPAQUE_THRESHOLD 512
+
+typedef struct DP_SampleBlock {
+    uint32_t red, green, blue, alpha;
+    uint32_t opaque_count;
+    uint32_t opaque_red, opaque_green, opaque_blue, opaque_alpha;
+} DP_SampleBlock;
+
+typedef struct DP_SampleSummary {
+    DP_SampleBlock small[SMALL_BLOCK_COUNT * SMALL_BLOCK_COUNT];
+    DP_SampleBlock large[LARGE_BLOCK_COUNT * LARGE_BLOCK_COUNT];
+} DP_SampleSummary;
+
+typedef struct DP_SampleCacheEntry {
+    DP_Tile *tile;
+    DP_SampleSummary *summary;
+} DP_SampleCacheEntry;
+
+struct DP_SampleCache {
+    int tile_count;
+    int summary_count;
+    DP_SampleCacheEntry *entries;
+};
+
+
+DP_SampleCache *DP_sample_cache_new(void)
+{
+    DP_SampleCache *sc = DP_malloc(sizeof(*sc));
+    *sc = (DP_SampleCache){0, 0, NULL};
+    return sc;
+}
+
+static void clear_summaries(DP_SampleCache *sc)
+{
+    int tile_count = sc->tile_count;
+    for (int i = 0; i < tile_count; ++i) {
+        DP_SampleCacheEntry *entry = &sc->entries[i];
+        DP_tile_decref_nullable(entry->tile);
+        DP_free(entry->summary);
+        entry->tile = NULL;
+        entry->summary = NULL;
+    }
+    sc->summary_count = 0;
+}
+
+void DP_sample_cache_clear(DP_SampleCache *sc_or_null)
+{
+    if (sc_or_null) {
+        clear_summaries(sc_or_null);
+        DP_free(sc_or_null->entries);
+        sc_or_null->tile_count = 0;
+        sc_or_null->entries = NULL;
+    }
+}
+
+void DP_sample_cache_free(DP_SampleCache *sc)
+{
+    if (sc) {
+        DP_sample_cache_clear(sc);
+        DP_free(sc);
+    }
+}
+
+int DP_sample_cache_summary_count(DP_SampleCache *sc)
+{
+    DP_ASSERT(sc);
+    return sc->summary_count;
+}
+
+bool DP_sample_cache_applies(int diameter, bool pigment)
+{
+    return !pigment && diameter >= MIN_DIAMETER;
+}
+
+
+static void sum_block(DP_SampleBlock *dst, const DP_SampleBlock *src)
+{
+    dst->red += src->red;
+    dst->green += src->green;
+    dst->blue += src->blue;
+    dst->alpha += src->alpha;
+    dst->opaque_count += src->opaque_count;
+    dst->opaque_red += src->opaque_red;
+    dst->opaque_green += src->opaque_green;
+    dst->opaque_blue += src->opaque_blue;
+    dst->opaque_alpha += src->opaque_alpha;
+}
+
+static void summarize_tile(DP_SampleSummary *summary, DP_Tile *tile)
+{
+    memset(summary, 0, sizeof(*summary));
+
+    const DP_Pixel15 *pixels = DP_tile_pixels(tile);
+    for (int y = 0; y < DP_TILE_SIZE; ++y) {
+        DP_SampleBlock *row =
+            summary->small + (y / SMALL_BLOCK_SIZE) * SMALL_BLOCK_COUNT;
+        for (int x = 0; x < DP_TILE_SIZE; ++x) {
+            DP_Pixel15 p = pixels[y * DP_TILE_SIZE + x];
+            DP_SampleBlock *block = row + x / SMALL_BLOCK_SIZE;
+            block->red += p.r;
+            block->green += p.g;
+            block->blue += p.b;
+            block->alpha += p.a;
+            if (p.a > OPAQUE_THRESHOLD) {
+                ++block->opaque_count;
+                block->opaque_red += p.r;
+                block->opaque_green += p.g;
+                block->opaque_blue += p.b;
+                block->opaque_alpha += p.a;
+            }
+        }
+    }
+
+    int ratio = LARGE_BLOCK_SIZE / SMALL_BLOCK_SIZE;
+    for (int y = 0; y < SMALL_BLOCK_COUNT; ++y) {
+        for (int x = 0; x < SMALL_BLOCK_COUNT; ++x) {
+            sum_block(summary->large + (y / ratio) * LARGE_BLOCK_COUNT
+                          + x / ratio,
+                      summary->small + y * SMALL_BLOCK_COUNT + x);
+        }
+    }
+}
+
+static DP_SampleSummary *get_summary(DP_SampleCache *sc, DP_Tile *tile,
+                                     int tile_index, int tile_count)
+{
+    if (sc->tile_count != tile_count) {
+        DP_sample_cache_clear(sc);
+        sc->tile_count = tile_count;
+        sc->entries = DP_malloc_zeroed(DP_int_to_size(tile_count)
+                                       * sizeof(*sc->entries));
+    }
+
+    DP_ASSERT(tile_index >= 0);
+    DP_ASSERT(tile_index < tile_count);
+    DP_SampleCacheEntry *entry = &sc->entries[tile_index];
+    if (entry->tile != tile) {
+        if (!entry->summary) {
+            if (sc->summary_count >= MAX_SUMMARIES) {
+                clear_summaries(sc);
+            }
+            entry->summary = DP_malloc(sizeof(*entry->summary));
+            ++sc->summary_count;
+        }
+        DP_tile_decref_nullable(entry->tile);
+        entry->tile = DP_tile_incref(tile);
+        summarize_tile(entry->summary, tile);
+    }
+    return entry->summary;
+}
+
+static void sample_blocks(const DP_SampleBlock *blocks, int block_count,
+                          int block_size, const uint16_t *mask,
+                          int mask_stride, int x, int y, int width, int height,
+                          bool opaque, float *in_out_weight, float *in_out_red,
+                          float *in_out_green, float *in_out_blue,
+                          float *in_out_alpha)
+{
+    float weight = 0.0f;
+    float red = 0.0f;
+    float green = 0.0f;
+    float blue = 0.0f;
+    float alpha = 0.0f;
+    float bit15 = (float)DP_BIT15;
+    int half = block_size / 2;
+
+    // Each block whose center lies within the sampled area counts fully,
+    // weighted by the stamp value at that center. Since the area is split
+    // along tile boundaries, which are also block boundaries, every block
+    // under the stamp gets counted exactly once.
+    int by_end = (y + height - 1) / block_size;
+    int bx_end = (x + width - 1) / block_size;
+    for (int by = y / block_size; by <= by_end; ++by) {
+        int cy = by * block_size + half;
+        if (cy < y || cy >= y + height) {
+            continue;
+        }
+        for (int bx = x / block_size; bx <= bx_end; ++bx) {
+            int cx = bx * block_size + half;
+            if (cx < x || cx >= x + width) {
+                continue;
+            }
+
+            uint16_t m = mask[(cy - y) * mask_stride + (cx - x)];
+            const DP_SampleBlock *block = blocks + by * block_count + bx;
+            float fm = (float)m;
+            if (!opaque) {
+                weight += fm * (float)(block_size * block_size);
+                red += fm * (float)block->red / bit15;
+                green += fm * (float)block->green / bit15;
+                blue += fm * (float)block->blue / bit15;
+                alpha += fm * (float)block->alpha / bit15;
+            }
+            else if (m > OPAQUE_THRESHOLD) {
+                weight += fm * (float)block->opaque_count;
+                red += fm * (float)block->opaque_red / bit15;
+                green += fm * (float)block->opaque_green / bit15;
+                blue += fm * (float)block->opaque_blue / bit15;
+                alpha += fm * (float)block->opaque_alpha / bit15;
+            }
+        }
+    }
+
+    *in_out_weight += weight;
+    *in_out_red += red;
+    *in_out_green += green;
+    *in_out_blue += blue;
+    *in_out_alpha += alpha;
+}
+
+static void sample_blank(int block_size, const uint16_t *mask, int mask_stride,
+                         int x, int y, int width, int height,
+                         float *in_out_weight)
+{
+    float weight = 0.0f;
+    int half = block_size / 2;
+    int by_end = (y + height - 1) / block_size;
+    int bx_end = (x + width - 1) / block_size;
+    for (int by = y / block_size; by <= by_end; ++by) {
+        int cy = by * block_size + half;
+        if (cy < y || cy >= y + height) {
+            continue;
+        }
+        for (int bx = x / block_size; bx <= bx_end; ++bx) {
+            int cx = bx * block_size + half;
+            if (cx >= x && cx < x + width) {
+                weight += (float)mask[(cy - y) * mask_stride + (cx - x)];
+            }
+        }
+    }
+    *in_out_weight += weight * (float)(block_size * block_size);
+}
+
+void DP_sample_cache_sample(DP_SampleCache *sc, DP_Tile *tile_or_null,
+                            int tile_index, int tile_count,
+                            const uint16_t *mask, int mask_stride, int x,
+                            int y, int width, int height, int diameter,
+                            bool opaque, float *in_out_weight,
+                            float *in_out_red, float *in_out_green,
+                            float *in_out_blue, float *in_out_alpha)
+{
+    DP_ASSERT(sc);
+    DP_ASSERT(mask);
+    DP_ASSERT(x >= 0);
+    DP_ASSERT(y >= 0);
+    DP_ASSERT(width > 0);
+    DP_ASSERT(height > 0);
+    DP_ASSERT(x + width <= DP_TILE_SIZE);
+    DP_ASSERT(y + height <= DP_TILE_SIZE);
+    bool large = diameter >= LARGE_DIAMETER;
+    int block_size = large ? LARGE_BLOCK_SIZE : SMALL_BLOCK_SIZE;
+    if (tile_or_null) {
+        DP_SampleSummary *summary =
+            get_summary(sc, tile_or_null, tile_index, tile_count);
+        sample_blocks(large ? summary->large : summary->small,
+                      large ? LARGE_BLOCK_COUNT : SMALL_BLOCK_COUNT,
+                      block_size, mask, mask_stride, x, y, width, height,
+                      opaque, in_out_weight, in_out_red, in_out_green,
+                      in_out_blue, in_out_alpha);
+    }
+    else if (!opaque) {
+        sample_blank(block_size, mask, mask_stride, x, y, width, height,
+                     in_out_weight);
+    }
+}
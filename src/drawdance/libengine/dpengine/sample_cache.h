@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#ifndef DPENGINE_SAMPLE_CACHE_H
+#define DPENGINE_SAMPLE_CACHE_H
+#include <dpcommon/common.h>
+
+typedef struct DP_Tile DP_Tile;
+
+
+// Approximate color sampling for large dabs. Instead of reading every pixel
+// under the sampling stamp, tiles are summarized into blocks of pixel sums
+// and each block gets weighted by the stamp value at its center. Summaries
+// are built lazily and keyed on tile identity: tiles are immutable once
+// they're part of a canvas state, so a different tile pointer at the same
+// position means the contents changed and the summary is rebuilt.
+//
+// The results differ slightly from the exact sampling, so this is only for
+// local use, never for anything that needs to be reproducible on others'
+// machines. Pigment sampling isn't linear, so it's not covered by this.
+typedef struct DP_SampleCache DP_SampleCache;
+
+DP_SampleCache *DP_sample_cache_new(void);
+
+void DP_sample_cache_free(DP_SampleCache *sc);
+
+// Drops all summaries and the tiles they hold on to. The brush engine does
+// this at the end of every stroke, so the cache doesn't keep old canvas
+// contents alive. Within a stroke, the number of summaries is bounded too.
+void DP_sample_cache_clear(DP_SampleCache *sc_or_null);
+
+int DP_sample_cache_summary_count(DP_SampleCache *sc);
+
+// Whether sampling with the given diameter should use the cache at all. For
+// small dabs, reading the pixels is cheaper than looking up the summaries.
+bool DP_sample_cache_applies(int diameter, bool pigment);
+
+// Like DP_tile_sample, but using the summary of the given tile. The tile
+// index and count identify the tile's position on the layer, the cache is
+// cleared if the count changes. Mask points to the stamp value at the top-
+// left of the sampled area, with rows mask_stride values apart.
+void DP_sample_cache_sample(DP_SampleCache *sc, DP_Tile *tile_or_null,
+                            int tile_index, int tile_count,
+                            const uint16_t *mask, int mask_stride, int x,
+                            int y, int width, int height, int diameter,
+                            bool opaque, float *in_out_weight,
+                            float *in_out_red, float *in_out_green,
+                            float *in_out_blue, float *in_out_alpha);
+
+#endif
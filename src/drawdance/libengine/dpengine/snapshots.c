@@ -19,6 +19,7 @@
 #include "tile.h"
 #include "timeline.h"
 #include "track.h"
+#include <dpcommon/atomic.h>
 #include <dpcommon/common.h>
 #include <dpcommon/conversions.h>
 #include <dpcommon/output.h>
@@ -28,6 +29,7 @@
 #include <dpcommon/worker.h>
 #include <dpmsg/ids.h>
 #include <dpmsg/message.h>
+#include <uthash_inc.h>
 
 #define DP_PERF_CONTEXT "snapshots"
 
@@ -211,6 +213,193 @@ void DP_snapshot_queue_get_with(DP_SnapshotQueue *sq, DP_SnapshotsGetFn get_fn,
 }
 
 
+// Cache of compressed tile payloads, keyed by tile identity and compression.
+// Tiles in a canvas state are persistent, so as long as the cache holds a
+// reference to a tile, its pointer can't be reused and its content can't
+// change. Entries are kept in least-recently-used order via uthash's insertion
+// order, hits get re-inserted at the end and eviction happens from the front.
+// Tiles that are still part of a canvas state don't cost the cache anything
+// extra, so only the compressed data is charged for them. Tiles that only the
+// cache still holds onto are charged at their full size whenever the cache
+// gets rechecked, they're evicted first and get swept before each reset image.
+
+typedef enum DP_ResetImageCacheKind {
+    DP_RESET_IMAGE_CACHE_GZIP8BE,
+    DP_RESET_IMAGE_CACHE_ZSTD8LE,
+    DP_RESET_IMAGE_CACHE_MASK_ZSTD8LE,
+} DP_ResetImageCacheKind;
+
+typedef struct DP_ResetImageCacheKey {
+    DP_Tile *t;
+    DP_ResetImageCacheKind kind;
+} DP_ResetImageCacheKey;
+
+typedef struct DP_ResetImageCacheEntry {
+    UT_hash_handle hh;
+    DP_ResetImageCacheKey key;
+    bool stale;
+    size_t size;
+    unsigned char data[];
+} DP_ResetImageCacheEntry;
+
+#define RESET_IMAGE_CACHE_ENTRY_OVERHEAD \
+    (sizeof(DP_ResetImageCacheEntry) + sizeof(UT_hash_bucket))
+
+static struct {
+    DP_Mutex *mutex;
+    DP_ResetImageCacheEntry *entries;
+    size_t max_bytes;
+    size_t used_bytes;
+    unsigned long long hits;
+    unsigned long long misses;
+} reset_image_cache = {
+    NULL, NULL, DP_RESET_IMAGE_CACHE_MAX_BYTES_DEFAULT, 0, 0, 0};
+
+static DP_Mutex *reset_image_cache_mutex(void)
+{
+    DP_ATOMIC_DECLARE_STATIC_SPIN_LOCK(reset_image_cache_spinlock);
+    if (!reset_image_cache.mutex) {
+        DP_atomic_lock(&reset_image_cache_spinlock);
+        if (!reset_image_cache.mutex) {
+            reset_image_cache.mutex = DP_mutex_new();
+            if (!reset_image_cache.mutex) {
+                DP_warn("Failed to create reset image cache mutex: %s",
+                        DP_error());
+            }
+        }
+        DP_atomic_unlock(&reset_image_cache_spinlock);
+    }
+    return reset_image_cache.mutex;
+}
+
+static size_t reset_image_cache_entry_bytes(DP_ResetImageCacheEntry *entry)
+{
+    return RESET_IMAGE_CACHE_ENTRY_OVERHEAD + entry->size
+         + (entry->stale ? DP_TILE_BYTES : 0);
+}
+
+static void reset_image_cache_remove(DP_ResetImageCacheEntry *entry)
+{
+    HASH_DEL(reset_image_cache.entries, entry);
+    reset_image_cache.used_bytes -= reset_image_cache_entry_bytes(entry);
+    DP_tile_decref(entry->key.t);
+    DP_free(entry);
+}
+
+// Charges the full tile size for entries whose tile only the cache still
+// references and stops charging it for ones that got picked up again.
+static void reset_image_cache_recharge(void)
+{
+    DP_ResetImageCacheEntry *entry, *tmp;
+    HASH_ITER(hh, reset_image_cache.entries, entry, tmp) {
+        bool stale = DP_tile_refcount(entry->key.t) == 1;
+        if (stale && !entry->stale) {
+            reset_image_cache.used_bytes += DP_TILE_BYTES;
+        }
+        else if (!stale && entry->stale) {
+            reset_image_cache.used_bytes -= DP_TILE_BYTES;
+        }
+        entry->stale = stale;
+    }
+}
+
+static void reset_image_cache_remove_stale(size_t max_bytes)
+{
+    reset_image_cache_recharge();
+    DP_ResetImageCacheEntry *entry, *tmp;
+    HASH_ITER(hh, reset_image_cache.entries, entry, tmp) {
+        if (reset_image_cache.used_bytes <= max_bytes) {
+            break;
+        }
+        else if (entry->stale) {
+            reset_image_cache_remove(entry);
+        }
+    }
+}
+
+static void reset_image_cache_evict_lru(size_t max_bytes)
+{
+    DP_ResetImageCacheEntry *entry, *tmp;
+    HASH_ITER(hh, reset_image_cache.entries, entry, tmp) {
+        if (reset_image_cache.used_bytes <= max_bytes) {
+            break;
+        }
+        reset_image_cache_remove(entry);
+    }
+}
+
+static void reset_image_cache_evict(size_t max_bytes)
+{
+    // Get rid of tiles nothing else needs anymore before the live ones.
+    reset_image_cache_remove_stale(max_bytes);
+    reset_image_cache_evict_lru(max_bytes);
+}
+
+static DP_ResetImageCacheKey reset_image_cache_key(DP_Tile *t,
+                                                   DP_ResetImageCacheKind kind)
+{
+    // The key is hashed bytewise, so padding must be zeroed.
+    DP_ResetImageCacheKey key;
+    memset(&key, 0, sizeof(key));
+    key.t = t;
+    key.kind = kind;
+    return key;
+}
+
+// Returns the cache mutex if caching is enabled, NULL otherwise.
+static DP_Mutex *reset_image_cache_sweep(void)
+{
+    DP_Mutex *mutex = reset_image_cache_mutex();
+    if (mutex) {
+        DP_MUTEX_MUST_LOCK(mutex);
+        reset_image_cache_remove_stale(0);
+        bool enabled = reset_image_cache.max_bytes != 0;
+        DP_MUTEX_MUST_UNLOCK(mutex);
+        return enabled ? mutex : NULL;
+    }
+    else {
+        return NULL;
+    }
+}
+
+void DP_reset_image_cache_max_bytes_set(size_t max_bytes)
+{
+    DP_Mutex *mutex = reset_image_cache_mutex();
+    if (mutex) {
+        DP_MUTEX_MUST_LOCK(mutex);
+        reset_image_cache.max_bytes = max_bytes;
+        reset_image_cache_evict(max_bytes);
+        DP_MUTEX_MUST_UNLOCK(mutex);
+    }
+}
+
+void DP_reset_image_cache_clear(void)
+{
+    DP_Mutex *mutex = reset_image_cache_mutex();
+    if (mutex) {
+        DP_MUTEX_MUST_LOCK(mutex);
+        reset_image_cache_evict(0);
+        DP_MUTEX_MUST_UNLOCK(mutex);
+    }
+}
+
+DP_ResetImageCacheStatistics DP_reset_image_cache_statistics(void)
+{
+    DP_ResetImageCacheStatistics rics = {0, 0, 0, 0, 0};
+    DP_Mutex *mutex = reset_image_cache_mutex();
+    if (mutex) {
+        DP_MUTEX_MUST_LOCK(mutex);
+        reset_image_cache_recharge();
+        rics = (DP_ResetImageCacheStatistics){
+            reset_image_cache.max_bytes, reset_image_cache.used_bytes,
+            HASH_COUNT(reset_image_cache.entries), reset_image_cache.hits,
+            reset_image_cache.misses};
+        DP_MUTEX_MUST_UNLOCK(mutex);
+    }
+    return rics;
+}
+
+
 struct DP_ResetImageOutputBuffer {
     size_t capacity;
     void *data;
@@ -234,6 +423,7 @@ struct DP_ResetImageContext {
     void (*handle_entry)(void *, const DP_ResetEntry *);
     void *handle_entry_user;
     struct DP_ResetImageBuffer *buffers;
+    DP_Mutex *cache_mutex;
 };
 
 enum DP_ResetImageJobType {
@@ -251,6 +441,7 @@ struct DP_ResetImageTileJob {
     int tile_index;
     int tile_run;
     bool holds_ref;
+    bool cacheable;
 };
 
 struct DP_ResetImageSelectionTileJob {
@@ -315,21 +506,96 @@ static size_t reset_image_compress_tile_zstd8le(struct DP_ResetImageContext *c,
                                          &buffer->output);
 }
 
-static size_t reset_image_compress_tile(struct DP_ResetImageContext *c,
-                                        int buffer_index, DP_Tile *t)
+static size_t reset_image_cache_get(struct DP_ResetImageContext *c,
+                                    int buffer_index, DP_Tile *t,
+                                    DP_ResetImageCacheKind kind)
 {
+    DP_Mutex *mutex = c->cache_mutex;
+    if (!mutex || !t) {
+        return 0;
+    }
+
+    DP_ResetImageCacheKey key = reset_image_cache_key(t, kind);
     size_t size;
-    switch (c->options.compression) {
-    case DP_RESET_IMAGE_COMPRESSION_ZSTD8LE:
-        size = reset_image_compress_tile_zstd8le(c, buffer_index, t);
-        break;
-    default:
-        size = reset_image_compress_tile_gzip8be(c, buffer_index, t);
-        break;
+    DP_MUTEX_MUST_LOCK(mutex);
+    DP_ResetImageCacheEntry *entry;
+    HASH_FIND(hh, reset_image_cache.entries, &key, sizeof(key), entry);
+    if (entry) {
+        // Move the entry to the end of the list to mark it recently used.
+        HASH_DEL(reset_image_cache.entries, entry);
+        HASH_ADD(hh, reset_image_cache.entries, key, sizeof(entry->key), entry);
+        size = entry->size;
+        struct DP_ResetImageBuffer *buffer = &c->buffers[buffer_index];
+        memcpy(reset_image_get_output_buffer(size, &buffer->output),
+               entry->data, size);
+        ++reset_image_cache.hits;
     }
+    else {
+        size = 0;
+        ++reset_image_cache.misses;
+    }
+    DP_MUTEX_MUST_UNLOCK(mutex);
+    return size;
+}
+
+static void reset_image_cache_put(struct DP_ResetImageContext *c,
+                                  int buffer_index, DP_Tile *t,
+                                  DP_ResetImageCacheKind kind, size_t size)
+{
+    DP_Mutex *mutex = c->cache_mutex;
+    if (!mutex || !t || size == 0) {
+        return;
+    }
+
+    size_t entry_bytes = RESET_IMAGE_CACHE_ENTRY_OVERHEAD + size;
+    DP_MUTEX_MUST_LOCK(mutex);
+    size_t max_bytes = reset_image_cache.max_bytes;
+    DP_ResetImageCacheKey key = reset_image_cache_key(t, kind);
+    DP_ResetImageCacheEntry *entry;
+    HASH_FIND(hh, reset_image_cache.entries, &key, sizeof(key), entry);
+    // Another thread may have compressed the same tile in the meantime.
+    if (!entry && entry_bytes <= max_bytes) {
+        // Stale tiles got swept before the reset image started and the canvas
+        // state being built keeps its own tiles alive, so there's no need to
+        // recheck every entry for each tile. Just drop the least recent ones.
+        reset_image_cache_evict_lru(max_bytes - entry_bytes);
+        entry = DP_malloc(DP_FLEX_SIZEOF(DP_ResetImageCacheEntry, data, size));
+        // The key is hashed bytewise, struct assignment might not copy the
+        // zeroed padding over.
+        memset(entry, 0, sizeof(*entry));
+        memcpy(&entry->key, &key, sizeof(key));
+        DP_tile_incref(t);
+        entry->size = size;
+        memcpy(entry->data, c->buffers[buffer_index].output.data, size);
+        HASH_ADD(hh, reset_image_cache.entries, key, sizeof(entry->key), entry);
+        reset_image_cache.used_bytes += entry_bytes;
+    }
+    DP_MUTEX_MUST_UNLOCK(mutex);
+}
+
+static size_t reset_image_compress_tile(struct DP_ResetImageContext *c,
+                                        int buffer_index, DP_Tile *t,
+                                        bool cacheable)
+{
+    bool zstd8le = c->options.compression == DP_RESET_IMAGE_COMPRESSION_ZSTD8LE;
+    DP_ResetImageCacheKind kind =
+        zstd8le ? DP_RESET_IMAGE_CACHE_ZSTD8LE : DP_RESET_IMAGE_CACHE_GZIP8BE;
+    if (cacheable) {
+        size_t cached_size = reset_image_cache_get(c, buffer_index, t, kind);
+        if (cached_size != 0) {
+            return cached_size;
+        }
+    }
+
+    size_t size = zstd8le
+                    ? reset_image_compress_tile_zstd8le(c, buffer_index, t)
+                    : reset_image_compress_tile_gzip8be(c, buffer_index, t);
     if (size == 0) {
         DP_warn("Reset image: error tile: %s", DP_error());
     }
+    else if (cacheable) {
+        reset_image_cache_put(c, buffer_index, t, kind, size);
+    }
     return size;
 }
 
@@ -337,6 +603,12 @@ static size_t
 reset_image_compress_selection_tile(struct DP_ResetImageContext *c,
                                     int buffer_index, DP_Tile *t)
 {
+    size_t cached_size = reset_image_cache_get(
+        c, buffer_index, t, DP_RESET_IMAGE_CACHE_MASK_ZSTD8LE);
+    if (cached_size != 0) {
+        return cached_size;
+    }
+
     struct DP_ResetImageBuffer *buffer = &c->buffers[buffer_index];
     size_t size = DP_tile_compress_mask_delta_zstd8le(
         t, &buffer->zstd_context, buffer->pixels->channel,
@@ -344,6 +616,10 @@ reset_image_compress_selection_tile(struct DP_ResetImageContext *c,
     if (size == 0) {
         DP_warn("Reset image: error selection tile: %s", DP_error());
     }
+    else {
+        reset_image_cache_put(c, buffer_index, t,
+                              DP_RESET_IMAGE_CACHE_MASK_ZSTD8LE, size);
+    }
     return size;
 }
 
@@ -363,7 +639,12 @@ static bool layer_fill(DP_LayerContent *lc, DP_Pixel15 *out_pixel)
     int counts[FILL_BUCKETS];
     DP_Pixel15 pixels[FILL_BUCKETS];
 
-    for (int i = 0; i < total; ++i) {
+    // Null tiles count as blank, they can't be the fill. They can't decide
+    // whether some other pixel makes up the majority either, so there's no
+    // need to look at them at all.
+    int cursor = 0;
+    int i;
+    while ((i = DP_layer_content_next_populated_tile(lc, &cursor)) != -1) {
         DP_Tile *t = DP_layer_content_tile_at_index_noinc(lc, i);
         DP_Pixel15 pixel;
         if (DP_tile_same_pixel(t, &pixel) && pixel.a != 0) {
@@ -421,7 +702,7 @@ static bool tile_is_effectively_blank(DP_Tile *t, DP_Pixel15 fill_pixel)
 static void background_to_reset_image(struct DP_ResetImageContext *c,
                                       int buffer_index, DP_Tile *t)
 {
-    size_t size = reset_image_compress_tile(c, buffer_index, t);
+    size_t size = reset_image_compress_tile(c, buffer_index, t, true);
     if (size != 0) {
         reset_image_handle(
             c, (DP_ResetEntry){
@@ -433,9 +714,9 @@ static void background_to_reset_image(struct DP_ResetImageContext *c,
 static void tile_to_reset_image(struct DP_ResetImageContext *c,
                                 int buffer_index, int layer_index, int layer_id,
                                 int sublayer_id, int tile_index, int tile_run,
-                                DP_Tile *t)
+                                DP_Tile *t, bool cacheable)
 {
-    size_t size = reset_image_compress_tile(c, buffer_index, t);
+    size_t size = reset_image_compress_tile(c, buffer_index, t, cacheable);
     if (size != 0) {
         reset_image_handle(
             c, (DP_ResetEntry){DP_RESET_ENTRY_TILE,
@@ -520,7 +801,8 @@ static void reset_image_job(void *user, int thread_index)
         DP_Tile *t = job->tile.t;
         tile_to_reset_image(job->c, thread_index, job->tile.layer_index,
                             job->tile.layer_id, job->tile.sublayer_id,
-                            job->tile.tile_index, job->tile.tile_run, t);
+                            job->tile.tile_index, job->tile.tile_run, t,
+                            job->tile.cacheable);
         if (job->tile.holds_ref) {
             DP_tile_decref(t);
         }
@@ -552,12 +834,12 @@ static void flush_tile(struct DP_ResetImageContext *c, int layer_index,
         struct DP_ResetImageJob job = {
             c, DP_RESET_IMAGE_JOB_TILE,
             .tile = {hold_ref ? DP_tile_incref(t) : t, layer_index, layer_id,
-                     sublayer_id, tile_index, tile_run, hold_ref}};
+                     sublayer_id, tile_index, tile_run, hold_ref, !ephemeral}};
         DP_worker_push(worker, &job);
     }
     else {
         tile_to_reset_image(c, 0, layer_index, layer_id, sublayer_id,
-                            tile_index, tile_run, t);
+                            tile_index, tile_run, t, !ephemeral);
     }
 }
 
@@ -571,8 +853,27 @@ static void tiles_to_reset_image(struct DP_ResetImageContext *c,
     int tile_run = 0;
     int start_index = 0;
     DP_Tile *start_tile = NULL;
+    // Without a fill, null tiles are blank, so they can be skipped over. That
+    // just has to end the current run of tiles, like any other blank tile.
+    bool skip_null = fill_pixel.a == 0;
+    int cursor = 0;
 
     for (int i = 0; i < count; ++i) {
+        if (skip_null) {
+            int next = DP_layer_content_next_populated_tile(lc, &cursor);
+            if (next != i) {
+                if (tile_run != 0) {
+                    flush_tile(c, layer_index, layer_id, sublayer_id,
+                               start_index, tile_run, start_tile, ephemeral);
+                    tile_run = 0;
+                }
+                if (next == -1) {
+                    break;
+                }
+                i = next;
+            }
+        }
+
         DP_Tile *t = DP_layer_content_tile_at_index_noinc(lc, i);
         if (!tile_is_effectively_blank(t, fill_pixel)) {
             if (tile_run != 0) {
@@ -732,8 +1033,6 @@ static void selections_to_reset_image(struct DP_ResetImageContext *c,
 {
     DP_SelectionSet *ss = DP_canvas_state_selections_noinc_nullable(cs);
     if (ss) {
-        int tile_count = DP_tile_total_round(DP_canvas_state_width(cs),
-                                             DP_canvas_state_height(cs));
         int selection_count = DP_selection_set_count(ss);
         int selection_index = 0;
         for (int i = 0; i < selection_count; ++i) {
@@ -742,14 +1041,15 @@ static void selections_to_reset_image(struct DP_ResetImageContext *c,
             if (selection_id >= DP_SELECTION_ID_FIRST_REMOTE) {
                 unsigned int context_id = DP_selection_context_id(sel);
                 DP_LayerContent *lc = DP_selection_content_noinc(sel);
-                for (int tile_index = 0; tile_index < tile_count;
-                     ++tile_index) {
-                    DP_Tile *t =
-                        DP_layer_content_tile_at_index_noinc(lc, tile_index);
-                    if (t) {
-                        flush_selection_tile(c, selection_index, context_id,
-                                             selection_id, tile_index, t);
-                    }
+                int cursor = 0;
+                int tile_index;
+                while ((tile_index = DP_layer_content_next_populated_tile(
+                            lc, &cursor))
+                       != -1) {
+                    flush_selection_tile(
+                        c, selection_index, context_id, selection_id,
+                        tile_index,
+                        DP_layer_content_tile_at_index_noinc(lc, tile_index));
                 }
                 ++selection_index;
             }
@@ -887,9 +1187,17 @@ void DP_reset_image_build_with(
         buffers_count = 1;
     }
 
+    // Tiles only held onto by the cache won't be seen again, so get rid of
+    // them now rather than letting them linger until they get evicted.
+    DP_Mutex *cache_mutex = reset_image_cache_sweep();
+
     struct DP_ResetImageContext c = {
-        worker, *options, handle_entry, user,
-        DP_malloc(sizeof(*c.buffers) * DP_int_to_size(buffers_count))};
+        worker,
+        *options,
+        handle_entry,
+        user,
+        DP_malloc(sizeof(*c.buffers) * DP_int_to_size(buffers_count)),
+        cache_mutex};
     for (int i = 0; i < buffers_count; ++i) {
         c.buffers[i] = (struct DP_ResetImageBuffer){
             {0, NULL}, DP_malloc(sizeof(*c.buffers[i].pixels)), NULL};
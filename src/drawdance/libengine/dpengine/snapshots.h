@@ -26,6 +26,21 @@ typedef DP_Snapshot *(*DP_SnapshotAtFn)(DP_SnapshotQueue *sq, size_t index);
 typedef void (*DP_SnapshotsGetFn)(void *user, DP_SnapshotQueue *sq,
                                   size_t count, DP_SnapshotAtFn at);
 
+// Compressed tile payloads are cached across reset images, so that tiles that
+// didn't change since the last reset, autoreset or snapshot don't have to be
+// compressed again. The budget is in bytes of compressed data plus overhead,
+// which includes the full size of tiles that only the cache keeps alive.
+#define DP_RESET_IMAGE_CACHE_MAX_BYTES_DEFAULT \
+    ((size_t)32 * (size_t)1024 * (size_t)1024)
+
+typedef struct DP_ResetImageCacheStatistics {
+    size_t max_bytes;
+    size_t used_bytes;
+    unsigned int entries;
+    unsigned long long hits;
+    unsigned long long misses;
+} DP_ResetImageCacheStatistics;
+
 typedef enum DP_ResetImageCompression {
     DP_RESET_IMAGE_COMPRESSION_GZIP8BE,
     DP_RESET_IMAGE_COMPRESSION_ZSTD8LE,
@@ -156,6 +171,13 @@ void DP_snapshot_queue_get_with(DP_SnapshotQueue *sq, DP_SnapshotsGetFn get_fn,
                                 void *user);
 
 
+// Setting the maximum to zero disables the cache.
+void DP_reset_image_cache_max_bytes_set(size_t max_bytes);
+
+void DP_reset_image_cache_clear(void);
+
+DP_ResetImageCacheStatistics DP_reset_image_cache_statistics(void);
+
 void DP_reset_image_build_with(
     DP_CanvasState *cs, const DP_ResetImageOptions *options,
     void (*handle_entry)(void *, const DP_ResetEntry *), void *user);
@@ -0,0 +1,172 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/layer_content.h>
+#include <dpengine/layer_list.h>
+#include <dpengine/tile.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/ids.h>
+#include <dpmsg/message.h>
+#include <dpmsg/messages.h>
+#include <dptest.h>
+
+#define CANVAS_WIDTH  640
+#define CANVAS_HEIGHT 480
+#define LAYER_ID      0x0101
+// Flags for masking with the first remote selection id.
+#define SELECTION_FLAGS (1 << 3)
+
+
+// Checksums of the drawn dabs, taken from the scalar implementation that was
+// in place before classic brush masks were vectorized. Mask generation must
+// give exactly the same result on every machine, so these must match at every
+// CPU support level. Set the DP_CPU_SUPPORT environment variable to switch
+// which one to use. The dabs are drawn behind onto an empty layer, since that
+// blend mode has no vector version that could muddy the results.
+typedef struct DabsFixture {
+    const char *name;
+    int x, y; // In quarter pixels.
+    int dx, dy;
+    int count;
+    uint32_t first_size, last_size; // In 1/256 pixels.
+    uint8_t hardness;
+    uint8_t opacity;
+    bool selection;
+    uint64_t expected_checksum;
+} DabsFixture;
+
+static const DabsFixture fixtures[] = {
+    {"single pixel", 80, 80, 5, 3, 120, 40, 500, 200, 255, false,
+     0xae6d2193b2d1c514u},
+    {"high resolution soft", 80, 400, 7, 1, 140, 512, 2040, 0, 200, false,
+     0x609ac6fe7f1c3150u},
+    {"high resolution hard", 80, 800, 9, 2, 120, 512, 2040, 255, 255, false,
+     0x1122cd664bca8fe8u},
+    {"small soft", 160, 1200, 13, 3, 150, 2048, 12800, 60, 180, false,
+     0xdf162fbbca8b01d2u},
+    {"small hard", 160, 1600, 11, 1, 160, 2048, 16384, 255, 255, false,
+     0x7fed12903cb1879fu},
+    {"large soft", 400, 400, 21, 15, 60, 16384, 51200, 100, 120, false,
+     0x196d435e2ada6d14u},
+    {"large hard", 400, 400, 25, 19, 40, 12800, 38400, 255, 255, false,
+     0xb9cc5688d8c98167u},
+    {"small hard masked", 160, 160, 13, 11, 150, 2560, 14336, 255, 255, true,
+     0x810f5f0c83afecd5u},
+    {"large soft masked", 400, 400, 21, 15, 60, 16384, 51200, 100, 120, true,
+     0x857e7899b26cf8f6u},
+};
+
+
+static void handle_ok(TEST_PARAMS, DP_CanvasHistory *ch, DP_DrawContext *dc,
+                      DP_Message *msg)
+{
+    OK(DP_canvas_history_handle(ch, dc, msg), "handle %s",
+       DP_message_type_enum_name(DP_message_type(msg)));
+    DP_message_decref(msg);
+}
+
+static void set_dabs(int count, DP_ClassicDab *out, void *user)
+{
+    const DabsFixture *f = user;
+    for (int i = 0; i < count; ++i) {
+        int64_t size_delta = (int64_t)f->last_size - (int64_t)f->first_size;
+        uint32_t size = DP_int64_to_uint32((int64_t)f->first_size
+                                           + size_delta * i / (count - 1));
+        DP_classic_dab_init(out, i, DP_int_to_int8(i == 0 ? 0 : f->dx),
+                            DP_int_to_int8(i == 0 ? 0 : f->dy), size,
+                            f->hardness, f->opacity);
+    }
+}
+
+// A selection with a hole and a diagonal staircase edge, so that dabs cross
+// fully selected, partially selected and unselected tiles.
+static void put_selection(TEST_PARAMS, DP_CanvasHistory *ch,
+                          DP_DrawContext *dc)
+{
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_selection_put_new(1, DP_SELECTION_ID_FIRST_REMOTE,
+                                       DP_MSG_SELECTION_PUT_OP_REPLACE, 30, 30,
+                                       500, 380, NULL, 0, NULL));
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_selection_put_new(1, DP_SELECTION_ID_FIRST_REMOTE,
+                                       DP_MSG_SELECTION_PUT_OP_EXCLUDE, 150,
+                                       100, 70, 90, NULL, 0, NULL));
+    for (int i = 0; i < 20; ++i) {
+        handle_ok(TEST_ARGS, ch, dc,
+                  DP_msg_selection_put_new(
+                      1, DP_SELECTION_ID_FIRST_REMOTE,
+                      DP_MSG_SELECTION_PUT_OP_EXCLUDE, 300 + i * 7, 200 + i * 9,
+                      200, 9, NULL, 0, NULL));
+    }
+}
+
+static DP_CanvasState *draw(TEST_PARAMS, const DabsFixture *f)
+{
+    DP_CanvasHistory *ch = DP_canvas_history_new(NULL, NULL, false, NULL);
+    DP_DrawContext *dc = DP_draw_context_new();
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_canvas_resize_new(1, 0, CANVAS_WIDTH, CANVAS_HEIGHT, 0));
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_layer_tree_create_new(1, LAYER_ID, 0, 0, 0, 0, "", 0));
+    if (f->selection) {
+        put_selection(TEST_ARGS, ch, dc);
+    }
+    handle_ok(TEST_ARGS, ch, dc, DP_msg_undo_point_new(1));
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_draw_dabs_classic_new(
+                  1, f->selection ? SELECTION_FLAGS : 0, LAYER_ID, f->x, f->y,
+                  0xff2060a0u, DP_BLEND_MODE_BEHIND, set_dabs, f->count,
+                  (void *)f));
+    DP_CanvasState *cs = DP_canvas_history_get(ch);
+    DP_draw_context_free(dc);
+    DP_canvas_history_free(ch);
+    return cs;
+}
+
+static uint64_t checksum_layer(DP_CanvasState *cs)
+{
+    DP_LayerList *ll = DP_canvas_state_layers_noinc(cs);
+    DP_LayerContent *lc =
+        DP_layer_list_entry_content_noinc(DP_layer_list_at_noinc(ll, 0));
+    uint64_t hash = 14695981039346656037u;
+    for (int y = 0; y < CANVAS_HEIGHT; ++y) {
+        for (int x = 0; x < CANVAS_WIDTH; ++x) {
+            DP_Tile *t = DP_layer_content_tile_at_noinc(lc, x / DP_TILE_SIZE,
+                                                        y / DP_TILE_SIZE);
+            DP_Pixel15 pixel =
+                t ? DP_tile_pixel_at(t, x % DP_TILE_SIZE, y % DP_TILE_SIZE)
+                  : (DP_Pixel15){0, 0, 0, 0};
+            hash = (hash ^ ((uint64_t)pixel.b | (uint64_t)pixel.g << 16u
+                            | (uint64_t)pixel.r << 32u
+                            | (uint64_t)pixel.a << 48u))
+                 * 1099511628211u;
+        }
+    }
+    return hash;
+}
+
+static void dabs_match_scalar_output(TEST_PARAMS)
+{
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(fixtures); ++i) {
+        const DabsFixture *f = &fixtures[i];
+        DP_CanvasState *cs = draw(TEST_ARGS, f);
+        uint64_t checksum = checksum_layer(cs);
+        OK(checksum == f->expected_checksum, "%s: checksum 0x%016llx",
+           f->name, (unsigned long long)checksum);
+        DP_canvas_state_decref(cs);
+    }
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(dabs_match_scalar_output);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/gradient.h>
+#include <dpengine/layer_content.h>
+#include <dpengine/layer_list.h>
+#include <dpengine/tile.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/ids.h>
+#include <dpmsg/message.h>
+#include <dpmsg/messages.h>
+#include <dptest.h>
+
+#define CANVAS_WIDTH  640
+#define CANVAS_HEIGHT 480
+#define LAYER_ID      0x0101
+
+
+// Checksums of the filled layer. Gradient rendering must give exactly the
+// same result on every machine and regardless of how the fill gets split up
+// into tiles, so any change to these is a change in the output.
+typedef struct GradientFixture {
+    const char *name;
+    DP_GradientShape shape;
+    DP_GradientSpread spread;
+    int x, y, w, h;
+    int x1, y1, x2, y2; // In quarter pixels.
+    uint16_t focus;
+    uint32_t color1, color2;
+    bool selection;
+    uint64_t expected_checksum;
+} GradientFixture;
+
+static const GradientFixture fixtures[] = {
+    {"linear pad", DP_GRADIENT_SHAPE_LINEAR, DP_GRADIENT_SPREAD_PAD, 0, 0,
+     CANVAS_WIDTH, CANVAS_HEIGHT, 400, 300, 2000, 1500, 0, 0xff2060a0u,
+     0x80f0c010u, false, 0x92b9582211b17933u},
+    {"linear repeat", DP_GRADIENT_SHAPE_LINEAR, DP_GRADIENT_SPREAD_REPEAT, 37,
+     21, 500, 411, 1000, 1000, 1130, 1290, 0, 0xffff0000u, 0xff0000ffu, false,
+     0x085ea4a9fb596e4bu},
+    {"linear reflect", DP_GRADIENT_SHAPE_LINEAR, DP_GRADIENT_SPREAD_REFLECT, 0,
+     0, CANVAS_WIDTH, CANVAS_HEIGHT, 1201, 803, 1003, 1397, 0, 0x00000000u,
+     0xff10a050u, false, 0x65a9e069aea23fa4u},
+    {"radial pad", DP_GRADIENT_SHAPE_RADIAL, DP_GRADIENT_SPREAD_PAD, 0, 0,
+     CANVAS_WIDTH, CANVAS_HEIGHT, 1280, 960, 2080, 1260, 0, 0xffffffffu,
+     0xff000000u, false, 0x6b8a0610626117adu},
+    {"radial focus repeat", DP_GRADIENT_SHAPE_RADIAL,
+     DP_GRADIENT_SPREAD_REPEAT, 64, 64, 513, 350, 1000, 900, 1300, 1100, 40000,
+     0xc0ff8000u, 0x4000ff80u, false, 0x5f5b611f54afe203u},
+    {"radial focus reflect", DP_GRADIENT_SHAPE_RADIAL,
+     DP_GRADIENT_SPREAD_REFLECT, 0, 0, CANVAS_WIDTH, CANVAS_HEIGHT, 1500, 700,
+     1100, 500, 65535, 0xff2060a0u, 0x00000000u, false, 0x7de5cc14f40df834u},
+    {"linear masked", DP_GRADIENT_SHAPE_LINEAR, DP_GRADIENT_SPREAD_PAD, 0, 0,
+     CANVAS_WIDTH, CANVAS_HEIGHT, 400, 300, 2000, 1500, 0, 0xff2060a0u,
+     0x80f0c010u, true, 0x5cf3e3e0386e7c89u},
+    {"radial masked", DP_GRADIENT_SHAPE_RADIAL, DP_GRADIENT_SPREAD_REFLECT, 0,
+     0, CANVAS_WIDTH, CANVAS_HEIGHT, 1280, 960, 1680, 1160, 20000, 0xffffffffu,
+     0xff000000u, true, 0x7f21c409d17d80dcu},
+};
+
+
+static void handle_ok(TEST_PARAMS, DP_CanvasHistory *ch, DP_DrawContext *dc,
+                      DP_Message *msg)
+{
+    OK(DP_canvas_history_handle(ch, dc, msg), "handle %s",
+       DP_message_type_enum_name(DP_message_type(msg)));
+    DP_message_decref(msg);
+}
+
+// A selection with a hole and a diagonal staircase edge, so that the fill
+// covers fully selected, partially selected and unselected tiles.
+static void put_selection(TEST_PARAMS, DP_CanvasHistory *ch,
+                          DP_DrawContext *dc)
+{
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_selection_put_new(1, DP_SELECTION_ID_FIRST_REMOTE,
+                                       DP_MSG_SELECTION_PUT_OP_REPLACE, 30, 30,
+                                       500, 380, NULL, 0, NULL));
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_selection_put_new(1, DP_SELECTION_ID_FIRST_REMOTE,
+                                       DP_MSG_SELECTION_PUT_OP_EXCLUDE, 150,
+                                       100, 70, 90, NULL, 0, NULL));
+    for (int i = 0; i < 20; ++i) {
+        handle_ok(TEST_ARGS, ch, dc,
+                  DP_msg_selection_put_new(
+                      1, DP_SELECTION_ID_FIRST_REMOTE,
+                      DP_MSG_SELECTION_PUT_OP_EXCLUDE, 300 + i * 7, 200 + i * 9,
+                      200, 9, NULL, 0, NULL));
+    }
+}
+
+static DP_CanvasState *fill(TEST_PARAMS, const GradientFixture *f)
+{
+    DP_CanvasHistory *ch = DP_canvas_history_new(NULL, NULL, false, NULL);
+    DP_DrawContext *dc = DP_draw_context_new();
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_canvas_resize_new(1, 0, CANVAS_WIDTH, CANVAS_HEIGHT, 0));
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_layer_tree_create_new(1, LAYER_ID, 0, 0, 0, 0, "", 0));
+    if (f->selection) {
+        put_selection(TEST_ARGS, ch, dc);
+    }
+    handle_ok(TEST_ARGS, ch, dc, DP_msg_undo_point_new(1));
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_fill_gradient_new(
+                  1, LAYER_ID, DP_BLEND_MODE_NORMAL, (uint8_t)f->shape,
+                  (uint8_t)f->spread,
+                  f->selection ? DP_SELECTION_ID_FIRST_REMOTE : 0,
+                  DP_int_to_uint32(f->x), DP_int_to_uint32(f->y),
+                  DP_int_to_uint32(f->w), DP_int_to_uint32(f->h), f->x1, f->y1,
+                  f->x2, f->y2, f->focus, f->color1, f->color2));
+    DP_CanvasState *cs = DP_canvas_history_get(ch);
+    DP_draw_context_free(dc);
+    DP_canvas_history_free(ch);
+    return cs;
+}
+
+static uint64_t checksum_layer(DP_CanvasState *cs)
+{
+    DP_LayerList *ll = DP_canvas_state_layers_noinc(cs);
+    DP_LayerContent *lc =
+        DP_layer_list_entry_content_noinc(DP_layer_list_at_noinc(ll, 0));
+    uint64_t hash = 14695981039346656037u;
+    for (int y = 0; y < CANVAS_HEIGHT; ++y) {
+        for (int x = 0; x < CANVAS_WIDTH; ++x) {
+            DP_Tile *t = DP_layer_content_tile_at_noinc(lc, x / DP_TILE_SIZE,
+                                                        y / DP_TILE_SIZE);
+            DP_Pixel15 pixel =
+                t ? DP_tile_pixel_at(t, x % DP_TILE_SIZE, y % DP_TILE_SIZE)
+                  : (DP_Pixel15){0, 0, 0, 0};
+            hash = (hash ^ ((uint64_t)pixel.b | (uint64_t)pixel.g << 16u
+                            | (uint64_t)pixel.r << 32u
+                            | (uint64_t)pixel.a << 48u))
+                 * 1099511628211u;
+        }
+    }
+    return hash;
+}
+
+static void gradients_match_checksums(TEST_PARAMS)
+{
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(fixtures); ++i) {
+        const GradientFixture *f = &fixtures[i];
+        DP_CanvasState *cs = fill(TEST_ARGS, f);
+        uint64_t checksum = checksum_layer(cs);
+        OK(checksum == f->expected_checksum, "%s: checksum 0x%016llx",
+           f->name, (unsigned long long)checksum);
+        DP_canvas_state_decref(cs);
+    }
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(gradients_match_checksums);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
@@ -0,0 +1,189 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/flood_fill.h>
+#include <dpengine/image.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/message.h>
+#include <dpmsg/messages.h>
+#include <dptest.h>
+
+// Large enough for expanding and feathering to be split into bands on machines
+// with multiple cores.
+#define CANVAS_WIDTH  640
+#define CANVAS_HEIGHT 560
+#define LAYER_ID      0x0101
+#define SELECTION_ID  1
+
+
+// Checksums of the fill results, taken from the single-threaded
+// implementation that was in place before the fills were split into bands.
+typedef struct FillFixture {
+    const char *name;
+    bool selection;
+    int x, y;
+    int gap, expand;
+    DP_FloodFillKernel kernel;
+    int feather;
+    bool from_edge;
+    int expected_x, expected_y, expected_width, expected_height;
+    uint64_t expected_checksum;
+} FillFixture;
+
+static const FillFixture fixtures[] = {
+    {"plain", false, 20, 20, 0, 0, DP_FLOOD_FILL_KERNEL_ROUND, 0, false, 0, 0,
+     640, 560, 0x5355028f5f4b2bf1u},
+    {"grow round feathered", false, 20, 20, 0, 6, DP_FLOOD_FILL_KERNEL_ROUND,
+     4, false, -4, -4, 648, 568, 0x0c9ca48fdb2a544du},
+    {"shrink square", false, 20, 20, 0, -3, DP_FLOOD_FILL_KERNEL_SQUARE, 0,
+     false, 0, 0, 640, 560, 0x7e3c5c49251bbc29u},
+    {"gap from edge", false, 330, 290, 3, 2, DP_FLOOD_FILL_KERNEL_SQUARE, 2,
+     true, 202, 152, 256, 282, 0x48e8afaf4ca55709u},
+    {"selection grow round feathered", true, 0, 0, 0, 8,
+     DP_FLOOD_FILL_KERNEL_ROUND, 6, false, 86, 66, 408, 328,
+     0x0cc87bfeb7f47021u},
+    {"selection shrink round", true, 0, 0, 0, -7, DP_FLOOD_FILL_KERNEL_ROUND,
+     0, false, 100, 80, 380, 300, 0x1f8e03f1cafd9805u},
+    {"selection feather from edge", true, 0, 0, 0, 0,
+     DP_FLOOD_FILL_KERNEL_SQUARE, 5, true, 95, 75, 390, 310,
+     0xd25ecc77e1171b79u},
+};
+
+
+static void handle_ok(TEST_PARAMS, DP_CanvasHistory *ch, DP_DrawContext *dc,
+                      DP_Message *msg)
+{
+    OK(DP_canvas_history_handle(ch, dc, msg), "handle %s",
+       DP_message_type_enum_name(DP_message_type(msg)));
+    DP_message_decref(msg);
+}
+
+static void fill_rect(TEST_PARAMS, DP_CanvasHistory *ch, DP_DrawContext *dc,
+                      int x, int y, int width, int height, uint32_t color)
+{
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_fill_rect_new(1, LAYER_ID, DP_BLEND_MODE_NORMAL,
+                                   DP_int_to_uint32(x), DP_int_to_uint32(y),
+                                   DP_int_to_uint32(width),
+                                   DP_int_to_uint32(height), color));
+}
+
+// A few outlines with gaps in them, a staircase to give the round kernels some
+// diagonals to work with, a checkerboard and some translucent areas.
+static DP_CanvasState *make_canvas(TEST_PARAMS)
+{
+    DP_CanvasHistory *ch = DP_canvas_history_new(NULL, NULL, false, NULL);
+    DP_DrawContext *dc = DP_draw_context_new();
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_canvas_resize_new(1, 0, CANVAS_WIDTH, CANVAS_HEIGHT, 0));
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_layer_tree_create_new(1, LAYER_ID, 0, 0, 0, 0, "", 0));
+    handle_ok(TEST_ARGS, ch, dc, DP_msg_undo_point_new(1));
+
+    fill_rect(TEST_ARGS, ch, dc, 200, 150, 260, 6, 0xff000000u);
+    fill_rect(TEST_ARGS, ch, dc, 200, 430, 260, 6, 0xff000000u);
+    fill_rect(TEST_ARGS, ch, dc, 200, 150, 6, 120, 0xff000000u);
+    fill_rect(TEST_ARGS, ch, dc, 200, 272, 6, 164, 0xff000000u);
+    fill_rect(TEST_ARGS, ch, dc, 454, 150, 6, 286, 0xff000000u);
+    for (int i = 0; i < 40; ++i) {
+        fill_rect(TEST_ARGS, ch, dc, 40 + i * 3, 300 + i * 5, 30, 5,
+                  0xff2040c0u);
+    }
+    for (int y = 0; y < 8; ++y) {
+        for (int x = 0; x < 8; ++x) {
+            if ((x + y) % 2 == 0) {
+                fill_rect(TEST_ARGS, ch, dc, 500 + x * 12, 40 + y * 12, 12, 12,
+                          0xffc02020u);
+            }
+        }
+    }
+    fill_rect(TEST_ARGS, ch, dc, 260, 200, 120, 80, 0x80208020u);
+    fill_rect(TEST_ARGS, ch, dc, 300, 330, 90, 60, 0x40000000u);
+
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_selection_put_new(1, SELECTION_ID,
+                                       DP_MSG_SELECTION_PUT_OP_REPLACE, 100,
+                                       80, 380, 300, NULL, 0, NULL));
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_selection_put_new(1, SELECTION_ID,
+                                       DP_MSG_SELECTION_PUT_OP_EXCLUDE, 220,
+                                       180, 90, 70, NULL, 0, NULL));
+
+    DP_CanvasState *cs = DP_canvas_history_get(ch);
+    DP_draw_context_free(dc);
+    DP_canvas_history_free(ch);
+    return cs;
+}
+
+static uint64_t checksum_image(DP_Image *img)
+{
+    uint64_t hash = 14695981039346656037u;
+    int width = DP_image_width(img);
+    int height = DP_image_height(img);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            DP_Pixel8 pixel = DP_image_pixel_at(img, x, y);
+            hash = (hash ^ pixel.color) * 1099511628211u;
+        }
+    }
+    return hash;
+}
+
+static DP_FloodFillResult run_fixture(DP_CanvasState *cs,
+                                      const FillFixture *f, DP_Image **out_img,
+                                      int *out_x, int *out_y)
+{
+    DP_UPixelFloat color = {0.2f, 0.4f, 0.8f, 1.0f};
+    if (f->selection) {
+        return DP_selection_fill(cs, 1, SELECTION_ID, color, f->expand,
+                                 f->kernel, f->feather, f->from_edge, out_img,
+                                 out_x, out_y, NULL, NULL);
+    }
+    else {
+        return DP_flood_fill(cs, 1, 0, f->x, f->y, color, 0.05, LAYER_ID, -1,
+                             f->gap, f->expand, f->kernel, f->feather,
+                             f->from_edge, true, false, DP_VIEW_MODE_NORMAL,
+                             LAYER_ID, 0, out_img, out_x, out_y, NULL, NULL);
+    }
+}
+
+
+static void fills_match_previous_output(TEST_PARAMS)
+{
+    DP_CanvasState *cs = make_canvas(TEST_ARGS);
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(fixtures); ++i) {
+        const FillFixture *f = &fixtures[i];
+        DP_Image *img;
+        int x, y;
+        DP_FloodFillResult result = run_fixture(cs, f, &img, &x, &y);
+        if (result != DP_FLOOD_FILL_SUCCESS) {
+            FAIL("%s: fill failed with result %d", f->name, (int)result);
+            continue;
+        }
+
+        int width = DP_image_width(img);
+        int height = DP_image_height(img);
+        uint64_t checksum = checksum_image(img);
+        DP_image_free(img);
+        OK(x == f->expected_x && y == f->expected_y
+               && width == f->expected_width && height == f->expected_height,
+           "%s: bounds %d, %d, %d, %d", f->name, x, y, width, height);
+        OK(checksum == f->expected_checksum, "%s: checksum 0x%016llx",
+           f->name, (unsigned long long)checksum);
+    }
+    DP_canvas_state_decref(cs);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(fills_match_previous_output);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
@@ -0,0 +1,231 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpengine/canvas_diff.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/layer_content.h>
+#include <dpengine/layer_list.h>
+#include <dpengine/tile.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/message.h>
+#include <dpmsg/messages.h>
+#include <dptest.h>
+
+// More tiles than a change record holds, so filling everything overflows it.
+#define TILES_X    24
+#define TILES_Y    24
+#define TILE_COUNT (TILES_X * TILES_Y)
+#define LAYER_ID   0x0101
+#define MAX_STATES 32
+
+
+typedef struct ChangeStates {
+    int count;
+    DP_CanvasState *states[MAX_STATES];
+    const char *names[MAX_STATES];
+} ChangeStates;
+
+static void handle_ok(TEST_PARAMS, DP_CanvasHistory *ch, DP_DrawContext *dc,
+                      DP_Message *msg)
+{
+    OK(DP_canvas_history_handle(ch, dc, msg), "handle %s",
+       DP_message_type_enum_name(DP_message_type(msg)));
+    DP_message_decref(msg);
+}
+
+static void fill_tiles(TEST_PARAMS, DP_CanvasHistory *ch, DP_DrawContext *dc,
+                       int tile_x, int tile_y, int tile_width, int tile_height,
+                       uint32_t color)
+{
+    handle_ok(TEST_ARGS, ch, dc, DP_msg_undo_point_new(1));
+    handle_ok(
+        TEST_ARGS, ch, dc,
+        DP_msg_fill_rect_new(1, LAYER_ID, DP_BLEND_MODE_NORMAL,
+                             DP_int_to_uint32(tile_x * DP_TILE_SIZE),
+                             DP_int_to_uint32(tile_y * DP_TILE_SIZE),
+                             DP_int_to_uint32(tile_width * DP_TILE_SIZE),
+                             DP_int_to_uint32(tile_height * DP_TILE_SIZE),
+                             color));
+}
+
+static void undo(TEST_PARAMS, DP_CanvasHistory *ch, DP_DrawContext *dc,
+                 bool redo)
+{
+    handle_ok(TEST_ARGS, ch, dc, DP_msg_undo_new(1, 0, redo));
+}
+
+static void create_canvas(TEST_PARAMS, DP_CanvasHistory *ch,
+                          DP_DrawContext *dc)
+{
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_canvas_resize_new(1, 0, TILES_X * DP_TILE_SIZE,
+                                       TILES_Y * DP_TILE_SIZE, 0));
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_layer_tree_create_new(1, LAYER_ID, 0, 0, 0, 0, "", 0));
+}
+
+static void capture(ChangeStates *cs, DP_CanvasHistory *ch, const char *name)
+{
+    DP_ASSERT(cs->count < MAX_STATES);
+    cs->states[cs->count] = DP_canvas_history_get(ch);
+    cs->names[cs->count] = name;
+    ++cs->count;
+}
+
+static DP_LayerContent *layer_content(DP_CanvasState *cs)
+{
+    DP_LayerList *ll = DP_canvas_state_layers_noinc(cs);
+    return DP_layer_list_entry_content_noinc(DP_layer_list_at_noinc(ll, 0));
+}
+
+static void mark_index(void *data, int tile_index)
+{
+    bool *marked = data;
+    DP_ASSERT(tile_index >= 0);
+    DP_ASSERT(tile_index < TILE_COUNT);
+    marked[tile_index] = true;
+}
+
+// The diff must mark exactly the tiles that differ between the two states,
+// no matter whether it used change records or fell back to looking at all of
+// them.
+static void diff_ok(TEST_PARAMS, DP_CanvasDiff *diff, ChangeStates *cs,
+                    int prev_index, int index)
+{
+    DP_CanvasState *prev = cs->states[prev_index];
+    DP_CanvasState *current = cs->states[index];
+    bool marked[TILE_COUNT] = {false};
+    DP_canvas_state_diff(current, prev, diff, 0);
+    DP_canvas_diff_each_index_reset(diff, mark_index, marked);
+
+    DP_LayerContent *prev_lc = layer_content(prev);
+    DP_LayerContent *lc = layer_content(current);
+    int missed = 0;
+    int extra = 0;
+    for (int i = 0; i < TILE_COUNT; ++i) {
+        int x = i % TILES_X;
+        int y = i / TILES_X;
+        bool changed = DP_layer_content_tile_at_noinc(lc, x, y)
+                    != DP_layer_content_tile_at_noinc(prev_lc, x, y);
+        if (changed && !marked[i]) {
+            ++missed;
+        }
+        else if (!changed && marked[i]) {
+            ++extra;
+        }
+    }
+    OK(missed == 0 && extra == 0, "diff %s -> %s (%d missed, %d extra)",
+       cs->names[prev_index], cs->names[index], missed, extra);
+}
+
+static void diff_all_ok(TEST_PARAMS, ChangeStates *cs)
+{
+    // Diffing against nothing marks everything, which initializes the diff.
+    DP_CanvasDiff *diff = DP_canvas_diff_new();
+    bool marked[TILE_COUNT];
+    DP_canvas_state_diff(cs->states[0], NULL, diff, 0);
+    DP_canvas_diff_each_index_reset(diff, mark_index, marked);
+    for (int i = 0; i < cs->count; ++i) {
+        for (int j = 0; j < cs->count; ++j) {
+            diff_ok(TEST_ARGS, diff, cs, i, j);
+        }
+    }
+    DP_canvas_diff_free(diff);
+}
+
+static void dispose_states(ChangeStates *cs)
+{
+    for (int i = 0; i < cs->count; ++i) {
+        DP_canvas_state_decref(cs->states[i]);
+    }
+}
+
+
+static void changes_across_undo_and_redo(TEST_PARAMS)
+{
+    DP_CanvasHistory *ch = DP_canvas_history_new(NULL, NULL, false, NULL);
+    DP_DrawContext *dc = DP_draw_context_new();
+    ChangeStates cs = {0, {NULL}, {NULL}};
+
+    create_canvas(TEST_ARGS, ch, dc);
+    capture(&cs, ch, "blank");
+    fill_tiles(TEST_ARGS, ch, dc, 1, 1, 2, 2, 0xffff0000u);
+    capture(&cs, ch, "fill 1");
+    fill_tiles(TEST_ARGS, ch, dc, 2, 2, 3, 1, 0xff00ff00u);
+    capture(&cs, ch, "fill 2");
+    fill_tiles(TEST_ARGS, ch, dc, 10, 5, 1, 4, 0xff0000ffu);
+    capture(&cs, ch, "fill 3");
+
+    undo(TEST_ARGS, ch, dc, false);
+    capture(&cs, ch, "undo 3");
+    undo(TEST_ARGS, ch, dc, false);
+    capture(&cs, ch, "undo 2");
+    undo(TEST_ARGS, ch, dc, true);
+    capture(&cs, ch, "redo 2");
+
+    // Branches off after the undo, the undone fill is gone for good.
+    undo(TEST_ARGS, ch, dc, false);
+    fill_tiles(TEST_ARGS, ch, dc, 20, 20, 2, 2, 0xffffff00u);
+    capture(&cs, ch, "branch");
+    fill_tiles(TEST_ARGS, ch, dc, 0, 0, TILES_X, TILES_Y, 0x80808080u);
+    capture(&cs, ch, "fill all");
+    fill_tiles(TEST_ARGS, ch, dc, 5, 5, 1, 1, 0xff000000u);
+    capture(&cs, ch, "after fill all");
+    undo(TEST_ARGS, ch, dc, false);
+    undo(TEST_ARGS, ch, dc, false);
+    capture(&cs, ch, "undo fill all");
+
+    diff_all_ok(TEST_ARGS, &cs);
+    dispose_states(&cs);
+    DP_draw_context_free(dc);
+    DP_canvas_history_free(ch);
+}
+
+static void changes_across_reset(TEST_PARAMS)
+{
+    DP_CanvasHistory *ch = DP_canvas_history_new(NULL, NULL, false, NULL);
+    DP_DrawContext *dc = DP_draw_context_new();
+    ChangeStates cs = {0, {NULL}, {NULL}};
+
+    create_canvas(TEST_ARGS, ch, dc);
+    fill_tiles(TEST_ARGS, ch, dc, 3, 3, 4, 4, 0xffff0000u);
+    capture(&cs, ch, "before reset");
+    fill_tiles(TEST_ARGS, ch, dc, 4, 4, 1, 1, 0xff00ff00u);
+    capture(&cs, ch, "last before reset");
+
+    // Back to an earlier state, whose layer content was already continued.
+    DP_canvas_history_reset_to_state_noinc(
+        ch, DP_canvas_state_incref(cs.states[0]));
+    capture(&cs, ch, "reset to state");
+    fill_tiles(TEST_ARGS, ch, dc, 8, 8, 2, 2, 0xff0000ffu);
+    capture(&cs, ch, "after reset to state");
+    fill_tiles(TEST_ARGS, ch, dc, 9, 8, 2, 2, 0xff00ffffu);
+    capture(&cs, ch, "after reset to state 2");
+
+    // Hard reset and rebuild, like when a session gets reset.
+    DP_canvas_history_reset(ch);
+    create_canvas(TEST_ARGS, ch, dc);
+    fill_tiles(TEST_ARGS, ch, dc, 3, 3, 4, 4, 0xffff0000u);
+    capture(&cs, ch, "rebuilt");
+    fill_tiles(TEST_ARGS, ch, dc, 12, 0, 1, 24, 0xffff00ffu);
+    capture(&cs, ch, "after rebuild");
+
+    diff_all_ok(TEST_ARGS, &cs);
+    dispose_states(&cs);
+    DP_draw_context_free(dc);
+    DP_canvas_history_free(ch);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(changes_across_undo_and_redo);
+    REGISTER_TEST(changes_across_reset);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
@@ -0,0 +1,125 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/geom.h>
+#include <dpengine/layer_content.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
+#include <dpmsg/blend_mode.h>
+#include <dptest.h>
+
+#define TILES_X 9
+#define TILES_Y 7
+#define WIDTH   (TILES_X * DP_TILE_SIZE)
+#define HEIGHT  (TILES_Y * DP_TILE_SIZE)
+
+
+static void fill_tile(DP_TransientLayerContent *tlc, int i, uint32_t color)
+{
+    int x = i % TILES_X * DP_TILE_SIZE;
+    int y = i / TILES_X * DP_TILE_SIZE;
+    DP_transient_layer_content_fill_rect(
+        tlc, 1, DP_BLEND_MODE_REPLACE, x, y, x + DP_TILE_SIZE,
+        y + DP_TILE_SIZE, DP_upixel15_from_color(color));
+}
+
+// The populated tile index must give exactly the non-null tiles of the dense
+// array, in ascending order.
+static void populated_ok(TEST_PARAMS, DP_LayerContent *lc, const char *title)
+{
+    int count = DP_tile_total_round(DP_layer_content_width(lc),
+                                    DP_layer_content_height(lc));
+    int cursor = 0;
+    int first_mismatch = -1;
+    int mismatches = 0;
+    for (int i = 0; i < count; ++i) {
+        if (DP_layer_content_tile_at_index_noinc(lc, i)) {
+            int actual = DP_layer_content_next_populated_tile(lc, &cursor);
+            if (actual != i && mismatches++ == 0) {
+                first_mismatch = i;
+            }
+        }
+    }
+    INT_EQ_OK(mismatches, 0, "%s: index matches tiles (first mismatch %d)",
+              title, first_mismatch);
+    INT_EQ_OK(DP_layer_content_next_populated_tile(lc, &cursor), -1,
+              "%s: index has no extra tiles", title);
+}
+
+static void empty_layer(TEST_PARAMS)
+{
+    DP_TransientLayerContent *tlc =
+        DP_transient_layer_content_new_init(WIDTH, HEIGHT, NULL);
+    DP_LayerContent *lc = DP_transient_layer_content_persist(tlc);
+    populated_ok(TEST_ARGS, lc, "empty");
+    NOK(DP_layer_content_has_content(lc), "empty layer has no content");
+    DP_Rect bounds;
+    NOK(DP_layer_content_bounds(lc, false, &bounds), "empty layer no bounds");
+    DP_layer_content_decref(lc);
+}
+
+static void sparse_layer(TEST_PARAMS)
+{
+    static const int indexes[] = {0, 5, 17, 18, 40, TILES_X * TILES_Y - 1};
+    DP_TransientLayerContent *tlc =
+        DP_transient_layer_content_new_init(WIDTH, HEIGHT, NULL);
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(indexes); ++i) {
+        fill_tile(tlc, indexes[i], 0xff102030u + DP_size_to_uint32(i));
+    }
+    populated_ok(TEST_ARGS, (DP_LayerContent *)tlc, "transient");
+
+    DP_LayerContent *lc = DP_transient_layer_content_persist(tlc);
+    populated_ok(TEST_ARGS, lc, "persisted");
+    OK(DP_layer_content_has_content(lc), "sparse layer has content");
+    DP_Rect bounds;
+    if (OK(DP_layer_content_bounds(lc, false, &bounds), "sparse bounds")) {
+        INT_EQ_OK(DP_rect_width(bounds), WIDTH, "bounds width");
+        INT_EQ_OK(DP_rect_height(bounds), HEIGHT, "bounds height");
+    }
+
+    // Clear some tiles, add another and make sure the index follows.
+    tlc = DP_transient_layer_content_new(lc);
+    DP_layer_content_decref(lc);
+    DP_transient_layer_content_tile_set_noinc(tlc, NULL, 0);
+    DP_transient_layer_content_tile_set_noinc(tlc, NULL, 17);
+    fill_tile(tlc, 30, 0xff405060u);
+    lc = DP_transient_layer_content_persist(tlc);
+    populated_ok(TEST_ARGS, lc, "modified");
+    NULL_OK(DP_layer_content_tile_at_index_noinc(lc, 0), "tile 0 cleared");
+    NOT_NULL_OK(DP_layer_content_tile_at_index_noinc(lc, 30), "tile 30 set");
+
+    // Resizing by whole tiles shifts the populated tiles around.
+    DP_TransientLayerContent *resized = DP_layer_content_resize(
+        lc, 1, DP_TILE_SIZE, DP_TILE_SIZE * 2, 0, -DP_TILE_SIZE);
+    DP_LayerContent *resized_lc = DP_transient_layer_content_persist(resized);
+    populated_ok(TEST_ARGS, resized_lc, "resized");
+    OK(DP_layer_content_has_content(resized_lc), "resized layer has content");
+
+    DP_layer_content_decref(resized_lc);
+    DP_layer_content_decref(lc);
+}
+
+static void blank_tiles(TEST_PARAMS)
+{
+    DP_TransientLayerContent *tlc =
+        DP_transient_layer_content_new_init(WIDTH, HEIGHT, NULL);
+    fill_tile(tlc, 3, 0xff000000u);
+    fill_tile(tlc, 3, 0x00000000u);
+    DP_LayerContent *lc = DP_transient_layer_content_persist(tlc);
+    populated_ok(TEST_ARGS, lc, "blank");
+    NOK(DP_layer_content_has_content(lc), "blank tiles aren't content");
+    DP_layer_content_decref(lc);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(empty_layer);
+    REGISTER_TEST(sparse_layer);
+    REGISTER_TEST(blank_tiles);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
@@ -0,0 +1,127 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpengine/layer_content.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
+#include <dptest.h>
+
+// Deliberately not a multiple of the tile size, so that the partial tiles
+// along the right and bottom edges get moved too.
+#define WIDTH  300
+#define HEIGHT 230
+
+
+static bool is_blank_area(int x, int y)
+{
+    // A full tile column and a corner stay blank, so that not every tile of
+    // the source is populated.
+    return (x >= 2 * DP_TILE_SIZE && x < 3 * DP_TILE_SIZE)
+        || (x < DP_TILE_SIZE && y >= 3 * DP_TILE_SIZE);
+}
+
+static DP_Pixel15 source_pixel(int x, int y)
+{
+    if (is_blank_area(x, y)) {
+        return DP_pixel15_zero();
+    }
+    else {
+        uint32_t h = DP_int_to_uint32(x) * 2654435761u
+                   ^ DP_int_to_uint32(y) * 2246822519u;
+        uint16_t a = DP_uint32_to_uint16(h % DP_BIT15 + 1u);
+        return (DP_Pixel15){
+            DP_uint32_to_uint16((h >> 8) % (a + 1u)),
+            DP_uint32_to_uint16((h >> 16) % (a + 1u)),
+            DP_uint32_to_uint16((h >> 24) % (a + 1u)),
+            a,
+        };
+    }
+}
+
+static DP_LayerContent *make_source(void)
+{
+    DP_TransientLayerContent *tlc =
+        DP_transient_layer_content_new_init(WIDTH, HEIGHT, NULL);
+    for (int y = 0; y < HEIGHT; ++y) {
+        for (int x = 0; x < WIDTH; ++x) {
+            DP_Pixel15 pixel = source_pixel(x, y);
+            if (pixel.a != 0) {
+                DP_transient_layer_content_pixel_at_set(tlc, 1, x, y, pixel);
+            }
+        }
+    }
+    return DP_transient_layer_content_persist(tlc);
+}
+
+static bool pixels_equal(DP_Pixel15 a, DP_Pixel15 b)
+{
+    return a.b == b.b && a.g == b.g && a.r == b.r && a.a == b.a;
+}
+
+static void resize_ok(TEST_PARAMS, DP_LayerContent *lc, int top, int right,
+                      int bottom, int left)
+{
+    DP_LayerContent *resized = DP_transient_layer_content_persist(
+        DP_layer_content_resize(lc, 1, top, right, bottom, left));
+    int width = WIDTH + left + right;
+    int height = HEIGHT + top + bottom;
+    INT_EQ_OK(DP_layer_content_width(resized), width,
+              "resize %d %d %d %d width", top, right, bottom, left);
+    INT_EQ_OK(DP_layer_content_height(resized), height,
+              "resize %d %d %d %d height", top, right, bottom, left);
+
+    int mismatches = 0;
+    int first_x = -1;
+    int first_y = -1;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            int src_x = x - left;
+            int src_y = y - top;
+            DP_Pixel15 expected =
+                src_x >= 0 && src_x < WIDTH && src_y >= 0 && src_y < HEIGHT
+                    ? source_pixel(src_x, src_y)
+                    : DP_pixel15_zero();
+            DP_Pixel15 actual = DP_layer_content_pixel_at(resized, x, y);
+            if (!pixels_equal(expected, actual) && mismatches++ == 0) {
+                first_x = x;
+                first_y = y;
+            }
+        }
+    }
+    INT_EQ_OK(mismatches, 0,
+              "resize %d %d %d %d moves every pixel (first mismatch at %d, "
+              "%d)",
+              top, right, bottom, left, first_x, first_y);
+
+    DP_layer_content_decref(resized);
+}
+
+static void resize_unaligned(TEST_PARAMS)
+{
+    DP_LayerContent *lc = make_source();
+    // Growing and shrinking on each side by amounts that aren't multiples of
+    // the tile size, in both directions and mixed.
+    resize_ok(TEST_ARGS, lc, 13, 29, 7, 50);
+    resize_ok(TEST_ARGS, lc, -13, -29, -7, -50);
+    resize_ok(TEST_ARGS, lc, -77, 40, 5, 91);
+    resize_ok(TEST_ARGS, lc, 100, -130, -3, -65);
+    resize_ok(TEST_ARGS, lc, 0, 0, 0, 1);
+    resize_ok(TEST_ARGS, lc, -1, 0, 0, 0);
+    resize_ok(TEST_ARGS, lc, 63, -63, -63, 63);
+    // Moves everything off of the canvas.
+    resize_ok(TEST_ARGS, lc, -200, 37, 11, -290);
+    // Aligned ones take a different path, they must agree.
+    resize_ok(TEST_ARGS, lc, 64, -64, 128, -128);
+    DP_layer_content_decref(lc);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(resize_unaligned);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
@@ -0,0 +1,195 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/cpu.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
+#include <dpmsg/blend_mode.h>
+#include <dptest.h>
+
+
+// Checksums of pigment and OKLab blending, both for brush masks and for
+// blending whole layers, taken from the implementation before brush color
+// conversions were hoisted out of the pixel loops. Every client must render
+// the same pixels, so these must keep matching. The vector implementations
+// round differently from the scalar one, so each CPU support level has its
+// own checksums. Set the DP_CPU_SUPPORT environment variable to switch which
+// one to use. Modes that only apply to brushes have no layer checksums.
+typedef struct BlendFixture {
+    int blend_mode;
+    // Indexed by CPU support level: default, SSE 4.2, AVX, AVX2.
+    uint64_t expected_mask_checksums[4];
+    uint64_t expected_pixels_checksums[4];
+} BlendFixture;
+
+static const BlendFixture fixtures[] = {
+    {DP_BLEND_MODE_PIGMENT,
+     {0x75aad158aeb8ca14u, 0x7ee6044181249876u,
+      0x75aad158aeb8ca14u, 0x7ee6044181249876u},
+     {0x5c94b82f9a1e857bu, 0x37be1ef4a8e75db1u,
+      0x5c94b82f9a1e857bu, 0x37be1ef4a8e75db1u}},
+    {DP_BLEND_MODE_PIGMENT_ALPHA,
+     {0xbbf42aa220d01346u, 0x060ce147132621b8u,
+      0xbbf42aa220d01346u, 0x060ce147132621b8u},
+     {0x9fc606a077d39839u, 0x65f3a69193630924u,
+      0x9fc606a077d39839u, 0x65f3a69193630924u}},
+    {DP_BLEND_MODE_PIGMENT_AND_ERASER,
+     {0xa4a57bf33476b2c3u, 0xea441a4b9725c477u,
+      0xa4a57bf33476b2c3u, 0xea441a4b9725c477u},
+     {0}},
+    {DP_BLEND_MODE_OKLAB_NORMAL,
+     {0x629e19ed5124ef07u, 0xe80cfa0f50981715u,
+      0xe80cfa0f50981715u, 0xe54eb00dbe1475f2u},
+     {0x9c94e29aac619302u, 0x915a6bfbee1e8056u,
+      0x9c94e29aac619302u, 0x516296ac0fe3ef3cu}},
+    {DP_BLEND_MODE_OKLAB_RECOLOR,
+     {0xb36a1851817f8294u, 0xeecf684ca07f31e5u,
+      0xeecf684ca07f31e5u, 0x7c86152273712a6du},
+     {0xf899f02d12d2672fu, 0xf899f02d12d2672fu,
+      0xf899f02d12d2672fu, 0xf899f02d12d2672fu}},
+    {DP_BLEND_MODE_OKLAB_NORMAL_AND_ERASER,
+     {0x37c49c5e05f7ff2eu, 0xc88a706abab88876u,
+      0xc88a706abab88876u, 0x3c25671b0c042ea9u},
+     {0}},
+};
+
+static const DP_UPixel15 brush_colors[] = {
+    {0, 0, 0, DP_BIT15},
+    {DP_BIT15, DP_BIT15, DP_BIT15, DP_BIT15},
+    {3210, 17000, 29876, DP_BIT15},
+    {24000, 1000, 12345, 20000},
+};
+
+static const uint16_t opacities[] = {DP_BIT15, 23456, 1000};
+
+
+static uint32_t next_random(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13u;
+    x ^= x >> 17u;
+    x ^= x << 5u;
+    *state = x;
+    return x;
+}
+
+// Premultiplied pixels with the odd fully transparent and fully opaque one.
+static void fill_pixels(DP_Pixel15 *pixels, uint32_t *state)
+{
+    for (int i = 0; i < DP_TILE_LENGTH; ++i) {
+        uint32_t r = next_random(state);
+        uint16_t a;
+        switch (r % 8u) {
+        case 0:
+            a = 0;
+            break;
+        case 1:
+            a = DP_BIT15;
+            break;
+        default:
+            a = DP_uint32_to_uint16((r >> 3u) % (DP_BIT15 + 1u));
+            break;
+        }
+        uint32_t c = next_random(state);
+        pixels[i] = (DP_Pixel15){
+            DP_uint32_to_uint16((c & 0xffffu) % (a + 1u)),
+            DP_uint32_to_uint16((c >> 16u) % (a + 1u)),
+            DP_uint32_to_uint16(next_random(state) % (a + 1u)),
+            a,
+        };
+    }
+}
+
+static void fill_mask(uint16_t *mask, uint32_t *state)
+{
+    for (int i = 0; i < DP_TILE_LENGTH; ++i) {
+        uint32_t r = next_random(state);
+        mask[i] = r % 4u == 0 ? 0
+                : r % 4u == 1 ? DP_BIT15
+                              : DP_uint32_to_uint16((r >> 2u) % DP_BIT15);
+    }
+}
+
+static uint64_t checksum_pixels(uint64_t hash, const DP_Pixel15 *pixels)
+{
+    for (int i = 0; i < DP_TILE_LENGTH; ++i) {
+        DP_Pixel15 pixel = pixels[i];
+        hash = (hash ^ ((uint64_t)pixel.b | (uint64_t)pixel.g << 16u
+                        | (uint64_t)pixel.r << 32u | (uint64_t)pixel.a << 48u))
+             * 1099511628211u;
+    }
+    return hash;
+}
+
+static uint64_t blend_mask_checksum(int blend_mode)
+{
+    DP_Pixel15 *dst = DP_malloc_simd(DP_TILE_BYTES);
+    uint16_t *mask = DP_malloc_simd(DP_TILE_LENGTH * sizeof(*mask));
+    uint32_t state = 0x12345678u;
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(brush_colors); ++i) {
+        for (size_t j = 0; j < DP_ARRAY_LENGTH(opacities); ++j) {
+            fill_pixels(dst, &state);
+            fill_mask(mask, &state);
+            // Whole tile at once, then a narrower area to hit the skips and
+            // the leftover pixels that don't fill a whole vector.
+            DP_blend_mask(dst, brush_colors[i], blend_mode, mask, opacities[j],
+                          DP_TILE_SIZE, DP_TILE_SIZE, 0, 0);
+            DP_blend_mask(dst + 3, brush_colors[i], blend_mode, mask,
+                          opacities[j], 37, 50, DP_TILE_SIZE - 37,
+                          DP_TILE_SIZE - 37);
+            hash = checksum_pixels(hash, dst);
+        }
+    }
+    DP_free_simd(mask);
+    DP_free_simd(dst);
+    return hash;
+}
+
+static uint64_t blend_pixels_checksum(int blend_mode)
+{
+    DP_Pixel15 *dst = DP_malloc_simd(DP_TILE_BYTES);
+    DP_Pixel15 *src = DP_malloc_simd(DP_TILE_BYTES);
+    uint32_t state = 0x87654321u;
+    uint64_t hash = 14695981039346656037u;
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(opacities); ++i) {
+        fill_pixels(dst, &state);
+        fill_pixels(src, &state);
+        DP_blend_pixels(dst, src, DP_TILE_LENGTH, opacities[i], blend_mode);
+        DP_blend_pixels(dst + 1, src + 2, 29, opacities[i], blend_mode);
+        hash = checksum_pixels(hash, dst);
+    }
+    DP_free_simd(src);
+    DP_free_simd(dst);
+    return hash;
+}
+
+static void pigment_oklab_match_checksums(TEST_PARAMS)
+{
+    int level = (int)DP_cpu_support;
+    for (size_t i = 0; i < DP_ARRAY_LENGTH(fixtures); ++i) {
+        const BlendFixture *f = &fixtures[i];
+        const char *name = DP_blend_mode_enum_name(f->blend_mode);
+        uint64_t mask_checksum = blend_mask_checksum(f->blend_mode);
+        OK(mask_checksum == f->expected_mask_checksums[level],
+           "%s: mask checksum 0x%016llx", name,
+           (unsigned long long)mask_checksum);
+        if (DP_blend_mode_valid_for_layer(f->blend_mode)) {
+            uint64_t pixels_checksum = blend_pixels_checksum(f->blend_mode);
+            OK(pixels_checksum == f->expected_pixels_checksums[level],
+               "%s: pixels checksum 0x%016llx", name,
+               (unsigned long long)pixels_checksum);
+        }
+    }
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(pigment_oklab_match_checksums);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
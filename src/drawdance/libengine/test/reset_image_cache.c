@@ -0,0 +1,207 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpengine/canvas_history.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/snapshots.h>
+#include <dpengine/tile.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/message.h>
+#include <dpmsg/messages.h>
+#include <dptest.h>
+
+#define CANVAS_TILES 4
+#define CANVAS_SIZE  (CANVAS_TILES * DP_TILE_SIZE)
+#define TILE_COUNT   (CANVAS_TILES * CANVAS_TILES)
+#define LAYER_ID     0x0101
+
+
+typedef struct ResetImageTiles {
+    int count;
+    size_t size;
+    unsigned char *data;
+} ResetImageTiles;
+
+static void handle_ok(TEST_PARAMS, DP_CanvasHistory *ch, DP_DrawContext *dc,
+                      DP_Message *msg)
+{
+    OK(DP_canvas_history_handle(ch, dc, msg), "handle %s",
+       DP_message_type_enum_name(DP_message_type(msg)));
+    DP_message_decref(msg);
+}
+
+// Canvas with one layer where every tile has a different color, the seed
+// allows making canvases whose tiles are all different from each other.
+static DP_CanvasState *make_canvas(TEST_PARAMS, uint32_t seed)
+{
+    DP_CanvasHistory *ch = DP_canvas_history_new(NULL, NULL, false, NULL);
+    DP_DrawContext *dc = DP_draw_context_new();
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_canvas_resize_new(1, 0, CANVAS_SIZE, CANVAS_SIZE, 0));
+    handle_ok(TEST_ARGS, ch, dc,
+              DP_msg_layer_tree_create_new(1, LAYER_ID, 0, 0, 0, 0, "", 0));
+    handle_ok(TEST_ARGS, ch, dc, DP_msg_undo_point_new(1));
+    for (int i = 0; i < TILE_COUNT; ++i) {
+        uint32_t color = 0xff000000u | (seed << 8u) | DP_int_to_uint32(i);
+        handle_ok(TEST_ARGS, ch, dc,
+                  DP_msg_fill_rect_new(
+                      1, LAYER_ID, DP_BLEND_MODE_NORMAL,
+                      DP_int_to_uint32(i % CANVAS_TILES * DP_TILE_SIZE),
+                      DP_int_to_uint32(i / CANVAS_TILES * DP_TILE_SIZE),
+                      DP_TILE_SIZE, DP_TILE_SIZE, color));
+    }
+    DP_CanvasState *cs = DP_canvas_history_get(ch);
+    DP_draw_context_free(dc);
+    DP_canvas_history_free(ch);
+    return cs;
+}
+
+static void collect_tile(void *user, const DP_ResetEntry *entry)
+{
+    if (entry->type == DP_RESET_ENTRY_TILE) {
+        ResetImageTiles *rit = user;
+        const DP_ResetEntryTile *ret = &entry->tile;
+        rit->data = DP_realloc(rit->data, rit->size + ret->size);
+        memcpy(rit->data + rit->size, ret->data, ret->size);
+        rit->size += ret->size;
+        ++rit->count;
+    }
+}
+
+static ResetImageTiles build(DP_CanvasState *cs)
+{
+    DP_ResetImageOptions options = {
+        false, false, false, DP_RESET_IMAGE_COMPRESSION_ZSTD8LE, 0, 0, NULL};
+    ResetImageTiles rit = {0, 0, NULL};
+    DP_reset_image_build_with(cs, &options, collect_tile, &rit);
+    return rit;
+}
+
+static void reset_cache(void)
+{
+    DP_reset_image_cache_clear();
+    DP_reset_image_cache_max_bytes_set(DP_RESET_IMAGE_CACHE_MAX_BYTES_DEFAULT);
+}
+
+
+static void cache_hits_give_same_output(TEST_PARAMS)
+{
+    reset_cache();
+    DP_CanvasState *cs = make_canvas(TEST_ARGS, 1);
+
+    DP_ResetImageCacheStatistics before = DP_reset_image_cache_statistics();
+    ResetImageTiles uncached = build(cs);
+    DP_ResetImageCacheStatistics middle = DP_reset_image_cache_statistics();
+    ResetImageTiles cached = build(cs);
+    DP_ResetImageCacheStatistics after = DP_reset_image_cache_statistics();
+
+    INT_EQ_OK(uncached.count, TILE_COUNT, "got all tiles uncached");
+    INT_EQ_OK(cached.count, TILE_COUNT, "got all tiles cached");
+    UINT_EQ_OK(middle.entries, TILE_COUNT, "every tile got cached");
+    UINT_EQ_OK(middle.hits - before.hits, 0, "no hits on first build");
+    UINT_EQ_OK(after.hits - middle.hits, TILE_COUNT,
+               "all hits on second build");
+    OK(uncached.size == cached.size
+           && memcmp(uncached.data, cached.data, cached.size) == 0,
+       "cached output is identical");
+
+    DP_free(cached.data);
+    DP_free(uncached.data);
+    DP_canvas_state_decref(cs);
+    reset_cache();
+}
+
+static void cache_charges_for_stale_tiles(TEST_PARAMS)
+{
+    reset_cache();
+    DP_CanvasState *cs = make_canvas(TEST_ARGS, 2);
+
+    ResetImageTiles rit = build(cs);
+    DP_ResetImageCacheStatistics rics = DP_reset_image_cache_statistics();
+    OK(rics.used_bytes >= rit.size
+           && rics.used_bytes < rit.size + TILE_COUNT * DP_TILE_BYTES,
+       "used bytes don't include live tiles (%zu)", rics.used_bytes);
+
+    // Only room for half of the tiles, the budget must hold.
+    size_t max_bytes = rics.used_bytes / 2;
+    DP_reset_image_cache_max_bytes_set(max_bytes);
+    DP_free(build(cs).data);
+    rics = DP_reset_image_cache_statistics();
+    OK(rics.used_bytes <= max_bytes, "used bytes within budget (%zu <= %zu)",
+       rics.used_bytes, max_bytes);
+    OK(rics.entries < TILE_COUNT, "not all tiles cached (%u)", rics.entries);
+
+    // Now the cache is the only thing keeping the tiles alive.
+    DP_reset_image_cache_max_bytes_set(DP_RESET_IMAGE_CACHE_MAX_BYTES_DEFAULT);
+    DP_free(build(cs).data);
+    DP_canvas_state_decref(cs);
+    rics = DP_reset_image_cache_statistics();
+    OK(rics.used_bytes >= rit.size + TILE_COUNT * DP_TILE_BYTES,
+       "used bytes include stale tiles (%zu >= %zu)", rics.used_bytes,
+       rit.size + TILE_COUNT * DP_TILE_BYTES);
+
+    DP_free(rit.data);
+    reset_cache();
+}
+
+static void cache_holds_more_live_tiles_than_fit_pinned(TEST_PARAMS)
+{
+    reset_cache();
+    DP_CanvasState *cs = make_canvas(TEST_ARGS, 5);
+
+    // Like a big canvas, where the tiles themselves are way larger than the
+    // budget. Repeated reset images must still hit every time.
+    DP_reset_image_cache_max_bytes_set(TILE_COUNT * DP_TILE_BYTES / 2);
+    DP_free(build(cs).data);
+    DP_ResetImageCacheStatistics before = DP_reset_image_cache_statistics();
+    DP_free(build(cs).data);
+    DP_ResetImageCacheStatistics after = DP_reset_image_cache_statistics();
+    UINT_EQ_OK(after.entries, TILE_COUNT, "every tile cached");
+    UINT_EQ_OK(after.hits - before.hits, TILE_COUNT, "all hits");
+    UINT_EQ_OK(after.misses - before.misses, 0, "no misses");
+
+    DP_canvas_state_decref(cs);
+    reset_cache();
+}
+
+static void cache_evicts_stale_tiles_first(TEST_PARAMS)
+{
+    reset_cache();
+    DP_CanvasState *live = make_canvas(TEST_ARGS, 3);
+    DP_CanvasState *stale = make_canvas(TEST_ARGS, 4);
+
+    // The live canvas gets cached first, so it would be the first to go if
+    // eviction were purely least recently used.
+    DP_free(build(live).data);
+    size_t live_bytes = DP_reset_image_cache_statistics().used_bytes;
+    DP_free(build(stale).data);
+    DP_canvas_state_decref(stale);
+    DP_ResetImageCacheStatistics rics = DP_reset_image_cache_statistics();
+    UINT_EQ_OK(rics.entries, TILE_COUNT * 2, "both canvases cached");
+
+    DP_reset_image_cache_max_bytes_set(live_bytes);
+    rics = DP_reset_image_cache_statistics();
+    UINT_EQ_OK(rics.entries, TILE_COUNT, "stale tiles evicted");
+
+    DP_ResetImageCacheStatistics before = DP_reset_image_cache_statistics();
+    DP_free(build(live).data);
+    DP_ResetImageCacheStatistics after = DP_reset_image_cache_statistics();
+    UINT_EQ_OK(after.hits - before.hits, TILE_COUNT, "live tiles still cached");
+
+    DP_canvas_state_decref(live);
+    reset_cache();
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(cache_hits_give_same_output);
+    REGISTER_TEST(cache_charges_for_stale_tiles);
+    REGISTER_TEST(cache_holds_more_live_tiles_than_fit_pinned);
+    REGISTER_TEST(cache_evicts_stale_tiles_first);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpengine/pixels.h>
+#include <dpengine/sample_cache.h>
+#include <dpengine/tile.h>
+#include <dptest.h>
+#include <math.h>
+
+#define DIAMETER    128
+#define TILE_COUNT  1024
+#define MAX_SUMMARY 512
+
+
+typedef struct SampleResult {
+    float weight, red, green, blue, alpha;
+} SampleResult;
+
+static uint16_t *full_mask(void)
+{
+    uint16_t *mask = DP_malloc(sizeof(*mask) * DP_TILE_LENGTH);
+    for (int i = 0; i < DP_TILE_LENGTH; ++i) {
+        mask[i] = DP_BIT15;
+    }
+    return mask;
+}
+
+static SampleResult sample_cached(DP_SampleCache *sc, DP_Tile *tile,
+                                  int tile_index, const uint16_t *mask)
+{
+    SampleResult sr = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    DP_sample_cache_sample(sc, tile, tile_index, TILE_COUNT, mask,
+                           DP_TILE_SIZE, 0, 0, DP_TILE_SIZE, DP_TILE_SIZE,
+                           DIAMETER, false, &sr.weight, &sr.red, &sr.green,
+                           &sr.blue, &sr.alpha);
+    return sr;
+}
+
+static SampleResult sample_exact(DP_Tile *tile, const uint16_t *mask)
+{
+    SampleResult sr = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+    DP_tile_sample(tile, mask, 0, 0, DP_TILE_SIZE, DP_TILE_SIZE, 0, false,
+                   &sr.weight, &sr.red, &sr.green, &sr.blue, &sr.alpha);
+    return sr;
+}
+
+static bool close_to(float a, float b)
+{
+    return fabsf(a - b) <= fabsf(b) * 0.001f;
+}
+
+
+static void matches_exact_sampling(TEST_PARAMS)
+{
+    DP_SampleCache *sc = DP_sample_cache_new();
+    uint16_t *mask = full_mask();
+    DP_Tile *tile = DP_tile_new_zebra(0, (DP_Pixel15){0, 0, DP_BIT15, DP_BIT15},
+                                      (DP_Pixel15){0, 8192, 0, 16384});
+
+    SampleResult cached = sample_cached(sc, tile, 0, mask);
+    SampleResult exact = sample_exact(tile, mask);
+    OK(close_to(cached.weight, exact.weight), "weight %f ~ %f", cached.weight,
+       exact.weight);
+    OK(close_to(cached.red, exact.red), "red %f ~ %f", cached.red, exact.red);
+    OK(close_to(cached.green, exact.green), "green %f ~ %f", cached.green,
+       exact.green);
+    OK(close_to(cached.alpha, exact.alpha), "alpha %f ~ %f", cached.alpha,
+       exact.alpha);
+
+    DP_tile_decref(tile);
+    DP_free(mask);
+    DP_sample_cache_free(sc);
+}
+
+static void summaries_are_bounded(TEST_PARAMS)
+{
+    DP_SampleCache *sc = DP_sample_cache_new();
+    uint16_t *mask = full_mask();
+    DP_Tile *tile = DP_tile_new_from_bgra(0, 0xff336699u);
+
+    int max_count = 0;
+    for (int i = 0; i < TILE_COUNT; ++i) {
+        sample_cached(sc, tile, i, mask);
+        max_count = DP_max_int(max_count, DP_sample_cache_summary_count(sc));
+    }
+    OK(max_count > 0, "summaries got cached");
+    OK(max_count <= MAX_SUMMARY, "summary count bounded (%d <= %d)",
+       max_count, MAX_SUMMARY);
+    OK(DP_tile_refcount(tile) <= MAX_SUMMARY + 1,
+       "flushed summaries release their tiles (refcount %d)",
+       DP_tile_refcount(tile));
+
+    DP_tile_decref(tile);
+    DP_free(mask);
+    DP_sample_cache_free(sc);
+}
+
+static void clear_releases_tiles(TEST_PARAMS)
+{
+    DP_SampleCache *sc = DP_sample_cache_new();
+    uint16_t *mask = full_mask();
+    DP_Tile *tile = DP_tile_new_from_bgra(0, 0xff336699u);
+
+    for (int i = 0; i < 10; ++i) {
+        sample_cached(sc, tile, i, mask);
+    }
+    INT_EQ_OK(DP_sample_cache_summary_count(sc), 10, "one summary per tile");
+    INT_EQ_OK(DP_tile_refcount(tile), 11, "cache holds the tiles");
+
+    DP_sample_cache_clear(sc);
+    INT_EQ_OK(DP_sample_cache_summary_count(sc), 0, "no summaries after clear");
+    INT_EQ_OK(DP_tile_refcount(tile), 1, "tiles released after clear");
+
+    SampleResult sr = sample_cached(sc, tile, 0, mask);
+    OK(sr.weight > 0.0f, "cache still usable after clear");
+    INT_EQ_OK(DP_sample_cache_summary_count(sc), 1, "summary rebuilt");
+
+    DP_sample_cache_clear(NULL);
+    DP_tile_decref(tile);
+    DP_free(mask);
+    DP_sample_cache_free(sc);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(matches_exact_sampling);
+    REGISTER_TEST(summaries_are_bounded);
+    REGISTER_TEST(clear_releases_tiles);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
@@ -1579,7 +1579,7 @@ DP_Player *DP_load_recording(const char *path, DP_LoadResult *out_result)
 {
     if (path) {
         DP_PERF_BEGIN_DETAIL(fn, "recording", "path=%s", path);
-        DP_Input *input = DP_file_input_new_from_path(path);
+        DP_Input *input = DP_file_input_new_mapped_from_path(path);
         DP_Player *player;
         if (input) {
             player =
@@ -1609,7 +1609,7 @@ DP_Player *DP_load_debug_dump(const char *path, DP_LoadResult *out_result)
 {
     if (path) {
         DP_PERF_BEGIN_DETAIL(fn, "dump", "path=%s", path);
-        DP_Input *input = DP_file_input_new_from_path(path);
+        DP_Input *input = DP_file_input_new_mapped_from_path(path);
         DP_Player *player;
         if (input) {
             return DP_player_new(DP_PLAYER_TYPE_DEBUG_DUMP, NULL, input,
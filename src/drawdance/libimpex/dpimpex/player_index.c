@@ -1,13 +1,16 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #include "player_index.h"
 #include "image_impex.h"
+#include <dpcommon/atomic.h>
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
 #include <dpcommon/conversions.h>
 #include <dpcommon/input.h>
 #include <dpcommon/output.h>
 #include <dpcommon/perf.h>
+#include <dpcommon/threading.h>
 #include <dpcommon/vector.h>
+#include <dpcommon/worker.h>
 #include <dpengine/annotation.h>
 #include <dpengine/annotation_list.h>
 #include <dpengine/canvas_history.h>
@@ -29,6 +32,7 @@
 #include <dpmsg/acl.h>
 #include <dpmsg/binary_reader.h>
 #include <dpmsg/blend_mode.h>
+#include <dpmsg/message_queue.h>
 #include <dpmsg/protover.h>
 #include <dpmsg/text_reader.h>
 #include <parson.h>
@@ -41,16 +45,32 @@
 #define INDEX_VERSION_LENGTH  2
 #define INDEX_HEADER_LENGTH   (INDEX_MAGIC_LENGTH + INDEX_VERSION_LENGTH + 12)
 #define INITAL_ENTRY_CAPACITY 64
+// Replay stalls when this many snapshots are waiting to be written, so that
+// a slow output can't make the pending canvas states pile up.
+#define MAX_PENDING_SNAPSHOTS 4
+// Layers with fewer tiles than this get decompressed inline when loading.
+#define INDEX_TILE_WORKER_MIN_COUNT 16
 
 static_assert(INDEX_MAGIC_LENGTH < sizeof(DP_OutputBinaryEntry),
               "index header fits into output binary entry");
 
+static DP_Atomic build_threaded = DP_ATOMIC_INIT(1);
+
 struct DP_PlayerIndexEntrySnapshot {
     DP_CanvasState *cs;
     int message_count;
     DP_Message *messages[];
 };
 
+// Threads to compress or decompress tiles with, each with a draw context of
+// its own for the intermediate 8 bit tile buffer.
+typedef struct DP_IndexTileWorker {
+    DP_Worker *worker;
+    DP_Semaphore *sem;
+    int thread_count;
+    DP_DrawContext **dcs;
+} DP_IndexTileWorker;
+
 typedef struct DP_BuildIndexTileMap {
     DP_Tile *t;
     size_t offset;
@@ -91,13 +111,32 @@ typedef struct DP_BuildIndexMaps {
     } timeline;
 } DP_BuildIndexMaps;
 
+// Tiles compressed ahead of time by the tile worker, to be written in order.
+typedef struct DP_BuildIndexPendingTile {
+    DP_Tile *t;
+    unsigned char *buffer; // Compressed size as uint16 followed by the data.
+    size_t size;
+    UT_hash_handle hh;
+} DP_BuildIndexPendingTile;
+
+// Everything needed to write a snapshot, captured on the replay thread. The
+// canvas state and messages are immutable, so they can be written out on
+// another thread while replay continues.
+typedef struct DP_BuildIndexSnapshot {
+    struct DP_BuildIndexContext *c;
+    long long message_index;
+    size_t message_offset;
+    DP_CanvasState *cs;
+    DP_Vector messages;
+} DP_BuildIndexSnapshot;
+
 typedef struct DP_BuildIndexEntryContext {
     DP_Output *output;
-    DP_AclState *acls;
-    DP_LocalState *local_state;
-    DP_CanvasHistory *ch;
+    DP_BuildIndexSnapshot *snapshot;
     DP_CanvasState *cs;
     DP_DrawContext *dc;
+    DP_IndexTileWorker *tile_worker;
+    DP_BuildIndexPendingTile *pending_tiles;
     DP_BuildIndexMaps current;
     DP_BuildIndexMaps *last;
     int message_count;
@@ -127,6 +166,14 @@ typedef struct DP_BuildIndexContext {
     DP_PlayerIndexShouldSnapshotFn should_snapshot_fn;
     DP_PlayerIndexProgressFn progress_fn;
     void *user;
+    struct {
+        DP_Worker *worker;
+        DP_Semaphore *sem;
+        DP_DrawContext *dc;
+        DP_IndexTileWorker *tile_worker;
+        DP_Atomic failed;
+        char *error;
+    } writer;
 } DP_BuildIndexContext;
 
 struct DP_BuildIndexLayerProps {
@@ -144,6 +191,55 @@ struct DP_BuildIndexLayerProps {
     uint8_t group;
 };
 
+static DP_IndexTileWorker *index_tile_worker_new(size_t element_size,
+                                                  DP_WorkerJobFn job_fn)
+{
+    DP_Semaphore *sem = DP_semaphore_new(0);
+    if (!sem) {
+        return NULL;
+    }
+
+    DP_Worker *worker =
+        DP_worker_new(64, element_size, DP_worker_cpu_count(32), job_fn);
+    if (!worker) {
+        DP_semaphore_free(sem);
+        return NULL;
+    }
+
+    int thread_count = DP_worker_thread_count(worker);
+    DP_IndexTileWorker *itw = DP_malloc(sizeof(*itw));
+    itw->worker = worker;
+    itw->sem = sem;
+    itw->thread_count = thread_count;
+    itw->dcs = DP_malloc(sizeof(*itw->dcs) * DP_int_to_size(thread_count));
+    for (int i = 0; i < thread_count; ++i) {
+        itw->dcs[i] = DP_draw_context_new();
+    }
+    return itw;
+}
+
+static void index_tile_worker_free(DP_IndexTileWorker *itw)
+{
+    if (itw) {
+        DP_worker_free_join(itw->worker);
+        int thread_count = itw->thread_count;
+        for (int i = 0; i < thread_count; ++i) {
+            DP_draw_context_free(itw->dcs[i]);
+        }
+        DP_free(itw->dcs);
+        DP_semaphore_free(itw->sem);
+        DP_free(itw);
+    }
+}
+
+static void index_tile_worker_wait(DP_IndexTileWorker *itw, int count)
+{
+    if (count > 0) {
+        DP_SEMAPHORE_MUST_WAIT_N(itw->sem, count);
+    }
+}
+
+
 static bool write_index_header(DP_BuildIndexContext *c)
 {
     return DP_OUTPUT_WRITE_LITTLEENDIAN(
@@ -181,21 +277,6 @@ static bool write_index_history_message_dec(DP_BuildIndexEntryContext *e,
     }
 }
 
-static bool init_reset_image(void *user, DP_CanvasState *cs)
-{
-    DP_BuildIndexEntryContext *e = user;
-    e->cs = cs;
-    return write_index_history_message_dec(
-               e, DP_acl_state_msg_feature_access_all_new(0))
-        && write_index_history_message_dec(
-               e, DP_acl_state_msg_feature_limits_none_new(0));
-}
-
-static bool write_reset_image_message(void *user, DP_Message *msg)
-{
-    return write_index_history_message_dec(user, msg);
-}
-
 static bool write_index_history(DP_BuildIndexEntryContext *e)
 {
     bool error;
@@ -204,27 +285,57 @@ static bool write_index_history(DP_BuildIndexEntryContext *e)
         return false;
     }
 
-    if (!DP_canvas_history_reset_image_new(e->ch, init_reset_image,
-                                           write_reset_image_message, e)) {
-        return false;
-    }
-
-    // The state of the permissions at this point.
-    if (!DP_acl_state_reset_image_build(
-            e->acls, 0, DP_ACL_STATE_RESET_IMAGE_RECORDING_FLAGS, NULL, NULL,
-            write_reset_image_message, e)) {
-        return false;
-    }
-    // Local changes (hidden layers, local canvas background).
-    if (!DP_local_state_reset_image_build(e->local_state, e->dc,
-                                          write_reset_image_message, e)) {
-        return false;
+    DP_Vector *messages = &e->snapshot->messages;
+    size_t count = messages->used;
+    for (size_t i = 0; i < count; ++i) {
+        DP_Message *msg = DP_message_vector_at(messages, i);
+        if (!write_index_history_message_dec(e, DP_message_incref(msg))) {
+            return false;
+        }
     }
 
     e->offset.history = offset;
     return true;
 }
 
+static bool collect_reset_image_state(void *user, DP_CanvasState *cs)
+{
+    DP_BuildIndexSnapshot *s = user;
+    s->cs = DP_canvas_state_incref(cs);
+    DP_message_vector_push_noinc(&s->messages,
+                                 DP_acl_state_msg_feature_access_all_new(0));
+    DP_message_vector_push_noinc(&s->messages,
+                                 DP_acl_state_msg_feature_limits_none_new(0));
+    return true;
+}
+
+static bool collect_reset_image_message(void *user, DP_Message *msg)
+{
+    DP_BuildIndexSnapshot *s = user;
+    DP_message_vector_push_noinc(&s->messages, msg);
+    return true;
+}
+
+static bool collect_index_history(DP_BuildIndexContext *c,
+                                  DP_BuildIndexSnapshot *s)
+{
+    return DP_canvas_history_reset_image_new(c->ch, collect_reset_image_state,
+                                             collect_reset_image_message, s)
+        // The state of the permissions at this point.
+        && DP_acl_state_reset_image_build(
+            c->acls, 0, DP_ACL_STATE_RESET_IMAGE_RECORDING_FLAGS, NULL, NULL,
+            collect_reset_image_message, s)
+        // Local changes (hidden layers, local canvas background).
+        && DP_local_state_reset_image_build(c->local_state, c->dc,
+                                            collect_reset_image_message, s);
+}
+
+static void dispose_index_snapshot(DP_BuildIndexSnapshot *s)
+{
+    DP_message_vector_dispose(&s->messages);
+    DP_canvas_state_decref_nullable(s->cs);
+}
+
 static DP_BuildIndexTileMap *search_tile(DP_BuildIndexTileMap *tiles,
                                          DP_Tile *t)
 {
@@ -264,12 +375,105 @@ static unsigned char *get_compression_buffer(size_t size, void *user)
     return pool + sizeof(uint16_t);
 }
 
-static size_t write_index_tile(DP_BuildIndexEntryContext *e, DP_Tile *t)
+static unsigned char *get_pending_tile_buffer(size_t size, void *user)
+{
+    DP_BuildIndexPendingTile *pt = user;
+    pt->buffer = DP_malloc(sizeof(uint16_t) + size);
+    return pt->buffer + sizeof(uint16_t);
+}
+
+struct DP_BuildIndexTileJob {
+    DP_IndexTileWorker *itw;
+    DP_BuildIndexPendingTile *pt;
+};
+
+static void compress_index_tile_job(void *element, int thread_index)
 {
+    struct DP_BuildIndexTileJob *job = element;
+    DP_IndexTileWorker *itw = job->itw;
+    DP_BuildIndexPendingTile *pt = job->pt;
     size_t size = DP_tile_compress_deflate(
-        t, DP_draw_context_tile8_buffer(e->dc), get_compression_buffer, e->dc);
+        pt->t, DP_draw_context_tile8_buffer(itw->dcs[thread_index]),
+        get_pending_tile_buffer, pt);
     if (size == 0) {
-        return 0;
+        DP_warn("Error compressing index tile: %s", DP_error());
+        DP_free(pt->buffer);
+        pt->buffer = NULL;
+    }
+    else {
+        DP_write_littleendian_uint16(DP_size_to_uint16(size), pt->buffer);
+        pt->size = size;
+    }
+    DP_SEMAPHORE_MUST_POST(itw->sem);
+}
+
+// Compresses the layer's tiles that haven't been written yet in parallel. The
+// results get picked up by write_index_tile, which writes them out in order.
+static void compress_index_tiles(DP_BuildIndexEntryContext *e,
+                                 DP_LayerContent *lc, DP_TileCounts tile_counts)
+{
+    DP_IndexTileWorker *itw = e->tile_worker;
+    if (!itw) {
+        return;
+    }
+
+    int count = 0;
+    for (int y = 0; y < tile_counts.y; ++y) {
+        for (int x = 0; x < tile_counts.x; ++x) {
+            DP_Tile *t = DP_layer_content_tile_at_noinc(lc, x, y);
+            DP_BuildIndexPendingTile *pt;
+            HASH_FIND_PTR(e->pending_tiles, &t, pt);
+            bool should_compress = t && !pt
+                                && !search_tile(e->current.tiles, t)
+                                && !search_tile(e->last->tiles, t);
+            if (should_compress) {
+                pt = DP_malloc(sizeof(*pt));
+                pt->t = t;
+                pt->buffer = NULL;
+                pt->size = 0;
+                HASH_ADD_PTR(e->pending_tiles, t, pt);
+                struct DP_BuildIndexTileJob job = {itw, pt};
+                DP_worker_push(itw->worker, &job);
+                ++count;
+            }
+        }
+    }
+
+    index_tile_worker_wait(itw, count);
+}
+
+static void dispose_pending_tiles(DP_BuildIndexEntryContext *e)
+{
+    DP_BuildIndexPendingTile *pt, *tmp;
+    HASH_ITER(hh, e->pending_tiles, pt, tmp) {
+        HASH_DEL(e->pending_tiles, pt);
+        DP_free(pt->buffer);
+        DP_free(pt);
+    }
+}
+
+static size_t write_index_tile(DP_BuildIndexEntryContext *e, DP_Tile *t)
+{
+    unsigned char *buffer;
+    size_t size;
+    DP_BuildIndexPendingTile *pt;
+    HASH_FIND_PTR(e->pending_tiles, &t, pt);
+    if (pt) {
+        if (!pt->buffer) {
+            DP_error_set("Error compressing index tile");
+            return 0;
+        }
+        buffer = pt->buffer;
+        size = pt->size;
+    }
+    else {
+        size = DP_tile_compress_deflate(t, DP_draw_context_tile8_buffer(e->dc),
+                                        get_compression_buffer, e->dc);
+        if (size == 0) {
+            return 0;
+        }
+        buffer = DP_draw_context_pool(e->dc);
+        DP_write_littleendian_uint16(DP_size_to_uint16(size), buffer);
     }
 
     bool error;
@@ -278,12 +482,16 @@ static size_t write_index_tile(DP_BuildIndexEntryContext *e, DP_Tile *t)
         return 0;
     }
 
-    unsigned char *buffer = DP_draw_context_pool(e->dc);
-    DP_write_littleendian_uint16(DP_size_to_uint16(size), buffer);
     if (!DP_output_write(e->output, buffer, size + sizeof(uint16_t))) {
         return 0;
     }
 
+    // Remember the tile, so that it's not written again if it shows up in
+    // another layer or in the next snapshot.
+    DP_BuildIndexTileMap *entry = DP_malloc(sizeof(*entry));
+    entry->t = DP_tile_incref(t);
+    entry->offset = offset;
+    HASH_ADD_PTR(e->current.tiles, t, entry);
     return offset;
 }
 
@@ -381,6 +589,32 @@ static bool is_relevant_sublayer(DP_LayerProps *sub_lp)
     return sub_id >= 0 && sub_id <= UINT8_MAX;
 }
 
+static bool write_index_layer_tiles(DP_BuildIndexEntryContext *e,
+                                    DP_LayerContent *lc,
+                                    DP_TileCounts tile_counts,
+                                    unsigned char *tile_buffer)
+{
+    compress_index_tiles(e, lc, tile_counts);
+    size_t written = 0;
+    for (int y = 0; y < tile_counts.y; ++y) {
+        for (int x = 0; x < tile_counts.x; ++x) {
+            DP_Tile *t = DP_layer_content_tile_at_noinc(lc, x, y);
+            size_t tile_offset;
+            if (!maybe_write_index_tile(e, t, &tile_offset)) {
+                dispose_pending_tiles(e);
+                return false;
+            }
+            written += DP_write_littleendian_uint64(tile_offset,
+                                                    tile_buffer + written);
+        }
+    }
+    DP_ASSERT(written
+              == DP_int_to_size(tile_counts.x * tile_counts.y)
+                     * sizeof(uint64_t));
+    dispose_pending_tiles(e);
+    return true;
+}
+
 static size_t write_index_layer_content(DP_BuildIndexEntryContext *e,
                                         DP_LayerContent *lc, DP_LayerProps *lp,
                                         bool sublayer)
@@ -441,21 +675,11 @@ static size_t write_index_layer_content(DP_BuildIndexEntryContext *e,
     int tile_total = tile_counts.x * tile_counts.y;
     size_t tile_buffer_size = DP_int_to_size(tile_total) * sizeof(uint64_t);
     unsigned char *tile_buffer = DP_malloc(tile_buffer_size);
-    size_t written = 0;
-    for (int y = 0; y < tile_counts.y; ++y) {
-        for (int x = 0; x < tile_counts.x; ++x) {
-            DP_Tile *t = DP_layer_content_tile_at_noinc(lc, x, y);
-            size_t tile_offset;
-            if (!maybe_write_index_tile(e, t, &tile_offset)) {
-                DP_free(sub_buffer);
-                DP_free(tile_buffer);
-                return 0;
-            }
-            written += DP_write_littleendian_uint64(tile_offset,
-                                                    tile_buffer + written);
-        }
+    if (!write_index_layer_tiles(e, lc, tile_counts, tile_buffer)) {
+        DP_free(sub_buffer);
+        DP_free(tile_buffer);
+        return 0;
     }
-    DP_ASSERT(written == tile_buffer_size);
 
     bool error;
     size_t offset = DP_output_tell(e->output, &error);
@@ -465,7 +689,19 @@ static size_t write_index_layer_content(DP_BuildIndexEntryContext *e,
            && DP_output_write(e->output, tile_buffer, tile_buffer_size);
     DP_free(sub_buffer);
     DP_free(tile_buffer);
-    return ok ? offset : 0;
+    if (!ok) {
+        return 0;
+    }
+
+    if (!sublayer) {
+        DP_BuildIndexLayerMap *entry = DP_malloc_zeroed(sizeof(*entry));
+        entry->key.lc = DP_layer_content_incref(lc);
+        entry->key.lp = DP_layer_props_incref(lp);
+        entry->offset = offset;
+        HASH_ADD(hh, e->current.layers, key, sizeof(entry->key), entry);
+    }
+
+    return offset;
 }
 
 static size_t write_index_layer_group(DP_BuildIndexEntryContext *e,
@@ -900,15 +1136,15 @@ static void dispose_index_maps(DP_BuildIndexMaps *maps)
     DP_timeline_decref_nullable(maps->timeline.tl);
 }
 
-static bool make_index_entry(DP_BuildIndexContext *c, long long message_index,
-                             size_t message_offset)
+static bool write_index_entry_snapshot(DP_BuildIndexContext *c,
+                                       DP_BuildIndexSnapshot *s)
 {
     DP_BuildIndexEntryContext e = {c->output,
-                                   c->acls,
-                                   c->local_state,
-                                   c->ch,
+                                   s,
+                                   s->cs,
+                                   c->writer.dc,
+                                   c->writer.tile_worker,
                                    NULL,
-                                   c->dc,
                                    {NULL, NULL, NULL, {NULL, 0}, {NULL, 0}},
                                    &c->last,
                                    0,
@@ -920,7 +1156,7 @@ static bool make_index_entry(DP_BuildIndexContext *c, long long message_index,
         return false;
     }
 
-    DP_PlayerIndexEntry entry = {message_index, message_offset,
+    DP_PlayerIndexEntry entry = {s->message_index, s->message_offset,
                                  e.offset.snapshot, e.offset.thumbnail};
     DP_VECTOR_PUSH_TYPE(&c->entries, DP_PlayerIndexEntry, entry);
 
@@ -930,6 +1166,50 @@ static bool make_index_entry(DP_BuildIndexContext *c, long long message_index,
     return true;
 }
 
+static void write_index_entry_job(void *element, DP_UNUSED int thread_index)
+{
+    DP_BuildIndexSnapshot *s = element;
+    DP_BuildIndexContext *c = s->c;
+    // After an error, remaining snapshots just get discarded.
+    if (!DP_atomic_get(&c->writer.failed)
+        && !write_index_entry_snapshot(c, s)) {
+        c->writer.error = DP_strdup(DP_error());
+        DP_atomic_set(&c->writer.failed, 1);
+    }
+    dispose_index_snapshot(s);
+    DP_SEMAPHORE_MUST_POST(c->writer.sem);
+}
+
+static bool make_index_entry(DP_BuildIndexContext *c, long long message_index,
+                             size_t message_offset)
+{
+    DP_BuildIndexSnapshot s = {c, message_index, message_offset, NULL,
+                               DP_VECTOR_NULL};
+    DP_message_vector_init(&s.messages, 64);
+    if (!collect_index_history(c, &s)) {
+        dispose_index_snapshot(&s);
+        return false;
+    }
+
+    DP_Worker *worker = c->writer.worker;
+    if (worker) {
+        DP_SEMAPHORE_MUST_WAIT(c->writer.sem);
+        if (DP_atomic_get(&c->writer.failed)) {
+            dispose_index_snapshot(&s);
+            return false;
+        }
+        else {
+            DP_worker_push(worker, &s);
+            return true;
+        }
+    }
+    else {
+        bool ok = write_index_entry_snapshot(c, &s);
+        dispose_index_snapshot(&s);
+        return ok;
+    }
+}
+
 static bool write_index_messages(DP_BuildIndexContext *c)
 {
     DP_Player *player = c->player;
@@ -1038,10 +1318,79 @@ static bool write_index_finish(DP_BuildIndexContext *c)
                                         DP_OUTPUT_UINT64(entries_offset));
 }
 
+static void init_index_writer(DP_BuildIndexContext *c)
+{
+    if (!DP_atomic_get(&build_threaded)) {
+        c->writer.dc = c->dc;
+        return;
+    }
+
+    c->writer.tile_worker = index_tile_worker_new(
+        sizeof(struct DP_BuildIndexTileJob), compress_index_tile_job);
+    if (!c->writer.tile_worker) {
+        DP_warn("Error creating index tile worker: %s", DP_error());
+    }
+
+    // Snapshots are written on a single thread, so they end up in order.
+    c->writer.sem = DP_semaphore_new(MAX_PENDING_SNAPSHOTS);
+    if (c->writer.sem) {
+        c->writer.worker =
+            DP_worker_new(MAX_PENDING_SNAPSHOTS, sizeof(DP_BuildIndexSnapshot),
+                          1, write_index_entry_job);
+    }
+
+    if (c->writer.worker) {
+        c->writer.dc = DP_draw_context_new();
+    }
+    else {
+        DP_warn("Error creating index writer, writing synchronously: %s",
+                DP_error());
+        c->writer.dc = c->dc;
+    }
+}
+
+void DP_player_index_build_threaded_set(bool threaded)
+{
+    DP_atomic_set(&build_threaded, threaded ? 1 : 0);
+}
+
+bool DP_player_index_build_threaded(void)
+{
+    return DP_atomic_get(&build_threaded);
+}
+
+static bool join_index_writer(DP_BuildIndexContext *c)
+{
+    DP_worker_free_join(c->writer.worker);
+    c->writer.worker = NULL;
+    if (DP_atomic_get(&c->writer.failed)) {
+        DP_error_set("%s", c->writer.error ? c->writer.error
+                                           : "Error writing index snapshot");
+        return false;
+    }
+    else {
+        return true;
+    }
+}
+
+static void dispose_index_writer(DP_BuildIndexContext *c)
+{
+    DP_worker_free_join(c->writer.worker);
+    if (c->writer.dc != c->dc) {
+        DP_draw_context_free(c->writer.dc);
+    }
+    index_tile_worker_free(c->writer.tile_worker);
+    DP_semaphore_free(c->writer.sem);
+    DP_free(c->writer.error);
+}
+
 static bool write_index(DP_BuildIndexContext *c)
 {
-    return write_index_header(c) && write_index_messages(c)
-        && write_index_finish(c) && DP_output_flush(c->output);
+    bool ok = write_index_header(c) && write_index_messages(c);
+    // Snapshots may still be in flight. If writing one of them failed, that
+    // error is the relevant one, since it's what made replay bail out.
+    ok = join_index_writer(c) && ok;
+    return ok && write_index_finish(c) && DP_output_flush(c->output);
 }
 
 bool DP_player_index_build(DP_Player *player, DP_DrawContext *dc,
@@ -1063,7 +1412,7 @@ bool DP_player_index_build(DP_Player *player, DP_DrawContext *dc,
         return false;
     }
 
-    DP_Input *input = DP_file_input_new_from_path(recording_path);
+    DP_Input *input = DP_file_input_new_mapped_from_path(recording_path);
     if (!input) {
         return false;
     }
@@ -1100,9 +1449,13 @@ bool DP_player_index_build(DP_Player *player, DP_DrawContext *dc,
                               {NULL, NULL, NULL, {NULL, 0}, {NULL, 0}},
                               should_snapshot_fn,
                               progress_fn,
-                              user};
+                              user,
+                              {NULL, NULL, NULL, NULL, DP_ATOMIC_INIT(0),
+                               NULL}};
     DP_VECTOR_INIT_TYPE(&c.entries, DP_PlayerIndexEntry, INITAL_ENTRY_CAPACITY);
+    init_index_writer(&c);
     bool ok = write_index(&c);
+    dispose_index_writer(&c);
     dispose_index_maps(&c.last);
     DP_vector_dispose(&c.entries);
     DP_canvas_history_free(ch);
@@ -1140,11 +1493,11 @@ static bool read_index_input(DP_BufferedInput *input, size_t size)
 
 #define READ_INDEX(INPUT, TYPE, OUT)             \
     (read_index_input((INPUT), sizeof(TYPE##_t)) \
-     && ((OUT) = DP_read_littleendian_##TYPE((INPUT)->buffer), true))
+     && ((OUT) = DP_read_littleendian_##TYPE((INPUT)->data), true))
 
 #define READ_INDEX_SIZE(INPUT, OUT)              \
     (read_index_input((INPUT), sizeof(uint64_t)) \
-     && ((OUT) = read_littleendian_size((INPUT)->buffer), true))
+     && ((OUT) = read_littleendian_size((INPUT)->data), true))
 
 static size_t read_littleendian_size(const unsigned char *d)
 {
@@ -1155,7 +1508,7 @@ static bool check_index_magic(DP_ReadIndexContext *c)
 {
     DP_BufferedInput *input = &c->input;
     if (read_index_input(input, INDEX_MAGIC_LENGTH)) {
-        if (memcmp(input->buffer, INDEX_MAGIC, INDEX_MAGIC_LENGTH) == 0) {
+        if (memcmp(input->data, INDEX_MAGIC, INDEX_MAGIC_LENGTH) == 0) {
             return true;
         }
         else {
@@ -1220,10 +1573,10 @@ static bool read_index_entries(DP_ReadIndexContext *c)
         }
         else if (read == ENTRY_SIZE) {
             DP_PlayerIndexEntry entry = {
-                DP_read_littleendian_uint32(c->input.buffer),
-                read_littleendian_size(c->input.buffer + 4),
-                read_littleendian_size(c->input.buffer + 12),
-                read_littleendian_size(c->input.buffer + 20),
+                DP_read_littleendian_uint32(c->input.data),
+                read_littleendian_size(c->input.data + 4),
+                read_littleendian_size(c->input.data + 12),
+                read_littleendian_size(c->input.data + 20),
             };
             DP_debug("Read index entry %zu with message index %lld, message "
                      "offset %zu, snapshot offset %zu, thumbnail offset %zu",
@@ -1257,7 +1610,7 @@ bool DP_player_index_load(DP_Player *player)
         return false;
     }
 
-    DP_Input *input = DP_file_input_new_from_path(path);
+    DP_Input *input = DP_file_input_new_mapped_from_path(path);
     if (!input) {
         return false;
     }
@@ -1270,7 +1623,8 @@ bool DP_player_index_load(DP_Player *player)
     if (ok) {
         DP_player_index_set(player, (DP_PlayerIndex){c.input, c.message_count,
                                                      c.entries.elements,
-                                                     c.entries.used});
+                                                     c.entries.used, NULL,
+                                                     NULL});
     }
     else {
         DP_vector_dispose(&c.entries);
@@ -1302,6 +1656,8 @@ typedef struct DP_ReadTileMap {
 typedef struct DP_ReadSnapshotContext {
     DP_BufferedInput *input;
     DP_DrawContext *dc;
+    DP_PlayerIndex *index;
+    bool tile_worker_failed;
     DP_TransientCanvasState *tcs;
     DP_ReadTileMap *tiles;
     DP_PlayerIndexEntrySnapshot *snapshot;
@@ -1346,7 +1702,7 @@ static bool read_index_tile_inc(DP_ReadSnapshotContext *c, size_t offset,
             return false;
         }
 
-        DP_Tile *t = DP_tile_new_from_deflate(c->dc, 0, input->buffer, size);
+        DP_Tile *t = DP_tile_new_from_deflate(c->dc, 0, input->data, size);
         if (!t) {
             return false;
         }
@@ -1361,6 +1717,134 @@ static bool read_index_tile_inc(DP_ReadSnapshotContext *c, size_t offset,
     return true;
 }
 
+struct DP_ReadIndexTileJob {
+    DP_IndexTileWorker *itw;
+    DP_ReadTileMap *entry;
+    unsigned char *buffer;
+    size_t size;
+};
+
+static void decompress_index_tile_job(void *element, int thread_index)
+{
+    struct DP_ReadIndexTileJob *job = element;
+    DP_IndexTileWorker *itw = job->itw;
+    job->entry->t = DP_tile_new_from_deflate(itw->dcs[thread_index], 0,
+                                             job->buffer, job->size);
+    if (!job->entry->t) {
+        DP_warn("Error decompressing index tile: %s", DP_error());
+    }
+    DP_free(job->buffer);
+    DP_SEMAPHORE_MUST_POST(itw->sem);
+}
+
+static void free_index_tile_worker(void *tile_worker)
+{
+    index_tile_worker_free(tile_worker);
+}
+
+// The worker lives as long as the index, so that seeking around doesn't start
+// up and join a bunch of threads every time.
+static DP_IndexTileWorker *get_index_tile_worker(DP_ReadSnapshotContext *c)
+{
+    DP_PlayerIndex *pi = c->index;
+    if (!pi->tile_worker && !c->tile_worker_failed) {
+        DP_IndexTileWorker *itw = index_tile_worker_new(
+            sizeof(struct DP_ReadIndexTileJob), decompress_index_tile_job);
+        if (itw) {
+            pi->tile_worker = itw;
+            pi->tile_worker_free = free_index_tile_worker;
+        }
+        else {
+            DP_warn("Error creating index tile worker: %s", DP_error());
+            c->tile_worker_failed = true;
+        }
+    }
+    return pi->tile_worker;
+}
+
+// Reads the compressed tiles sequentially, since that's how the input works,
+// but decompresses them in parallel. Tiles that were already loaded are
+// reused, as are ones that show up multiple times in the given offsets. Small
+// layers aren't worth the synchronization, those get decompressed inline.
+static bool read_index_tiles_inc(DP_ReadSnapshotContext *c, int count,
+                                 size_t *offsets, DP_Tile **out_tiles)
+{
+    DP_IndexTileWorker *itw =
+        count < INDEX_TILE_WORKER_MIN_COUNT ? NULL : get_index_tile_worker(c);
+    if (!itw) {
+        for (int i = 0; i < count; ++i) {
+            if (!read_index_tile_inc(c, offsets[i], &out_tiles[i])) {
+                for (int j = 0; j < i; ++j) {
+                    DP_tile_decref_nullable(out_tiles[j]);
+                }
+                return false;
+            }
+        }
+        return true;
+    }
+
+    DP_BufferedInput *input = c->input;
+    DP_ReadTileMap **entries =
+        DP_malloc(sizeof(*entries) * DP_int_to_size(count));
+    int pushed = 0;
+    bool ok = true;
+    for (int i = 0; i < count; ++i) {
+        size_t offset = offsets[i];
+        DP_ReadTileMap *entry;
+        if (offset == 0) {
+            entry = NULL;
+        }
+        else {
+            HASH_FIND(hh, c->tiles, &offset, sizeof(offset), entry);
+            if (!entry) {
+                size_t size;
+                ok = DP_buffered_input_seek(input, offset)
+                  && READ_INDEX(input, uint16, size)
+                  && read_index_input(input, size);
+                if (!ok) {
+                    break;
+                }
+
+                entry = DP_malloc(sizeof(*entry));
+                entry->offset = offset;
+                entry->t = NULL;
+                HASH_ADD(hh, c->tiles, offset, sizeof(offset), entry);
+
+                unsigned char *buffer = DP_malloc(size);
+                memcpy(buffer, input->data, size);
+                struct DP_ReadIndexTileJob job = {itw, entry, buffer, size};
+                DP_worker_push(itw->worker, &job);
+                ++pushed;
+            }
+        }
+        entries[i] = entry;
+    }
+
+    index_tile_worker_wait(itw, pushed);
+
+    if (ok) {
+        for (int i = 0; i < count; ++i) {
+            DP_ReadTileMap *entry = entries[i];
+            if (entry && !entry->t) {
+                DP_error_set("Error decompressing tile at offset %zu",
+                             entry->offset);
+                ok = false;
+                break;
+            }
+        }
+    }
+
+    if (ok) {
+        for (int i = 0; i < count; ++i) {
+            DP_ReadTileMap *entry = entries[i];
+            out_tiles[i] = entry ? DP_tile_incref(entry->t) : NULL;
+        }
+    }
+
+    DP_free(entries);
+    return ok;
+}
+
 static bool read_index_offsets(DP_BufferedInput *input, int count,
                                size_t **out_offsets)
 {
@@ -1379,7 +1863,7 @@ static bool read_index_offsets(DP_BufferedInput *input, int count,
 
     size_t *offsets = scount == 0 ? NULL : DP_malloc(sizeof(*offsets) * scount);
     for (size_t i = 0, j = 0; i < scount; i += 1, j += sizeof(uint64_t)) {
-        offsets[i] = read_littleendian_size(input->buffer + j);
+        offsets[i] = read_littleendian_size(input->data + j);
     }
     *out_offsets = offsets;
     return true;
@@ -1388,7 +1872,9 @@ static bool read_index_offsets(DP_BufferedInput *input, int count,
 static bool read_index_canvas_state(DP_ReadSnapshotContext *c,
                                     unsigned int width, unsigned int height)
 {
-    if (DP_canvas_state_dimensions_in_bounds(width, height)) {
+    // A snapshot from before the canvas got its initial size is empty.
+    bool empty = width == 0 && height == 0;
+    if (!empty && !DP_canvas_state_dimensions_in_bounds(width, height)) {
         DP_error_set("Canvas dimensions %ux%u out of bounds", width, height);
         return false;
     }
@@ -1418,7 +1904,7 @@ static DP_Annotation *read_index_annotation(DP_BufferedInput *input,
             DP_transient_annotation_new_init(id, x, y, width, height);
         DP_transient_annotation_background_color_set(ta, background_color);
         DP_transient_annotation_valign_set(ta, valign);
-        DP_transient_annotation_text_set(ta, (const char *)input->buffer,
+        DP_transient_annotation_text_set(ta, (const char *)input->data,
                                          text_length);
         return DP_transient_annotation_persist(ta);
     }
@@ -1485,7 +1971,7 @@ static DP_TransientKeyFrame *read_index_key_frame(DP_ReadSnapshotContext *c,
 
     DP_TransientKeyFrame *tkf =
         DP_transient_key_frame_new_init(layer_id, layers_count);
-    DP_transient_key_frame_title_set(tkf, (const char *)input->buffer,
+    DP_transient_key_frame_title_set(tkf, (const char *)input->data,
                                      title_length);
     for (int i = 0; i < layers_count; ++i) {
         DP_KeyFrameLayer kfl;
@@ -1516,7 +2002,7 @@ static DP_TransientTrack *read_index_track(DP_ReadSnapshotContext *c)
 
     DP_TransientTrack *tt = DP_transient_track_new_init(key_frame_count);
     DP_transient_track_id_set(tt, track_id);
-    DP_transient_track_title_set(tt, (const char *)input->buffer, title_length);
+    DP_transient_track_title_set(tt, (const char *)input->data, title_length);
     for (int i = 0; i < key_frame_count; ++i) {
         int frame_index;
         DP_TransientKeyFrame *tkf = read_index_key_frame(c, &frame_index);
@@ -1582,7 +2068,7 @@ static bool read_index_layer_title(DP_BufferedInput *input, size_t title_length,
 {
     if (read_index_input(input, title_length)) {
         char *title = DP_malloc(title_length);
-        memcpy(title, input->buffer, title_length);
+        memcpy(title, input->data, title_length);
         *out_title = title;
         return true;
     }
@@ -1660,18 +2146,19 @@ read_index_layer_content(DP_ReadSnapshotContext *c,
         DP_transient_layer_content_new_init_with_transient_sublayers_noinc(
             width, height, NULL, sub_tll, sub_tlpl);
 
+    DP_Tile **tiles = DP_malloc(sizeof(*tiles) * DP_int_to_size(tile_total));
+    bool tiles_ok = read_index_tiles_inc(c, tile_total, tile_offsets, tiles);
+    DP_free(tile_offsets);
+    if (!tiles_ok) {
+        DP_free(tiles);
+        DP_transient_layer_content_decref(tlc);
+        return read_snapshot_layer_null();
+    }
+
     for (int i = 0; i < tile_total; ++i) {
-        DP_Tile *t;
-        if (read_index_tile_inc(c, tile_offsets[i], &t)) {
-            DP_transient_layer_content_tile_set_noinc(tlc, t, i);
-        }
-        else {
-            DP_transient_layer_content_decref(tlc);
-            DP_free(tile_offsets);
-            return read_snapshot_layer_null();
-        }
+        DP_transient_layer_content_tile_set_noinc(tlc, tiles[i], i);
     }
-    DP_free(tile_offsets);
+    DP_free(tiles);
 
     DP_TransientLayerProps *tlp = to_transient_layer_props(bilp, NULL);
     return (struct DP_ReadSnapshotLayer){{.tlc = tlc}, tlp};
@@ -1809,7 +2296,7 @@ static bool read_index_history(DP_ReadSnapshotContext *c, size_t offset,
         }
 
         DP_Message *msg = DP_message_deserialize_length(
-            input->buffer, length, length < 2 ? 0 : length - 2, true);
+            input->data, length, length < 2 ? 0 : length - 2, true);
         if (msg) {
             snapshot->messages[i] = msg;
         }
@@ -1865,13 +2352,14 @@ DP_player_index_entry_load(DP_Player *player, DP_DrawContext *dc,
     }
 
     DP_PERF_BEGIN_DETAIL(fn, "index_entry_load", "offset=%zu", snapshot_offset);
-    DP_ReadSnapshotContext c = {input, dc, NULL, NULL, NULL};
+    DP_ReadSnapshotContext c = {
+        input, dc, DP_player_index(player), false, NULL, NULL, NULL};
     bool ok = read_index_snapshot(&c);
 
     DP_ReadTileMap *tile_entry, *tile_tmp;
     HASH_ITER(hh, c.tiles, tile_entry, tile_tmp) {
         HASH_DEL(c.tiles, tile_entry);
-        DP_tile_decref(tile_entry->t);
+        DP_tile_decref_nullable(tile_entry->t);
         DP_free(tile_entry);
     }
 
@@ -2020,7 +2508,7 @@ DP_Image *DP_player_index_thumbnail_at(DP_Player *player, size_t index,
         return NULL;
     }
 
-    size_t length = DP_read_littleendian_uint32(input->buffer);
+    size_t length = DP_read_littleendian_uint32(input->data);
     if (length == 0) {
         DP_error_set("Thumbnail has zero length");
         assign_out_error(true, out_error);
@@ -2038,7 +2526,7 @@ DP_Image *DP_player_index_thumbnail_at(DP_Player *player, size_t index,
         return NULL;
     }
 
-    DP_Input *mem_input = DP_mem_input_new(input->buffer, length, NULL, NULL);
+    DP_Input *mem_input = DP_mem_input_new_keep_on_close(input->data, length);
     DP_Image *img = DP_image_read_png(mem_input);
     DP_input_free(mem_input);
 
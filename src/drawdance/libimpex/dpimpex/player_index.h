@@ -21,6 +21,13 @@ bool DP_player_index_build(DP_Player *player, DP_DrawContext *dc,
                            DP_PlayerIndexShouldSnapshotFn should_snapshot_fn,
                            DP_PlayerIndexProgressFn progress_fn, void *user);
 
+// Index building compresses tiles and writes snapshots on worker threads by
+// default. Turning that off makes it do everything on the calling thread, the
+// resulting index is the same either way.
+void DP_player_index_build_threaded_set(bool threaded);
+
+bool DP_player_index_build_threaded(void);
+
 
 bool DP_player_index_load(DP_Player *player);
 
@@ -0,0 +1,182 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/file.h>
+#include <dpcommon/output.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/player.h>
+#include <dpengine/recorder.h>
+#include <dpengine/tile.h>
+#include <dpimpex/load.h>
+#include <dpimpex/player_index.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/message.h>
+#include <dpmsg/messages.h>
+#include <dptest.h>
+
+#define RECORDING_PATH  "test/tmp/player_index.dprec"
+#define CANVAS_TILES    6
+#define CANVAS_SIZE     (CANVAS_TILES * DP_TILE_SIZE)
+#define LAYER_COUNT     3
+#define SNAPSHOT_EVERY  7
+#define MIN_ENTRY_COUNT 4
+
+
+typedef struct BuiltIndex {
+    size_t entry_count;
+    size_t size;
+    void *data;
+} BuiltIndex;
+
+static void push_ok(TEST_PARAMS, DP_Recorder *r, DP_Message *msg)
+{
+    OK(DP_recorder_message_push_noinc(r, msg), "record %s",
+       DP_message_type_enum_name(DP_message_type(msg)));
+}
+
+static void fill_rect(TEST_PARAMS, DP_Recorder *r, int layer, int x, int y,
+                      int width, int height, uint32_t color)
+{
+    push_ok(TEST_ARGS, r,
+            DP_msg_fill_rect_new(1, DP_int_to_uint32(0x0101 + layer),
+                                 DP_BLEND_MODE_NORMAL, DP_int_to_uint32(x),
+                                 DP_int_to_uint32(y), DP_int_to_uint32(width),
+                                 DP_int_to_uint32(height), color));
+}
+
+// A few layers with fills all over the place, so that snapshots have lots of
+// tiles to compress, some of which are shared with earlier snapshots.
+static void record(TEST_PARAMS)
+{
+    DP_Output *output = DP_file_output_new_from_path(RECORDING_PATH);
+    FATAL(NOT_NULL_OK(output, "got output for %s", RECORDING_PATH));
+    DP_Recorder *r = DP_recorder_new_inc(
+        DP_RECORDER_TYPE_BINARY, DP_recorder_header_new(NULL), NULL, NULL,
+        NULL, output);
+    FATAL(NOT_NULL_OK(r, "got recorder"));
+
+    push_ok(TEST_ARGS, r,
+            DP_msg_canvas_resize_new(1, 0, CANVAS_SIZE, CANVAS_SIZE, 0));
+    for (int i = 0; i < LAYER_COUNT; ++i) {
+        push_ok(TEST_ARGS, r,
+                DP_msg_layer_tree_create_new(
+                    1, DP_int_to_uint32(0x0101 + i), 0, 0, 0, 0, "", 0));
+    }
+
+    for (int i = 0; i < 40; ++i) {
+        push_ok(TEST_ARGS, r, DP_msg_undo_point_new(1));
+        int layer = i % LAYER_COUNT;
+        int x = (i * 37) % (CANVAS_SIZE - 50);
+        int y = (i * 61) % (CANVAS_SIZE - 50);
+        uint32_t color = 0xff000000u | DP_int_to_uint32(i * 0x050a0f);
+        fill_rect(TEST_ARGS, r, layer, x, y, 30 + i * 3, 20 + i * 2, color);
+        if (i % 9 == 8) {
+            push_ok(TEST_ARGS, r, DP_msg_undo_new(1, 0, false));
+        }
+    }
+
+    char *error;
+    DP_recorder_free_join(r, &error);
+    NULL_OK(error, "recorder finished without error");
+    DP_free(error);
+}
+
+static bool should_snapshot(void *user)
+{
+    int *counter = user;
+    return ++*counter % SNAPSHOT_EVERY == 0;
+}
+
+static BuiltIndex build(TEST_PARAMS, bool threaded)
+{
+    BuiltIndex bi = {0, 0, NULL};
+    DP_Player *player = DP_load_recording(RECORDING_PATH, NULL);
+    FATAL(NOT_NULL_OK(player, "loaded %s", RECORDING_PATH));
+
+    DP_player_index_build_threaded_set(threaded);
+    DP_DrawContext *dc = DP_draw_context_new();
+    int counter = 0;
+    bool built =
+        DP_player_index_build(player, dc, should_snapshot, NULL, &counter);
+    DP_draw_context_free(dc);
+    DP_player_index_build_threaded_set(true);
+
+    const char *index_path = DP_player_index_path(player);
+    if (OK(built, "built %s index", threaded ? "threaded" : "synchronous")
+        && OK(DP_player_index_load(player), "loaded index")) {
+        bi.entry_count = DP_player_index_entry_count(player);
+        bi.data = DP_file_slurp(index_path, &bi.size);
+        NOT_NULL_OK(bi.data, "read %s", index_path);
+    }
+    DP_player_free(player);
+    return bi;
+}
+
+
+static void threaded_build_matches_synchronous(TEST_PARAMS)
+{
+    record(TEST_ARGS);
+    BuiltIndex threaded = build(TEST_ARGS, true);
+    BuiltIndex synchronous = build(TEST_ARGS, false);
+
+    OK(threaded.entry_count >= MIN_ENTRY_COUNT, "got %zu index entries",
+       threaded.entry_count);
+    UINT_EQ_OK(threaded.entry_count, synchronous.entry_count,
+               "same number of entries");
+    OK(threaded.data && synchronous.data && threaded.size == synchronous.size
+           && memcmp(threaded.data, synchronous.data, threaded.size) == 0,
+       "threaded index is identical to synchronous one (%zu, %zu bytes)",
+       threaded.size, synchronous.size);
+
+    DP_free(synchronous.data);
+    DP_free(threaded.data);
+}
+
+static void load_entries(TEST_PARAMS, DP_Player *player, DP_DrawContext *dc,
+                         bool reverse)
+{
+    DP_PlayerIndex *pi = DP_player_index(player);
+    for (size_t i = 0; i < pi->entry_count; ++i) {
+        size_t j = reverse ? pi->entry_count - i - 1 : i;
+        DP_PlayerIndexEntrySnapshot *snapshot =
+            DP_player_index_entry_load(player, dc, pi->entries[j]);
+        if (NOT_NULL_OK(snapshot, "loaded snapshot %zu", j)) {
+            DP_player_index_entry_snapshot_free(snapshot);
+        }
+    }
+}
+
+static void load_reuses_tile_worker(TEST_PARAMS)
+{
+    record(TEST_ARGS);
+    DP_Player *player = DP_load_recording(RECORDING_PATH, NULL);
+    FATAL(NOT_NULL_OK(player, "loaded %s", RECORDING_PATH));
+
+    DP_DrawContext *dc = DP_draw_context_new();
+    int counter = 0;
+    if (OK(DP_player_index_build(player, dc, should_snapshot, NULL, &counter),
+           "built index")
+        && OK(DP_player_index_load(player), "loaded index")) {
+        DP_PlayerIndex *pi = DP_player_index(player);
+        OK(!pi->tile_worker, "no tile worker before loading");
+        load_entries(TEST_ARGS, player, dc, false);
+        void *tile_worker = pi->tile_worker;
+        OK(tile_worker, "tile worker created while loading");
+        load_entries(TEST_ARGS, player, dc, true);
+        OK(pi->tile_worker == tile_worker, "tile worker reused");
+    }
+    DP_draw_context_free(dc);
+    DP_player_free(player);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(threaded_build_matches_synchronous);
+    REGISTER_TEST(load_reuses_tile_worker);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
@@ -1239,6 +1239,14 @@ static bool handle_command_message(DP_AclState *acls, DP_Message *msg,
                     acls, user_id,
                     DP_protocol_to_layer_id(
                         DP_msg_fill_rect_layer(DP_message_internal(msg)))));
+    case DP_MSG_FILL_GRADIENT:
+        return override
+            || (DP_acl_state_can_use_feature(acls, DP_FEATURE_PUT_IMAGE,
+                                             user_id)
+                && !DP_acl_state_layer_locked_for(
+                    acls, user_id,
+                    DP_protocol_to_layer_id(DP_msg_fill_gradient_layer(
+                        DP_message_internal(msg)))));
     case DP_MSG_ANNOTATION_CREATE:
         return handle_annotation_create(acls, msg, user_id, override);
     case DP_MSG_ANNOTATION_RESHAPE:
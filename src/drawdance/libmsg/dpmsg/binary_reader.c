@@ -244,27 +244,39 @@ double DP_binary_reader_progress(DP_BinaryReader *reader)
 static void ensure_buffer_size(DP_BinaryReader *reader, size_t required_size)
 {
     if (reader->buffer_size < required_size) {
-        reader->buffer = DP_realloc(
-            reader->buffer,
-            required_size < MIN_BUFFER_SIZE ? MIN_BUFFER_SIZE : required_size);
+        size_t buffer_size =
+            required_size < MIN_BUFFER_SIZE ? MIN_BUFFER_SIZE : required_size;
+        reader->buffer = DP_realloc(reader->buffer, buffer_size);
+        reader->buffer_size = buffer_size;
     }
 }
 
-static size_t read_into(DP_BinaryReader *reader, size_t size, size_t offset,
-                        bool *out_error)
+// Inputs that have their contents in memory are read from directly, others
+// get read into the buffer at the given offset. Returns where the data is.
+static const unsigned char *read_into(DP_BinaryReader *reader, size_t size,
+                                      size_t offset, size_t *out_read,
+                                      bool *out_error)
 {
-    ensure_buffer_size(reader, size + offset);
-    size_t read =
-        DP_input_read(reader->input, reader->buffer + offset, size, out_error);
-    reader->input_offset += read;
-    return read;
+    const unsigned char *data =
+        DP_input_read_direct(reader->input, size, out_read, out_error);
+    if (!data && !*out_error) {
+        ensure_buffer_size(reader, size + offset);
+        *out_read = DP_input_read(reader->input, reader->buffer + offset, size,
+                                  out_error);
+        data = reader->buffer + offset;
+    }
+    reader->input_offset += *out_read;
+    return data;
 }
 
-static DP_BinaryReaderResult read_message_header(DP_BinaryReader *reader,
-                                                 size_t *out_body_length)
+static DP_BinaryReaderResult
+read_message_header(DP_BinaryReader *reader, const unsigned char **out_header,
+                    size_t *out_body_length)
 {
     bool error;
-    size_t read = read_into(reader, DP_MESSAGE_HEADER_LENGTH, 0, &error);
+    size_t read;
+    const unsigned char *header =
+        read_into(reader, DP_MESSAGE_HEADER_LENGTH, 0, &read, &error);
     if (error) {
         return DP_BINARY_READER_ERROR_INPUT;
     }
@@ -277,7 +289,8 @@ static DP_BinaryReaderResult read_message_header(DP_BinaryReader *reader,
         return DP_BINARY_READER_ERROR_INPUT;
     }
     else {
-        *out_body_length = DP_read_bigendian_uint16(reader->buffer);
+        *out_header = header;
+        *out_body_length = DP_read_bigendian_uint16(header);
         return DP_BINARY_READER_SUCCESS;
     }
 }
@@ -288,15 +301,18 @@ read_message(DP_BinaryReader *reader, bool decode_opaque,
                                            size_t bufsize, bool decode_opaque),
              DP_Message **out_msg)
 {
+    const unsigned char *header;
     size_t body_length;
-    DP_BinaryReaderResult result = read_message_header(reader, &body_length);
+    DP_BinaryReaderResult result =
+        read_message_header(reader, &header, &body_length);
     if (result != DP_BINARY_READER_SUCCESS) {
         return result;
     }
 
     bool error;
-    size_t read =
-        read_into(reader, body_length, DP_MESSAGE_HEADER_LENGTH, &error);
+    size_t read;
+    const unsigned char *body = read_into(
+        reader, body_length, DP_MESSAGE_HEADER_LENGTH, &read, &error);
     if (error) {
         return DP_BINARY_READER_ERROR_INPUT;
     }
@@ -306,8 +322,24 @@ read_message(DP_BinaryReader *reader, bool decode_opaque,
         return DP_BINARY_READER_ERROR_INPUT;
     }
 
+    // Reading the body into the buffer may have moved the header along with
+    // it. When read directly from memory, the two are usually adjacent too.
+    const unsigned char *message;
+    if (body == reader->buffer + DP_MESSAGE_HEADER_LENGTH) {
+        message = reader->buffer;
+    }
+    else if (body == header + DP_MESSAGE_HEADER_LENGTH) {
+        message = header;
+    }
+    else {
+        ensure_buffer_size(reader, DP_MESSAGE_HEADER_LENGTH + body_length);
+        memcpy(reader->buffer, header, DP_MESSAGE_HEADER_LENGTH);
+        memcpy(reader->buffer + DP_MESSAGE_HEADER_LENGTH, body, body_length);
+        message = reader->buffer;
+    }
+
     DP_Message *msg = deserialize_fn(
-        reader->buffer, DP_MESSAGE_HEADER_LENGTH + body_length, decode_opaque);
+        message, DP_MESSAGE_HEADER_LENGTH + body_length, decode_opaque);
     if (msg) {
         *out_msg = msg;
         return DP_BINARY_READER_SUCCESS;
@@ -343,8 +375,10 @@ int DP_binary_reader_skip_message(DP_BinaryReader *reader, uint8_t *out_type,
 {
     DP_ASSERT(reader);
 
+    const unsigned char *header;
     size_t body_length;
-    DP_BinaryReaderResult result = read_message_header(reader, &body_length);
+    DP_BinaryReaderResult result =
+        read_message_header(reader, &header, &body_length);
     if (result != DP_BINARY_READER_SUCCESS) {
         return -1;
     }
@@ -355,10 +389,10 @@ int DP_binary_reader_skip_message(DP_BinaryReader *reader, uint8_t *out_type,
     }
 
     if (out_type) {
-        *out_type = reader->buffer[2];
+        *out_type = header[2];
     }
     if (out_context_id) {
-        *out_context_id = reader->buffer[3];
+        *out_context_id = header[3];
     }
     return DP_size_to_int(DP_MESSAGE_HEADER_LENGTH + body_length);
 }
@@ -16,8 +16,19 @@
 
 #define DP_LAYER_ID_SELECTION_FLAG (1 << 23)
 
-#define DP_SELECTION_ID_MAIN         1
+#define DP_SELECTION_ID_MAIN 1
+// Dabs only have 5 bits for the selection id that masks them.
+#define DP_SELECTION_ID_LOCAL_MAX 31
+// Local selections are synchronized to remote ids starting from here, see
+// push_selection_sync in brush_engine.c.
 #define DP_SELECTION_ID_FIRST_REMOTE 128
+#define DP_SELECTION_ID_LAST_REMOTE \
+    (DP_SELECTION_ID_FIRST_REMOTE + DP_SELECTION_ID_LOCAL_MAX - 1)
+// Scratch selection for masked fills, outside of the range used by brushes.
+#define DP_SELECTION_ID_REMOTE_FILL 255
+
+static_assert(DP_SELECTION_ID_REMOTE_FILL > DP_SELECTION_ID_LAST_REMOTE,
+              "Remote fill selection id collides with brush selection ids");
 
 
 DP_INLINE int DP_protocol_to_layer_id(uint32_t protocol_layer_id)
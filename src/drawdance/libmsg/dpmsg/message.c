@@ -26,6 +26,12 @@
 #include <dpcommon/atomic.h>
 #include <dpcommon/binary.h>
 #include <dpcommon/common.h>
+#include <dpcommon/conversions.h>
+#include <dpcommon/memory_pool.h>
+#include <dpcommon/perf.h>
+#include <dpcommon/threading.h>
+
+#define DP_PERF_CONTEXT "message"
 
 #define FLAG_NONE   0x0
 #define FLAG_OPAQUE 0x1
@@ -35,15 +41,202 @@ typedef DP_Message *(*DP_MessageDeserializeFn)(unsigned int context_id,
                                                const unsigned char *buffer,
                                                size_t length);
 
+// Pool class index + 1, zero means the message was allocated on the heap.
+#define POOL_CLASS_NONE 0
+
 struct DP_Message {
     DP_Atomic refcount;
     uint8_t type;
     uint8_t flags;
+    uint8_t pool_class;
     unsigned int context_id;
     const DP_MessageMethods *methods;
+    DP_AtomicPtr decoded;
     alignas(DP_max_align_t) unsigned char internal[];
 };
 
+
+// Messages are allocated from size-classed memory pools. Most of them are
+// short-lived dabs that get deserialized, queued, applied and thrown away,
+// which otherwise makes malloc and free show up at the top of profiles. Each
+// class has its own lock and allocation only tries to grab it, so threads
+// contending for the same class fall back to the heap instead of waiting.
+#define POOL_BUCKET_BYTES ((size_t)65536)
+
+// Once this many buckets worth of elements are free, the pool releases the
+// buckets that are entirely unused, keeping POOL_KEEP_BUCKETS of them. If
+// fragmentation keeps buckets alive, the next trim waits until twice as many
+// elements are free as were left over, so the free list walks don't pile up.
+#define POOL_TRIM_BUCKETS 4
+#define POOL_KEEP_BUCKETS 1
+
+typedef struct DP_MessagePool {
+    DP_Mutex *mutex;
+    DP_MemoryPool pool;
+    DP_MessagePoolStatistics stats;
+    size_t trim_at;
+    DP_Atomic contended;
+} DP_MessagePool;
+
+static const size_t pool_class_sizes[DP_MESSAGE_POOL_CLASS_COUNT] = {
+    64, 128, 256, 512, 1024, 2048, 4096, 8192,
+};
+
+static DP_Atomic pool_enabled = DP_ATOMIC_INIT(1);
+static DP_Atomic pool_initialized;
+static DP_MessagePool pools[DP_MESSAGE_POOL_CLASS_COUNT];
+
+static bool init_pools(void)
+{
+    DP_ATOMIC_DECLARE_STATIC_SPIN_LOCK(pool_lock);
+    if (!DP_atomic_get(&pool_initialized)) {
+        DP_atomic_lock(&pool_lock);
+        if (!DP_atomic_get(&pool_initialized)) {
+            bool ok = true;
+            for (int i = 0; i < DP_MESSAGE_POOL_CLASS_COUNT; ++i) {
+                DP_MessagePool *mp = &pools[i];
+                size_t el_size = pool_class_sizes[i];
+                mp->mutex = DP_mutex_new();
+                if (!mp->mutex) {
+                    DP_warn("Error creating message pool mutex: %s",
+                            DP_error());
+                    ok = false;
+                }
+                size_t bucket_el_count = POOL_BUCKET_BYTES / el_size;
+                mp->pool = DP_memory_pool_new(el_size, bucket_el_count);
+                mp->stats = (DP_MessagePoolStatistics){el_size, bucket_el_count,
+                                                       1, 0, 0, 0};
+                mp->trim_at = bucket_el_count * POOL_TRIM_BUCKETS;
+            }
+            DP_atomic_set(&pool_initialized, ok ? 1 : -1);
+        }
+        DP_atomic_unlock(&pool_lock);
+    }
+    return DP_atomic_get(&pool_initialized) == 1;
+}
+
+static int search_pool_class(size_t size)
+{
+    for (int i = 0; i < DP_MESSAGE_POOL_CLASS_COUNT; ++i) {
+        if (size <= pool_class_sizes[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void *pool_alloc(DP_MessagePool *mp)
+{
+    size_t buckets_before = mp->pool.buckets_len;
+    void *el = DP_memory_pool_alloc_el(&mp->pool);
+    ++mp->stats.allocations;
+    size_t buckets_after = mp->pool.buckets_len;
+    if (buckets_after != buckets_before) {
+        mp->stats.buckets = buckets_after;
+        DP_PERF_BEGIN_DETAIL(fn, "pool:grow", "class=%zu,buckets=%zu",
+                             mp->stats.el_size, buckets_after);
+        DP_PERF_END(fn);
+    }
+    return el;
+}
+
+static void pool_trim(DP_MessagePool *mp)
+{
+    size_t bucket_el_count = mp->pool.bucket_el_count;
+    size_t capacity = mp->pool.buckets_len * bucket_el_count;
+    size_t live = (size_t)(mp->stats.allocations - mp->stats.frees);
+    size_t free_count = capacity - live;
+    if (free_count >= mp->trim_at) {
+        DP_PERF_BEGIN_DETAIL(fn, "pool:trim", "class=%zu,buckets=%zu",
+                             mp->stats.el_size, mp->pool.buckets_len);
+        size_t released = DP_memory_pool_trim(&mp->pool, POOL_KEEP_BUCKETS);
+        mp->stats.buckets = mp->pool.buckets_len;
+        size_t left_over = free_count - released * bucket_el_count;
+        mp->trim_at =
+            DP_max_size(bucket_el_count * POOL_TRIM_BUCKETS, left_over * 2);
+        DP_PERF_END(fn);
+    }
+}
+
+static DP_Message *alloc_message(size_t size)
+{
+    if (DP_atomic_get(&pool_enabled) && init_pools()) {
+        int i = search_pool_class(size);
+        if (i != -1) {
+            DP_MessagePool *mp = &pools[i];
+            if (DP_MUTEX_MUST_TRY_LOCK(mp->mutex)) {
+                DP_Message *msg = pool_alloc(mp);
+                DP_MUTEX_MUST_UNLOCK(mp->mutex);
+                memset(msg, 0, size);
+                msg->pool_class = (uint8_t)(i + 1);
+                return msg;
+            }
+            else {
+                DP_atomic_inc(&mp->contended);
+            }
+        }
+    }
+    return DP_malloc_zeroed(size);
+}
+
+// Put in place of the decoded payload when it gets taken, so that a decoder
+// that's late to the party knows that its work isn't needed anymore.
+static DP_MessageDecoded decoded_taken;
+
+static void free_decoded(DP_MessageDecoded *decoded)
+{
+    if (decoded && decoded != &decoded_taken) {
+        decoded->free(decoded);
+    }
+}
+
+static void free_message(DP_Message *msg)
+{
+    free_decoded(DP_atomic_ptr_xch(&msg->decoded, NULL));
+    int pool_class = msg->pool_class;
+    if (pool_class == POOL_CLASS_NONE) {
+        DP_free(msg);
+    }
+    else {
+        DP_MessagePool *mp = &pools[pool_class - 1];
+        DP_MUTEX_MUST_LOCK(mp->mutex);
+        DP_memory_pool_free_el(&mp->pool, msg);
+        ++mp->stats.frees;
+        pool_trim(mp);
+        DP_MUTEX_MUST_UNLOCK(mp->mutex);
+    }
+}
+
+void DP_message_pool_enabled_set(bool enabled)
+{
+    DP_atomic_set(&pool_enabled, enabled ? 1 : 0);
+}
+
+bool DP_message_pool_enabled(void)
+{
+    return DP_atomic_get(&pool_enabled);
+}
+
+DP_MessagePoolStatistics DP_message_pool_statistics(int pool_class)
+{
+    DP_ASSERT(pool_class >= 0);
+    DP_ASSERT(pool_class < DP_MESSAGE_POOL_CLASS_COUNT);
+    if (DP_atomic_get(&pool_initialized) == 1) {
+        DP_MessagePool *mp = &pools[pool_class];
+        DP_MUTEX_MUST_LOCK(mp->mutex);
+        DP_MessagePoolStatistics stats = mp->stats;
+        DP_MUTEX_MUST_UNLOCK(mp->mutex);
+        stats.contended = DP_int_to_ullong(DP_atomic_get(&mp->contended));
+        return stats;
+    }
+    else {
+        size_t el_size = pool_class_sizes[pool_class];
+        return (DP_MessagePoolStatistics){
+            el_size, POOL_BUCKET_BYTES / el_size, 0, 0, 0, 0};
+    }
+}
+
+
 DP_Message *DP_message_new(DP_MessageType type, unsigned int context_id,
                            const DP_MessageMethods *methods,
                            size_t internal_size)
@@ -58,11 +251,12 @@ DP_Message *DP_message_new(DP_MessageType type, unsigned int context_id,
     DP_ASSERT(methods->write_payload_text);
     DP_ASSERT(internal_size <= SIZE_MAX - sizeof(DP_Message));
     DP_Message *msg =
-        DP_malloc_zeroed(DP_FLEX_SIZEOF(DP_Message, internal, internal_size));
+        alloc_message(DP_FLEX_SIZEOF(DP_Message, internal, internal_size));
     DP_atomic_set(&msg->refcount, 1);
     msg->type = (uint8_t)type;
     msg->flags = FLAG_NONE;
     msg->context_id = context_id;
+    DP_atomic_ptr_set(&msg->decoded, NULL);
     msg->methods = methods;
     return msg;
 }
@@ -126,12 +320,13 @@ DP_Message *DP_message_new_opaque(DP_MessageType type, unsigned int context_id,
     DP_ASSERT(type <= DP_MESSAGE_MAX);
     DP_ASSERT(context_id <= UINT8_MAX);
     DP_ASSERT(length <= SIZE_MAX - sizeof(DP_Message));
-    DP_Message *msg = DP_malloc_zeroed(DP_FLEX_SIZEOF(
+    DP_Message *msg = alloc_message(DP_FLEX_SIZEOF(
         DP_Message, internal, DP_FLEX_SIZEOF(DP_OpaqueMessage, body, length)));
     DP_atomic_set(&msg->refcount, 1);
     msg->type = (uint8_t)type;
     msg->flags = FLAG_OPAQUE;
     msg->context_id = context_id;
+    DP_atomic_ptr_set(&msg->decoded, NULL);
     msg->methods = &opaque_methods;
     DP_OpaqueMessage *om = (void *)msg->internal;
     om->length = length;
@@ -159,7 +354,7 @@ void DP_message_decref(DP_Message *msg)
     DP_ASSERT(msg);
     DP_ASSERT(DP_atomic_get(&msg->refcount) > 0);
     if (DP_atomic_dec(&msg->refcount)) {
-        DP_free(msg);
+        free_message(msg);
     }
 }
 
@@ -179,6 +374,38 @@ int DP_message_refcount(DP_Message *msg)
 }
 
 
+bool DP_message_decoded_wanted(DP_Message *msg)
+{
+    DP_ASSERT(msg);
+    return DP_atomic_ptr_get(&msg->decoded) != &decoded_taken;
+}
+
+bool DP_message_decoded_set(DP_Message *msg, DP_MessageDecoded *decoded)
+{
+    DP_ASSERT(msg);
+    DP_ASSERT(decoded);
+    DP_ASSERT(decoded->free);
+    DP_MessageDecoded *prev = DP_atomic_ptr_xch(&msg->decoded, decoded);
+    if (prev == &decoded_taken) {
+        // Got handled in the meantime. Put the marker back, unless the
+        // handler just now grabbed the payload after all.
+        free_decoded(DP_atomic_ptr_xch(&msg->decoded, &decoded_taken));
+        return false;
+    }
+    else {
+        free_decoded(prev);
+        return true;
+    }
+}
+
+DP_MessageDecoded *DP_message_decoded_take(DP_Message *msg)
+{
+    DP_ASSERT(msg);
+    DP_MessageDecoded *decoded =
+        DP_atomic_ptr_xch(&msg->decoded, &decoded_taken);
+    return decoded == &decoded_taken ? NULL : decoded;
+}
+
 DP_MessageType DP_message_type(DP_Message *msg)
 {
     DP_ASSERT(msg);
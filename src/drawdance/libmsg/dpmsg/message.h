@@ -45,10 +45,42 @@ typedef struct DP_TextWriter DP_TextWriter;
 #define DP_MYPAINT_BRUSH_MODE_ERASE       0x3
 #define DP_MYPAINT_BRUSH_MODE_MASK        0x3
 
+#define DP_MESSAGE_POOL_CLASS_COUNT 8
+
 typedef struct DP_Message DP_Message;
 
+typedef struct DP_MessagePoolStatistics {
+    size_t el_size;
+    size_t bucket_el_count;
+    size_t buckets;
+    unsigned long long allocations;
+    unsigned long long frees;
+    unsigned long long contended;
+} DP_MessagePoolStatistics;
+
 typedef unsigned char *(*DP_GetMessageBufferFn)(void *user, size_t length);
 
+// Something derived from a message's payload ahead of time, like the
+// decompressed pixels of an image, so that whoever handles the message later
+// doesn't have to do that work itself. Embed this as the first member of the
+// actual structure. The free function is called with it if the message gets
+// freed while it's still attached.
+typedef struct DP_MessageDecoded DP_MessageDecoded;
+struct DP_MessageDecoded {
+    void (*free)(DP_MessageDecoded *decoded);
+};
+
+
+// Pooled message allocation is enabled by default. Programs that mostly keep
+// messages around for a long time, like a server holding an entire session
+// history in memory, can turn it off. Messages allocated before the switch
+// are still returned to wherever they came from.
+void DP_message_pool_enabled_set(bool enabled);
+
+bool DP_message_pool_enabled(void);
+
+DP_MessagePoolStatistics DP_message_pool_statistics(int pool_class);
+
 
 DP_Message *DP_message_new(DP_MessageType type, unsigned int context_id,
                            const DP_MessageMethods *methods,
@@ -67,6 +99,18 @@ void DP_message_decref_nullable(DP_Message *msg_or_null);
 
 int DP_message_refcount(DP_Message *msg);
 
+// Decoded payloads are meant to be attached by one background thread while
+// the message waits to be handled. Once the handler took it, which it does
+// whether or not anything was attached yet, decoding is no longer wanted and
+// anything attached afterwards gets freed right away, returning false.
+bool DP_message_decoded_wanted(DP_Message *msg);
+
+bool DP_message_decoded_set(DP_Message *msg, DP_MessageDecoded *decoded);
+
+// Returns the attached payload, passing ownership to the caller, or NULL if
+// there is none (yet).
+DP_MessageDecoded *DP_message_decoded_take(DP_Message *msg);
+
 
 DP_MessageType DP_message_type(DP_Message *msg);
 
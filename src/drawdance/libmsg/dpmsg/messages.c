@@ -136,6 +136,7 @@ bool DP_message_type_command(DP_MessageType type)
     case DP_MSG_CANVAS_BACKGROUND_ZSTD:
     case DP_MSG_MOVE_RECT_ZSTD:
     case DP_MSG_TRANSFORM_REGION_ZSTD:
+    case DP_MSG_FILL_GRADIENT:
     case DP_MSG_UNDO:
         return true;
     default:
@@ -371,6 +372,8 @@ const char *DP_message_type_name(DP_MessageType type)
         return "moverectzstd";
     case DP_MSG_TRANSFORM_REGION_ZSTD:
         return "transformregionzstd";
+    case DP_MSG_FILL_GRADIENT:
+        return "fillgradient";
     case DP_MSG_UNDO:
         return "undo";
     default:
@@ -531,6 +534,8 @@ const char *DP_message_type_enum_name(DP_MessageType type)
         return "DP_MSG_MOVE_RECT_ZSTD";
     case DP_MSG_TRANSFORM_REGION_ZSTD:
         return "DP_MSG_TRANSFORM_REGION_ZSTD";
+    case DP_MSG_FILL_GRADIENT:
+        return "DP_MSG_FILL_GRADIENT";
     case DP_MSG_UNDO:
         return "DP_MSG_UNDO";
     default:
@@ -738,6 +743,9 @@ DP_MessageType DP_message_type_from_name(const char *type_name,
     else if (DP_str_equal(type_name, "transformregionzstd")) {
         return DP_MSG_TRANSFORM_REGION_ZSTD;
     }
+    else if (DP_str_equal(type_name, "fillgradient")) {
+        return DP_MSG_FILL_GRADIENT;
+    }
     else if (DP_str_equal(type_name, "undo")) {
         return DP_MSG_UNDO;
     }
@@ -796,6 +804,7 @@ bool DP_message_dirties_canvas(DP_Message *msg)
     case DP_MSG_CANVAS_BACKGROUND_ZSTD:
     case DP_MSG_MOVE_RECT_ZSTD:
     case DP_MSG_TRANSFORM_REGION_ZSTD:
+    case DP_MSG_FILL_GRADIENT:
     case DP_MSG_UNDO:
         return true;
     default:
@@ -997,6 +1006,8 @@ DP_Message *DP_message_deserialize_body(int type, unsigned int context_id,
         case DP_MSG_TRANSFORM_REGION_ZSTD:
             return DP_msg_transform_region_zstd_deserialize(context_id, buf,
                                                             length);
+        case DP_MSG_FILL_GRADIENT:
+            return DP_msg_fill_gradient_deserialize(context_id, buf, length);
         case DP_MSG_UNDO:
             return DP_msg_undo_deserialize(context_id, buf, length);
         default:
@@ -1251,6 +1262,10 @@ DP_Message *DP_message_deserialize_body_compat(int type,
             DP_error_set("Can't deserialize incompatible message type 182 "
                          "DP_MSG_TRANSFORM_REGION_ZSTD");
             return NULL;
+        case DP_MSG_FILL_GRADIENT:
+            DP_error_set("Can't deserialize incompatible message type 183 "
+                         "DP_MSG_FILL_GRADIENT");
+            return NULL;
         case DP_MSG_UNDO:
             return DP_msg_undo_deserialize_compat(context_id, buf, length);
         default:
@@ -1438,6 +1453,8 @@ DP_Message *DP_message_parse_body(DP_MessageType type, unsigned int context_id,
         return DP_msg_move_rect_zstd_parse(context_id, reader);
     case DP_MSG_TRANSFORM_REGION_ZSTD:
         return DP_msg_transform_region_zstd_parse(context_id, reader);
+    case DP_MSG_FILL_GRADIENT:
+        return DP_msg_fill_gradient_parse(context_id, reader);
     case DP_MSG_UNDO:
         return DP_msg_undo_parse(context_id, reader);
     default:
@@ -12803,6 +12820,320 @@ DP_MsgTransformRegion *DP_msg_transform_region_zstd_cast(DP_Message *msg)
 }
 
 
+/* DP_MSG_FILL_GRADIENT */
+
+const char *DP_msg_fill_gradient_shape_variant_name(unsigned int value)
+{
+    switch (value) {
+    case DP_MSG_FILL_GRADIENT_SHAPE_LINEAR:
+        return "Linear";
+    case DP_MSG_FILL_GRADIENT_SHAPE_RADIAL:
+        return "Radial";
+    default:
+        return NULL;
+    }
+}
+
+const char *DP_msg_fill_gradient_spread_variant_name(unsigned int value)
+{
+    switch (value) {
+    case DP_MSG_FILL_GRADIENT_SPREAD_PAD:
+        return "Pad";
+    case DP_MSG_FILL_GRADIENT_SPREAD_REPEAT:
+        return "Repeat";
+    case DP_MSG_FILL_GRADIENT_SPREAD_REFLECT:
+        return "Reflect";
+    default:
+        return NULL;
+    }
+}
+
+struct DP_MsgFillGradient {
+    uint32_t layer;
+    uint8_t mode;
+    uint8_t shape;
+    uint8_t spread;
+    uint8_t selection_id;
+    uint32_t x;
+    uint32_t y;
+    uint32_t w;
+    uint32_t h;
+    int32_t x1;
+    int32_t y1;
+    int32_t x2;
+    int32_t y2;
+    uint16_t focus;
+    uint32_t color1;
+    uint32_t color2;
+};
+
+static size_t msg_fill_gradient_payload_length(DP_UNUSED DP_Message *msg)
+{
+    return ((size_t)49);
+}
+
+static size_t msg_fill_gradient_serialize_payload(DP_Message *msg,
+                                                  unsigned char *data)
+{
+    DP_MsgFillGradient *mfg = DP_message_internal(msg);
+    size_t written = 0;
+    written += DP_write_bigendian_uint24(mfg->layer, data + written);
+    written += DP_write_bigendian_uint8(mfg->mode, data + written);
+    written += DP_write_bigendian_uint8(mfg->shape, data + written);
+    written += DP_write_bigendian_uint8(mfg->spread, data + written);
+    written += DP_write_bigendian_uint8(mfg->selection_id, data + written);
+    written += DP_write_bigendian_uint32(mfg->x, data + written);
+    written += DP_write_bigendian_uint32(mfg->y, data + written);
+    written += DP_write_bigendian_uint32(mfg->w, data + written);
+    written += DP_write_bigendian_uint32(mfg->h, data + written);
+    written += DP_write_bigendian_int32(mfg->x1, data + written);
+    written += DP_write_bigendian_int32(mfg->y1, data + written);
+    written += DP_write_bigendian_int32(mfg->x2, data + written);
+    written += DP_write_bigendian_int32(mfg->y2, data + written);
+    written += DP_write_bigendian_uint16(mfg->focus, data + written);
+    written += DP_write_bigendian_uint32(mfg->color1, data + written);
+    written += DP_write_bigendian_uint32(mfg->color2, data + written);
+    DP_ASSERT(written == msg_fill_gradient_payload_length(msg));
+    return written;
+}
+
+static bool msg_fill_gradient_write_payload_text(DP_Message *msg,
+                                                 DP_TextWriter *writer)
+{
+    DP_MsgFillGradient *mfg = DP_message_internal(msg);
+    return DP_text_writer_write_argb_color(writer, "color1", mfg->color1)
+        && DP_text_writer_write_argb_color(writer, "color2", mfg->color2)
+        && DP_text_writer_write_uint(writer, "focus", mfg->focus)
+        && DP_text_writer_write_uint(writer, "h", mfg->h)
+        && DP_text_writer_write_uint(writer, "layer", mfg->layer)
+        && DP_text_writer_write_blend_mode(writer, "mode", mfg->mode)
+        && DP_text_writer_write_uint(writer, "selection_id", mfg->selection_id)
+        && DP_text_writer_write_uint(writer, "shape", mfg->shape)
+        && DP_text_writer_write_uint(writer, "spread", mfg->spread)
+        && DP_text_writer_write_uint(writer, "w", mfg->w)
+        && DP_text_writer_write_uint(writer, "x", mfg->x)
+        && DP_text_writer_write_decimal(writer, "x1", (double)mfg->x1 / 4.0)
+        && DP_text_writer_write_decimal(writer, "x2", (double)mfg->x2 / 4.0)
+        && DP_text_writer_write_uint(writer, "y", mfg->y)
+        && DP_text_writer_write_decimal(writer, "y1", (double)mfg->y1 / 4.0)
+        && DP_text_writer_write_decimal(writer, "y2", (double)mfg->y2 / 4.0);
+}
+
+static bool msg_fill_gradient_equals(DP_Message *DP_RESTRICT msg,
+                                     DP_Message *DP_RESTRICT other)
+{
+    DP_MsgFillGradient *a = DP_message_internal(msg);
+    DP_MsgFillGradient *b = DP_message_internal(other);
+    return a->layer == b->layer && a->mode == b->mode && a->shape == b->shape
+        && a->spread == b->spread && a->selection_id == b->selection_id
+        && a->x == b->x && a->y == b->y && a->w == b->w && a->h == b->h
+        && a->x1 == b->x1 && a->y1 == b->y1 && a->x2 == b->x2
+        && a->y2 == b->y2 && a->focus == b->focus && a->color1 == b->color1
+        && a->color2 == b->color2;
+}
+
+static const DP_MessageMethods msg_fill_gradient_methods = {
+    msg_fill_gradient_payload_length,     msg_fill_gradient_serialize_payload,
+    msg_fill_gradient_payload_length,     msg_fill_gradient_serialize_payload,
+    msg_fill_gradient_write_payload_text, msg_fill_gradient_equals,
+};
+
+DP_Message *DP_msg_fill_gradient_new(
+    unsigned int context_id, uint32_t layer, uint8_t mode, uint8_t shape,
+    uint8_t spread, uint8_t selection_id, uint32_t x, uint32_t y, uint32_t w,
+    uint32_t h, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint16_t focus,
+    uint32_t color1, uint32_t color2)
+{
+    DP_Message *msg =
+        DP_message_new(DP_MSG_FILL_GRADIENT, context_id,
+                       &msg_fill_gradient_methods, sizeof(DP_MsgFillGradient));
+    DP_MsgFillGradient *mfg = DP_message_internal(msg);
+    mfg->layer = layer;
+    mfg->mode = mode;
+    mfg->shape = shape;
+    mfg->spread = spread;
+    mfg->selection_id = selection_id;
+    mfg->x = x;
+    mfg->y = y;
+    mfg->w = w;
+    mfg->h = h;
+    mfg->x1 = x1;
+    mfg->y1 = y1;
+    mfg->x2 = x2;
+    mfg->y2 = y2;
+    mfg->focus = focus;
+    mfg->color1 = color1;
+    mfg->color2 = color2;
+    return msg;
+}
+
+DP_Message *DP_msg_fill_gradient_deserialize(unsigned int context_id,
+                                             const unsigned char *buffer,
+                                             size_t length)
+{
+    if (length != 49) {
+        DP_error_set("Wrong length for fillgradient message; "
+                     "expected 49, got %zu",
+                     length);
+        return NULL;
+    }
+    size_t read = 0;
+    uint32_t layer = read_uint24(buffer + read, &read);
+    uint8_t mode = read_uint8(buffer + read, &read);
+    uint8_t shape = read_uint8(buffer + read, &read);
+    uint8_t spread = read_uint8(buffer + read, &read);
+    uint8_t selection_id = read_uint8(buffer + read, &read);
+    uint32_t x = read_uint32(buffer + read, &read);
+    uint32_t y = read_uint32(buffer + read, &read);
+    uint32_t w = read_uint32(buffer + read, &read);
+    uint32_t h = read_uint32(buffer + read, &read);
+    int32_t x1 = read_int32(buffer + read, &read);
+    int32_t y1 = read_int32(buffer + read, &read);
+    int32_t x2 = read_int32(buffer + read, &read);
+    int32_t y2 = read_int32(buffer + read, &read);
+    uint16_t focus = read_uint16(buffer + read, &read);
+    uint32_t color1 = read_uint32(buffer + read, &read);
+    uint32_t color2 = read_uint32(buffer + read, &read);
+    return DP_msg_fill_gradient_new(context_id, layer, mode, shape, spread,
+                                    selection_id, x, y, w, h, x1, y1, x2, y2,
+                                    focus, color1, color2);
+}
+
+DP_Message *DP_msg_fill_gradient_parse(unsigned int context_id,
+                                       DP_TextReader *reader)
+{
+    uint32_t layer =
+        (uint32_t)DP_text_reader_get_ulong(reader, "layer", DP_UINT24_MAX);
+    uint8_t mode = DP_text_reader_get_blend_mode(reader, "mode");
+    uint8_t shape =
+        (uint8_t)DP_text_reader_get_ulong(reader, "shape", UINT8_MAX);
+    uint8_t spread =
+        (uint8_t)DP_text_reader_get_ulong(reader, "spread", UINT8_MAX);
+    uint8_t selection_id =
+        (uint8_t)DP_text_reader_get_ulong(reader, "selection_id", UINT8_MAX);
+    uint32_t x = (uint32_t)DP_text_reader_get_ulong(reader, "x", UINT32_MAX);
+    uint32_t y = (uint32_t)DP_text_reader_get_ulong(reader, "y", UINT32_MAX);
+    uint32_t w = (uint32_t)DP_text_reader_get_ulong(reader, "w", UINT32_MAX);
+    uint32_t h = (uint32_t)DP_text_reader_get_ulong(reader, "h", UINT32_MAX);
+    int32_t x1 = (int32_t)DP_text_reader_get_decimal(reader, "x1", 4.0,
+                                                     INT32_MIN, INT32_MAX);
+    int32_t y1 = (int32_t)DP_text_reader_get_decimal(reader, "y1", 4.0,
+                                                     INT32_MIN, INT32_MAX);
+    int32_t x2 = (int32_t)DP_text_reader_get_decimal(reader, "x2", 4.0,
+                                                     INT32_MIN, INT32_MAX);
+    int32_t y2 = (int32_t)DP_text_reader_get_decimal(reader, "y2", 4.0,
+                                                     INT32_MIN, INT32_MAX);
+    uint16_t focus =
+        (uint16_t)DP_text_reader_get_ulong(reader, "focus", UINT16_MAX);
+    uint32_t color1 = DP_text_reader_get_argb_color(reader, "color1");
+    uint32_t color2 = DP_text_reader_get_argb_color(reader, "color2");
+    return DP_msg_fill_gradient_new(context_id, layer, mode, shape, spread,
+                                    selection_id, x, y, w, h, x1, y1, x2, y2,
+                                    focus, color1, color2);
+}
+
+DP_MsgFillGradient *DP_msg_fill_gradient_cast(DP_Message *msg)
+{
+    return DP_message_cast(msg, DP_MSG_FILL_GRADIENT);
+}
+
+uint32_t DP_msg_fill_gradient_layer(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->layer;
+}
+
+uint8_t DP_msg_fill_gradient_mode(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->mode;
+}
+
+uint8_t DP_msg_fill_gradient_shape(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->shape;
+}
+
+uint8_t DP_msg_fill_gradient_spread(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->spread;
+}
+
+uint8_t DP_msg_fill_gradient_selection_id(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->selection_id;
+}
+
+uint32_t DP_msg_fill_gradient_x(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->x;
+}
+
+uint32_t DP_msg_fill_gradient_y(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->y;
+}
+
+uint32_t DP_msg_fill_gradient_w(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->w;
+}
+
+uint32_t DP_msg_fill_gradient_h(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->h;
+}
+
+int32_t DP_msg_fill_gradient_x1(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->x1;
+}
+
+int32_t DP_msg_fill_gradient_y1(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->y1;
+}
+
+int32_t DP_msg_fill_gradient_x2(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->x2;
+}
+
+int32_t DP_msg_fill_gradient_y2(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->y2;
+}
+
+uint16_t DP_msg_fill_gradient_focus(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->focus;
+}
+
+uint32_t DP_msg_fill_gradient_color1(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->color1;
+}
+
+uint32_t DP_msg_fill_gradient_color2(const DP_MsgFillGradient *mfg)
+{
+    DP_ASSERT(mfg);
+    return mfg->color2;
+}
+
+
 /* DP_MSG_UNDO */
 
 struct DP_MsgUndo {
@@ -32,8 +32,8 @@ typedef void (*DP_MessageLocalMatchSetFn)(size_t, unsigned char *, void *);
 #define DP_PROTOCOL_VERSION_NAMESPACE        "dp"
 #define DP_PROTOCOL_VERSION_SERVER           4
 #define DP_PROTOCOL_VERSION_MAJOR            25
-#define DP_PROTOCOL_VERSION_MINOR            1
-#define DP_PROTOCOL_VERSION                  "dp:4.25.1"
+#define DP_PROTOCOL_VERSION_MINOR            2
+#define DP_PROTOCOL_VERSION                  "dp:4.25.2"
 #define DP_PROTOCOL_COMPAT_VERSION_NAMESPACE "dp"
 #define DP_PROTOCOL_COMPAT_VERSION_SERVER    4
 #define DP_PROTOCOL_COMPAT_VERSION_MAJOR     24
@@ -126,6 +126,7 @@ typedef enum DP_MessageType {
     DP_MSG_CANVAS_BACKGROUND_ZSTD = 180,
     DP_MSG_MOVE_RECT_ZSTD = 181,
     DP_MSG_TRANSFORM_REGION_ZSTD = 182,
+    DP_MSG_FILL_GRADIENT = 183,
     DP_MSG_UNDO = 255,
     DP_MSG_TYPE_COUNT,
 } DP_MessageType;
@@ -3322,6 +3323,97 @@ DP_Message *DP_msg_transform_region_zstd_parse(unsigned int context_id,
 DP_MsgTransformRegion *DP_msg_transform_region_zstd_cast(DP_Message *msg);
 
 
+/*
+ * DP_MSG_FILL_GRADIENT
+ *
+ * Fill a gradient into an area of a layer
+ *
+ * The area is given by x, y, w and h. If selection_id is nonzero, the
+ * fill is additionally masked by that selection of the user, which must
+ * have been synchronized via SyncSelectionTile, so the id must be 128 or
+ * higher. Pixels outside of the mask are transparent, which only makes a
+ * difference for the Replace and Normal and Eraser blend modes.
+ *
+ * The gradient points are given in 1/4 pixel resolution. For a linear
+ * gradient, color1 is at the first point and color2 at the second. For a
+ * radial gradient, the first point is the center and the distance to the
+ * second one is the radius. The focal point lies on the line between
+ * them, where a focus of 0 is at the center and 65535 is at the edge. If
+ * both colors are the same, this is a solid fill.
+ */
+
+#define DP_MSG_FILL_GRADIENT_STATIC_LENGTH 49
+
+#define DP_MSG_FILL_GRADIENT_SHAPE_LINEAR 0
+#define DP_MSG_FILL_GRADIENT_SHAPE_RADIAL 1
+
+#define DP_MSG_FILL_GRADIENT_NUM_SHAPE 2
+#define DP_MSG_FILL_GRADIENT_ALL_SHAPE \
+    DP_MSG_FILL_GRADIENT_SHAPE_LINEAR, DP_MSG_FILL_GRADIENT_SHAPE_RADIAL
+
+const char *DP_msg_fill_gradient_shape_variant_name(unsigned int value);
+
+#define DP_MSG_FILL_GRADIENT_SPREAD_PAD     0
+#define DP_MSG_FILL_GRADIENT_SPREAD_REPEAT  1
+#define DP_MSG_FILL_GRADIENT_SPREAD_REFLECT 2
+
+#define DP_MSG_FILL_GRADIENT_NUM_SPREAD 3
+#define DP_MSG_FILL_GRADIENT_ALL_SPREAD                                    \
+    DP_MSG_FILL_GRADIENT_SPREAD_PAD, DP_MSG_FILL_GRADIENT_SPREAD_REPEAT, \
+        DP_MSG_FILL_GRADIENT_SPREAD_REFLECT
+
+const char *DP_msg_fill_gradient_spread_variant_name(unsigned int value);
+
+typedef struct DP_MsgFillGradient DP_MsgFillGradient;
+
+DP_Message *DP_msg_fill_gradient_new(
+    unsigned int context_id, uint32_t layer, uint8_t mode, uint8_t shape,
+    uint8_t spread, uint8_t selection_id, uint32_t x, uint32_t y, uint32_t w,
+    uint32_t h, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint16_t focus,
+    uint32_t color1, uint32_t color2);
+
+DP_Message *DP_msg_fill_gradient_deserialize(unsigned int context_id,
+                                             const unsigned char *buffer,
+                                             size_t length);
+
+DP_Message *DP_msg_fill_gradient_parse(unsigned int context_id,
+                                       DP_TextReader *reader);
+
+DP_MsgFillGradient *DP_msg_fill_gradient_cast(DP_Message *msg);
+
+uint32_t DP_msg_fill_gradient_layer(const DP_MsgFillGradient *mfg);
+
+uint8_t DP_msg_fill_gradient_mode(const DP_MsgFillGradient *mfg);
+
+uint8_t DP_msg_fill_gradient_shape(const DP_MsgFillGradient *mfg);
+
+uint8_t DP_msg_fill_gradient_spread(const DP_MsgFillGradient *mfg);
+
+uint8_t DP_msg_fill_gradient_selection_id(const DP_MsgFillGradient *mfg);
+
+uint32_t DP_msg_fill_gradient_x(const DP_MsgFillGradient *mfg);
+
+uint32_t DP_msg_fill_gradient_y(const DP_MsgFillGradient *mfg);
+
+uint32_t DP_msg_fill_gradient_w(const DP_MsgFillGradient *mfg);
+
+uint32_t DP_msg_fill_gradient_h(const DP_MsgFillGradient *mfg);
+
+int32_t DP_msg_fill_gradient_x1(const DP_MsgFillGradient *mfg);
+
+int32_t DP_msg_fill_gradient_y1(const DP_MsgFillGradient *mfg);
+
+int32_t DP_msg_fill_gradient_x2(const DP_MsgFillGradient *mfg);
+
+int32_t DP_msg_fill_gradient_y2(const DP_MsgFillGradient *mfg);
+
+uint16_t DP_msg_fill_gradient_focus(const DP_MsgFillGradient *mfg);
+
+uint32_t DP_msg_fill_gradient_color1(const DP_MsgFillGradient *mfg);
+
+uint32_t DP_msg_fill_gradient_color2(const DP_MsgFillGradient *mfg);
+
+
 /*
  * DP_MSG_UNDO
  *
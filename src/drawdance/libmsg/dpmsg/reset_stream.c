@@ -137,6 +137,27 @@ DP_Message **DP_reset_stream_producer_free_finish(DP_ResetStreamProducer *rsp,
     return msgs;
 }
 
+DP_Message **DP_reset_stream_producer_take(DP_ResetStreamProducer *rsp,
+                                           int *out_count)
+{
+    DP_ASSERT(rsp);
+    size_t used = rsp->msgs.used;
+    if (out_count) {
+        *out_count = DP_size_to_int(used);
+    }
+
+    if (used == 0) {
+        return NULL;
+    }
+    else {
+        size_t size = sizeof(DP_Message *) * used;
+        DP_Message **msgs = DP_malloc(size);
+        memcpy(msgs, rsp->msgs.elements, size);
+        rsp->msgs.used = 0;
+        return msgs;
+    }
+}
+
 static unsigned char *stream_producer_get_serialize_buffer(void *user,
                                                            size_t size)
 {
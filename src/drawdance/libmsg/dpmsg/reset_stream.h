@@ -15,6 +15,12 @@ void DP_reset_stream_producer_free_discard(DP_ResetStreamProducer *rsp);
 DP_Message **DP_reset_stream_producer_free_finish(DP_ResetStreamProducer *rsp,
                                                   int *out_count);
 
+// Takes the reset stream messages produced thus far, so that they can be sent
+// while more messages are being pushed. Returns NULL if there are none yet.
+// The caller owns the returned messages and must free the array.
+DP_Message **DP_reset_stream_producer_take(DP_ResetStreamProducer *rsp,
+                                           int *out_count);
+
 // Size of the reset image in bytes thus far.
 size_t DP_reset_stream_producer_image_size(DP_ResetStreamProducer *rsp);
 
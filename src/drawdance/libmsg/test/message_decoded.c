@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include <dpcommon/atomic.h>
+#include <dpcommon/common.h>
+#include <dpcommon/threading.h>
+#include <dpmsg/message.h>
+#include <dpmsg/messages.h>
+#include <dptest.h>
+
+#define RACE_ITERATIONS 10000
+
+
+typedef struct TestDecoded {
+    DP_MessageDecoded parent;
+    DP_Atomic *freed;
+} TestDecoded;
+
+static void free_test_decoded(DP_MessageDecoded *decoded)
+{
+    TestDecoded *td = (TestDecoded *)decoded;
+    DP_atomic_inc(td->freed);
+    DP_free(td);
+}
+
+static DP_MessageDecoded *test_decoded_new(DP_Atomic *freed)
+{
+    TestDecoded *td = DP_malloc(sizeof(*td));
+    *td = (TestDecoded){{free_test_decoded}, freed};
+    return &td->parent;
+}
+
+
+static void set_and_take(TEST_PARAMS)
+{
+    DP_Atomic freed = DP_ATOMIC_INIT(0);
+    DP_Message *msg = DP_msg_pen_up_new(1, 0);
+
+    OK(DP_message_decoded_wanted(msg), "decoding wanted initially");
+    OK(DP_message_decoded_set(msg, test_decoded_new(&freed)),
+       "setting payload succeeds");
+    OK(DP_message_decoded_set(msg, test_decoded_new(&freed)),
+       "setting payload again succeeds");
+    INT_EQ_OK(DP_atomic_get(&freed), 1, "replaced payload was freed");
+
+    DP_MessageDecoded *decoded = DP_message_decoded_take(msg);
+    NOT_NULL_OK(decoded, "taking payload returns it");
+    NOK(DP_message_decoded_wanted(msg), "decoding not wanted after take");
+    NULL_OK(DP_message_decoded_take(msg), "taking again returns nothing");
+    decoded->free(decoded);
+    INT_EQ_OK(DP_atomic_get(&freed), 2, "taken payload freed by taker");
+
+    NOK(DP_message_decoded_set(msg, test_decoded_new(&freed)),
+        "setting payload after take fails");
+    INT_EQ_OK(DP_atomic_get(&freed), 3, "late payload freed right away");
+
+    DP_message_decref(msg);
+    INT_EQ_OK(DP_atomic_get(&freed), 3, "nothing freed with message");
+}
+
+static void take_before_set(TEST_PARAMS)
+{
+    DP_Atomic freed = DP_ATOMIC_INIT(0);
+    DP_Message *msg = DP_msg_pen_up_new(1, 0);
+    NULL_OK(DP_message_decoded_take(msg), "nothing to take before set");
+    NOK(DP_message_decoded_set(msg, test_decoded_new(&freed)),
+        "setting payload after take fails");
+    INT_EQ_OK(DP_atomic_get(&freed), 1, "late payload freed right away");
+    DP_message_decref(msg);
+    INT_EQ_OK(DP_atomic_get(&freed), 1, "nothing freed with message");
+}
+
+static void free_with_message(TEST_PARAMS)
+{
+    DP_Atomic freed = DP_ATOMIC_INIT(0);
+    DP_Message *msg = DP_msg_pen_up_new(1, 0);
+    OK(DP_message_decoded_set(msg, test_decoded_new(&freed)),
+       "setting payload succeeds");
+    DP_message_decref(msg);
+    INT_EQ_OK(DP_atomic_get(&freed), 1, "untaken payload freed with message");
+}
+
+
+typedef struct RaceParams {
+    DP_Message *msg;
+    DP_MessageDecoded *decoded;
+    DP_Atomic ready;
+    DP_Atomic go;
+    bool set_result;
+} RaceParams;
+
+static void race_set(void *data)
+{
+    RaceParams *params = data;
+    DP_atomic_set(&params->ready, 1);
+    while (!DP_atomic_get(&params->go)) {
+        // Spin until the main thread is about to take.
+    }
+    params->set_result =
+        DP_message_decoded_set(params->msg, params->decoded);
+}
+
+// A decoder thread attaching the payload races against the handler taking it.
+// Either way, the payload must end up freed exactly once and the handler gets
+// it if and only if the decoder's set succeeded.
+static void handoff_race(TEST_PARAMS)
+{
+    DP_Atomic freed = DP_ATOMIC_INIT(0);
+    int taken = 0;
+    int mismatched = 0;
+    for (int i = 0; i < RACE_ITERATIONS; ++i) {
+        RaceParams params = {DP_msg_pen_up_new(1, 0), test_decoded_new(&freed),
+                             DP_ATOMIC_INIT(0), DP_ATOMIC_INIT(0), false};
+        DP_Thread *thread = DP_thread_new(race_set, &params);
+        if (!thread) {
+            FAIL("thread creation failed: %s", DP_error());
+            params.decoded->free(params.decoded);
+            DP_message_decref(params.msg);
+            return;
+        }
+        while (!DP_atomic_get(&params.ready)) {
+            // Spin until the decoder thread is about to set.
+        }
+        DP_atomic_set(&params.go, 1);
+        DP_MessageDecoded *decoded = DP_message_decoded_take(params.msg);
+        DP_thread_free_join(thread);
+
+        if ((decoded != NULL) != params.set_result) {
+            ++mismatched;
+        }
+        if (decoded) {
+            ++taken;
+            decoded->free(decoded);
+        }
+        DP_message_decref(params.msg);
+    }
+
+    INT_EQ_OK(mismatched, 0, "handler got payload iff set succeeded");
+    INT_EQ_OK(DP_atomic_get(&freed), RACE_ITERATIONS,
+              "every payload freed exactly once");
+    DIAG("payload taken in %d of %d iterations", taken, RACE_ITERATIONS);
+}
+
+
+static void register_tests(REGISTER_PARAMS)
+{
+    REGISTER_TEST(set_and_take);
+    REGISTER_TEST(take_before_set);
+    REGISTER_TEST(free_with_message);
+    REGISTER_TEST(handoff_race);
+}
+
+int main(int argc, char **argv)
+{
+    return DP_test_main(argc, argv, register_tests, NULL);
+}
@@ -863,6 +863,19 @@ static DP_Message *generate_transform_region_zstd(void)
         NULL);
 }
 
+static DP_Message *generate_fill_gradient(void)
+{
+    return DP_msg_fill_gradient_new(
+        generate_context_id(), random_uint24(), generate_blend_mode(),
+        generate_variant((unsigned int[]){DP_MSG_FILL_GRADIENT_ALL_SHAPE},
+                         DP_MSG_FILL_GRADIENT_NUM_SHAPE),
+        generate_variant((unsigned int[]){DP_MSG_FILL_GRADIENT_ALL_SPREAD},
+                         DP_MSG_FILL_GRADIENT_NUM_SPREAD),
+        random_uint8(), random_uint32(), random_uint32(), random_uint32(),
+        random_uint32(), random_int32(), random_int32(), random_int32(),
+        random_int32(), random_uint16(), random_uint32(), random_uint32());
+}
+
 static DP_Message *generate_put_tile_zstd(void)
 {
     return DP_msg_put_tile_zstd_new(
@@ -943,6 +956,7 @@ static GenerateFn generate_fns[] = {
     generate_canvas_background_zstd,
     generate_move_rect_zstd,
     generate_transform_region_zstd,
+    generate_fill_gradient,
     generate_put_tile_zstd,
     generate_undo,
 };
@@ -1121,10 +1135,20 @@ static void free_stream_messages(int count, DP_Message **msgs)
     DP_free(msgs);
 }
 
-static void reset_stream_roundtrip(TEST_PARAMS)
+static void push_stream_messages(DP_Vector *stream_msgs, int count,
+                                 DP_Message **msgs)
+{
+    for (int i = 0; i < count; ++i) {
+        DP_message_vector_push_noinc(stream_msgs, msgs[i]);
+    }
+    DP_free(msgs);
+}
+
+static void reset_stream_roundtrip_with(TEST_PARAMS, bool incremental)
 {
     size_t count = (size_t)1 + (size_t)random_uint32() % (size_t)1000;
-    NOTE("Testing round-trip with %zu message(s)", count);
+    NOTE("Testing %sround-trip with %zu message(s)",
+         incremental ? "incremental " : "", count);
 
     DP_Vector in_msgs;
     DP_message_vector_init(&in_msgs, count);
@@ -1140,21 +1164,40 @@ static void reset_stream_roundtrip(TEST_PARAMS)
         return;
     }
 
+    DP_Vector taken_msgs;
+    DP_message_vector_init(&taken_msgs, 16);
     for (size_t i = 0; i < count; ++i) {
         if (!OK(DP_reset_stream_producer_push(
                     rsp, DP_message_vector_at(&in_msgs, i)),
                 "push producer message %zu", i)) {
             DP_reset_stream_producer_free_discard(rsp);
+            DP_message_vector_dispose(&taken_msgs);
             DP_message_vector_dispose(&in_msgs);
             return;
         }
+
+        if (incremental) {
+            int taken_count;
+            DP_Message **taken =
+                DP_reset_stream_producer_take(rsp, &taken_count);
+            push_stream_messages(&taken_msgs, taken_count, taken);
+        }
+    }
+
+    int finished_count;
+    DP_Message **finished_msgs =
+        DP_reset_stream_producer_free_finish(rsp, &finished_count);
+    if (!OK(finished_msgs, "producer finished")) {
+        DP_message_vector_dispose(&taken_msgs);
+        DP_message_vector_dispose(&in_msgs);
+        return;
     }
+    push_stream_messages(&taken_msgs, finished_count, finished_msgs);
 
-    int stream_count;
-    DP_Message **stream_msgs =
-        DP_reset_stream_producer_free_finish(rsp, &stream_count);
-    if (!OK(stream_msgs, "producer finished")
-        || !OK(stream_count > 0, "stream message count %d", stream_count)) {
+    int stream_count = DP_size_to_int(taken_msgs.used);
+    DP_Message **stream_msgs = taken_msgs.elements;
+    if (!OK(stream_count > 0, "stream message count %d", stream_count)) {
+        DP_message_vector_dispose(&taken_msgs);
         DP_message_vector_dispose(&in_msgs);
         return;
     }
@@ -1207,11 +1250,22 @@ static void reset_stream_roundtrip(TEST_PARAMS)
     DP_message_vector_dispose(&in_msgs);
 }
 
+static void reset_stream_roundtrip(TEST_PARAMS)
+{
+    reset_stream_roundtrip_with(TEST_ARGS, false);
+}
+
+static void reset_stream_roundtrip_incremental(TEST_PARAMS)
+{
+    reset_stream_roundtrip_with(TEST_ARGS, true);
+}
+
 
 static void register_tests(REGISTER_PARAMS)
 {
     REGISTER_TEST(read_write_roundtrip);
     REGISTER_TEST(reset_stream_roundtrip);
+    REGISTER_TEST(reset_stream_roundtrip_incremental);
 }
 
 int main(int argc, char **argv)
@@ -67,8 +67,8 @@ pub const DP_BLEND_MODE_MAX: u32 = 255;
 pub const DP_PROTOCOL_VERSION_NAMESPACE: &[u8; 3] = b"dp\0";
 pub const DP_PROTOCOL_VERSION_SERVER: u32 = 4;
 pub const DP_PROTOCOL_VERSION_MAJOR: u32 = 25;
-pub const DP_PROTOCOL_VERSION_MINOR: u32 = 1;
-pub const DP_PROTOCOL_VERSION: &[u8; 10] = b"dp:4.25.1\0";
+pub const DP_PROTOCOL_VERSION_MINOR: u32 = 2;
+pub const DP_PROTOCOL_VERSION: &[u8; 10] = b"dp:4.25.2\0";
 pub const DP_PROTOCOL_COMPAT_VERSION_NAMESPACE: &[u8; 3] = b"dp\0";
 pub const DP_PROTOCOL_COMPAT_VERSION_SERVER: u32 = 4;
 pub const DP_PROTOCOL_COMPAT_VERSION_MAJOR: u32 = 24;
@@ -340,6 +340,14 @@ pub const DP_MSG_PUT_TILE_ZSTD_STATIC_LENGTH: u32 = 0;
 pub const DP_MSG_CANVAS_BACKGROUND_ZSTD_STATIC_LENGTH: u32 = 0;
 pub const DP_MSG_MOVE_RECT_ZSTD_STATIC_LENGTH: u32 = 0;
 pub const DP_MSG_TRANSFORM_REGION_ZSTD_STATIC_LENGTH: u32 = 0;
+pub const DP_MSG_FILL_GRADIENT_STATIC_LENGTH: u32 = 49;
+pub const DP_MSG_FILL_GRADIENT_SHAPE_LINEAR: u32 = 0;
+pub const DP_MSG_FILL_GRADIENT_SHAPE_RADIAL: u32 = 1;
+pub const DP_MSG_FILL_GRADIENT_NUM_SHAPE: u32 = 2;
+pub const DP_MSG_FILL_GRADIENT_SPREAD_PAD: u32 = 0;
+pub const DP_MSG_FILL_GRADIENT_SPREAD_REPEAT: u32 = 1;
+pub const DP_MSG_FILL_GRADIENT_SPREAD_REFLECT: u32 = 2;
+pub const DP_MSG_FILL_GRADIENT_NUM_SPREAD: u32 = 3;
 pub const DP_MSG_UNDO_STATIC_LENGTH: u32 = 2;
 pub const DP_MSG_UNDO_STATIC_LENGTH_COMPAT: u32 = 2;
 pub const DP_MESSAGE_MAX: u32 = 255;
@@ -6867,6 +6875,9 @@ pub struct DP_PlayerIndex {
     pub message_count: ::std::os::raw::c_uint,
     pub entries: *mut DP_PlayerIndexEntry,
     pub entry_count: usize,
+    pub tile_worker: *mut ::std::os::raw::c_void,
+    pub tile_worker_free:
+        ::std::option::Option<unsafe extern "C" fn(tile_worker: *mut ::std::os::raw::c_void)>,
 }
 #[test]
 fn bindgen_test_layout_DP_PlayerIndex() {
@@ -6874,7 +6885,7 @@ fn bindgen_test_layout_DP_PlayerIndex() {
     let ptr = UNINIT.as_ptr();
     assert_eq!(
         ::std::mem::size_of::<DP_PlayerIndex>(),
-        48usize,
+        64usize,
         concat!("Size of: ", stringify!(DP_PlayerIndex))
     );
     assert_eq!(
@@ -6922,6 +6933,26 @@ fn bindgen_test_layout_DP_PlayerIndex() {
             stringify!(entry_count)
         )
     );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).tile_worker) as usize - ptr as usize },
+        48usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(DP_PlayerIndex),
+            "::",
+            stringify!(tile_worker)
+        )
+    );
+    assert_eq!(
+        unsafe { ::std::ptr::addr_of!((*ptr).tile_worker_free) as usize - ptr as usize },
+        56usize,
+        concat!(
+            "Offset of field: ",
+            stringify!(DP_PlayerIndex),
+            "::",
+            stringify!(tile_worker_free)
+        )
+    );
 }
 extern "C" {
     pub fn DP_player_new(
@@ -9943,6 +9974,7 @@ pub const DP_MSG_PUT_TILE_ZSTD: DP_MessageType = 179;
 pub const DP_MSG_CANVAS_BACKGROUND_ZSTD: DP_MessageType = 180;
 pub const DP_MSG_MOVE_RECT_ZSTD: DP_MessageType = 181;
 pub const DP_MSG_TRANSFORM_REGION_ZSTD: DP_MessageType = 182;
+pub const DP_MSG_FILL_GRADIENT: DP_MessageType = 183;
 pub const DP_MSG_UNDO: DP_MessageType = 255;
 pub const DP_MSG_TYPE_COUNT: DP_MessageType = 256;
 pub type DP_MessageType = ::std::os::raw::c_uint;
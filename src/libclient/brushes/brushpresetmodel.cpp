@@ -49,6 +49,33 @@ struct CachedTag {
 
 struct CachedPreset : Preset {
 	QSet<int> tagIds;
+	// Thumbnails are only decoded once something asks for them, which for a
+	// large library is usually just the few presets that are scrolled into
+	// view. A pending changed thumbnail has a null pixmap as a placeholder.
+	std::optional<QByteArray> pendingOriginalThumbnail;
+	std::optional<QByteArray> pendingChangedThumbnail;
+
+	CachedPreset &withThumbnails()
+	{
+		if(pendingOriginalThumbnail.has_value()) {
+			if(!originalThumbnail.loadFromData(
+				   pendingOriginalThumbnail.value())) {
+				qWarning("Error loading thumbnail for preset %d", id);
+			}
+			pendingOriginalThumbnail = {};
+		}
+		if(pendingChangedThumbnail.has_value()) {
+			QPixmap pixmap;
+			if(pixmap.loadFromData(pendingChangedThumbnail.value())) {
+				changedThumbnail = pixmap;
+			} else {
+				qWarning("Error loading changed thumbnail for preset %d", id);
+				changedThumbnail = {};
+			}
+			pendingChangedThumbnail = {};
+		}
+		return *this;
+	}
 };
 
 struct PresetChange {
@@ -517,6 +544,7 @@ public:
 			cp.changedName = {};
 			cp.changedDescription = {};
 			cp.changedThumbnail = {};
+			cp.pendingChangedThumbnail = {};
 			cp.changedBrush = {};
 		}
 	}
@@ -807,24 +835,32 @@ private:
 		if(query.exec(sql, params)) {
 			while(query.next()) {
 				CachedPreset cp;
-				readPreset(cp, query);
+				readPreset(cp, query, false);
+				cp.pendingOriginalThumbnail = query.columnBlob(3);
+				if(!query.columnNull(7)) {
+					cp.changedThumbnail = QPixmap();
+					cp.pendingChangedThumbnail = query.columnBlob(7);
+				}
 				parseGroupedTagIds(query.columnText16(9), cp.tagIds);
 				m_presetCache.append(cp);
 			}
 		}
 	}
 
-	void readPreset(Preset &preset, drawdance::Query &query)
+	void readPreset(
+		Preset &preset, drawdance::Query &query, bool readThumbnails = true)
 	{
 		preset.id = query.columnInt(0);
 		preset.originalName = query.columnText16(1);
 		preset.originalDescription = query.columnText16(2);
 
 		QPixmap pixmap;
-		if(pixmap.loadFromData(query.columnBlob(3))) {
-			preset.originalThumbnail = pixmap;
-		} else {
-			qWarning("Error loading thumbnail for preset %d", preset.id);
+		if(readThumbnails) {
+			if(pixmap.loadFromData(query.columnBlob(3))) {
+				preset.originalThumbnail = pixmap;
+			} else {
+				qWarning("Error loading thumbnail for preset %d", preset.id);
+			}
 		}
 
 		preset.originalBrush = loadBrush(preset.id, query.columnBlob(4));
@@ -837,7 +873,7 @@ private:
 			preset.changedDescription = query.columnText16(6);
 		}
 
-		if(!query.columnNull(7)) {
+		if(readThumbnails && !query.columnNull(7)) {
 			if(pixmap.loadFromData(query.columnBlob(7))) {
 				preset.changedThumbnail = pixmap;
 			} else {
@@ -2068,7 +2104,9 @@ QVariant BrushPresetModel::data(const QModelIndex &index, int role) const
 		}
 	case EffectiveThumbnailRole: {
 		if(cached) {
-			return d->getCachedPreset(index.row()).effectiveThumbnail();
+			return d->getCachedPreset(index.row())
+				.withThumbnails()
+				.effectiveThumbnail();
 		} else {
 			QPixmap pixmap;
 			if(pixmap.loadFromData(
@@ -2087,7 +2125,8 @@ QVariant BrushPresetModel::data(const QModelIndex &index, int role) const
 		}
 	case PresetRole:
 		if(cached) {
-			return QVariant::fromValue<Preset>(d->getCachedPreset(index.row()));
+			return QVariant::fromValue<Preset>(
+				d->getCachedPreset(index.row()).withThumbnails());
 		} else {
 			std::optional<Preset> opt = d->readPresetById(index.internalId());
 			return opt.has_value() ? QVariant::fromValue<Preset>(opt.value())
@@ -2143,7 +2182,7 @@ std::optional<Preset> BrushPresetModel::searchPresetBrushData(int presetId)
 	if(i == -1) {
 		return d->readPresetById(presetId);
 	} else {
-		return d->getCachedPreset(i);
+		return d->getCachedPreset(i).withThumbnails();
 	}
 }
 
@@ -2158,7 +2197,7 @@ QPixmap BrushPresetModel::searchPresetThumbnail(int presetId)
 			return QPixmap();
 		}
 	} else {
-		return d->getCachedPreset(i).effectiveThumbnail();
+		return d->getCachedPreset(i).withThumbnails().effectiveThumbnail();
 	}
 }
 
@@ -2306,6 +2345,7 @@ void BrushPresetModel::changePreset(
 		cp.changedName = name;
 		cp.changedDescription = description;
 		cp.changedThumbnail = thumbnail;
+		cp.pendingChangedThumbnail = {};
 		cp.changedBrush = brush;
 		if(brush.has_value() && inEraserSlot) {
 			cp.changedBrush->setEraser(cp.originalBrush.isEraser());
@@ -581,6 +581,46 @@ static int getAutoselect(
 	return -1;
 }
 
+static bool haveSameStructure(
+	const QVector<LayerListItem> &a, const QVector<LayerListItem> &b)
+{
+	int count = a.size();
+	if(b.size() != count) {
+		return false;
+	}
+
+	for(int i = 0; i < count; ++i) {
+		const LayerListItem &x = a[i];
+		const LayerListItem &y = b[i];
+		if(x.id != y.id || x.group != y.group || x.children != y.children ||
+		   x.relIndex != y.relIndex || x.left != y.left || x.right != y.right) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool haveSameProps(const LayerListItem &a, const LayerListItem &b)
+{
+	return a.title == b.title && a.color == b.color &&
+		   a.opacity == b.opacity && a.blend == b.blend &&
+		   a.sketchOpacity == b.sketchOpacity && a.sketchTint == b.sketchTint &&
+		   a.hidden == b.hidden && a.censored == b.censored &&
+		   a.revealed == b.revealed && a.isolated == b.isolated &&
+		   a.clip == b.clip && a.alphaLock == b.alphaLock;
+}
+
+static void markWithChildren(
+	QVector<bool> &marked, const QVector<LayerListItem> &items, int i)
+{
+	marked[i] = true;
+	int right = items[i].right;
+	int count = items.size();
+	for(int j = i + 1; j < count && items[j].left < right; ++j) {
+		marked[j] = true;
+	}
+}
+
 void LayerListModel::setLayers(
 	const drawdance::LayerPropsList &lpl, const QSet<int> &revealedLayers)
 {
@@ -611,13 +651,28 @@ void LayerListModel::setLayers(
 		}
 	}
 
-	beginResetModel();
-	m_rootLayerCount = lpl.count();
-	m_items = newItems;
-	if(m_checkMode) {
-		m_checkStates = checkStates;
+	if(haveSameStructure(m_items, newItems)) {
+		// Only properties changed, which is the common case when someone
+		// toggles visibility or drags an opacity slider. Resetting the model
+		// would make views rebuild everything, so just update the layers
+		// that are actually different.
+		QVector<LayerListItem> oldItems = m_items;
+		QHash<int, CheckState> oldCheckStates = m_checkStates;
+		m_items = newItems;
+		if(m_checkMode) {
+			m_checkStates = checkStates;
+		}
+		emitChangedItems(oldItems, oldCheckStates);
+		emit layersUpdated();
+	} else {
+		beginResetModel();
+		m_rootLayerCount = lpl.count();
+		m_items = newItems;
+		if(m_checkMode) {
+			m_checkStates = checkStates;
+		}
+		endResetModel();
 	}
-	endResetModel();
 
 	emit layersChanged(m_items);
 	if(m_fillSourceLayerId != 0 && !layerIndex(m_fillSourceLayerId).isValid()) {
@@ -636,6 +691,41 @@ void LayerListModel::setLayers(
 	}
 }
 
+void LayerListModel::emitChangedItems(
+	const QVector<LayerListItem> &oldItems,
+	const QHash<int, CheckState> &oldCheckStates)
+{
+	int count = m_items.size();
+	QVector<bool> changed(count, false);
+	for(int i = 0; i < count; ++i) {
+		const LayerListItem &item = m_items[i];
+		bool checkStateChanged =
+			m_checkMode && m_checkStates.value(item.id, Unchecked) !=
+							   oldCheckStates.value(item.id, Unchecked);
+		if(checkStateChanged || !haveSameProps(item, oldItems[i])) {
+			// Children inherit hidden and censored states from their parents.
+			markWithChildren(changed, m_items, i);
+			// Clipping layers above inherit the hidden state of their base.
+			QModelIndex parentIndex = parent(createIndex(item.relIndex, 0, i));
+			for(int row = item.relIndex - 1; row >= 0; --row) {
+				int above = int(index(row, 0, parentIndex).internalId());
+				if(m_items[above].clip) {
+					markWithChildren(changed, m_items, above);
+				} else {
+					break;
+				}
+			}
+		}
+	}
+
+	for(int i = 0; i < count; ++i) {
+		if(changed[i]) {
+			QModelIndex idx = createIndex(m_items[i].relIndex, 0, i);
+			emit dataChanged(idx, idx);
+		}
+	}
+}
+
 void LayerListModel::setLayersVisibleInFrame(
 	const QSet<int> &layers, int viewMode)
 {
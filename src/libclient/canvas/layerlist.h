@@ -259,6 +259,10 @@ public slots:
 signals:
 	void layersChanged(const QVector<LayerListItem> &items);
 
+	//! Layers changed in place, the changed ones got dataChanged signals
+	//! Structural changes, like adding or moving layers, reset the model.
+	void layersUpdated();
+
 	//! A new layer was created that should be automatically selected
 	void autoSelectRequest(int);
 
@@ -285,6 +289,10 @@ private:
 		int &index, const drawdance::LayerPropsList &lpl,
 		const QSet<int> &revealedLayers, bool parentCensored);
 
+	void emitChangedItems(
+		const QVector<LayerListItem> &oldItems,
+		const QHash<int, CheckState> &oldCheckStates);
+
 	void flattenKeyFrameLayer(
 		QVector<KeyFrameLayerItem> &items, int &index, int &layerIndex,
 		int relIndex, const QHash<int, bool> &layerVisibiltiy) const;
@@ -28,6 +28,9 @@ TransformModel::TransformModel(CanvasModel *canvas)
 	connect(
 		layerlist, &LayerListModel::modelReset, this,
 		&TransformModel::updateLayerIds);
+	connect(
+		layerlist, &LayerListModel::layersUpdated, this,
+		&TransformModel::updateLayerIds);
 	connect(
 		layerlist, &LayerListModel::layerCheckStateToggled, this,
 		&TransformModel::updateLayerIds);
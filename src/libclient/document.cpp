@@ -81,6 +81,8 @@ Document::Document(
 		m_toolctrl, &tools::ToolController::setGlobalSmoothing);
 	m_settings.bindInterpolateInputs(
 		m_toolctrl, &tools::ToolController::setInterpolateInputs);
+	m_settings.bindFastColorSampling(
+		m_toolctrl, &tools::ToolController::setFastColorSampling);
 	m_settings.bindMouseSmoothing(
 		m_toolctrl, &tools::ToolController::setMouseSmoothing);
 	m_settings.bindCancelDeselects(
@@ -149,9 +151,12 @@ Document::Document(
 	connect(
 		this, &Document::justInTimeSnapshotGenerated, this,
 		&Document::sendResetSnapshot, Qt::QueuedConnection);
+	connect(
+		this, &Document::buildStreamResetImageProgressed, this,
+		&Document::addStreamResetImageChunks, Qt::QueuedConnection);
 	connect(
 		this, &Document::buildStreamResetImageFinished, this,
-		&Document::startSendingStreamResetSnapshot, Qt::QueuedConnection);
+		&Document::finishStreamResetImage, Qt::QueuedConnection);
 
 	connect(
 		m_toolctrl, &tools::ToolController::deselectRequested, this,
@@ -628,11 +633,9 @@ void Document::buildStreamResetImage(
 				: DP_ACL_STATE_RESET_IMAGE_SESSION_RESET_FLAGS);
 		utils::FunctionRunnable *runnable = new utils::FunctionRunnable(
 			[this, canvasState, correlator, metadata, prepended]() {
-				int messageCount;
-				net::MessageList image = generateStreamSnapshot(
-					canvasState, metadata, prepended, messageCount);
-				emit buildStreamResetImageFinished(
-					image, messageCount, correlator);
+				int messageCount = generateStreamSnapshot(
+					canvasState, metadata, prepended, correlator);
+				emit buildStreamResetImageFinished(messageCount, correlator);
 			});
 		QThreadPool::globalInstance()->start(runnable);
 	} else {
@@ -1307,120 +1310,181 @@ void Document::sendResetSnapshot()
 }
 
 namespace {
+// Feeds the reset image into the stream producer and hands off the compressed
+// chunks as soon as they're ready, so that they can be uploaded while the rest
+// of the image is still being built.
 struct ResetStreamImageContext {
+	Document *doc;
 	DP_ResetStreamProducer *rsp;
+	const QString &correlator;
+	size_t maxSize;
 	int count;
 	bool ok;
 
+	bool pushMessage(DP_Message *msg)
+	{
+		if(!DP_reset_stream_producer_push(rsp, msg)) {
+			qWarning("Reset stream: %s", DP_error());
+			return false;
+		}
+
+		++count;
+		if(maxSize > 0 && DP_reset_stream_producer_image_size(rsp) > maxSize) {
+			qWarning("Reset stream: oversized reset image");
+			return false;
+		}
+
+		int chunkCount;
+		DP_Message **chunks = DP_reset_stream_producer_take(rsp, &chunkCount);
+		if(chunks) {
+			emitChunks(chunkCount, chunks);
+		}
+		return true;
+	}
+
+	void emitChunks(int chunkCount, DP_Message **chunks)
+	{
+		net::MessageList image;
+		image.reserve(chunkCount);
+		for(int i = 0; i < chunkCount; ++i) {
+			image.append(net::Message::noinc(chunks[i]));
+		}
+		DP_free(chunks);
+		emit doc->buildStreamResetImageProgressed(image, correlator);
+	}
+
 	static void push(void *user, DP_Message *msg)
 	{
 		ResetStreamImageContext *ctx =
 			static_cast<ResetStreamImageContext *>(user);
 		if(ctx->ok) {
-			if(DP_reset_stream_producer_push(ctx->rsp, msg)) {
-				++ctx->count;
-			} else {
-				qWarning("Reset stream: %s", DP_error());
-				ctx->ok = false;
-			}
+			ctx->ok = ctx->pushMessage(msg);
 		}
 		DP_message_decref(msg);
 	}
 };
 }
 
-net::MessageList Document::generateStreamSnapshot(
+int Document::generateStreamSnapshot(
 	const drawdance::CanvasState &canvasState, const net::MessageList &metadata,
-	int prepended, int &outMessageCount) const
+	int prepended, const QString &correlator)
 {
 	bool compatibilityMode = isCompatibilityMode();
 	DP_ResetStreamProducer *rsp =
 		DP_reset_stream_producer_new(compatibilityMode);
 	if(!rsp) {
 		qWarning("Error initializing reset stream producer: %s", DP_error());
-		return {};
+		return 0;
 	}
 
+	ResetStreamImageContext ctx = {
+		this,
+		rsp,
+		correlator,
+		size_t(qMax(0, m_sessionHistoryMaxSize)),
+		0,
+		true};
 	for(int i = 0; i < prepended; ++i) {
-		if(!DP_reset_stream_producer_push(rsp, metadata[i].get())) {
-			qWarning("Reset stream: %s", DP_error());
+		if(!ctx.pushMessage(metadata[i].get())) {
 			DP_reset_stream_producer_free_discard(rsp);
-			return {};
+			return 0;
 		}
 	}
 
-	ResetStreamImageContext ctx = {rsp, 0, true};
 	DP_reset_image_build(
 		canvasState.get(), m_client->myId(), compatibilityMode,
 		ResetStreamImageContext::push, &ctx);
 	if(!ctx.ok) {
 		DP_reset_stream_producer_free_discard(rsp);
-		return {};
+		return 0;
 	}
 
 	int metadataCount = metadata.size();
 	for(int i = prepended; i < metadataCount; ++i) {
-		if(!DP_reset_stream_producer_push(rsp, metadata[i].get())) {
-			qWarning("Reset stream: %s", DP_error());
+		if(!ctx.pushMessage(metadata[i].get())) {
 			DP_reset_stream_producer_free_discard(rsp);
-			return {};
+			return 0;
 		}
 	}
 
-	if(m_sessionHistoryMaxSize > 0 && DP_reset_stream_producer_image_size(rsp) >
-										  size_t(m_sessionHistoryMaxSize)) {
-		qWarning("Reset stream: oversized reset image");
-		DP_reset_stream_producer_free_discard(rsp);
-		return {};
-	}
-
-	int count;
-	DP_Message **msgs = DP_reset_stream_producer_free_finish(rsp, &count);
-	if(!msgs) {
+	int chunkCount;
+	DP_Message **chunks = DP_reset_stream_producer_free_finish(rsp, &chunkCount);
+	if(!chunks) {
 		qWarning("Reset stream: %s", DP_error());
-		return {};
+		return 0;
 	}
+	ctx.emitChunks(chunkCount, chunks);
 
-	net::MessageList image;
-	image.reserve(count);
-	for(int i = 0; i < count; ++i) {
-		image.append(net::Message::noinc(msgs[i]));
+	return ctx.count;
+}
+
+void Document::addStreamResetImageChunks(
+	const net::MessageList &chunks, const QString &correlator)
+{
+	if(m_autoResetCorrelator != correlator) {
+		qWarning("Streamed reset image chunk does not match correlator");
+		return;
 	}
-	DP_free(msgs);
 
-	outMessageCount = metadataCount + ctx.count;
-	return image;
+	switch(m_streamResetState) {
+	case StreamResetState::Generating:
+		qDebug("Start sending stream reset image");
+		m_streamResetImage = chunks;
+		m_streamResetImageOriginalCount = chunks.size();
+		m_streamResetGenerated = false;
+		setStreamResetState(StreamResetState::Streaming);
+		sendNextStreamResetMessage();
+		break;
+	case StreamResetState::Streaming:
+		if(!m_streamResetGenerated) {
+			m_streamResetImage.append(chunks);
+			m_streamResetImageOriginalCount += chunks.size();
+			if(m_streamResetAwaitingChunk) {
+				sendNextStreamResetMessage();
+			}
+		}
+		break;
+	default:
+		// Reset got cancelled while generating, just drop the chunks.
+		break;
+	}
 }
 
-void Document::startSendingStreamResetSnapshot(
-	const QVector<net::Message> &image, int messageCount,
-	const QString &correlator)
+void Document::finishStreamResetImage(
+	int messageCount, const QString &correlator)
 {
-	if(m_streamResetState == StreamResetState::Generating &&
-	   m_autoResetCorrelator == correlator) {
-		if(messageCount > 0 && !image.isEmpty()) {
-			qDebug("Start sending stream reset image");
-			m_streamResetImage = image;
-			m_streamResetImageOriginalCount = image.size();
-			setStreamResetState(StreamResetState::Streaming, messageCount);
+	if(m_autoResetCorrelator != correlator ||
+	   m_streamResetState == StreamResetState::None) {
+		qWarning("Streamed reset image generated, but not ready to stream");
+	} else if(messageCount > 0 && !m_streamResetGenerated &&
+			  m_streamResetState == StreamResetState::Streaming) {
+		qDebug("Finished generating stream reset image");
+		m_streamResetGenerated = true;
+		m_streamResetMessageCount = messageCount;
+		if(m_streamResetAwaitingChunk) {
 			sendNextStreamResetMessage();
 		} else {
-			qDebug("Abort sending stream reset image");
-			m_streamResetImage.clear();
-			m_streamResetImageOriginalCount = 0;
-			setStreamResetState(StreamResetState::None);
-			m_client->sendMessage(
-				net::ServerCommand::make(QStringLiteral("stream-reset-abort")));
+			emitStreamResetProgress();
 		}
 	} else {
-		qWarning("Streamed reset image generated, but not ready to stream");
+		qDebug("Abort sending stream reset image");
+		m_streamResetImage.clear();
+		m_streamResetImageOriginalCount = 0;
+		setStreamResetState(StreamResetState::None);
+		m_client->sendMessage(
+			net::ServerCommand::make(QStringLiteral("stream-reset-abort")));
 	}
 }
 
 void Document::sendNextStreamResetMessage()
 {
 	if(m_streamResetState == StreamResetState::Streaming) {
-		if(m_streamResetImage.isEmpty()) {
+		m_streamResetAwaitingChunk = false;
+		if(m_streamResetImage.isEmpty() && !m_streamResetGenerated) {
+			// The server is ready for more, but the next chunk is still being
+			// compressed. It gets sent as soon as it arrives.
+			m_streamResetAwaitingChunk = true;
+		} else if(m_streamResetImage.isEmpty()) {
 			qDebug("Send stream-reset-finish");
 			m_client->sendMessage(net::ServerCommand::make(
 				QStringLiteral("stream-reset-finish"),
@@ -1439,6 +1503,7 @@ void Document::setStreamResetState(StreamResetState state, int messageCount)
 {
 	m_streamResetState = state;
 	m_streamResetMessageCount = messageCount;
+	m_streamResetAwaitingChunk = false;
 	emitStreamResetProgress();
 }
 
@@ -1452,6 +1517,11 @@ void Document::emitStreamResetProgress()
 		emit streamResetProgress(-1);
 		break;
 	case StreamResetState::Streaming: {
+		// The total isn't known until the image is done generating.
+		if(!m_streamResetGenerated) {
+			emit streamResetProgress(-1);
+			break;
+		}
 		qreal total = m_streamResetImageOriginalCount;
 		qreal sent = total - m_streamResetImage.size();
 		emit streamResetProgress(qBound(0, qRound(sent / total * 100.0), 100));
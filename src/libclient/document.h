@@ -232,9 +232,10 @@ signals:
 	void templateExported(const QString &errorMessage);
 
 	void justInTimeSnapshotGenerated();
+	void buildStreamResetImageProgressed(
+		const net::MessageList &chunks, const QString &correlator);
 	void buildStreamResetImageFinished(
-		const net::MessageList &image, int messageCount,
-		const QString &correlator);
+		int messageCount, const QString &correlator);
 
 	void permissionDenied(int feature);
 
@@ -357,14 +358,14 @@ private:
 	void generateJustInTimeSnapshot();
 	void sendResetSnapshot();
 
-	net::MessageList generateStreamSnapshot(
+	int generateStreamSnapshot(
 		const drawdance::CanvasState &canvasState,
 		const net::MessageList &metadata, int prepended,
-		int &outMessageCount) const;
-
-	void startSendingStreamResetSnapshot(
-		const net::MessageList &image, int messageCount,
 		const QString &correlator);
+
+	void addStreamResetImageChunks(
+		const net::MessageList &chunks, const QString &correlator);
+	void finishStreamResetImage(int messageCount, const QString &correlator);
 	void sendNextStreamResetMessage();
 	void setStreamResetState(StreamResetState state, int messageCount = 0);
 	void emitStreamResetProgress();
@@ -425,6 +426,8 @@ private:
 	int m_streamResetMessageCount = 0;
 	int m_streamResetImageOriginalCount = 0;
 	StreamResetState m_streamResetState = StreamResetState::None;
+	bool m_streamResetGenerated = false;
+	bool m_streamResetAwaitingChunk = false;
 
 	bool m_sessionOutOfSpace;
 	bool m_preparingReset;
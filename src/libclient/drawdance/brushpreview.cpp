@@ -15,7 +15,7 @@ namespace drawdance {
 
 BrushPreview::BrushPreview()
     : m_data{DP_brush_preview_new()}
-    , m_pixmap{}
+    , m_size{}
 {
 }
 
@@ -26,9 +26,7 @@ BrushPreview::~BrushPreview()
 
 void BrushPreview::reset(QSize size)
 {
-    if (size != m_pixmap.size()) {
-        m_pixmap = QPixmap{size};
-    }
+    m_size = size;
 }
 
 void BrushPreview::setSizeLimit(int limit)
@@ -38,30 +36,29 @@ void BrushPreview::setSizeLimit(int limit)
 
 void BrushPreview::renderClassic(const DP_ClassicBrush &brush, DP_BrushPreviewShape shape)
 {
-    QSize size = m_pixmap.size();
     DrawContext dc = DrawContextPool::acquire();
     DP_brush_preview_render_classic(
-        m_data, dc.get(), size.width(), size.height(), &brush, shape);
+        m_data, dc.get(), m_size.width(), m_size.height(), &brush, shape);
 }
 
 void BrushPreview::renderMyPaint(
     const DP_MyPaintBrush &brush, const DP_MyPaintSettings &settings,
     DP_BrushPreviewShape shape)
 {
-    QSize size = m_pixmap.size();
     DrawContext dc = DrawContextPool::acquire();
     DP_brush_preview_render_mypaint(
-        m_data, dc.get(), size.width(), size.height(), &brush, &settings, shape);
+        m_data, dc.get(), m_size.width(), m_size.height(), &brush, &settings,
+        shape);
 }
 
-void BrushPreview::paint(const QPixmap &background)
+QImage BrushPreview::toImage(const QImage &background) const
 {
     QImage img = wrapImage(DP_brush_preview_to_image(m_data));
-    m_pixmap.convertFromImage(img);
 
-    QPainter painter{&m_pixmap};
+    QPainter painter{&img};
     painter.setCompositionMode(QPainter::CompositionMode_DestinationOver);
-    painter.drawTiledPixmap(m_pixmap.rect(), background);
+    painter.fillRect(img.rect(), QBrush{background});
+    return img;
 }
 
 QPixmap BrushPreview::classicBrushPreviewDab(
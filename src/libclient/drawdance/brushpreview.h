@@ -7,6 +7,7 @@ extern "C" {
 #include <dpengine/brush_preview.h>
 }
 
+#include <QImage>
 #include <QPixmap>
 #include <QSize>
 
@@ -22,7 +23,7 @@ public:
     BrushPreview &operator=(const BrushPreview &) = delete;
     BrushPreview &operator=(BrushPreview &&) = delete;
 
-    const QPixmap &pixmap() const { return m_pixmap; }
+    const QSize &size() const { return m_size; }
 
     void reset(QSize size);
 
@@ -34,14 +35,15 @@ public:
         const DP_MyPaintBrush &brush, const DP_MyPaintSettings &settings,
         DP_BrushPreviewShape shape);
 
-    void paint(const QPixmap &background);
+    // Doesn't touch any pixmaps, so this can be used from a worker thread.
+    QImage toImage(const QImage &background) const;
 
     static QPixmap classicBrushPreviewDab(
         const DP_ClassicBrush &cb, int width, int height, const QColor &color);
 
 private:
     DP_BrushPreview *m_data;
-    QPixmap m_pixmap;
+    QSize m_size;
 };
 
 }
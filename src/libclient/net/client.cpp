@@ -727,4 +727,20 @@ void Client::requestUpdateAuthList(const QJsonArray &list)
 	sendMessage(net::ServerCommand::make(QStringLiteral("auth-list"), args));
 }
 
+void Client::sendInterest(bool cursors, bool lasers)
+{
+	if(serverSupportsInterest()) {
+		QJsonArray ephemeral;
+		if(cursors) {
+			ephemeral.append(QStringLiteral("cursors"));
+		}
+		if(lasers) {
+			ephemeral.append(QStringLiteral("lasers"));
+		}
+		QJsonObject kwargs = {{QStringLiteral("ephemeral"), ephemeral}};
+		sendMessage(
+			net::ServerCommand::make(QStringLiteral("interest"), {}, kwargs));
+	}
+}
+
 }
@@ -161,6 +161,14 @@ public:
 		return m_server && m_server->supportsAbuseReports();
 	}
 
+	/**
+	 * @brief Can the server skip cursor and laser messages we don't display?
+	 */
+	bool serverSupportsInterest() const
+	{
+		return m_server && m_server->supportsInterest();
+	}
+
 	bool sessionSupportsAutoReset() const { return m_supportsAutoReset; }
 
 	bool isCompatibilityMode() const { return m_compatibilityMode; }
@@ -243,6 +251,7 @@ public slots:
 	void requestBanExport(bool plain);
 	void requestBanImport(const QString &bans);
 	void requestUpdateAuthList(const QJsonArray &list);
+	void sendInterest(bool cursors, bool lasers);
 
 signals:
 	void catchupProgress(int percentage);
@@ -217,6 +217,8 @@ void LoginHandler::expectHello(const ServerReply &msg)
 			m_supportsLookup = true;
 		} else if(flag == QStringLiteral("CINFO")) {
 			m_supportsClientInfo = true;
+		} else if(flag == QStringLiteral("INTEREST")) {
+			m_supportsInterest = true;
 		} else {
 			qCWarning(lcDpLogin) << "Unknown server capability:" << flag;
 		}
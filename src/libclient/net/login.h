@@ -206,6 +206,7 @@ public:
 
 	bool supportsCryptBanImEx() const { return m_supportsCryptBanImpEx; }
 	bool supportsModBanImEx() const { return m_supportsModBanImpEx; }
+	bool supportsInterest() const { return m_supportsInterest; }
 
 	/**
 	 * @brief Can the server receive abuse reports?
@@ -579,6 +580,7 @@ private:
 	bool m_supportsModBanImpEx = false;
 	bool m_supportsClientInfo = false;
 	bool m_supportsLookup = false;
+	bool m_supportsInterest = false;
 	bool m_supportsExtAuthAvatars = false;
 	bool m_compatibilityMode = false;
 	bool m_needSessionPassword = false;
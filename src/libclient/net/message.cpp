@@ -1,7 +1,9 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 extern "C" {
 #include <dpengine/compress.h>
+#include <dpengine/gradient.h>
 #include <dpengine/local_state.h>
+#include <dpengine/tile.h>
 #include <dpmsg/ids.h>
 #include <dpmsg/msg_internal.h>
 }
@@ -9,12 +11,18 @@ extern "C" {
 #include "libclient/drawdance/global.h"
 #include "libclient/drawdance/tile.h"
 #include "libclient/net/message.h"
+#include "libshared/util/functionrunnable.h"
 #include "libshared/util/qtcompat.h"
+#include <QAtomicInt>
 #include <QByteArray>
 #include <QImage>
 #include <QJsonDocument>
+#include <QPainter>
+#include <QSemaphore>
 #include <QString>
+#include <QThreadPool>
 #include <QtEndian>
+#include <memory>
 
 namespace net {
 
@@ -83,6 +91,17 @@ makeFeatureLimitsMessage(uint8_t contextId, const QVector<int32_t> &limits)
 		const_cast<int32_t *>(limits.constData())));
 }
 
+Message makeFillGradientMessage(
+	uint8_t contextId, uint32_t layer, uint8_t mode, uint8_t shape,
+	uint8_t spread, uint8_t selectionId, uint32_t x, uint32_t y, uint32_t w,
+	uint32_t h, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint16_t focus,
+	const QColor &color1, const QColor &color2)
+{
+	return Message::noinc(DP_msg_fill_gradient_new(
+		contextId, layer, mode, shape, spread, selectionId, x, y, w, h, x1, y1,
+		x2, y2, focus, color1.rgba(), color2.rgba()));
+}
+
 Message makeFillRectMessage(
 	uint8_t contextId, uint32_t layer, uint8_t mode, uint32_t x, uint32_t y,
 	uint32_t w, uint32_t h, const QColor &color)
@@ -476,6 +495,15 @@ makeSetMetadataIntMessage(uint8_t contextId, uint8_t field, int32_t value)
 	return Message::noinc(DP_msg_set_metadata_int_new(contextId, field, value));
 }
 
+Message makeSyncSelectionTileMessage(
+	uint8_t contextId, uint8_t user, uint8_t selectionId, uint16_t col,
+	uint16_t row, const QByteArray &compressedMask)
+{
+	return Message::noinc(DP_msg_sync_selection_tile_new(
+		contextId, user, selectionId, col, row, &Message::setUchars,
+		compressedMask.size(), const_cast<char *>(compressedMask.data())));
+}
+
 Message makeTrackCreateMessage(
 	uint8_t contextId, uint16_t id, uint16_t insertId, uint16_t sourceId,
 	const QString &title)
@@ -565,10 +593,9 @@ public:
 				QImage cropped = converted.copy(
 					xoffset, yoffset, image.width() - xoffset,
 					image.height() - yoffset);
-				makeRecursive(
-					x + xoffset, y + yoffset, cropped, cropped.rect(), 0);
+				makeChunked(x + xoffset, y + yoffset, cropped);
 			} else {
-				makeRecursive(x, y, converted, converted.rect(), 0);
+				makeChunked(x, y, converted);
 			}
 		}
 	}
@@ -576,58 +603,183 @@ public:
 protected:
 	static constexpr compat::sizetype MAX_SIZE =
 		DP_MSG_PUT_IMAGE_IMAGE_MAX_SIZE;
+	// Chunks cover at most this many canvas tiles, so that each one fits
+	// into a single message even if its pixels don't compress at all. Both
+	// deflate and zstd make incompressible data bigger by well under 1/64.
+	static constexpr int MAX_CHUNK_TILES =
+		int(MAX_SIZE / (DP_TILE_COMPRESSED_BYTES +
+						DP_TILE_COMPRESSED_BYTES / 64));
+	static_assert(MAX_CHUNK_TILES >= 1, "tile must fit into a message");
+
+	struct Chunk {
+		QRect bounds;
+		net::Message msg;
+	};
+
+	struct ChunkJob {
+		int x;
+		int y;
+		QImage image;
+		QVector<Chunk> chunks;
+		QAtomicInt next;
+		QSemaphore done;
+	};
+
+	// Makes a maker of the same kind with its own compression buffers.
+	virtual std::unique_ptr<PutImageMaker> clone() const = 0;
 
 	virtual QByteArray compress(const QImage &image) = 0;
 
 	virtual net::Message
 	makeMessage(int x, int y, int w, int h, const QByteArray &compressed) = 0;
 
-	void makeRecursive(
-		int x, int y, const QImage &image, const QRect &bounds,
-		int estimatedSize)
+	void makeChunked(int x, int y, const QImage &image)
+	{
+		std::shared_ptr<ChunkJob> job = std::make_shared<ChunkJob>();
+		job->x = x;
+		job->y = y;
+		job->image = image;
+		job->chunks = gatherChunks(x, y, image);
+
+		int count = job->chunks.size();
+		if(count == 1) {
+			const QRect &bounds = job->chunks.first().bounds;
+			m_msgs.append(
+				makeChunkMessage(x + bounds.x(), y + bounds.y(), image, bounds));
+		} else if(count > 1) {
+			// The chunks don't overlap, so they can be compressed in any order.
+			// This thread pitches in too, so it doesn't matter if the thread
+			// pool is busy with something else or we're running inside of it.
+			QThreadPool *pool = QThreadPool::globalInstance();
+			int threads = qMin(count, pool->maxThreadCount()) - 1;
+			for(int i = 0; i < threads; ++i) {
+				pool->start(utils::FunctionRunnable::create([this, job] {
+					compressChunks(this, *job);
+				}));
+			}
+			compressChunks(this, *job);
+			job->done.acquire(count);
+			for(const Chunk &chunk : job->chunks) {
+				m_msgs.append(chunk.msg);
+			}
+		}
+	}
+
+	// Cuts the image along the canvas tile grid, leaving out blank tiles if
+	// they wouldn't do anything, and merges the remaining tiles into chunks
+	// of at most MAX_CHUNK_TILES tiles each.
+	QVector<Chunk> gatherChunks(int x, int y, const QImage &image) const
 	{
-		int w = bounds.width();
-		int h = bounds.height();
-		if(w > 0 && h > 0) {
-			int compressedSize;
-			// If our estimated size looks good, try compressing. Otherwise
-			// assume that the image is too big to fit into a message and split
-			// it up.
-			if(estimatedSize < MAX_SIZE) {
-				QImage subImage =
-					bounds == image.rect() ? image : image.copy(bounds);
-				QByteArray compressed = compress(subImage);
-				compressedSize = compressed.size();
-				if(compressedSize <= MAX_SIZE) {
-					m_msgs.append(makeMessage(x, y, w, h, compressed));
-					return;
+		bool skipBlank = m_mode != DP_BLEND_MODE_REPLACE &&
+						 m_mode != DP_BLEND_MODE_NORMAL_AND_ERASER;
+		int width = image.width();
+		int height = image.height();
+		if(width <= 0 || height <= 0) {
+			return {};
+		}
+
+		int col0 = x / DP_TILE_SIZE;
+		int cols = DP_tile_count_round(x + width) - col0;
+		int row0 = y / DP_TILE_SIZE;
+		int rows = DP_tile_count_round(y + height) - row0;
+
+		QVector<Chunk> chunks;
+		// Chunks that can still grow downwards, indexed by their first column
+		// relative to col0, along with their end column and tile row count.
+		QVector<int> openChunks(cols, -1);
+		QVector<int> openChunkEnds(cols);
+		QVector<int> openChunkRows(cols);
+		QVector<bool> blank(cols, false);
+		for(int row = 0; row < rows; ++row) {
+			int top = qMax(0, (row0 + row) * DP_TILE_SIZE - y);
+			int bottom = qMin(height, (row0 + row + 1) * DP_TILE_SIZE - y);
+			if(skipBlank) {
+				for(int col = 0; col < cols; ++col) {
+					blank[col] = isBlank(image, x, col0 + col, top, bottom);
 				}
-			} else {
-				compressedSize = estimatedSize;
 			}
-			// (Probably) too big to fit in a message, slice in half along the
-			// longest axis.
-			int estimatedSliceSize = compressedSize / 2;
-			if(w > h) {
-				int sx1 = w / 2;
-				int sx2 = w - sx1;
-				makeRecursive(
-					x, y, image, bounds.adjusted(0, 0, -sx1, 0),
-					estimatedSliceSize);
-				makeRecursive(
-					x + sx2, y, image, bounds.adjusted(sx2, 0, 0, 0),
-					estimatedSliceSize);
-			} else {
-				int sy1 = h / 2;
-				int sy2 = h - sy1;
-				makeRecursive(
-					x, y, image, bounds.adjusted(0, 0, 0, -sy1),
-					estimatedSliceSize);
-				makeRecursive(
-					x, y + sy2, image, bounds.adjusted(0, sy2, 0, 0),
-					estimatedSliceSize);
+
+			QVector<int> nextOpenChunks(cols, -1);
+			int col = 0;
+			while(col < cols) {
+				if(blank[col]) {
+					++col;
+					continue;
+				}
+
+				int first = col++;
+				while(col < cols && col - first < MAX_CHUNK_TILES &&
+					  !blank[col]) {
+					++col;
+				}
+
+				int open = openChunks[first];
+				if(open != -1 && openChunkEnds[first] == col &&
+				   (col - first) * (openChunkRows[first] + 1) <=
+					   MAX_CHUNK_TILES) {
+					chunks[open].bounds.setBottom(bottom - 1);
+					++openChunkRows[first];
+					nextOpenChunks[first] = open;
+				} else {
+					int left = qMax(0, (col0 + first) * DP_TILE_SIZE - x);
+					int right = qMin(width, (col0 + col) * DP_TILE_SIZE - x);
+					nextOpenChunks[first] = chunks.size();
+					openChunkEnds[first] = col;
+					openChunkRows[first] = 1;
+					chunks.append({QRect(left, top, right - left, bottom - top),
+								   {}});
+				}
+			}
+			openChunks = nextOpenChunks;
+		}
+		return chunks;
+	}
+
+	static bool
+	isBlank(const QImage &image, int x, int col, int top, int bottom)
+	{
+		int left = qMax(0, col * DP_TILE_SIZE - x);
+		int right = qMin(image.width(), (col + 1) * DP_TILE_SIZE - x);
+		for(int iy = top; iy < bottom; ++iy) {
+			const QRgb *scanLine =
+				reinterpret_cast<const QRgb *>(image.constScanLine(iy));
+			for(int ix = left; ix < right; ++ix) {
+				if(qAlpha(scanLine[ix]) != 0) {
+					return false;
+				}
 			}
 		}
+		return true;
+	}
+
+	// The prototype may only be touched after claiming a chunk, since the
+	// thread that started the job waits for all chunks to be done.
+	static void compressChunks(const PutImageMaker *prototype, ChunkJob &job)
+	{
+		std::unique_ptr<PutImageMaker> maker;
+		int count = job.chunks.size();
+		int i;
+		while((i = job.next.fetchAndAddOrdered(1)) < count) {
+			if(!maker) {
+				maker = prototype->clone();
+			}
+			Chunk &chunk = job.chunks[i];
+			const QRect &bounds = chunk.bounds;
+			chunk.msg = maker->makeChunkMessage(
+				job.x + bounds.x(), job.y + bounds.y(), job.image, bounds);
+			job.done.release();
+		}
+	}
+
+	// Chunks are small enough to always fit, so each one gets compressed
+	// exactly once.
+	net::Message makeChunkMessage(
+		int x, int y, const QImage &image, const QRect &bounds)
+	{
+		QImage subImage = bounds == image.rect() ? image : image.copy(bounds);
+		QByteArray compressed = compress(subImage);
+		Q_ASSERT(compressed.size() <= MAX_SIZE);
+		return makeMessage(x, y, bounds.width(), bounds.height(), compressed);
 	}
 
 	MessageList &m_msgs;
@@ -645,6 +797,12 @@ public:
 	}
 
 protected:
+	std::unique_ptr<PutImageMaker> clone() const override
+	{
+		return std::unique_ptr<PutImageMaker>(
+			new PutImageMakerDeflate(m_msgs, m_contextId, m_layer, m_mode));
+	}
+
 	QByteArray compress(const QImage &image) override
 	{
 		return compressImageDeflate(m_compressionBuffer, image);
@@ -672,6 +830,12 @@ public:
 	~PutImageMakerZstd() override { DP_compress_zstd_free(&m_ctx); }
 
 protected:
+	std::unique_ptr<PutImageMaker> clone() const override
+	{
+		return std::unique_ptr<PutImageMaker>(
+			new PutImageMakerZstd(m_msgs, m_contextId, m_layer, m_mode));
+	}
+
 	QByteArray compress(const QImage &image) override
 	{
 		return compressImageSplitDeltaZstd(
@@ -793,6 +957,129 @@ void makeSelectionPutMessages(
 	}
 }
 
+static int32_t toGradientCoordinate(qreal c)
+{
+	qreal max = qreal(DP_GRADIENT_COORDINATE_MAX);
+	return int32_t(qRound(qBound(-max, c * 4.0, max)));
+}
+
+// Returns 0 if all pixels are transparent, 2 if all are opaque, 1 otherwise.
+static int getAlphaMaskCoverage(const QImage &mask)
+{
+	bool anyBlank = false;
+	bool anyOpaque = false;
+	int width = mask.width();
+	int height = mask.height();
+	for(int y = 0; y < height; ++y) {
+		const QRgb *scanLine =
+			reinterpret_cast<const QRgb *>(mask.constScanLine(y));
+		for(int x = 0; x < width; ++x) {
+			int a = qAlpha(scanLine[x]);
+			if(a == 0) {
+				anyBlank = true;
+			} else if(a == 255) {
+				anyOpaque = true;
+			} else {
+				return 1;
+			}
+			if(anyBlank && anyOpaque) {
+				return 1;
+			}
+		}
+	}
+	return anyOpaque ? 2 : 0;
+}
+
+static void makeFillGradientMaskMessages(
+	MessageList &msgs, uint8_t contextId, uint8_t selectionId, const QRect &rect,
+	const QImage &mask)
+{
+	ZSTD_CCtx *ctx = nullptr;
+	QByteArray alphaMaskBuffer;
+	QByteArray compressionBuffer;
+	QImage tile(
+		DP_TILE_SIZE, DP_TILE_SIZE, QImage::Format_ARGB32_Premultiplied);
+	int colMin = rect.left() / DP_TILE_SIZE;
+	int colMax = rect.right() / DP_TILE_SIZE;
+	int rowMin = rect.top() / DP_TILE_SIZE;
+	int rowMax = rect.bottom() / DP_TILE_SIZE;
+	for(int row = rowMin; row <= rowMax; ++row) {
+		for(int col = colMin; col <= colMax; ++col) {
+			tile.fill(0);
+			{
+				QPainter painter(&tile);
+				painter.setCompositionMode(QPainter::CompositionMode_Source);
+				painter.drawImage(
+					rect.topLeft() -
+						QPoint(col * DP_TILE_SIZE, row * DP_TILE_SIZE),
+					mask);
+			}
+			// The selection got cleared beforehand, blank tiles can be skipped.
+			switch(getAlphaMaskCoverage(tile)) {
+			case 0:
+				break;
+			case 2:
+				msgs.append(makeSyncSelectionTileMessage(
+					contextId, contextId, selectionId, uint16_t(col),
+					uint16_t(row), QByteArray(1, '\0')));
+				break;
+			default:
+				msgs.append(makeSyncSelectionTileMessage(
+					contextId, contextId, selectionId, uint16_t(col),
+					uint16_t(row),
+					compressAlphaMaskDeltaZstd(
+						&ctx, alphaMaskBuffer, compressionBuffer, tile)));
+				break;
+			}
+		}
+	}
+	DP_compress_zstd_free(&ctx);
+}
+
+void makeFillGradientMessages(
+	MessageList &msgs, uint8_t contextId, uint32_t layer, uint8_t mode,
+	uint8_t shape, uint8_t spread, const QPointF &p1, const QPointF &p2,
+	qreal focus, const QColor &color1, const QColor &color2, int x, int y,
+	const QImage &mask, const QSize &canvasSize)
+{
+	QRect rect =
+		QRect(x, y, mask.width(), mask.height()) & QRect(QPoint(), canvasSize);
+	if(rect.isEmpty()) {
+		return;
+	}
+
+	QImage converted =
+		mask.copy(rect.translated(-x, -y))
+			.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+	int coverage = getAlphaMaskCoverage(converted);
+	if(coverage == 0) {
+		return;
+	}
+
+	uint8_t selectionId;
+	if(coverage == 2) {
+		selectionId = 0;
+	} else {
+		selectionId = DP_SELECTION_ID_REMOTE_FILL;
+		msgs.append(makeSyncSelectionTileMessage(
+			contextId, contextId, selectionId, 0xffff, 0xffff, QByteArray()));
+		makeFillGradientMaskMessages(
+			msgs, contextId, selectionId, rect, converted);
+	}
+
+	msgs.append(makeFillGradientMessage(
+		contextId, layer, mode, shape, spread, selectionId, uint32_t(rect.x()),
+		uint32_t(rect.y()), uint32_t(rect.width()), uint32_t(rect.height()),
+		toGradientCoordinate(p1.x()), toGradientCoordinate(p1.y()),
+		toGradientCoordinate(p2.x()), toGradientCoordinate(p2.y()),
+		uint16_t(qRound(qBound(0.0, focus, 1.0) * 65535.0)), color1, color2));
+
+	if(selectionId != 0) {
+		msgs.append(makeSyncSelectionTileMessage(
+			contextId, contextId, selectionId, 0xffff, 0xffff, QByteArray()));
+	}
+}
+
 Message makeLocalChangeLayerVisibilityMessage(int layerId, bool hidden)
 {
 	return Message::noinc(
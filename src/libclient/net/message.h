@@ -45,6 +45,12 @@ Message makeFeatureAccessLevelsMessage(
 Message
 makeFeatureLimitsMessage(uint8_t contextId, const QVector<int32_t> &limits);
 
+Message makeFillGradientMessage(
+	uint8_t contextId, uint32_t layer, uint8_t mode, uint8_t shape,
+	uint8_t spread, uint8_t selectionId, uint32_t x, uint32_t y, uint32_t w,
+	uint32_t h, int32_t x1, int32_t y1, int32_t x2, int32_t y2, uint16_t focus,
+	const QColor &color1, const QColor &color2);
+
 Message makeFillRectMessage(
 	uint8_t contextId, uint32_t layer, uint8_t mode, uint32_t x, uint32_t y,
 	uint32_t w, uint32_t h, const QColor &color);
@@ -133,6 +139,10 @@ Message makeSelectionPutMessage(
 Message
 makeSetMetadataIntMessage(uint8_t contextId, uint8_t field, int32_t value);
 
+Message makeSyncSelectionTileMessage(
+	uint8_t contextId, uint8_t user, uint8_t selectionId, uint16_t col,
+	uint16_t row, const QByteArray &compressedMask);
+
 Message makeTrackCreateMessage(
 	uint8_t contextId, uint16_t id, uint16_t insertId, uint16_t sourceId,
 	const QString &title);
@@ -167,6 +177,16 @@ void makeSelectionPutMessages(
 	MessageList &msgs, uint8_t contextId, uint8_t selectionId, uint8_t op,
 	int x, int y, int w, int h, const QImage &image);
 
+// Fills given message list with messages to fill a gradient masked by the
+// alpha of the given image, clipped to the canvas. If the mask isn't fully
+// opaque, it's synchronized into a scratch selection first. Gradient points
+// are in canvas coordinates, focus is between 0.0 and 1.0.
+void makeFillGradientMessages(
+	MessageList &msgs, uint8_t contextId, uint32_t layer, uint8_t mode,
+	uint8_t shape, uint8_t spread, const QPointF &p1, const QPointF &p2,
+	qreal focus, const QColor &color1, const QColor &color2, int x, int y,
+	const QImage &mask, const QSize &canvasSize);
+
 Message makeLocalChangeLayerVisibilityMessage(int layerId, bool hidden);
 Message makeLocalChangeBackgroundColorMessage(const QColor &color);
 Message makeLocalChangeBackgroundClearMessage();
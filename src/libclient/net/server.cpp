@@ -394,6 +394,7 @@ void Server::loginSuccess()
 	m_supportsCryptBanImpEx = m_loginstate->supportsCryptBanImEx();
 	m_supportsModBanImpEx = m_loginstate->supportsModBanImEx();
 	m_supportsAbuseReports = m_loginstate->supportsAbuseReports();
+	m_supportsInterest = m_loginstate->supportsInterest();
 	messageQueue()->setContextId(m_loginstate->userId());
 
 	emit loggedIn(
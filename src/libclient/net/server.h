@@ -87,6 +87,7 @@ public:
 	bool supportsCryptBanImpEx() const { return m_supportsCryptBanImpEx; }
 	bool supportsModBanImpEx() const { return m_supportsModBanImpEx; }
 	bool supportsAbuseReports() const { return m_supportsAbuseReports; }
+	bool supportsInterest() const { return m_supportsInterest; }
 
 	void setSmoothEnabled(bool smoothEnabled)
 	{
@@ -180,6 +181,7 @@ private:
 	bool m_supportsCryptBanImpEx = false;
 	bool m_supportsModBanImpEx = false;
 	bool m_supportsAbuseReports = false;
+	bool m_supportsInterest = false;
 	bool m_canReceive = true;
 	bool m_receiveMore = false;
 	bool m_handlingError = false;
@@ -123,14 +123,16 @@ void BuiltinSession::addToHistory(const net::Message &msg)
 	if(state() == State::Initialization) {
 		// Send to everyone except the initializing user
 		for(Client *client : clients()) {
-			if(client->id() != initUserId()) {
+			if(client->id() != initUserId() &&
+			   client->acceptsEphemeralMessage(msg)) {
 				client->sendDirectMessage(msg);
 			}
 		}
 
 	} else {
 		for(Client *client : clients()) {
-			if(!client->isAwaitingReset()) {
+			if(!client->isAwaitingReset() &&
+			   client->acceptsEphemeralMessage(msg)) {
 				client->sendDirectMessage(msg);
 			}
 		}
@@ -41,6 +41,7 @@ SETTING(engineFrameRate             , EngineFrameRate             , "settings/pa
 SETTING(engineSnapshotCount         , EngineSnapshotCount         , "settings/paintengine/snapshotcount"    , SNAPSHOT_COUNT_DEFAULT)
 SETTING(engineSnapshotInterval      , EngineSnapshotInterval      , "settings/paintengine/snapshotinterval" , 10)
 SETTING(engineUndoDepth             , EngineUndoDepth             , "settings/paintengine/undodepthlimit"   , ENGINE_UNDO_LIMIT_DEFAULT)
+SETTING(fastColorSampling           , FastColorSampling           , "settings/paintengine/fastsampling"     , false)
 SETTING(listServers                 , ListServers                 , "listservers"                           , QVector<QVariantMap>())
 SETTING(selectionColor              , SelectionColor              , "settings/selectioncolor"               , SELECTION_COLOR_DEFAULT)
 SETTING(serverAutoReset             , ServerAutoReset             , "settings/server/autoreset"             , true)
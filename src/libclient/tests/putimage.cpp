@@ -0,0 +1,143 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+extern "C" {
+#include <dpengine/draw_context.h>
+#include <dpengine/image.h>
+#include <dpengine/tile.h>
+#include <dpmsg/blend_mode.h>
+#include <dpmsg/messages.h>
+}
+#include "libclient/net/message.h"
+#include <QImage>
+#include <QtTest/QtTest>
+
+class TestPutImage final : public QObject {
+	Q_OBJECT
+private slots:
+	void testChunksFitIntoSingleMessages_data()
+	{
+		QTest::addColumn<bool>("compatibilityMode");
+		QTest::addColumn<int>("mode");
+		QTest::addColumn<int>("x");
+		QTest::addColumn<int>("y");
+		QTest::newRow("deflate normal") << true << int(DP_BLEND_MODE_NORMAL)
+										<< 37 << 70;
+		QTest::newRow("deflate replace")
+			<< true << int(DP_BLEND_MODE_REPLACE) << 0 << 0;
+		QTest::newRow("zstd normal") << false << int(DP_BLEND_MODE_NORMAL)
+									 << 37 << 70;
+		QTest::newRow("zstd replace")
+			<< false << int(DP_BLEND_MODE_REPLACE) << -20 << 130;
+	}
+
+	void testChunksFitIntoSingleMessages()
+	{
+		QFETCH(bool, compatibilityMode);
+		QFETCH(int, mode);
+		QFETCH(int, x);
+		QFETCH(int, y);
+
+		QImage image = makeNoise(700, 450);
+		net::MessageList msgs;
+		net::makePutImageMessagesCompat(
+			msgs, 1, 0x100, uint8_t(mode), x, y, image, compatibilityMode);
+		QVERIFY(!msgs.isEmpty());
+
+		// Negative coordinates get cropped off.
+		QRect imageBounds = QRect(x, y, image.width(), image.height())
+								.intersected(QRect(0, 0, 100000, 100000));
+		QImage expected = image.copy(imageBounds.translated(-x, -y));
+		QImage actual(expected.size(), QImage::Format_ARGB32_Premultiplied);
+		actual.fill(0);
+
+		DP_DrawContext *dc = DP_draw_context_new();
+		for(const net::Message &msg : msgs) {
+			DP_MsgPutImage *mpi;
+			if(compatibilityMode) {
+				QCOMPARE(msg.type(), DP_MSG_PUT_IMAGE);
+				mpi = DP_msg_put_image_cast(msg.get());
+			} else {
+				QCOMPARE(msg.type(), DP_MSG_PUT_IMAGE_ZSTD);
+				mpi = DP_msg_put_image_zstd_cast(msg.get());
+			}
+			QCOMPARE(int(DP_msg_put_image_mode(mpi)), mode);
+
+			QRect bounds(
+				int(DP_msg_put_image_x(mpi)), int(DP_msg_put_image_y(mpi)),
+				int(DP_msg_put_image_w(mpi)), int(DP_msg_put_image_h(mpi)));
+			// Every message must be a whole chunk along the tile grid. A chunk
+			// that got split up and recompressed wouldn't line up with it.
+			QVERIFY(imageBounds.contains(bounds));
+			QVERIFY(
+				bounds.left() == imageBounds.left() ||
+				bounds.left() % DP_TILE_SIZE == 0);
+			QVERIFY(
+				bounds.top() == imageBounds.top() ||
+				bounds.top() % DP_TILE_SIZE == 0);
+			QVERIFY(
+				bounds.right() == imageBounds.right() ||
+				(bounds.right() + 1) % DP_TILE_SIZE == 0);
+			QVERIFY(
+				bounds.bottom() == imageBounds.bottom() ||
+				(bounds.bottom() + 1) % DP_TILE_SIZE == 0);
+			int cols = DP_tile_count_round(bounds.right() + 1) -
+					   bounds.left() / DP_TILE_SIZE;
+			int rows = DP_tile_count_round(bounds.bottom() + 1) -
+					   bounds.top() / DP_TILE_SIZE;
+			QVERIFY(cols * rows <= 3);
+
+			size_t size;
+			const unsigned char *data = DP_msg_put_image_image(mpi, &size);
+			DP_Image *img =
+				compatibilityMode
+					? DP_image_new_from_deflate8be(
+						  bounds.width(), bounds.height(), data, size)
+					: DP_image_new_from_delta_zstd8le(
+						  dc, bounds.width(), bounds.height(), data, size);
+			QVERIFY(img);
+			QPoint offset = bounds.topLeft() - imageBounds.topLeft();
+			for(int iy = 0; iy < bounds.height(); ++iy) {
+				QRgb *scanLine =
+					reinterpret_cast<QRgb *>(actual.scanLine(offset.y() + iy));
+				for(int ix = 0; ix < bounds.width(); ++ix) {
+					QCOMPARE(qAlpha(scanLine[offset.x() + ix]), 0);
+					scanLine[offset.x() + ix] =
+						DP_image_pixel_at(img, ix, iy).color;
+				}
+			}
+			DP_image_free(img);
+		}
+		DP_draw_context_free(dc);
+
+		QCOMPARE(actual, expected);
+	}
+
+private:
+	// Random pixels that don't compress, with a transparent band that doesn't
+	// need to be sent at all when drawing in normal mode.
+	static QImage makeNoise(int width, int height)
+	{
+		QImage image(width, height, QImage::Format_ARGB32_Premultiplied);
+		quint32 state = 0x9e3779b9u;
+		for(int y = 0; y < height; ++y) {
+			QRgb *scanLine = reinterpret_cast<QRgb *>(image.scanLine(y));
+			for(int x = 0; x < width; ++x) {
+				state ^= state << 13;
+				state ^= state >> 17;
+				state ^= state << 5;
+				if(y >= 200 && y < 330) {
+					scanLine[x] = 0;
+				} else {
+					int a = int(state >> 24);
+					scanLine[x] = qRgba(
+						int(state & 0xffu) * a / 255,
+						int((state >> 8) & 0xffu) * a / 255,
+						int((state >> 16) & 0xffu) * a / 255, a);
+				}
+			}
+		}
+		return image;
+	}
+};
+
+QTEST_MAIN(TestPutImage)
+#include "putimage.moc"
@@ -0,0 +1,352 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+// The reference tracer is the one this generator replaced, based on
+// KisOutlineGenerator from Krita
+// SPDX-FileCopyrightText: 2004 Boudewijn Rempt <boud@valdyas.org>
+// SPDX-FileCopyrightText: 2007, 2010 Sven Langkamp <sven.langkamp@gmail.com>
+// Outline algorithm based of the limn of fontutils
+// SPDX-FileCopyrightText: 1992 Karl Berry <karl@cs.umb.edu>
+// SPDX-FileCopyrightText: 1992 Kathryn Hargreaves <letters@cs.umb.edu>
+extern "C" {
+#include <dpengine/layer_content.h>
+#include <dpengine/pixels.h>
+}
+#include "libclient/drawdance/layercontent.h"
+#include "libclient/utils/selectionoutlinegenerator.h"
+#include <QHash>
+#include <QImage>
+#include <QPolygon>
+#include <QtTest/QtTest>
+#include <functional>
+
+namespace {
+
+// Pixel-by-pixel outline tracer that follows each outline around, taken from
+// the previous generator with the downscaling removed.
+class ReferenceOutline {
+public:
+	explicit ReferenceOutline(const QImage &mask)
+		: m_width(mask.width())
+		, m_height(mask.height())
+		, m_bits(reinterpret_cast<const uint32_t *>(mask.constBits()))
+		, m_marks(m_width * m_height, 0)
+	{
+	}
+
+	QPainterPath trace()
+	{
+		QPainterPath paths;
+		for(int y = 0; y < m_height; ++y) {
+			for(int x = 0; x < m_width; ++x) {
+				if(!isTransparent(x, y)) {
+					traceFrom(paths, x, y);
+				}
+			}
+		}
+		return paths;
+	}
+
+private:
+	enum EdgeType {
+		TopEdge = 1,
+		LeftEdge = 2,
+		BottomEdge = 3,
+		RightEdge = 0,
+		NoEdge = 4
+	};
+
+	static EdgeType nextEdge(EdgeType edge)
+	{
+		return edge == NoEdge ? edge : EdgeType((edge + 1) % 4);
+	}
+
+	bool isTransparent(int x, int y) const
+	{
+		return qAlpha(m_bits[y * m_width + x]) == 0;
+	}
+
+	bool isOutlineEdge(EdgeType edge, int x, int y) const
+	{
+		if(!isTransparent(x, y)) {
+			switch(edge) {
+			case LeftEdge:
+				return x == 0 || isTransparent(x - 1, y);
+			case TopEdge:
+				return y == 0 || isTransparent(x, y - 1);
+			case RightEdge:
+				return x == m_width - 1 || isTransparent(x + 1, y);
+			case BottomEdge:
+				return y == m_height - 1 || isTransparent(x, y + 1);
+			case NoEdge:
+				break;
+			}
+		}
+		return false;
+	}
+
+	bool tryPixel(
+		EdgeType *edge, int *row, int *col, int deltaRow, int deltaCol,
+		EdgeType testEdge) const
+	{
+		int testRow = *row + deltaRow;
+		int testCol = *col + deltaCol;
+		if(testRow >= 0 && testRow < m_height && testCol >= 0 &&
+		   testCol < m_width && isOutlineEdge(testEdge, testCol, testRow)) {
+			*row = testRow;
+			*col = testCol;
+			*edge = testEdge;
+			return true;
+		}
+		return false;
+	}
+
+	void nextOutlineEdge(EdgeType *edge, int *row, int *col) const
+	{
+		int originalRow = *row;
+		int originalCol = *col;
+		switch(*edge) {
+		case RightEdge:
+			tryPixel(edge, row, col, -1, 0, RightEdge) ||
+				tryPixel(edge, row, col, -1, 1, BottomEdge);
+			break;
+		case TopEdge:
+			tryPixel(edge, row, col, 0, -1, TopEdge) ||
+				tryPixel(edge, row, col, -1, -1, RightEdge);
+			break;
+		case LeftEdge:
+			tryPixel(edge, row, col, 1, 0, LeftEdge) ||
+				tryPixel(edge, row, col, 1, -1, TopEdge);
+			break;
+		case BottomEdge:
+			tryPixel(edge, row, col, 0, 1, BottomEdge) ||
+				tryPixel(edge, row, col, 1, 1, LeftEdge);
+			break;
+		default:
+			break;
+		}
+		if(*row == originalRow && *col == originalCol) {
+			*edge = nextEdge(*edge);
+		}
+	}
+
+	static void appendCoordinate(QPolygon &path, int x, int y, EdgeType edge)
+	{
+		if(edge == TopEdge) {
+			++x;
+		} else if(edge == BottomEdge) {
+			++y;
+		} else if(edge == RightEdge) {
+			++x;
+			++y;
+		}
+		path.append(QPoint(x, y));
+	}
+
+	void traceFrom(QPainterPath &paths, int x, int y)
+	{
+		uint8_t &mark = m_marks[y * m_width + x];
+		EdgeType startEdge = TopEdge;
+		while(startEdge != NoEdge &&
+			  (mark & (1 << startEdge) || !isOutlineEdge(startEdge, x, y))) {
+			startEdge = nextEdge(startEdge);
+			if(startEdge == TopEdge) {
+				startEdge = NoEdge;
+			}
+		}
+		if(startEdge == NoEdge) {
+			return;
+		}
+
+		QPolygon path;
+		int row = y;
+		int col = x;
+		EdgeType currentEdge = startEdge;
+		EdgeType lastEdge = NoEdge;
+		if(currentEdge == BottomEdge) {
+			appendCoordinate(path, col, row, currentEdge);
+			lastEdge = BottomEdge;
+		}
+
+		while(true) {
+			m_marks[row * m_width + col] |= 1 << currentEdge;
+			nextOutlineEdge(&currentEdge, &row, &col);
+			if(lastEdge != currentEdge) {
+				appendCoordinate(path, col, row, currentEdge);
+				lastEdge = currentEdge;
+			}
+			if(row == y && col == x && currentEdge == startEdge) {
+				if(startEdge != BottomEdge) {
+					appendCoordinate(path, col, row, NoEdge);
+				}
+				break;
+			}
+		}
+		paths.addPolygon(path);
+	}
+
+	const int m_width;
+	const int m_height;
+	const uint32_t *const m_bits;
+	QVector<uint8_t> m_marks;
+};
+
+using SelectedFn = std::function<bool(int, int)>;
+
+// Spans several tiles in both directions, with shapes crossing the tile
+// boundaries, holes, a noisy patch and pixels that only touch at corners.
+bool initialSelection(int x, int y)
+{
+	int dx = x - 150;
+	int dy = y - 120;
+	bool ellipse = dx * dx * 4 + dy * dy * 9 < 90 * 90 * 4;
+	bool hole = x >= 120 && x < 140 && y >= 100 && y < 130;
+	bool frame = x >= 60 && x < 200 && y >= 60 && y < 196 &&
+				 !(x >= 66 && x < 194 && y >= 66 && y < 190);
+	bool checker = x >= 220 && x < 260 && y >= 20 && y < 70 &&
+				   (x / 2 + y / 3) % 2 == 0;
+	bool noise = x >= 10 && x < 50 && y >= 150 && y < 220 &&
+				 (x * 7919 + y * 104729) % 5 < 2;
+	bool diagonal = x >= 262 && x < 290 && x - 262 == y - 130;
+	return ((ellipse && !hole) || frame || checker || noise || diagonal) &&
+		   !(x == 127 && y == 127);
+}
+
+// Changes a few tiles in the middle, leaving the rest as it was.
+bool changedSelection(int x, int y)
+{
+	if(x >= 64 && x < 192 && y >= 128 && y < 192) {
+		return (x + y) % 11 < 6 && !(x >= 100 && x < 110);
+	} else {
+		return initialSelection(x, y);
+	}
+}
+
+QRect selectionBounds(int width, int height, const SelectedFn &selected)
+{
+	QRect bounds;
+	for(int y = 0; y < height; ++y) {
+		for(int x = 0; x < width; ++x) {
+			if(selected(x, y)) {
+				bounds |= QRect(x, y, 1, 1);
+			}
+		}
+	}
+	return bounds;
+}
+
+drawdance::LayerContent
+makeContent(int width, int height, const SelectedFn &selected)
+{
+	DP_TransientLayerContent *tlc =
+		DP_transient_layer_content_new_init(width, height, nullptr);
+	DP_Pixel15 pixel = {DP_BIT15, DP_BIT15, DP_BIT15, DP_BIT15};
+	for(int y = 0; y < height; ++y) {
+		for(int x = 0; x < width; ++x) {
+			if(selected(x, y)) {
+				DP_transient_layer_content_pixel_at_set(tlc, 0, x, y, pixel);
+			}
+		}
+	}
+	return drawdance::LayerContent::noinc(
+		DP_transient_layer_content_persist(tlc));
+}
+
+QImage makeMask(const QRect &bounds, const SelectedFn &selected)
+{
+	QImage mask(bounds.size(), QImage::Format_ARGB32_Premultiplied);
+	for(int y = 0; y < bounds.height(); ++y) {
+		for(int x = 0; x < bounds.width(); ++x) {
+			bool s = selected(bounds.x() + x, bounds.y() + y);
+			mask.setPixel(x, y, s ? 0xffffffffu : 0u);
+		}
+	}
+	return mask;
+}
+
+// Both tracers join edges into polygons differently, but they must cover the
+// exact same pixel edges. Keys are the start of each unit edge and whether
+// it's horizontal, diagonals aren't supposed to happen and get a key of 0.
+quint64 unitEdgeKey(int x, int y, bool horizontal)
+{
+	return (quint64(quint32(x + 1)) << 33) | (quint64(quint32(y + 1)) << 1) |
+		   quint64(horizontal);
+}
+
+QHash<quint64, int> unitEdges(const QPainterPath &path)
+{
+	QHash<quint64, int> edges;
+	for(const QPolygonF &polygon : path.toSubpathPolygons()) {
+		int count = polygon.size();
+		for(int i = 0; i < count; ++i) {
+			QPoint a = polygon[i].toPoint();
+			QPoint b = polygon[(i + 1) % count].toPoint();
+			if(a.x() != b.x() && a.y() != b.y()) {
+				++edges[0];
+			} else if(a.y() == b.y()) {
+				for(int x = qMin(a.x(), b.x()); x < qMax(a.x(), b.x()); ++x) {
+					++edges[unitEdgeKey(x, a.y(), true)];
+				}
+			} else {
+				for(int y = qMin(a.y(), b.y()); y < qMax(a.y(), b.y()); ++y) {
+					++edges[unitEdgeKey(a.x(), y, false)];
+				}
+			}
+		}
+	}
+	return edges;
+}
+
+}
+
+class TestSelectionOutlineGenerator final : public QObject {
+	Q_OBJECT
+private slots:
+	void testMatchesReferenceTracer()
+	{
+		QSharedPointer<SelectionOutlineCache> cache(new SelectionOutlineCache);
+		compareWithReference(cache, initialSelection, 1u);
+		// Same cache again, the unchanged tiles get reused this time.
+		compareWithReference(cache, changedSelection, 2u);
+		compareWithReference(cache, initialSelection, 3u);
+	}
+
+private:
+	static constexpr int WIDTH = 300;
+	static constexpr int HEIGHT = 230;
+
+	void compareWithReference(
+		const QSharedPointer<SelectionOutlineCache> &cache,
+		const SelectedFn &selected, unsigned int executionId)
+	{
+		QRect bounds = selectionBounds(WIDTH, HEIGHT, selected);
+		QVERIFY(bounds.width() > 64 * 3);
+		QVERIFY(bounds.height() > 64 * 2);
+
+		SelectionOutlineGenerator gen(
+			executionId, cache, makeContent(WIDTH, HEIGHT, selected), bounds);
+		gen.setAutoDelete(false);
+		int generated = 0;
+		QPainterPath path;
+		connect(
+			&gen, &SelectionOutlineGenerator::outlineGenerated, this,
+			[&](unsigned int id, const SelectionOutlinePath &outline) {
+				QCOMPARE(id, executionId);
+				++generated;
+				path = outline.value;
+			},
+			Qt::DirectConnection);
+		gen.run();
+		QCOMPARE(generated, 1);
+
+		QPainterPath expected =
+			ReferenceOutline(makeMask(bounds, selected)).trace();
+		QHash<quint64, int> actualEdges = unitEdges(path);
+		QHash<quint64, int> expectedEdges = unitEdges(expected);
+		QVERIFY(!expectedEdges.isEmpty());
+		QCOMPARE(actualEdges.size(), expectedEdges.size());
+		QVERIFY(actualEdges == expectedEdges);
+	}
+};
+
+
+QTEST_MAIN(TestSelectionOutlineGenerator)
+#include "selectionoutlinegenerator.moc"
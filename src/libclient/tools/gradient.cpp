@@ -1,16 +1,20 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
+extern "C" {
+#include <dpengine/gradient.h>
+#include <dpmsg/blend_mode.h>
+}
 #include "libclient/tools/gradient.h"
 #include "libclient/canvas/canvasmodel.h"
 #include "libclient/canvas/layerlist.h"
 #include "libclient/canvas/paintengine.h"
 #include "libclient/canvas/selectionmodel.h"
 #include "libclient/net/client.h"
+#include "libclient/net/message.h"
 #include "libclient/tools/toolcontroller.h"
 #include "libclient/tools/utils.h"
 #include "libclient/utils/cursors.h"
 #include <QAtomicInteger>
 #include <QCursor>
-#include <QGradient>
 #include <QLineF>
 #include <QPainter>
 #include <QPainterPath>
@@ -158,10 +162,19 @@ void GradientTool::finishMultipart()
 		if(canFill) {
 			uint8_t contextId = localUserId();
 			net::MessageList msgs;
-			net::makePutImageMessagesCompat(
-				msgs, contextId, m_owner.activeLayer(), m_blendMode,
-				m_pendingPos.x(), m_pendingPos.y(), m_pendingImage,
-				isCompatibilityMode());
+			if(isCompatibilityMode() ||
+			   !DP_blend_mode_valid_for_brush(m_blendMode)) {
+				net::makePutImageMessagesCompat(
+					msgs, contextId, layerId, m_blendMode, m_pendingPos.x(),
+					m_pendingPos.y(), m_pendingImage, isCompatibilityMode());
+			} else {
+				net::makeFillGradientMessages(
+					msgs, contextId, layerId, m_blendMode, protocolShape(),
+					protocolSpread(), m_points.constFirst(),
+					m_points.constLast(), m_focus, m_color1, m_color2,
+					m_pendingPos.x(), m_pendingPos.y(), m_pendingMask,
+					canvas->size());
+			}
 			if(!msgs.isEmpty()) {
 				msgs.prepend(net::makeUndoPointMessage(contextId));
 				m_owner.client()->sendMessages(msgs.size(), msgs.constData());
@@ -180,6 +193,7 @@ void GradientTool::cancelMultipart()
 		m_hoverIndex = -1;
 		m_pointsStackTop = -1;
 		m_pendingImage = QImage();
+		m_pendingMask = QImage();
 		m_clickDetector.clear();
 		updateAnchorLine();
 		previewPending();
@@ -333,6 +347,7 @@ void GradientTool::updatePending()
 	m_previewDebounce.stopTimer();
 	QPoint pos;
 	QImage img;
+	QImage mask;
 
 	if(isMultipart()) {
 		canvas::CanvasModel *canvas = m_owner.model();
@@ -340,9 +355,8 @@ void GradientTool::updatePending()
 			canvas::SelectionModel *selection = canvas->selection();
 			if(selection->isValid()) {
 				pos = selection->bounds().topLeft();
-				img = applyGradient(
-					selection->image(),
-					QLineF(m_points.first() - pos, m_points.last() - pos));
+				mask = selection->image();
+				img = applyGradient(mask, pos);
 			}
 		}
 	}
@@ -350,74 +364,66 @@ void GradientTool::updatePending()
 	if(!img.isNull() || !m_pendingImage.isNull()) {
 		m_pendingPos = pos;
 		m_pendingImage = img;
+		m_pendingMask = mask;
 		previewPending();
 	}
 }
 
-QImage GradientTool::applyGradient(const QImage &mask, const QLineF &line) const
+QImage GradientTool::applyGradient(const QImage &mask, const QPoint &pos) const
 {
 	if(mask.isNull()) {
 		return QImage();
-	} else {
-		switch(m_shape) {
-		case Shape::Linear:
-			return applyLinearGradient(mask, line);
-		case Shape::Radial:
-			return applyRadialGradient(mask, line);
-		default:
-			qWarning("Invalid gradient shape %d", int(m_shape));
-			return QImage();
-		}
 	}
-}
 
-QImage
-GradientTool::applyLinearGradient(const QImage &mask, const QLineF &line) const
-{
-	QLinearGradient gradient(line.p1(), line.p2());
-	prepareGradient(gradient);
-	return paintGradient(mask, gradient);
+	// Rendered by the paint engine, so the preview matches what the fill
+	// message will produce exactly.
+	QPointF p1 = m_points.constFirst() * 4.0;
+	QPointF p2 = m_points.constLast() * 4.0;
+	qreal max = qreal(DP_GRADIENT_COORDINATE_MAX);
+	DP_Gradient gradient;
+	DP_gradient_init(
+		&gradient, DP_GradientShape(protocolShape()),
+		DP_GradientSpread(protocolSpread()), qRound(qBound(-max, p1.x(), max)),
+		qRound(qBound(-max, p1.y(), max)), qRound(qBound(-max, p2.x(), max)),
+		qRound(qBound(-max, p2.y(), max)),
+		uint16_t(qRound(qBound(0.0, m_focus, 1.0) * 65535.0)), m_color1.rgba(),
+		m_color2.rgba());
+
+	QImage img(mask.size(), QImage::Format_ARGB32_Premultiplied);
+	DP_gradient_render(
+		&gradient, pos.x(), pos.y(), img.width(), img.height(),
+		reinterpret_cast<DP_Pixel8 *>(img.bits()));
+
+	QPainter painter(&img);
+	painter.setCompositionMode(QPainter::CompositionMode_DestinationIn);
+	painter.drawImage(0, 0, mask);
+	return img;
 }
 
-QImage
-GradientTool::applyRadialGradient(const QImage &mask, const QLineF &line) const
+uint8_t GradientTool::protocolShape() const
 {
-	QRadialGradient gradient(
-		line.p1(), line.length(), line.pointAt(qBound(0.0, m_focus, 1.0)));
-	prepareGradient(gradient);
-	return paintGradient(mask, gradient);
+	switch(m_shape) {
+	case Shape::Linear:
+		return DP_MSG_FILL_GRADIENT_SHAPE_LINEAR;
+	case Shape::Radial:
+		return DP_MSG_FILL_GRADIENT_SHAPE_RADIAL;
+	}
+	qWarning("Invalid gradient shape %d", int(m_shape));
+	return DP_MSG_FILL_GRADIENT_SHAPE_LINEAR;
 }
 
-void GradientTool::prepareGradient(QGradient &gradient) const
+uint8_t GradientTool::protocolSpread() const
 {
-	gradient.setColorAt(0.0, m_color1);
-	gradient.setColorAt(1.0, m_color2);
 	switch(m_spread) {
 	case Spread::Pad:
-		gradient.setSpread(QGradient::PadSpread);
-		break;
-	case Spread::Reflect:
-		gradient.setSpread(QGradient::ReflectSpread);
-		break;
+		return DP_MSG_FILL_GRADIENT_SPREAD_PAD;
 	case Spread::Repeat:
-		gradient.setSpread(QGradient::RepeatSpread);
-		break;
-	default:
-		qWarning("Unknown gradient spread %d", int(m_spread));
-		break;
+		return DP_MSG_FILL_GRADIENT_SPREAD_REPEAT;
+	case Spread::Reflect:
+		return DP_MSG_FILL_GRADIENT_SPREAD_REFLECT;
 	}
-}
-
-QImage
-GradientTool::paintGradient(const QImage &mask, QGradient &gradient) const
-{
-	QImage img = mask.copy();
-	QPainter painter(&img);
-	painter.setCompositionMode(QPainter::CompositionMode_SourceIn);
-	painter.setPen(Qt::NoPen);
-	painter.setBrush(gradient);
-	painter.drawRect(img.rect());
-	return img;
+	qWarning("Unknown gradient spread %d", int(m_spread));
+	return DP_MSG_FILL_GRADIENT_SPREAD_PAD;
 }
 
 void GradientTool::previewPending()
@@ -10,8 +10,6 @@
 #include <QPointF>
 #include <QVector>
 
-class QGradient;
-
 namespace tools {
 
 class GradientTool final : public Tool {
@@ -48,11 +46,9 @@ private:
 	void updateCursor();
 
 	void updatePending();
-	QImage applyGradient(const QImage &mask, const QLineF &line) const;
-	QImage applyLinearGradient(const QImage &mask, const QLineF &line) const;
-	QImage applyRadialGradient(const QImage &mask, const QLineF &line) const;
-	void prepareGradient(QGradient &gradient) const;
-	QImage paintGradient(const QImage &mask, QGradient &gradient) const;
+	QImage applyGradient(const QImage &mask, const QPoint &pos) const;
+	uint8_t protocolShape() const;
+	uint8_t protocolSpread() const;
 
 	void previewPending();
 
@@ -74,6 +70,7 @@ private:
 	bool m_hoverOutside = false;
 	QPoint m_pendingPos;
 	QImage m_pendingImage;
+	QImage m_pendingMask;
 	DebounceTimer m_previewDebounce;
 	ClickDetector m_clickDetector;
 };
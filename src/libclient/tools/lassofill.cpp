@@ -1,4 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
+extern "C" {
+#include <dpmsg/blend_mode.h>
+}
 #include "libclient/tools/lassofill.h"
 #include "libclient/canvas/canvasmodel.h"
 #include "libclient/canvas/paintengine.h"
@@ -102,12 +105,27 @@ void LassoFillTool::finishMultipart()
 	if(isMultipart()) {
 		QPoint pos;
 		const QImage *image;
-		if(m_shape.get(&pos, &image)) {
+		canvas::CanvasModel *canvas = m_owner.model();
+		if(canvas && m_shape.get(&pos, &image)) {
 			net::MessageList msgs;
 			uint8_t contextId = localUserId();
-			net::makePutImageMessagesCompat(
-				msgs, contextId, m_shape.layerId(), m_shape.blendMode(),
-				pos.x(), pos.y(), *image, isCompatibilityMode());
+			int blendMode = m_shape.blendMode();
+			if(isCompatibilityMode() ||
+			   !DP_blend_mode_valid_for_brush(blendMode)) {
+				net::makePutImageMessagesCompat(
+					msgs, contextId, m_shape.layerId(), blendMode, pos.x(),
+					pos.y(), *image, isCompatibilityMode());
+			} else {
+				// A solid fill through the shape's coverage, so only the
+				// mask needs to be sent, not the colored pixels.
+				QColor color = m_shape.color();
+				net::makeFillGradientMessages(
+					msgs, contextId, m_shape.layerId(), blendMode,
+					DP_MSG_FILL_GRADIENT_SHAPE_LINEAR,
+					DP_MSG_FILL_GRADIENT_SPREAD_PAD, QPointF(), QPointF(),
+					0.0, color, color, pos.x(), pos.y(), m_shape.getMask(),
+					canvas->size());
+			}
 			if(!msgs.isEmpty()) {
 				msgs.prepend(net::makeUndoPointMessage(contextId));
 				m_owner.client()->sendCommands(msgs.size(), msgs.constData());
@@ -222,14 +240,27 @@ bool LassoFillTool::Shape::get(QPoint *outPos, const QImage **outImage)
 	}
 }
 
+QImage LassoFillTool::Shape::getMask()
+{
+	updateImage();
+	if(!m_imageValid) {
+		return QImage();
+	} else if(m_color.alpha() == 255) {
+		return m_image;
+	} else {
+		QImage mask(m_image.size(), QImage::Format_ARGB32_Premultiplied);
+		paint(mask, Qt::white);
+		return mask;
+	}
+}
+
 void LassoFillTool::Shape::updateImage()
 {
 	if(m_pending && !m_imageValid && pointCount() > 1) {
 		QRect bounds = m_antiAlias ? m_polygonF.boundingRect().toAlignedRect()
 								   : m_polygon.boundingRect();
 
-		bool haveSel = !m_selBounds.isEmpty();
-		if(haveSel) {
+		if(!m_selBounds.isEmpty()) {
 			bounds &= m_selBounds;
 		}
 
@@ -239,28 +270,32 @@ void LassoFillTool::Shape::updateImage()
 			m_image = QImage(
 				bounds.width(), bounds.height(),
 				QImage::Format_ARGB32_Premultiplied);
-			m_image.fill(0);
-			QPainter painter(&m_image);
-			painter.setPen(Qt::NoPen);
-			painter.setBrush(m_color);
-			painter.setRenderHint(QPainter::Antialiasing, m_antiAlias);
-			painter.translate(-m_pos);
-			if(m_antiAlias) {
-				painter.drawPolygon(m_polygonF);
-			} else {
-				painter.drawPolygon(m_polygon);
-			}
-
-			if(haveSel) {
-				painter.resetTransform();
-				painter.setCompositionMode(
-					QPainter::CompositionMode_DestinationIn);
-				painter.drawImage(m_selBounds.topLeft() - m_pos, m_selImage);
-			}
+			paint(m_image, m_color);
 		}
 	}
 }
 
+void LassoFillTool::Shape::paint(QImage &img, const QColor &color) const
+{
+	img.fill(0);
+	QPainter painter(&img);
+	painter.setPen(Qt::NoPen);
+	painter.setBrush(color);
+	painter.setRenderHint(QPainter::Antialiasing, m_antiAlias);
+	painter.translate(-m_pos);
+	if(m_antiAlias) {
+		painter.drawPolygon(m_polygonF);
+	} else {
+		painter.drawPolygon(m_polygon);
+	}
+
+	if(!m_selBounds.isEmpty()) {
+		painter.resetTransform();
+		painter.setCompositionMode(QPainter::CompositionMode_DestinationIn);
+		painter.drawImage(m_selBounds.topLeft() - m_pos, m_selImage);
+	}
+}
+
 int LassoFillTool::getEffectiveStabilizerSampleCount() const
 {
 	return m_stabilizationMode == int(brushes::Stabilizer)
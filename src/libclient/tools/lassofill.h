@@ -44,11 +44,16 @@ private:
 
 		int layerId() const { return m_layerId; }
 		int blendMode() const { return m_blendMode; }
+		const QColor &color() const { return m_color; }
 
 		bool get(QPoint *outPos, const QImage **outImage);
 
+		// Coverage of the shape in the alpha channel, same area as the image.
+		QImage getMask();
+
 	private:
 		void updateImage();
+		void paint(QImage &img, const QColor &color) const;
 
 		bool m_pending = false;
 		bool m_antiAlias = false;
@@ -42,6 +42,7 @@ ToolController::ToolController(net::Client *client, QObject *parent)
 	, m_mouseSmoothing(false)
 	, m_globalSmoothing(0)
 	, m_interpolateInputs(false)
+	, m_fastColorSampling(false)
 	, m_stabilizationMode(brushes::Stabilizer)
 	, m_stabilizerSampleCount(0)
 	, m_smoothing(0)
@@ -286,6 +287,11 @@ void ToolController::setInterpolateInputs(bool interpolateInputs)
 	m_interpolateInputs = interpolateInputs;
 }
 
+void ToolController::setFastColorSampling(bool fastColorSampling)
+{
+	m_fastColorSampling = fastColorSampling;
+}
+
 void ToolController::setStabilizationMode(
 	brushes::StabilizationMode stabilizationMode)
 {
@@ -787,6 +793,7 @@ const brushes::ActiveBrush &ToolController::fillBrushEngineStrokeParams(
 			: DP_SELECTION_ID_MAIN,
 		activeLayerAlphaLock(),
 		freehand && brush.shouldSyncSamples(),
+		m_fastColorSampling,
 	};
 	if(freehand) {
 		stroke.se.interpolate = m_interpolateInputs;
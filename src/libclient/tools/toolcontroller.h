@@ -118,6 +118,8 @@ public:
 
 	void setInterpolateInputs(bool interpolateInputs);
 
+	void setFastColorSampling(bool fastColorSampling);
+
 	void setStabilizerUseBrushSampleCount(bool stabilizerUseBrushSampleCount);
 	bool stabilizerUseBrushSampleCount()
 	{
@@ -332,6 +334,7 @@ private:
 
 	int m_globalSmoothing;
 	bool m_interpolateInputs;
+	bool m_fastColorSampling;
 	brushes::StabilizationMode m_stabilizationMode;
 	int m_stabilizerSampleCount;
 	int m_smoothing;
@@ -1,377 +1,519 @@
-// SPDX-License-Identifier: GPL-2.0-or-later
-// Based on KisOutlineGenerator from Krita
-// SPDX-FileCopyrightText: 2004 Boudewijn Rempt <boud@valdyas.org>
-// SPDX-FileCopyrightText: 2007, 2010 Sven Langkamp <sven.langkamp@gmail.com>
-// Outline algorithm based of the limn of fontutils
-// SPDX-FileCopyrightText: 1992 Karl Berry <karl@cs.umb.edu>
-// SPDX-FileCopyrightText: 1992 Kathryn Hargreaves <letters@cs.umb.edu>
+// SPDX-License-Identifier: GPL-3.0-or-later
+extern "C" {
+#include <dpengine/layer_content.h>
+#include <dpengine/pixels.h>
+#include <dpengine/tile.h>
+}
 #include "libclient/utils/selectionoutlinegenerator.h"
-#include "libshared/util/qtcompat.h"
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPoint>
 #include <QPolygon>
-#include <QScopedPointer>
+#include <QVector>
+#include <cmath>
 
 namespace {
 
-enum EdgeType {
-	TopEdge = 1,
-	LeftEdge = 2,
-	BottomEdge = 3,
-	RightEdge = 0,
-	NoEdge = 4
+// A directed piece of outline. The selected side is always to its right, in
+// screen coordinates, which makes every outline a closed loop that can be
+// followed from segment to segment.
+struct Segment {
+	QPoint from;
+	QPoint to;
 };
 
-EdgeType nextEdge(EdgeType edge)
-{
-	return edge == NoEdge ? edge : EdgeType((edge + 1) % 4);
-}
-
-#define TRY_PIXEL(deltaRow, deltaCol, test_edge)                               \
-	{                                                                          \
-		long long test_row = *row + deltaRow;                                  \
-		long long test_col = *col + deltaCol;                                  \
-		if((0LL <= (test_row) && (test_row) < m_scaledHeight &&                \
-			0LL <= (test_col) && (test_col) < m_scaledWidth) &&                \
-		   isOutlineEdge(test_edge, test_col, test_row)) {                     \
-			*row = test_row;                                                   \
-			*col = test_col;                                                   \
-			*edge = test_edge;                                                 \
-			break;                                                             \
-		}                                                                      \
-	}
+struct TileKey {
+	DP_Tile *tile;
+	DP_Tile *left;
+	DP_Tile *above;
 
-class OutlineMap {
-	COMPAT_DISABLE_COPY_MOVE(OutlineMap)
-public:
-	static constexpr long long DIMENSION_LIMIT = 2048;
-
-	OutlineMap(
-		const QImage &mask, long long scaledWidth, long long scaledHeight)
-		: m_actualWidth(mask.width())
-		, m_actualHeight(mask.height())
-		, m_scaledWidth(scaledWidth)
-		, m_scaledHeight(scaledHeight)
-		, m_bits(reinterpret_cast<const uint32_t *>(mask.constBits()))
+	bool operator==(const TileKey &other) const
 	{
+		return tile == other.tile && left == other.left && above == other.above;
 	}
 
-	virtual ~OutlineMap() { delete[] m_marks; }
-
-	virtual uint32_t at(long long x, long long y) const = 0;
-	virtual bool isFullyOpaque() const = 0;
-	virtual void
-	appendToPath(QPolygon &path, long long x, long long y) const = 0;
-
-	long long actualWidth() const { return m_actualWidth; }
-	long long actualHeight() const { return m_actualHeight; }
-	long long scaledWidth() const { return m_scaledWidth; }
-	long long scaledHeight() const { return m_scaledHeight; }
+	bool isBlank() const { return !tile && !left && !above; }
+};
 
-	void allocateMarks()
-	{
-		Q_ASSERT(!m_marks);
-		long long size = m_scaledWidth * m_scaledHeight;
-		m_marks = new uint8_t[size];
-		memset(m_marks, 0, size);
-	}
+// Past this many segments, stitching and drawing the outline takes ages. That
+// only happens with noisy selections, which get traced on a coarser grid.
+constexpr int SEGMENT_LIMIT = 500000;
 
-	uint8_t *pickMark(long long x, long long y)
-	{
-		Q_ASSERT(x >= 0);
-		Q_ASSERT(y >= 0);
-		Q_ASSERT(x < m_scaledWidth);
-		Q_ASSERT(y < m_scaledHeight);
-		return m_marks + y * m_scaledWidth + x;
-	}
+uint16_t minimumSelectedAlpha()
+{
+	// Same cutoff as the image mask, which has 8 bit alpha.
+	static const uint16_t minimum = [] {
+		uint16_t a = 1;
+		while(DP_channel15_to_8(a) == 0) {
+			++a;
+		}
+		return a;
+	}();
+	return minimum;
+}
 
-	bool isTransparent(long long x, long long y) const
-	{
-		return qAlpha(at(x, y)) == 0LL;
-	}
+// Direction of the edge between two pixels: 1 if only the second one is
+// selected, -1 if only the first one is, 0 if there's no edge.
+int edgeDirection(bool first, bool second)
+{
+	return first == second ? 0 : second ? 1 : -1;
+}
 
-	bool isOutlineEdge(EdgeType edge, long long x, long long y) const
+class TileEdges {
+public:
+	TileEdges(
+		const TileKey &key, int x, int y, int width, int height,
+		bool lastColumn, bool lastRow)
+		: m_tile(key.tile ? DP_tile_pixels(key.tile) : nullptr)
+		, m_left(key.left ? DP_tile_pixels(key.left) : nullptr)
+		, m_above(key.above ? DP_tile_pixels(key.above) : nullptr)
+		, m_x(x)
+		, m_y(y)
+		, m_width(width)
+		, m_height(height)
+		, m_lastColumn(lastColumn)
+		, m_lastRow(lastRow)
+		, m_minimumAlpha(minimumSelectedAlpha())
 	{
-		if(!isTransparent(x, y)) {
-			switch(edge) {
-			case LeftEdge:
-				return x == 0LL || isTransparent(x - 1LL, y);
-			case TopEdge:
-				return y == 0LL || isTransparent(x, y - 1LL);
-			case RightEdge:
-				return x == m_scaledWidth - 1LL || isTransparent(x + 1LL, y);
-			case BottomEdge:
-				return y == m_scaledHeight - 1LL || isTransparent(x, y + 1LL);
-			case NoEdge:
-				break;
-			}
-		}
-		return false;
 	}
 
-	void nextOutlineEdge(EdgeType *edge, long long *row, long long *col) const
+	// Each tile covers the edges along the top and left of its pixels. The
+	// tiles at the right and bottom of the canvas also cover the edges along
+	// the canvas border, since there's no tile past them to do so.
+	void collect(QVector<Segment> &out) const
 	{
-		long long originalRow = *row;
-		long long originalCol = *col;
-
-		switch(*edge) {
-		case RightEdge:
-			TRY_PIXEL(-1LL, 0LL, RightEdge);
-			TRY_PIXEL(-1LL, 1LL, BottomEdge);
-			break;
-		case TopEdge:
-			TRY_PIXEL(0LL, -1LL, TopEdge);
-			TRY_PIXEL(-1LL, -1LL, RightEdge);
-			break;
-		case LeftEdge:
-			TRY_PIXEL(1LL, 0LL, LeftEdge);
-			TRY_PIXEL(1LL, -1LL, TopEdge);
-			break;
-		case BottomEdge:
-			TRY_PIXEL(0LL, 1LL, BottomEdge);
-			TRY_PIXEL(1LL, 1LL, LeftEdge);
-			break;
-		default:
-			break;
+		int rowEnd = m_lastRow ? m_height : m_height - 1;
+		for(int ty = 0; ty <= rowEnd; ++ty) {
+			collectRow(out, ty);
 		}
-
-		if(*row == originalRow && *col == originalCol) {
-			*edge = nextEdge(*edge);
+		int columnEnd = m_lastColumn ? m_width : m_width - 1;
+		for(int tx = 0; tx <= columnEnd; ++tx) {
+			collectColumn(out, tx);
 		}
 	}
 
-	void appendCoordinate(
-		QPolygon &path, long long x, long long y, EdgeType edge) const
-	{
-		if(edge == TopEdge) {
-			++x;
-		} else if(edge == BottomEdge) {
-			++y;
-		} else if(edge == RightEdge) {
-			++x;
-			++y;
-		}
-		appendToPath(path, x, y);
-	}
-
-protected:
-	const long long m_actualWidth;
-	const long long m_actualHeight;
-	const long long m_scaledWidth;
-	const long long m_scaledHeight;
-	const uint32_t *const m_bits;
-
 private:
-	uint8_t *m_marks = nullptr;
-};
-
-class PlainOutlineMap final : public OutlineMap {
-	COMPAT_DISABLE_COPY_MOVE(PlainOutlineMap)
-public:
-	PlainOutlineMap(const QImage &mask)
-		: OutlineMap(mask, mask.width(), mask.height())
+	static bool isSelectedIn(
+		const DP_Pixel15 *pixels, int tx, int ty, uint16_t minimumAlpha)
 	{
+		return pixels && pixels[ty * DP_TILE_SIZE + tx].a >= minimumAlpha;
 	}
 
-	uint32_t at(long long x, long long y) const override
+	bool isSelected(int tx, int ty) const
 	{
-		return m_bits[y * m_actualWidth + x];
+		return isSelectedIn(m_tile, tx, ty, m_minimumAlpha);
 	}
 
-	bool isFullyOpaque() const override
+	void collectRow(QVector<Segment> &out, int ty) const
 	{
-		long long size = m_actualWidth * m_actualHeight;
-		for(long long i = 0LL; i < size; ++i) {
-			if(qAlpha(m_bits[i]) == 0u) {
-				return false;
+		int y = m_y + ty;
+		int runStart = 0;
+		int runDirection = 0;
+		for(int tx = 0; tx <= m_width; ++tx) {
+			int direction = 0;
+			if(tx < m_width) {
+				bool above = ty == 0 ? isSelectedIn(
+										   m_above, tx, DP_TILE_SIZE - 1,
+										   m_minimumAlpha)
+									 : isSelected(tx, ty - 1);
+				bool below = ty < m_height && isSelected(tx, ty);
+				direction = edgeDirection(above, below);
+			}
+
+			if(direction != runDirection) {
+				// Top edges of selected pixels go right, bottom edges left.
+				if(runDirection == 1) {
+					out.append({QPoint(m_x + runStart, y), QPoint(m_x + tx, y)});
+				} else if(runDirection == -1) {
+					out.append({QPoint(m_x + tx, y), QPoint(m_x + runStart, y)});
+				}
+				runStart = tx;
+				runDirection = direction;
 			}
 		}
-		return true;
 	}
 
-	void appendToPath(QPolygon &path, long long x, long long y) const override
+	void collectColumn(QVector<Segment> &out, int tx) const
 	{
-		path.append(QPoint(x, y));
+		int x = m_x + tx;
+		int runStart = 0;
+		int runDirection = 0;
+		for(int ty = 0; ty <= m_height; ++ty) {
+			int direction = 0;
+			if(ty < m_height) {
+				bool left = tx == 0 ? isSelectedIn(
+										  m_left, DP_TILE_SIZE - 1, ty,
+										  m_minimumAlpha)
+									: isSelected(tx - 1, ty);
+				bool right = tx < m_width && isSelected(tx, ty);
+				direction = edgeDirection(left, right);
+			}
+
+			if(direction != runDirection) {
+				// Left edges of selected pixels go up, right edges down.
+				if(runDirection == 1) {
+					out.append({QPoint(x, m_y + ty), QPoint(x, m_y + runStart)});
+				} else if(runDirection == -1) {
+					out.append({QPoint(x, m_y + runStart), QPoint(x, m_y + ty)});
+				}
+				runStart = ty;
+				runDirection = direction;
+			}
+		}
 	}
+
+	const DP_Pixel15 *const m_tile;
+	const DP_Pixel15 *const m_left;
+	const DP_Pixel15 *const m_above;
+	const int m_x;
+	const int m_y;
+	const int m_width;
+	const int m_height;
+	const bool m_lastColumn;
+	const bool m_lastRow;
+	const uint16_t m_minimumAlpha;
 };
 
-class ScaledOutlineMap final : public OutlineMap {
-	COMPAT_DISABLE_COPY_MOVE(ScaledOutlineMap)
-public:
-	ScaledOutlineMap(const QImage &mask)
-		: OutlineMap(
-			  mask, clampDimension(mask.width()), clampDimension(mask.height()))
-		, m_ratioX(qreal(m_actualWidth) / qreal(m_scaledWidth))
-		, m_ratioY(qreal(m_actualHeight) / qreal(m_scaledHeight))
-	{
-	}
+// Samples the selection at the center of each grid cell and traces the edges
+// between the cells, scaled back up to canvas coordinates. Same directions as
+// the per-tile edges, so the result can be stitched the same way.
+QVector<Segment> collectGridSegments(
+	DP_LayerContent *lc, const QRect &bounds, int scale, QAtomicInt &running)
+{
+	int gridWidth = (bounds.width() + scale - 1) / scale;
+	int gridHeight = (bounds.height() + scale - 1) / scale;
+	uint16_t minimumAlpha = minimumSelectedAlpha();
 
-	uint32_t at(long long x, long long y) const override
-	{
-		long long actualX = toActualX(x);
-		Q_ASSERT(actualX >= 0LL);
-		Q_ASSERT(actualX < m_actualWidth);
-		long long actualY = toActualY(y);
-		Q_ASSERT(actualY >= 0LL);
-		Q_ASSERT(actualY < m_actualHeight);
-		return m_bits[actualY * m_actualWidth + actualX];
+	QVector<bool> grid(gridWidth * gridHeight);
+	for(int gy = 0; gy < gridHeight; ++gy) {
+		if(!running) {
+			return QVector<Segment>();
+		}
+		int y = bounds.y() + qMin(gy * scale + scale / 2, bounds.height() - 1);
+		for(int gx = 0; gx < gridWidth; ++gx) {
+			int x =
+				bounds.x() + qMin(gx * scale + scale / 2, bounds.width() - 1);
+			grid[gy * gridWidth + gx] =
+				DP_layer_content_pixel_at(lc, x, y).a >= minimumAlpha;
+		}
 	}
 
-	bool isFullyOpaque() const override
-	{
-		for(long long y = 0LL; y < m_scaledHeight; ++y) {
-			for(long long x = 0LL; x < m_scaledWidth; ++x) {
-				if(isTransparent(x, y)) {
-					return false;
+	auto isSelected = [&](int gx, int gy) {
+		return gx >= 0 && gy >= 0 && gx < gridWidth && gy < gridHeight &&
+			   grid[gy * gridWidth + gx];
+	};
+	auto toX = [&](int gx) {
+		return bounds.x() + qMin(gx * scale, bounds.width());
+	};
+	auto toY = [&](int gy) {
+		return bounds.y() + qMin(gy * scale, bounds.height());
+	};
+
+	QVector<Segment> segments;
+	for(int gy = 0; gy <= gridHeight && running; ++gy) {
+		int y = toY(gy);
+		int runStart = 0;
+		int runDirection = 0;
+		for(int gx = 0; gx <= gridWidth; ++gx) {
+			int direction =
+				gx < gridWidth
+					? edgeDirection(isSelected(gx, gy - 1), isSelected(gx, gy))
+					: 0;
+			if(direction != runDirection) {
+				if(runDirection == 1) {
+					segments.append(
+						{QPoint(toX(runStart), y), QPoint(toX(gx), y)});
+				} else if(runDirection == -1) {
+					segments.append(
+						{QPoint(toX(gx), y), QPoint(toX(runStart), y)});
 				}
+				runStart = gx;
+				runDirection = direction;
 			}
 		}
-		return true;
-	}
-
-	void appendToPath(QPolygon &path, long long x, long long y) const override
-	{
-		path.append(QPoint(toActualX(x), toActualY(y)));
 	}
-
-private:
-	static long long clampDimension(long long dimension)
-	{
-		return dimension < DIMENSION_LIMIT ? dimension : DIMENSION_LIMIT;
-	}
-
-	long long toActualX(long long scaledX) const
-	{
-		return qRound64(qreal(scaledX) * m_ratioX);
+	for(int gx = 0; gx <= gridWidth && running; ++gx) {
+		int x = toX(gx);
+		int runStart = 0;
+		int runDirection = 0;
+		for(int gy = 0; gy <= gridHeight; ++gy) {
+			int direction =
+				gy < gridHeight
+					? edgeDirection(isSelected(gx - 1, gy), isSelected(gx, gy))
+					: 0;
+			if(direction != runDirection) {
+				if(runDirection == 1) {
+					segments.append(
+						{QPoint(x, toY(gy)), QPoint(x, toY(runStart))});
+				} else if(runDirection == -1) {
+					segments.append(
+						{QPoint(x, toY(runStart)), QPoint(x, toY(gy))});
+				}
+				runStart = gy;
+				runDirection = direction;
+			}
+		}
 	}
+	return segments;
+}
 
-	long long toActualY(long long scaledY) const
-	{
-		return qRound64(qreal(scaledY) * m_ratioY);
+// Noise has fewer edges the coarser the grid, roughly by the square of the
+// scale, so start from there and keep making it coarser until it fits.
+QVector<Segment> collectDownscaledSegments(
+	DP_LayerContent *lc, const QRect &bounds, int segmentCount,
+	QAtomicInt &running)
+{
+	int maxScale = qMax(bounds.width(), bounds.height());
+	int scale = qMax(
+		2, int(std::ceil(
+			   std::sqrt(double(segmentCount) / double(SEGMENT_LIMIT)))));
+	while(true) {
+		QVector<Segment> segments =
+			collectGridSegments(lc, bounds, scale, running);
+		if(segments.size() <= SEGMENT_LIMIT || scale >= maxScale ||
+		   !running) {
+			return segments;
+		}
+		scale *= 2;
 	}
+}
 
-	const qreal m_ratioX;
-	const qreal m_ratioY;
-};
+quint64 pointKey(const QPoint &p)
+{
+	return (quint64(quint32(p.x())) << 32) | quint64(quint32(p.y()));
+}
 
-OutlineMap *makeOutlineSource(const QImage &mask)
+QPoint segmentDirection(const Segment &s)
 {
-	if(mask.width() < OutlineMap::DIMENSION_LIMIT &&
-	   mask.height() < OutlineMap::DIMENSION_LIMIT) {
-		return new PlainOutlineMap(mask);
-	} else {
-		return new ScaledOutlineMap(mask);
-	}
+	QPoint d = s.to - s.from;
+	return QPoint(d.x() > 0 ? 1 : d.x() < 0 ? -1 : 0,
+				  d.y() > 0 ? 1 : d.y() < 0 ? -1 : 0);
 }
 
-QPainterPath generateOutline(
-	const QImage &mask, bool simple, int xOffset, int yOffset,
+// Joins the segments of all tiles into closed polygons. Where two selected
+// areas only touch at a corner, two outlines meet in one point and either
+// way to continue gives closed loops, so the first one found is taken.
+QPainterPath stitchSegments(
+	const QVector<Segment> &segments, const QPoint &offset,
 	QAtomicInt &running)
 {
-	Q_ASSERT(mask.format() == QImage::Format_ARGB32_Premultiplied);
-	QScopedPointer<OutlineMap> o(makeOutlineSource(mask));
-
-	QPainterPath paths;
-	if(o->isFullyOpaque()) {
-		paths.addRect(xOffset, yOffset, o->actualWidth(), o->actualHeight());
-		return paths;
+	int count = segments.size();
+	QHash<quint64, int> firstByStart;
+	firstByStart.reserve(count);
+	QVector<int> nextWithSameStart(count, -1);
+	for(int i = count - 1; i >= 0; --i) {
+		quint64 key = pointKey(segments[i].from);
+		QHash<quint64, int>::iterator it = firstByStart.find(key);
+		if(it == firstByStart.end()) {
+			firstByStart.insert(key, i);
+		} else {
+			nextWithSameStart[i] = it.value();
+			it.value() = i;
+		}
 	}
 
-	o->allocateMarks();
-
-	long long scaledWidth = o->scaledWidth();
-	long long scaledHeight = o->scaledHeight();
-	for(long long y = 0; y < scaledHeight; y++) {
-		if(!running) {
-			paths.clear();
-			break;
+	QPainterPath path;
+	QVector<bool> used(count, false);
+	for(int i = 0; i < count; ++i) {
+		if(used[i]) {
+			continue;
+		} else if(!running) {
+			return QPainterPath();
 		}
 
-		for(long long x = 0; x < scaledWidth; x++) {
-			if(o->isTransparent(x, y)) {
-				continue;
+		QPolygon polygon;
+		polygon.append(segments[i].from + offset);
+		int current = i;
+		while(true) {
+			used[current] = true;
+			const Segment &s = segments[current];
+
+			int next = -1;
+			QHash<quint64, int>::const_iterator it =
+				firstByStart.constFind(pointKey(s.to));
+			if(it != firstByStart.constEnd()) {
+				for(int j = it.value(); j != -1; j = nextWithSameStart[j]) {
+					if(!used[j]) {
+						next = j;
+						break;
+					}
+				}
 			}
 
-			const EdgeType initialEdge = TopEdge;
-
-			EdgeType startEdge = initialEdge;
-			while(startEdge != NoEdge &&
-				  (*o->pickMark(x, y) & (1 << startEdge) ||
-				   !o->isOutlineEdge(startEdge, x, y))) {
-
-				startEdge = nextEdge(startEdge);
-				if(startEdge == initialEdge)
-					startEdge = NoEdge;
+			if(next == -1) {
+				polygon.append(s.to + offset);
+				break;
+			} else if(
+				segmentDirection(s) != segmentDirection(segments[next])) {
+				polygon.append(s.to + offset);
 			}
+			current = next;
+		}
+		path.addPolygon(polygon);
+	}
+	return path;
+}
 
-			if(startEdge != NoEdge) {
-				QPolygon path;
-				const bool clockwise = startEdge == BottomEdge;
-
-				long long row = y, col = x;
-				EdgeType currentEdge = startEdge;
-				EdgeType lastEdge = NoEdge;
+}
 
-				if(currentEdge == BottomEdge) {
-					o->appendCoordinate(
-						path, col + xOffset, row + yOffset, currentEdge);
-					lastEdge = BottomEdge;
-				}
+struct SelectionOutlineCache::Private {
+	struct Entry {
+		TileKey key;
+		QVector<Segment> segments;
+	};
 
-				while(true) {
-					*o->pickMark(col, row) |= 1 << currentEdge;
-					o->nextOutlineEdge(&currentEdge, &row, &col);
+	QMutex mutex;
+	int width = -1;
+	int height = -1;
+	QHash<int, Entry> entries;
 
-					// While following a straight line no points need to be
-					// added
-					if(lastEdge != currentEdge) {
-						o->appendCoordinate(
-							path, col + xOffset, row + yOffset, currentEdge);
-						lastEdge = currentEdge;
-					}
-
-					if(row == y && col == x && currentEdge == startEdge) {
-						if(startEdge != BottomEdge) {
-							// add last point of the polygon
-							o->appendCoordinate(
-								path, col + xOffset, row + yOffset, NoEdge);
-						}
-						break;
-					}
-				}
+	static void releaseEntry(const Entry &entry)
+	{
+		DP_tile_decref_nullable(entry.key.tile);
+		DP_tile_decref_nullable(entry.key.left);
+		DP_tile_decref_nullable(entry.key.above);
+	}
 
-				if(!simple || !clockwise) {
-					paths.addPolygon(path);
-				}
-			}
+	void clear()
+	{
+		for(const Entry &entry : entries) {
+			releaseEntry(entry);
 		}
+		entries.clear();
 	}
+};
 
-	return paths;
+SelectionOutlineCache::SelectionOutlineCache()
+	: d(new Private)
+{
 }
 
+SelectionOutlineCache::~SelectionOutlineCache()
+{
+	d->clear();
+	delete d;
 }
 
 
 SelectionOutlineGenerator::SelectionOutlineGenerator(
-	unsigned int executionId, const QImage &mask, bool simple, int xOffset,
-	int yOffset, QObject *parent)
+	unsigned int executionId,
+	const QSharedPointer<SelectionOutlineCache> &cache,
+	const drawdance::LayerContent &content, const QRect &bounds,
+	QObject *parent)
 	: QObject(parent)
 	, m_executionId(executionId)
-	, m_mask(mask)
-	, m_simple(simple)
-	, m_xOffset(xOffset)
-	, m_yOffset(yOffset)
+	, m_cache(cache)
+	, m_content(content)
+	, m_bounds(bounds)
 {
 	qRegisterMetaType<SelectionOutlinePath>();
 }
 
 void SelectionOutlineGenerator::run()
 {
+	if(!m_running) {
+		return;
+	}
+
+	DP_LayerContent *lc = m_content.get();
+	SelectionOutlineCache::Private *cache = m_cache->d;
+	QMutexLocker locker(&cache->mutex);
+
+	int width = DP_layer_content_width(lc);
+	int height = DP_layer_content_height(lc);
+	if(width != cache->width || height != cache->height) {
+		cache->clear();
+		cache->width = width;
+		cache->height = height;
+	}
+
+	// Edges along the right and bottom of the selection belong to the tiles
+	// past them, so those need to be included too.
+	QRect area = m_bounds.adjusted(0, 0, 1, 1).intersected(
+		QRect(0, 0, width, height));
+	int columns = DP_tile_count_round(width);
+	int rows = DP_tile_count_round(height);
+	int left = area.left() / DP_TILE_SIZE;
+	int top = area.top() / DP_TILE_SIZE;
+	int right = area.right() / DP_TILE_SIZE;
+	int bottom = area.bottom() / DP_TILE_SIZE;
+
+	QHash<int, SelectionOutlineCache::Private::Entry> entries;
+	QVector<Segment> segments;
+	for(int row = top; row <= bottom && m_running; ++row) {
+		for(int col = left; col <= right; ++col) {
+			TileKey key = {
+				DP_layer_content_tile_at_noinc(lc, col, row),
+				col == 0 ? nullptr
+						 : DP_layer_content_tile_at_noinc(lc, col - 1, row),
+				row == 0 ? nullptr
+						 : DP_layer_content_tile_at_noinc(lc, col, row - 1),
+			};
+			if(key.isBlank()) {
+				continue;
+			}
+
+			int index = row * columns + col;
+			QHash<int, SelectionOutlineCache::Private::Entry>::iterator it =
+				cache->entries.find(index);
+			if(it != cache->entries.end() && it->key == key) {
+				segments.append(it->segments);
+				entries.insert(index, std::move(it.value()));
+				cache->entries.erase(it);
+			} else {
+				int x = col * DP_TILE_SIZE;
+				int y = row * DP_TILE_SIZE;
+				QVector<Segment> tileSegments;
+				TileEdges(
+					key, x, y, qMin(DP_TILE_SIZE, width - x),
+					qMin(DP_TILE_SIZE, height - y), col == columns - 1,
+					row == rows - 1)
+					.collect(tileSegments);
+				segments.append(tileSegments);
+				DP_tile_incref_nullable(key.tile);
+				DP_tile_incref_nullable(key.left);
+				DP_tile_incref_nullable(key.above);
+				entries.insert(index, {key, std::move(tileSegments)});
+			}
+		}
+	}
+
 	if(m_running) {
-		SelectionOutlinePath path = {
-			generateOutline(m_mask, m_simple, m_xOffset, m_yOffset, m_running)};
-		if(m_running) {
-			emit outlineGenerated(m_executionId, path);
+		// Whatever is left over is for tiles that aren't around anymore.
+		cache->clear();
+		cache->entries = std::move(entries);
+	} else {
+		// Cancelled, keep everything for the next run to pick up.
+		for(QHash<int, SelectionOutlineCache::Private::Entry>::iterator it =
+				entries.begin();
+			it != entries.end(); ++it) {
+			QHash<int, SelectionOutlineCache::Private::Entry>::iterator
+				existing = cache->entries.find(it.key());
+			if(existing != cache->entries.end()) {
+				SelectionOutlineCache::Private::releaseEntry(existing.value());
+				existing.value() = std::move(it.value());
+			} else {
+				cache->entries.insert(it.key(), std::move(it.value()));
+			}
 		}
+		return;
+	}
+	locker.unlock();
+
+	// The tiles stay cached even then, a selection this noisy likely only
+	// changes in parts and the next run can reuse the rest.
+	int segmentCount = segments.size();
+	if(segmentCount > SEGMENT_LIMIT) {
+		segments = collectDownscaledSegments(
+			lc, m_bounds.intersected(QRect(0, 0, width, height)),
+			segmentCount, m_running);
+	}
+
+	SelectionOutlinePath path = {
+		stitchSegments(segments, -m_bounds.topLeft(), m_running)};
+	if(m_running) {
+		emit outlineGenerated(m_executionId, path);
 	}
 }
 
@@ -1,17 +1,13 @@
-// SPDX-License-Identifier: GPL-2.0-or-later
-// Based on KisOutlineGenerator from Krita
-// SPDX-FileCopyrightText: 2004 Boudewijn Rempt <boud@valdyas.org>
-// SPDX-FileCopyrightText: 2007, 2010 Sven Langkamp <sven.langkamp@gmail.com>
-// Outline algorithm based of the limn of fontutils
-// SPDX-FileCopyrightText: 1992 Karl Berry <karl@cs.umb.edu>
-// SPDX-FileCopyrightText: 1992 Kathryn Hargreaves <letters@cs.umb.edu>
+// SPDX-License-Identifier: GPL-3.0-or-later
 #ifndef LIBCLIENT_UTILS_SELECTIONOUTLINEGENERATOR_H
 #define LIBCLIENT_UTILS_SELECTIONOUTLINEGENERATOR_H
+#include "libclient/drawdance/layercontent.h"
 #include <QAtomicInt>
-#include <QImage>
 #include <QObject>
 #include <QPainterPath>
+#include <QRect>
 #include <QRunnable>
+#include <QSharedPointer>
 
 // Qt5 doesn't have a metatype registered for QPainterPath.
 struct SelectionOutlinePath {
@@ -19,12 +15,36 @@ struct SelectionOutlinePath {
 };
 Q_DECLARE_METATYPE(SelectionOutlinePath)
 
+// Outline edges of the selection, kept per tile across generator runs. A
+// tile's edges only depend on itself and its neighbors to the left and
+// above, so when those tiles are the same objects as last time, the edges
+// are reused instead of looking at the pixels again.
+class SelectionOutlineCache final {
+	friend class SelectionOutlineGenerator;
+
+public:
+	SelectionOutlineCache();
+	~SelectionOutlineCache();
+
+	SelectionOutlineCache(const SelectionOutlineCache &) = delete;
+	SelectionOutlineCache(SelectionOutlineCache &&) = delete;
+	SelectionOutlineCache &operator=(const SelectionOutlineCache &) = delete;
+	SelectionOutlineCache &operator=(SelectionOutlineCache &&) = delete;
+
+private:
+	struct Private;
+	Private *d;
+};
+
 class SelectionOutlineGenerator : public QObject, public QRunnable {
 	Q_OBJECT
 public:
+	// The resulting path is relative to the top-left of the given bounds.
 	explicit SelectionOutlineGenerator(
-		unsigned int executionId, const QImage &mask, bool simple, int xOffset,
-		int yOffset, QObject *parent = nullptr);
+		unsigned int executionId,
+		const QSharedPointer<SelectionOutlineCache> &cache,
+		const drawdance::LayerContent &content, const QRect &bounds,
+		QObject *parent = nullptr);
 
 	void run() override;
 
@@ -37,10 +57,9 @@ signals:
 
 private:
 	const unsigned int m_executionId;
-	const QImage m_mask;
-	const bool m_simple;
-	const int m_xOffset;
-	const int m_yOffset;
+	const QSharedPointer<SelectionOutlineCache> m_cache;
+	const drawdance::LayerContent m_content;
+	const QRect m_bounds;
 	QAtomicInt m_running = 1;
 };
 
@@ -159,6 +159,8 @@ struct Client::Private {
 	bool isAuthenticated = false;
 	bool isMuted = false;
 	bool isHoldLocked = false;
+	ClientMetrics metrics;
+	EphemeralFilter ephemeralFilter;
 	bool isBanTriggered = false;
 	bool isGhost = false;
 	bool gracefulDisconnect = false;
@@ -201,6 +203,12 @@ Client::Client(
 	connect(
 		d->msgqueue, &net::MessageQueue::writeError, this, &Client::writeError);
 	connect(d->msgqueue, &net::MessageQueue::timedOut, this, &Client::timedOut);
+	connect(
+		d->msgqueue, &net::MessageQueue::bytesReceived, this,
+		&Client::countBytesReceived);
+	connect(
+		d->msgqueue, &net::MessageQueue::bytesSent, this,
+		&Client::countBytesSent);
 }
 
 #ifdef HAVE_WEBSOCKETS
@@ -222,6 +230,12 @@ Client::Client(
 		&Client::receiveMessages);
 	connect(
 		d->msgqueue, &net::MessageQueue::badData, this, &Client::gotBadData);
+	connect(
+		d->msgqueue, &net::MessageQueue::bytesReceived, this,
+		&Client::countBytesReceived);
+	connect(
+		d->msgqueue, &net::MessageQueue::bytesSent, this,
+		&Client::countBytesSent);
 }
 #endif
 
@@ -286,6 +300,14 @@ QJsonObject Client::description(bool includeSession) const
 		break;
 	}
 	u.insert(QStringLiteral("state"), state);
+	u.insert(
+		QStringLiteral("uploadQueue"), double(d->msgqueue->uploadQueueBytes()));
+	u.insert(
+		QStringLiteral("coalescedMessages"),
+		double(d->msgqueue->coalescedMessages()));
+	u.insert(
+		QStringLiteral("coalescedBytes"),
+		double(d->msgqueue->coalescedBytes()));
 	return u;
 }
 
@@ -696,6 +718,11 @@ void Client::setConnectionTimeout(int timeout)
 	d->msgqueue->setIdleTimeout(timeout);
 }
 
+void Client::setTransientWatermark(int bytes)
+{
+	d->msgqueue->setTransientWatermark(bytes);
+}
+
 void Client::setKeepAliveTimeout(int timeout)
 {
 	d->msgqueue->setKeepAliveTimeout(timeout);
@@ -711,6 +738,57 @@ qint64 Client::lastActiveDrawing() const
 	return d->lastActiveDrawing;
 }
 
+const ClientMetrics &Client::metrics() const
+{
+	return d->metrics;
+}
+
+EphemeralFilter &Client::ephemeralFilter()
+{
+	return d->ephemeralFilter;
+}
+
+bool Client::acceptsEphemeralMessage(const net::Message &msg)
+{
+	if(d->ephemeralFilter.accept(msg)) {
+		return true;
+	} else {
+		if(d->session) {
+			d->session->metrics().bytesFiltered += quint64(msg.length());
+		}
+		return false;
+	}
+}
+
+void Client::filterEphemeralMessages(net::MessageList &msgs)
+{
+	// Every message has to go through the filter so that it can keep track
+	// of laser trails. The list is usually shared with the history cache, so
+	// only copy it once something actually gets filtered out.
+	int count = msgs.size();
+	int i = 0;
+	while(i < count && acceptsEphemeralMessage(msgs.at(i))) {
+		++i;
+	}
+
+	if(i < count) {
+		net::MessageList accepted = msgs.mid(0, i);
+		accepted.reserve(count - 1);
+		for(++i; i < count; ++i) {
+			const net::Message &msg = msgs.at(i);
+			if(acceptsEphemeralMessage(msg)) {
+				accepted.append(msg);
+			}
+		}
+		msgs = accepted;
+	}
+}
+
+int Client::uploadQueueBytes() const
+{
+	return d->msgqueue->uploadQueueBytes();
+}
+
 QHostAddress Client::peerAddress() const
 {
 	return d->socket->peerAddress();
@@ -773,6 +851,7 @@ void Client::receiveMessages()
 									 .arg(msg.type())));
 			}
 		} else {
+			++d->metrics.messagesReceived;
 			// Enforce origin ID, except when receiving a snapshot
 			if(d->session->initUserId() != d->id) {
 				msg.setContextId(d->id);
@@ -787,6 +866,22 @@ void Client::receiveMessages()
 	}
 }
 
+void Client::countBytesReceived(int count)
+{
+	d->metrics.bytesReceived += quint64(count);
+	if(d->session) {
+		d->session->metrics().bytesReceived += quint64(count);
+	}
+}
+
+void Client::countBytesSent(int count)
+{
+	d->metrics.bytesSent += quint64(count);
+	if(d->session) {
+		d->session->metrics().bytesSent += quint64(count);
+	}
+}
+
 void Client::gotBadData(int len, int type)
 {
 	log(Log()
@@ -1,7 +1,9 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #ifndef DP_SERVER_CLIENT_H
 #define DP_SERVER_CLIENT_H
+#include "libserver/ephemeralfilter.h"
 #include "libserver/jsonapi.h"
+#include "libserver/metrics.h"
 #include "libshared/net/message.h"
 #include <QAbstractSocket>
 #include <QObject>
@@ -178,6 +180,12 @@ public:
 	void setConnectionTimeout(int timeout);
 	void setKeepAliveTimeout(int timeout);
 
+	/**
+	 * @brief Set upload queue size above which pointer movements coalesce
+	 * @param bytes watermark in bytes, zero to disable
+	 */
+	void setTransientWatermark(int bytes);
+
 	/**
 	 * Get the timestamp of this client's last activity (i.e. non-keepalive
 	 * message received)
@@ -191,6 +199,26 @@ public:
 	 */
 	qint64 lastActiveDrawing() const;
 
+	//! Traffic totals of this client, for the metrics export
+	const ClientMetrics &metrics() const;
+
+	//! Number of bytes waiting to be sent to this client
+	int uploadQueueBytes() const;
+
+	//! Which cursor and laser pointer messages this client wants to receive
+	EphemeralFilter &ephemeralFilter();
+
+	/**
+	 * @brief Check if a message should be sent to this client
+	 *
+	 * Messages the client isn't interested in are counted towards the
+	 * session's filtered bytes.
+	 */
+	bool acceptsEphemeralMessage(const net::Message &msg);
+
+	//! Remove messages from the list that this client isn't interested in
+	void filterEphemeralMessages(net::MessageList &msgs);
+
 	enum class DisconnectionReason {
 		Kick,	  // kicked by an operator
 		Error,	  // kicked due to some server or protocol error
@@ -339,6 +367,8 @@ private slots:
 	void writeError();
 	void timedOut(qint64 idleTimeout);
 	void socketDisconnect();
+	void countBytesReceived(int count);
+	void countBytesSent(int count);
 
 protected:
 	Client(
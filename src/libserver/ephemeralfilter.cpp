@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include "libserver/ephemeralfilter.h"
+
+namespace server {
+
+EphemeralFilter::EphemeralFilter()
+	: m_interests(Interest::All)
+	, m_lasering(256)
+{
+}
+
+void EphemeralFilter::setInterests(Interests interests)
+{
+	m_interests = interests;
+}
+
+void EphemeralFilter::setViewport(const QRect &viewport)
+{
+	m_viewport = viewport;
+}
+
+bool EphemeralFilter::accept(const net::Message &msg)
+{
+	switch(msg.type()) {
+	case DP_MSG_LASER_TRAIL:
+		// A persistence of zero ends the trail.
+		m_lasering.setBit(
+			int(msg.contextId()),
+			DP_msg_laser_trail_persistence(msg.toLaserTrail()) != 0);
+		return m_interests.testFlag(Interest::Lasers);
+	case DP_MSG_MOVE_POINTER:
+		if(m_lasering.testBit(int(msg.contextId()))) {
+			return m_interests.testFlag(Interest::Lasers);
+		} else {
+			return m_interests.testFlag(Interest::Cursors) &&
+				   acceptCursor(msg);
+		}
+	case DP_MSG_LEAVE:
+		m_lasering.clearBit(int(msg.contextId()));
+		return true;
+	default:
+		return true;
+	}
+}
+
+bool EphemeralFilter::acceptCursor(const net::Message &msg) const
+{
+	if(m_viewport.isEmpty()) {
+		return true;
+	} else {
+		// Pointer coordinates are in quarter pixels.
+		DP_MsgMovePointer *mmp = msg.toMovePointer();
+		return m_viewport.contains(
+			DP_msg_move_pointer_x(mmp) / 4, DP_msg_move_pointer_y(mmp) / 4);
+	}
+}
+
+}
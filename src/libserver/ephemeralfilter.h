@@ -0,0 +1,60 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#ifndef DP_SERVER_EPHEMERALFILTER_H
+#define DP_SERVER_EPHEMERALFILTER_H
+#include "libshared/net/message.h"
+#include <QBitArray>
+#include <QFlags>
+#include <QRect>
+
+namespace server {
+
+/**
+ * @brief Decides which cursor and laser pointer messages a client gets
+ *
+ * These messages don't affect the canvas, so a client that doesn't display
+ * them can tell the server not to send them. Pointer movements are laser
+ * traffic while their user has a laser trail going and cursor traffic
+ * otherwise, so the filter has to see every message going to the client in
+ * order to keep track of that.
+ */
+class EphemeralFilter {
+public:
+	enum class Interest {
+		None = 0,
+		Cursors = 1 << 0,
+		Lasers = 1 << 1,
+		All = Cursors | Lasers,
+	};
+	Q_DECLARE_FLAGS(Interests, Interest)
+
+	EphemeralFilter();
+
+	Interests interests() const { return m_interests; }
+	void setInterests(Interests interests);
+
+	//! Area in canvas pixels that cursors are wanted in, empty means anywhere.
+	const QRect &viewport() const { return m_viewport; }
+	void setViewport(const QRect &viewport);
+
+	//! Whether anything gets filtered out at all.
+	bool isActive() const
+	{
+		return m_interests != Interest::All || !m_viewport.isEmpty();
+	}
+
+	//! Returns whether the message should be sent to the client.
+	bool accept(const net::Message &msg);
+
+private:
+	bool acceptCursor(const net::Message &msg) const;
+
+	Interests m_interests;
+	QRect m_viewport;
+	QBitArray m_lasering;
+};
+
+}
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(server::EphemeralFilter::Interests)
+
+#endif
@@ -16,12 +16,16 @@ extern "C" {
 #include <QSet>
 #include <QTimerEvent>
 #include <QVarLengthArray>
+#include <algorithm>
 #include <dpcommon/platform_qt.h>
 
 namespace server {
 
 // A block is closed when its size goes above this limit
 static const qint64 MAX_BLOCK_SIZE = 0xffff * 10;
+// Loaded block messages are released in least-recently-used order when their
+// combined recording size goes above this limit
+static const qint64 MAX_LOADED_BLOCK_BYTES = MAX_BLOCK_SIZE * 100;
 
 FiledHistory::FiledHistory(
 	const QDir &dir, QFile *journal, const QString &id, const QString &alias,
@@ -44,6 +48,11 @@ FiledHistory::FiledHistory(
 {
 	Q_ASSERT(journal);
 
+	m_blockCache.setMaxLoadedBytes(MAX_LOADED_BLOCK_BYTES);
+	m_blockCache.setBlockClosedCallback([this](compat::sizetype i) {
+		writeBlockEntryToJournal(m_blockCache.blockAt(i));
+	});
+
 	// Flush the recording file periodically
 	startTimer(1000 * 30, Qt::VeryCoarseTimer);
 }
@@ -228,6 +237,46 @@ void FiledHistory::writeFileEntryToJournal(const QString &fileName)
 	writeStringToJournal(QStringLiteral("FILE %1\n").arg(fileName));
 }
 
+static QByteArray userSetToJournal(const QSet<uint8_t> &userSet)
+{
+	QByteArray users;
+	for(uint8_t user : userSet) {
+		if(!users.isEmpty()) {
+			users.append(',');
+		}
+		users.append(QByteArray::number(int(user)));
+	}
+	return users.isEmpty() ? QByteArrayLiteral("-") : users;
+}
+
+static void userSetFromJournal(const QByteArray &arg, QSet<uint8_t> &outUsers)
+{
+	if(arg != QByteArrayLiteral("-")) {
+		for(const QByteArray &user : arg.split(',')) {
+			outUsers.insert(uint8_t(user.toInt()));
+		}
+	}
+}
+
+void FiledHistory::writeBlockEntryToJournal(const Block &b)
+{
+	writeBytesToJournal(
+		QByteArrayLiteral("BLOCK ") + QByteArray::number(b.startOffset) +
+		QByteArrayLiteral(" ") + QByteArray::number(b.endOffset) +
+		QByteArrayLiteral(" ") + QByteArray::number(b.count) +
+		QByteArrayLiteral(" ") + userSetToJournal(b.users) +
+		QByteArrayLiteral(" ") + userSetToJournal(b.leftUsers) +
+		QByteArrayLiteral("\n"));
+}
+
+void FiledHistory::writeClosedBlocksToJournal()
+{
+	compat::sizetype count = m_blockCache.size();
+	for(compat::sizetype i = 0; i < count - 1; ++i) {
+		writeBlockEntryToJournal(m_blockCache.blockAt(i));
+	}
+}
+
 void FiledHistory::writeStringToJournal(const QString &s)
 {
 	writeBytesToJournal(s.toUtf8());
@@ -317,6 +366,34 @@ bool FiledHistory::load()
 			recordingFile = QString::fromUtf8(params);
 			++m_fileCount;
 			m_blockCache.clear();
+			m_blockIndex.clear();
+
+		} else if(cmd == QByteArrayLiteral("BLOCK")) {
+			const QList<QByteArray> args = params.split(' ');
+			bool startOk, endOk, countOk;
+			BlockIndexEntry entry;
+			if(args.length() == 5) {
+				entry.startOffset = args.at(0).toLongLong(&startOk);
+				entry.endOffset = args.at(1).toLongLong(&endOk);
+				entry.count = args.at(2).toLongLong(&countOk);
+			} else {
+				startOk = endOk = countOk = false;
+			}
+			if(startOk && endOk && countOk &&
+			   entry.startOffset <= entry.endOffset && entry.count >= 0LL) {
+				userSetFromJournal(args.at(3), entry.users);
+				userSetFromJournal(args.at(4), entry.leftUsers);
+				// If blocks got re-indexed after a rescan, the later entries
+				// supersede the earlier ones.
+				while(!m_blockIndex.isEmpty() &&
+					  m_blockIndex.last().startOffset >= entry.startOffset) {
+					m_blockIndex.removeLast();
+				}
+				m_blockIndex.append(entry);
+			} else {
+				qWarning() << "Invalid BLOCK entry:"
+						   << QString::fromUtf8(params);
+			}
 
 		} else if(cmd == QByteArrayLiteral("ALIAS")) {
 			if(m_alias.isEmpty())
@@ -580,16 +657,59 @@ bool FiledHistory::load()
 	return true;
 }
 
+bool FiledHistory::seedBlocksFromIndex()
+{
+	// Use the prefix of the block index that is contiguous, starts at the
+	// beginning of the recording and lies within the file. Anything beyond
+	// that gets scanned from the recording itself.
+	qint64 offset = m_recording->pos();
+	qint64 fileSize = m_recording->size();
+	compat::sizetype usable = 0;
+	for(const BlockIndexEntry &entry : m_blockIndex) {
+		if(entry.startOffset != offset || entry.endOffset > fileSize) {
+			break;
+		}
+		offset = entry.endOffset;
+		++usable;
+	}
+
+	if(usable == 0 || !m_recording->seek(offset)) {
+		return false;
+	}
+
+	long long index = firstIndex();
+	for(compat::sizetype i = 0; i < usable; ++i) {
+		const BlockIndexEntry &entry = m_blockIndex[i];
+		m_blockCache.addIndexedBlock(entry, index);
+		index += entry.count;
+		// Same as what scanBlocks does when it encounters a leave message.
+		for(uint8_t user : entry.leftUsers) {
+			idQueue().reserveId(user);
+		}
+	}
+	m_blockCache.users() = m_blockIndex[usable - 1].users;
+	qDebug(
+		"Seeded %lld block(s) from index up to offset %lld",
+		static_cast<long long>(usable), static_cast<long long>(offset));
+	return true;
+}
+
 bool FiledHistory::scanBlocks()
 {
 	Q_ASSERT(m_blockCache.isEmpty());
 	// Note: m_recording should be at the start of the recording
 
-	m_blockCache.addBlock(m_recording->pos(), firstIndex());
+	if(seedBlocksFromIndex()) {
+		const Block &b = m_blockCache.lastBlock();
+		m_blockCache.addBlock(b.endOffset, b.startIndex + b.count);
+	} else {
+		m_blockCache.addBlock(m_recording->pos(), firstIndex());
+	}
+	m_blockIndex.clear();
 
-	QSet<uint8_t> users;
+	QSet<uint8_t> &users = m_blockCache.users();
 
-	do {
+	while(!m_recording->atEnd()) {
 		uint8_t msgType, ctxId;
 		int msglen = DP_binary_reader_skip_message(m_reader, &msgType, &ctxId);
 		if(msglen < 0) {
@@ -603,23 +723,20 @@ bool FiledHistory::scanBlocks()
 			m_recording->seek(offset);
 			break;
 		}
+		m_blockCache.updateUsers(msgType, ctxId);
 		m_blockCache.incrementLastBlock(msglen);
 		Q_ASSERT(m_blockCache.lastBlock().endOffset == m_recording->pos());
 
-		switch(msgType) {
-		case DP_MSG_JOIN:
-			users.insert(ctxId);
-			break;
-		case DP_MSG_LEAVE:
-			users.remove(ctxId);
+		if(msgType == DP_MSG_LEAVE) {
 			idQueue().reserveId(ctxId);
-			break;
 		}
-	} while(!m_recording->atEnd());
+	}
 
 	// There should be no users at the end of the recording.
-	for(const uint8_t user : users) {
+	const QSet<uint8_t> remainingUsers = users;
+	for(const uint8_t user : remainingUsers) {
 		net::Message msg = net::makeLeaveMessage(user);
+		m_blockCache.updateUsers(DP_MSG_LEAVE, user);
 		m_blockCache.incrementLastBlock(msg.length());
 		if(DP_binary_writer_write_message(m_writer, msg.get()) == 0) {
 			return false;
@@ -780,7 +897,8 @@ qint64 FiledHistory::resetStreamHeaderPos() const
 std::tuple<net::MessageList, long long>
 FiledHistory::getBatch(long long after) const
 {
-	Block &b = m_blockCache.findBlock(after);
+	compat::sizetype blockIndex = m_blockCache.findBlockIndex(after);
+	Block &b = m_blockCache.blockAt(blockIndex);
 	long long idxOffset = qMax(0LL, after - b.startIndex + 1LL);
 	if(idxOffset >= b.count) {
 		return std::make_tuple(
@@ -806,13 +924,16 @@ FiledHistory::getBatch(long long after) const
 		m_recording->seek(prevPos);
 	}
 	Q_ASSERT(b.messages.size() == b.count);
-	return std::make_tuple(
-		b.messages.mid(idxOffset), b.startIndex + b.count - 1LL);
+	net::MessageList batch = b.messages.mid(idxOffset);
+	long long lastIndex = b.startIndex + b.count - 1LL;
+	m_blockCache.touchLoaded(blockIndex);
+	return std::make_tuple(batch, lastIndex);
 }
 
 void FiledHistory::historyAdd(const net::Message &msg)
 {
 	size_t len = DP_binary_writer_write_message(m_writer, msg.get());
+	m_blockCache.updateUsers(msg.type(), msg.contextId());
 	m_blockCache.addToLastBlock(msg, len);
 }
 
@@ -906,6 +1027,7 @@ FiledHistory::addResetStreamMessage(const net::Message &msg)
 	Q_ASSERT(m_resetStreamWriter);
 	size_t len = DP_binary_writer_write_message(m_resetStreamWriter, msg.get());
 	if(len > 0) {
+		m_resetStreamBlockCache.updateUsers(msg.type(), msg.contextId());
 		m_resetStreamBlockCache.incrementLastBlock(len);
 		return StreamResetAddResult::Ok;
 	} else {
@@ -989,6 +1111,7 @@ bool FiledHistory::resolveResetStream(
 
 	m_blockCache.replaceWithResetStream(
 		m_resetStreamBlockCache, m_resetStreamBlockIndex, newFirstIndex);
+	writeClosedBlocksToJournal();
 
 	outMessageCount = m_blockCache.totalMessageCount();
 	outSizeInBytes = m_recording->pos() - m_resetStreamHeaderPos;
@@ -1191,16 +1314,19 @@ CheckInviteResult FiledHistory::checkInvite(
 }
 
 
-FiledHistory::Block &FiledHistory::BlockCache::findBlock(long long after)
+compat::sizetype
+FiledHistory::BlockCache::findBlockIndex(long long after) const
 {
-	int i = m_blocks.size() - 1;
-	for(; i > 0; --i) {
-		const Block &b = m_blocks.at(i - 1);
-		if(b.startIndex + b.count - 1LL <= after) {
-			break;
-		}
-	}
-	return m_blocks[i];
+	// Blocks are contiguous and sorted by index, so binary search for the
+	// first one that ends after the given index. The last block is the
+	// fallback, since it's still open and may receive more messages.
+	Q_ASSERT(!m_blocks.isEmpty());
+	auto end = m_blocks.cend() - 1;
+	auto it = std::partition_point(
+		m_blocks.cbegin(), end, [after](const Block &b) {
+			return b.startIndex + b.count - 1LL <= after;
+		});
+	return compat::sizetype(it - m_blocks.cbegin());
 }
 
 void FiledHistory::BlockCache::addBlock(qint64 offset, long long index)
@@ -1208,16 +1334,94 @@ void FiledHistory::BlockCache::addBlock(qint64 offset, long long index)
 	m_blocks.append(Block(offset, index));
 }
 
+void FiledHistory::BlockCache::addIndexedBlock(
+	const BlockIndexEntry &entry, long long index)
+{
+	Block b(entry.startOffset, index);
+	b.count = entry.count;
+	b.endOffset = entry.endOffset;
+	b.users = entry.users;
+	b.leftUsers = entry.leftUsers;
+	m_blocks.append(b);
+}
+
+void FiledHistory::BlockCache::clear()
+{
+	m_blocks.clear();
+	m_loadedLru.clear();
+	m_loadedBytes = 0;
+	m_users.clear();
+}
+
+void FiledHistory::BlockCache::updateUsers(uint8_t type, uint8_t contextId)
+{
+	switch(type) {
+	case DP_MSG_JOIN:
+		m_users.insert(contextId);
+		break;
+	case DP_MSG_LEAVE:
+		m_users.remove(contextId);
+		if(!m_blocks.isEmpty()) {
+			m_blocks.last().leftUsers.insert(contextId);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+void FiledHistory::BlockCache::touchLoaded(compat::sizetype i)
+{
+	Block &b = m_blocks[i];
+	if(b.messages.isEmpty()) {
+		return;
+	}
+
+	if(!m_loadedLru.removeOne(i)) {
+		b.loadedBytes = b.endOffset - b.startOffset;
+		m_loadedBytes += b.loadedBytes;
+	}
+	m_loadedLru.append(i);
+	// Never release the block that was just touched, the last one is fine to
+	// release since it gets reloaded from disk when needed.
+	while(m_loadedBytes > m_maxLoadedBytes && m_loadedLru.size() > 1) {
+		releaseLoaded(m_loadedLru.takeFirst());
+	}
+}
+
+void FiledHistory::BlockCache::releaseLoaded(compat::sizetype i)
+{
+	Block &b = m_blocks[i];
+	m_loadedBytes -= b.loadedBytes;
+	b.loadedBytes = 0;
+	if(!b.messages.isEmpty()) {
+		qDebug(
+			"Releasing least recently used history block from %lld to %lld",
+			b.startIndex, b.startIndex + b.count - 1LL);
+		b.messages = net::MessageList();
+	}
+}
+
 void FiledHistory::BlockCache::addToLastBlock(
 	const net::Message &msg, size_t len)
 {
 	Block &b = m_blocks.last();
 	// Add message to cache, if already active (if cache is empty, it will be
 	// loaded from disk when needed)
-	if(!b.messages.isEmpty()) {
+	if(b.messages.isEmpty()) {
+		incrementBlock(b, len);
+	} else {
+		// The block keeps growing after it got loaded, so count the new
+		// message towards the memory cap too.
 		b.messages.append(msg);
+		if(b.loadedBytes != 0) {
+			b.loadedBytes += qint64(len);
+			m_loadedBytes += qint64(len);
+		}
+		compat::sizetype i = m_blocks.size() - 1;
+		incrementBlock(b, len);
+		touchLoaded(i);
 	}
-	incrementBlock(b, len);
 }
 
 void FiledHistory::BlockCache::incrementLastBlock(size_t len)
@@ -1233,20 +1437,30 @@ void FiledHistory::BlockCache::closeLastBlock()
 	Block &b = m_blocks.last();
 	if(b.count != 0) {
 		// Mark last block as closed and start a new one
-		m_blocks.append(Block(b.endOffset, b.startIndex + b.count));
+		appendBlock(b.endOffset, b.startIndex + b.count);
+	}
+}
+
+void FiledHistory::BlockCache::appendBlock(qint64 offset, long long index)
+{
+	compat::sizetype closedIndex = m_blocks.size() - 1;
+	m_blocks[closedIndex].users = m_users;
+	m_blocks.append(Block(offset, index));
+	if(m_blockClosed) {
+		m_blockClosed(closedIndex);
 	}
 }
 
 void FiledHistory::BlockCache::cleanup(long long before)
 {
-	for(Block &b : m_blocks) {
+	compat::sizetype count = m_blocks.size();
+	for(compat::sizetype i = 0; i < count; ++i) {
+		const Block &b = m_blocks[i];
 		if(b.startIndex + b.count >= before) {
 			break;
 		} else if(!b.messages.isEmpty()) {
-			qDebug(
-				"Releasing history block cache from %lld to %lld", b.startIndex,
-				b.startIndex + b.count - 1LL);
-			b.messages = net::MessageList();
+			m_loadedLru.removeOne(i);
+			releaseLoaded(i);
 		}
 	}
 }
@@ -1273,6 +1487,10 @@ void FiledHistory::BlockCache::replaceWithResetStream(
 		nextStartIndex = b.startIndex + b.count;
 	}
 
+	// The last block of the stream gets closed by the forked blocks following
+	// it, so it ends with the users from the server-side state messages.
+	streamCache.m_blocks.last().users = streamCache.m_users;
+
 	// Move forked blocks over to the new stream cache.
 	compat::sizetype count = m_blocks.size();
 	for(compat::sizetype i = blockIndex; i < count; ++i) {
@@ -1288,6 +1506,18 @@ void FiledHistory::BlockCache::replaceWithResetStream(
 	// Replace ourselves.
 	m_blocks.clear();
 	m_blocks.swap(streamCache.m_blocks);
+	streamCache.clear();
+
+	// Only keep the last block's messages around, since it's the one that
+	// gets appended to. The rest gets reloaded from disk as needed.
+	m_loadedLru.clear();
+	m_loadedBytes = 0;
+	compat::sizetype last = m_blocks.size() - 1;
+	for(compat::sizetype i = 0; i < last; ++i) {
+		m_blocks[i].messages = net::MessageList();
+		m_blocks[i].loadedBytes = 0;
+	}
+	touchLoaded(last);
 }
 
 void FiledHistory::BlockCache::incrementBlock(Block &b, size_t len)
@@ -1295,7 +1525,7 @@ void FiledHistory::BlockCache::incrementBlock(Block &b, size_t len)
 	++b.count;
 	b.endOffset += len;
 	if(b.endOffset - b.startOffset > MAX_BLOCK_SIZE) {
-		m_blocks.append(Block(b.endOffset, b.startIndex + b.count));
+		appendBlock(b.endOffset, b.startIndex + b.count);
 	}
 }
 
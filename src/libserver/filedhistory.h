@@ -5,7 +5,9 @@
 #include "libshared/net/protover.h"
 #include "libshared/util/qtcompat.h"
 #include <QDir>
+#include <QSet>
 #include <QVector>
+#include <functional>
 
 struct DP_BinaryReader;
 struct DP_BinaryWriter;
@@ -55,6 +57,20 @@ public:
 	 */
 	void setArchive(bool archive) { m_archive = archive; }
 
+	//! Size of the recording parts whose messages are currently in memory
+	qint64 loadedBlockBytes() const { return m_blockCache.loadedBytes(); }
+
+	/**
+	 * @brief Set the limit for loadedBlockBytes()
+	 *
+	 * Past this, the least recently used blocks are released. They get
+	 * reloaded from the recording when needed again.
+	 */
+	void setMaxLoadedBlockBytes(qint64 maxBytes)
+	{
+		m_blockCache.setMaxLoadedBytes(maxBytes);
+	}
+
 	//! Get the metadata journal file name for the given session ID
 	static QString journalFilename(const QString &id);
 
@@ -137,6 +153,12 @@ private:
 		long long count;
 		qint64 endOffset;
 		net::MessageList messages;
+		// Users present at the end of the block, only set once it's closed.
+		QSet<uint8_t> users;
+		// Users that left during the block, their ids get reserved on load.
+		QSet<uint8_t> leftUsers;
+		// Size accounted for in the cache's loaded bytes, zero if unloaded.
+		qint64 loadedBytes = 0;
 
 		Block(qint64 offset, long long index)
 			: startOffset(offset)
@@ -147,32 +169,68 @@ private:
 		}
 	};
 
+	// Entry of the block index persisted in the journal, see BLOCK entries.
+	struct BlockIndexEntry {
+		qint64 startOffset;
+		qint64 endOffset;
+		long long count;
+		QSet<uint8_t> users;
+		QSet<uint8_t> leftUsers;
+	};
+
 	class BlockCache {
 	public:
 		const Block &lastBlock() const { return m_blocks.last(); }
-		Block &findBlock(long long after);
+		const Block &blockAt(compat::sizetype i) const { return m_blocks[i]; }
+		Block &blockAt(compat::sizetype i) { return m_blocks[i]; }
+		compat::sizetype findBlockIndex(long long after) const;
 
 		void addBlock(qint64 offset, long long index);
+		void addIndexedBlock(const BlockIndexEntry &entry, long long index);
 		void addToLastBlock(const net::Message &msg, size_t len);
 		void incrementLastBlock(size_t len);
 		void closeLastBlock();
 
+		// Marks the messages of the given block as recently used and releases
+		// the least recently used ones if the memory cap is exceeded.
+		void touchLoaded(compat::sizetype i);
+
+		qint64 loadedBytes() const { return m_loadedBytes; }
+		void setMaxLoadedBytes(qint64 maxBytes) { m_maxLoadedBytes = maxBytes; }
+
 		void cleanup(long long before);
 
 		long long totalMessageCount() const;
 
 		compat::sizetype size() const { return m_blocks.size(); }
-		void clear() { m_blocks.clear(); }
+		void clear();
 		bool isEmpty() const { return m_blocks.isEmpty(); }
 
 		void replaceWithResetStream(
 			BlockCache &streamCache, compat::sizetype blockIndex,
 			long long newFirstIndex);
 
+		// Current set of users, used to tag blocks when they're closed.
+		QSet<uint8_t> &users() { return m_users; }
+		void updateUsers(uint8_t type, uint8_t contextId);
+
+		// Called with the index of each block that gets closed.
+		void setBlockClosedCallback(std::function<void(compat::sizetype)> fn)
+		{
+			m_blockClosed = fn;
+		}
+
 	private:
 		void incrementBlock(Block &b, size_t len);
+		void appendBlock(qint64 offset, long long index);
+		void releaseLoaded(compat::sizetype i);
 
 		QVector<Block> m_blocks;
+		QList<compat::sizetype> m_loadedLru;
+		qint64 m_loadedBytes = 0;
+		qint64 m_maxLoadedBytes = 0;
+		QSet<uint8_t> m_users;
+		std::function<void(compat::sizetype)> m_blockClosed;
 	};
 
 	FiledHistory(
@@ -191,6 +249,9 @@ private:
 		DP_BinaryReader **outReader, DP_BinaryWriter **outWriter);
 
 	void writeFileEntryToJournal(const QString &fileName);
+	void writeBlockEntryToJournal(const Block &b);
+	void writeClosedBlocksToJournal();
+	bool seedBlocksFromIndex();
 	void writeStringToJournal(const QString &s);
 	void writeBytesToJournal(const QByteArray &bytes);
 	void flushRecording();
@@ -219,6 +280,7 @@ private:
 	QStringList m_announcements;
 
 	mutable BlockCache m_blockCache;
+	QVector<BlockIndexEntry> m_blockIndex;
 	int m_fileCount;
 	bool m_archive;
 
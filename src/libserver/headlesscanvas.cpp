@@ -0,0 +1,285 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+extern "C" {
+#include <dpengine/canvas_history.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/snapshots.h>
+#include <dpmsg/acl.h>
+}
+#include "libserver/headlesscanvas.h"
+#include "libshared/util/functionrunnable.h"
+#include "libshared/util/qtcompat.h"
+#include <QDebug>
+#include <QMutexLocker>
+
+namespace server {
+
+struct HeadlessCanvas::ResetImageParams {
+	HeadlessCanvas *hc;
+	QString correlator;
+	net::MessageList batch;
+	size_t batchSize;
+	int count;
+	bool ok;
+};
+
+HeadlessCanvas::HeadlessCanvas(
+	long long historyPosition, bool compatibilityMode, QObject *parent)
+	: QObject(parent)
+	, m_compatibilityMode(compatibilityMode)
+	, m_historyPosition(historyPosition)
+	, m_ch(DP_canvas_history_new(nullptr, nullptr, false, nullptr))
+	, m_acls(DP_acl_state_new())
+	, m_dc(DP_draw_context_new())
+{
+	// One thread handles messages in order, the other builds reset images
+	// while message handling continues.
+	m_threadPool.setMaxThreadCount(2);
+}
+
+HeadlessCanvas::~HeadlessCanvas()
+{
+	m_cancelled.storeRelease(1);
+	m_threadPool.waitForDone();
+	DP_draw_context_free(m_dc);
+	DP_acl_state_free(m_acls);
+	DP_canvas_history_free(m_ch);
+}
+
+void HeadlessCanvas::reset(long long historyPosition)
+{
+	m_historyPosition = historyPosition;
+	enqueue([this] {
+		resetEngine();
+	});
+}
+
+void HeadlessCanvas::handleMessages(
+	const net::MessageList &msgs, long long lastIndex)
+{
+	Q_ASSERT(!m_busy);
+	m_busy = true;
+	m_historyPosition = lastIndex;
+	enqueue([this, msgs] {
+		for(const net::Message &msg : msgs) {
+			handleMessage(msg);
+		}
+		QMetaObject::invokeMethod(
+			this,
+			[this] {
+				m_busy = false;
+				emit messagesHandled();
+			},
+			Qt::QueuedConnection);
+	});
+}
+
+void HeadlessCanvas::generateResetImage(const QString &correlator)
+{
+	enqueue([this, correlator] {
+		startResetImage(correlator);
+	});
+}
+
+void HeadlessCanvas::enqueue(std::function<void()> &&fn)
+{
+	QMutexLocker locker(&m_queueMutex);
+	m_queue.enqueue(std::move(fn));
+	if(!m_draining) {
+		m_draining = true;
+		m_threadPool.start(new utils::FunctionRunnable([this] {
+			drainQueue();
+		}));
+	}
+}
+
+void HeadlessCanvas::drainQueue()
+{
+	while(true) {
+		std::function<void()> fn;
+		{
+			QMutexLocker locker(&m_queueMutex);
+			if(m_queue.isEmpty()) {
+				m_draining = false;
+				return;
+			}
+			fn = m_queue.dequeue();
+		}
+		if(!m_cancelled.loadAcquire()) {
+			fn();
+		}
+	}
+}
+
+void HeadlessCanvas::resetEngine()
+{
+	DP_canvas_history_reset(m_ch);
+	DP_acl_state_reset(m_acls, 0);
+	m_pinnedMessage.clear();
+	m_defaultLayer = 0;
+}
+
+void HeadlessCanvas::handleMessage(const net::Message &msg)
+{
+	uint8_t result = DP_acl_state_handle(m_acls, msg.get(), false);
+	if(result & DP_ACL_STATE_FILTERED_BIT) {
+		return;
+	}
+
+	DP_MessageType type = msg.type();
+	switch(type) {
+	case DP_MSG_SOFT_RESET:
+		DP_canvas_history_soft_reset(
+			m_ch, m_dc, msg.contextId(), nullptr, nullptr);
+		break;
+	case DP_MSG_UNDO_DEPTH: {
+		DP_MsgUndoDepth *mud =
+			static_cast<DP_MsgUndoDepth *>(DP_message_internal(msg.get()));
+		DP_canvas_history_undo_depth_limit_set(
+			m_ch, m_dc, DP_msg_undo_depth_depth(mud));
+		break;
+	}
+	case DP_MSG_CHAT: {
+		DP_MsgChat *mc = msg.toChat();
+		if(DP_msg_chat_oflags(mc) & DP_MSG_CHAT_OFLAGS_PIN) {
+			size_t len;
+			const char *text = DP_msg_chat_message(mc, &len);
+			if(len == 1 && *text == '-') {
+				m_pinnedMessage.clear();
+			} else {
+				m_pinnedMessage =
+					QString::fromUtf8(text, compat::castSize(len));
+			}
+		}
+		break;
+	}
+	case DP_MSG_DEFAULT_LAYER:
+		m_defaultLayer = int(DP_msg_default_layer_id(msg.toDefaultLayer()));
+		break;
+	default:
+		if(DP_message_type_command(type) &&
+		   !DP_canvas_history_handle(m_ch, m_dc, msg.get())) {
+			qWarning(
+				"Headless canvas error handling %s: %s",
+				DP_message_type_enum_name_unprefixed(type), DP_error());
+		}
+		break;
+	}
+}
+
+void HeadlessCanvas::startResetImage(const QString &correlator)
+{
+	// Same metadata a client would put around its reset image.
+	net::MessageList metadata;
+	if(!m_pinnedMessage.isEmpty()) {
+		metadata.append(net::makeChatMessage(
+			0, 0, DP_MSG_CHAT_OFLAGS_PIN, m_pinnedMessage));
+	}
+	metadata.append(net::Message::noinc(DP_msg_undo_depth_new(
+		0, uint8_t(DP_canvas_history_undo_depth_limit(m_ch)))));
+	int prepended = metadata.size();
+
+	if(m_defaultLayer > 0) {
+		metadata.append(net::Message::noinc(
+			DP_msg_default_layer_new(0, uint32_t(m_defaultLayer))));
+	}
+
+	DP_acl_state_reset_image_build(
+		m_acls, 0,
+		m_compatibilityMode
+			? DP_ACL_STATE_RESET_IMAGE_SESSION_RESET_COMPAT_FLAGS
+			: DP_ACL_STATE_RESET_IMAGE_SESSION_RESET_FLAGS,
+		nullptr, nullptr, &HeadlessCanvas::pushAclMessage, &metadata);
+
+	// Canvas states are immutable, so the image can be built from this one
+	// while further messages get handled.
+	DP_CanvasState *cs = DP_canvas_history_get(m_ch);
+	m_threadPool.start(new utils::FunctionRunnable(
+		[this, cs, metadata, prepended, correlator] {
+			buildResetImage(cs, metadata, prepended, correlator);
+			DP_canvas_state_decref(cs);
+		}));
+}
+
+void HeadlessCanvas::buildResetImage(
+	DP_CanvasState *cs, const net::MessageList &metadata, int prepended,
+	const QString &correlator)
+{
+	ResetImageParams params = {this, correlator, {}, 0, 0, true};
+	for(int i = 0; i < prepended; ++i) {
+		appendResetImageMessage(params, DP_message_incref(metadata[i].get()));
+	}
+
+	DP_reset_image_build(
+		cs, 0, m_compatibilityMode, &HeadlessCanvas::pushResetImageMessage,
+		&params);
+
+	int metadataCount = metadata.size();
+	for(int i = prepended; i < metadataCount; ++i) {
+		appendResetImageMessage(params, DP_message_incref(metadata[i].get()));
+	}
+
+	if(params.ok) {
+		flushResetImageMessages(params);
+		QMetaObject::invokeMethod(
+			this,
+			[this, correlator, count = params.count] {
+				emit resetImageFinished(correlator, count);
+			},
+			Qt::QueuedConnection);
+	} else {
+		QMetaObject::invokeMethod(
+			this,
+			[this, correlator] {
+				emit resetImageFinished(correlator, 0);
+			},
+			Qt::QueuedConnection);
+	}
+}
+
+bool HeadlessCanvas::pushAclMessage(void *user, DP_Message *msg)
+{
+	static_cast<net::MessageList *>(user)->append(net::Message::noinc(msg));
+	return true;
+}
+
+void HeadlessCanvas::pushResetImageMessage(void *user, DP_Message *msg)
+{
+	ResetImageParams *params = static_cast<ResetImageParams *>(user);
+	params->hc->appendResetImageMessage(*params, msg);
+}
+
+void HeadlessCanvas::appendResetImageMessage(
+	ResetImageParams &params, DP_Message *msg)
+{
+	net::Message message = net::Message::noinc(msg);
+	if(params.ok) {
+		if(m_cancelled.loadAcquire()) {
+			params.ok = false;
+		} else {
+			++params.count;
+			params.batchSize += message.length();
+			params.batch.append(std::move(message));
+			if(params.batchSize >= RESET_IMAGE_BATCH_SIZE) {
+				flushResetImageMessages(params);
+			}
+		}
+	}
+}
+
+void HeadlessCanvas::flushResetImageMessages(ResetImageParams &params)
+{
+	if(!params.batch.isEmpty()) {
+		QMetaObject::invokeMethod(
+			this,
+			[this, correlator = params.correlator,
+			 msgs = std::move(params.batch)] {
+				emit resetImageMessagesGenerated(correlator, msgs);
+			},
+			Qt::QueuedConnection);
+		params.batch = net::MessageList();
+		params.batchSize = 0;
+	}
+}
+
+}
@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#ifndef LIBSERVER_HEADLESSCANVAS_H
+#define LIBSERVER_HEADLESSCANVAS_H
+#include "libshared/net/message.h"
+#include <QAtomicInt>
+#include <QMutex>
+#include <QObject>
+#include <QQueue>
+#include <QThreadPool>
+#include <functional>
+
+struct DP_AclState;
+struct DP_CanvasHistory;
+struct DP_CanvasState;
+struct DP_DrawContext;
+struct DP_Message;
+
+namespace server {
+
+/**
+ * @brief A canvas maintained by the server itself
+ *
+ * The session history is fed through a headless paint engine on a background
+ * thread, so that the server can generate its own reset images instead of
+ * relying on a client to have the bandwidth and inclination to do it.
+ *
+ * All public functions must be called from the thread this object lives in
+ * and the signals are emitted there too, the engine itself is only ever
+ * touched from the background thread.
+ */
+class HeadlessCanvas final : public QObject {
+	Q_OBJECT
+public:
+	explicit HeadlessCanvas(
+		long long historyPosition, bool compatibilityMode,
+		QObject *parent = nullptr);
+
+	~HeadlessCanvas() override;
+
+	/**
+	 * @brief Get the index of the last message handed to the engine
+	 *
+	 * The engine may still be busy handling messages up to this point.
+	 */
+	long long historyPosition() const { return m_historyPosition; }
+
+	void addToHistoryPosition(long long offset)
+	{
+		m_historyPosition += offset;
+	}
+
+	//! Is a batch of messages still being handled?
+	bool isBusy() const { return m_busy; }
+
+	/**
+	 * @brief Discard the canvas, e.g. because the session was hard reset
+	 *
+	 * @param historyPosition the index of the message before the new history.
+	 */
+	void reset(long long historyPosition);
+
+	/**
+	 * @brief Queue a batch of history messages to be handled
+	 *
+	 * messagesHandled() is emitted once they're done.
+	 *
+	 * @param lastIndex history index of the last message in the batch.
+	 */
+	void handleMessages(const net::MessageList &msgs, long long lastIndex);
+
+	/**
+	 * @brief Generate a reset image of the current canvas
+	 *
+	 * The canvas state is taken after all previously queued messages have been
+	 * handled. The image is built in the background and delivered in batches
+	 * via resetImageMessagesGenerated(), followed by resetImageFinished().
+	 * Message handling continues while the image is being built.
+	 */
+	void generateResetImage(const QString &correlator);
+
+signals:
+	void messagesHandled();
+	void resetImageMessagesGenerated(
+		const QString &correlator, const net::MessageList &msgs);
+	void resetImageFinished(const QString &correlator, int messageCount);
+
+private:
+	// Hand over reset image messages in batches of about this many bytes.
+	static constexpr size_t RESET_IMAGE_BATCH_SIZE = 1024 * 1024;
+
+	struct ResetImageParams;
+
+	void enqueue(std::function<void()> &&fn);
+	void drainQueue();
+
+	void resetEngine();
+	void handleMessage(const net::Message &msg);
+	void startResetImage(const QString &correlator);
+	void buildResetImage(
+		DP_CanvasState *cs, const net::MessageList &metadata, int prepended,
+		const QString &correlator);
+
+	static bool pushAclMessage(void *user, DP_Message *msg);
+	static void pushResetImageMessage(void *user, DP_Message *msg);
+	void appendResetImageMessage(ResetImageParams &params, DP_Message *msg);
+	void flushResetImageMessages(ResetImageParams &params);
+
+	const bool m_compatibilityMode;
+	long long m_historyPosition;
+	bool m_busy = false;
+
+	QThreadPool m_threadPool;
+	QMutex m_queueMutex;
+	QQueue<std::function<void()>> m_queue;
+	bool m_draining = false;
+	QAtomicInt m_cancelled;
+
+	// Only accessed from the background thread.
+	DP_CanvasHistory *m_ch;
+	DP_AclState *m_acls;
+	DP_DrawContext *m_dc;
+	QString m_pinnedMessage;
+	int m_defaultLayer = 0;
+};
+
+}
+
+#endif
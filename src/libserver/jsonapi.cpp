@@ -1,7 +1,9 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "libserver/jsonapi.h"
+#include "libserver/passwordcheck.h"
 
+#include <QHostAddress>
 #include <QJsonObject>
 
 namespace server {
@@ -16,6 +18,39 @@ JsonApiErrorResult(JsonApiResult::Status status, const QString &message)
 	return JsonApiResult{status, QJsonDocument(o)};
 }
 
+JsonApiResult
+JsonApiPasswordCheckResult(const QString &password, const QByteArray &hash)
+{
+	// A null password would look like the result isn't deferred.
+	QString deferredPassword = password.isNull() ? QStringLiteral("") : password;
+	return JsonApiResult{
+		JsonApiResult::Ok, QJsonDocument(), deferredPassword, hash};
+}
+
+void JsonApiResolveResult(
+	const JsonApiResult &result, const QHostAddress &address, QObject *context,
+	const std::function<void(const JsonApiResult &)> &callback)
+{
+	if(!result.isDeferred()) {
+		callback(result);
+		return;
+	}
+
+	bool started = PasswordCheck::start(
+		address, result.deferredPassword, result.deferredPasswordHash, context,
+		[callback](bool match) {
+			callback(JsonApiResult{
+				JsonApiResult::Ok,
+				QJsonDocument(QJsonObject{{"status", match}})});
+		});
+
+	if(!started) {
+		callback(JsonApiErrorResult(
+			JsonApiResult::TooManyRequests,
+			QStringLiteral("Too many password attempts, try again later")));
+	}
+}
+
 std::tuple<QString, QStringList> popApiPath(const QStringList &path)
 {
 	if(path.isEmpty())
@@ -3,11 +3,16 @@
 #ifndef DP_SERVER_JSONAPI_H
 #define DP_SERVER_JSONAPI_H
 
+#include <QByteArray>
 #include <QJsonDocument>
 #include <QStringList>
 #include <QMetaType>
+#include <functional>
 #include <tuple>
 
+class QHostAddress;
+class QObject;
+
 namespace server {
 
 enum class JsonApiMethod {
@@ -19,6 +24,10 @@ enum class JsonApiMethod {
 
 /**
  * @brief Result of a JSON API call
+ *
+ * Checking a password is too slow to do on the main thread, so calls that
+ * need one leave the password and its hash in the result instead. Callers
+ * must pass results through JsonApiResolveResult to get the final outcome.
  */
 struct JsonApiResult {
 	enum Status {
@@ -27,12 +36,17 @@ struct JsonApiResult {
 		Forbidden=403,
 		NotFound=404,
 		Conflict=409,
+		TooManyRequests=429,
 		InternalError=505,
 		ConnectionError=-1
 	};
 
 	Status status;
 	QJsonDocument body;
+	QString deferredPassword = QString();
+	QByteArray deferredPasswordHash = QByteArray();
+
+	bool isDeferred() const { return !deferredPassword.isNull(); }
 };
 
 //! A convenience function to generate a standard error message
@@ -40,6 +54,20 @@ JsonApiResult JsonApiErrorResult(JsonApiResult::Status status, const QString &me
 inline JsonApiResult JsonApiNotFound() { return JsonApiErrorResult(JsonApiResult::NotFound, QStringLiteral("Not found")); }
 inline JsonApiResult JsonApiBadMethod() { return JsonApiErrorResult(JsonApiResult::BadRequest, QStringLiteral("Unsupported method")); /* TODO: correct error type */ }
 
+//! A result whose body will be {"status": match} once the password is checked
+JsonApiResult JsonApiPasswordCheckResult(const QString &password, const QByteArray &hash);
+
+/**
+ * @brief Get the final outcome of a JSON API call
+ *
+ * Deferred password checks are handed to PasswordCheck, which limits how many
+ * can be pending for the given address. The callback is called on the context
+ * object's thread, right away if the result wasn't deferred.
+ */
+void JsonApiResolveResult(
+	const JsonApiResult &result, const QHostAddress &address, QObject *context,
+	const std::function<void(const JsonApiResult &)> &callback);
+
 //! A convenience function that returns the fist path element and the remaining path
 std::tuple<QString, QStringList> popApiPath(const QStringList &path);
 
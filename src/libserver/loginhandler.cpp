@@ -2,6 +2,7 @@
 #include "libserver/loginhandler.h"
 #include "cmake-config/config.h"
 #include "libserver/client.h"
+#include "libserver/passwordcheck.h"
 #include "libserver/serverconfig.h"
 #include "libserver/serverlog.h"
 #include "libserver/session.h"
@@ -12,6 +13,7 @@
 #include "libshared/util/validators.h"
 #include <QNetworkReply>
 #include <QNetworkRequest>
+#include <QPointer>
 #include <QRegularExpression>
 #include <QStringList>
 #include <utility>
@@ -120,7 +122,8 @@ void LoginHandler::startLoginProcess()
 #endif
 	flags << QStringLiteral("MBANIMPEX") // Moderators can always export bans.
 		  << QStringLiteral("LOOKUP")	 // This server supports lookups.
-		  << QStringLiteral("CINFO");	 // Supports client info messages.
+		  << QStringLiteral("CINFO")	 // Supports client info messages.
+		  << QStringLiteral("INTEREST"); // Supports the interest command.
 
 	QJsonObject methods;
 	bool allowGuestHosts =
@@ -316,6 +319,17 @@ void LoginHandler::handleLoginMessage(const net::Message &msg)
 			m_client->disconnectClient(
 				Client::DisconnectionReason::Error, "invalid message", cmd.cmd);
 		}
+	} else if(m_state == State::WaitForPassword) {
+		// The client must wait for the result of the password check.
+		m_client->log(
+			Log()
+				.about(Log::Level::Error, Log::Topic::RuleBreak)
+				.message(
+					"Login command while waiting for password check: " +
+					cmd.cmd));
+		m_state = State::Ignore;
+		m_client->disconnectClient(
+			Client::DisconnectionReason::Error, "invalid message", cmd.cmd);
 	} else {
 		if(cmd.cmd == "host") {
 			handleHostMessage(cmd);
@@ -539,8 +553,7 @@ void LoginHandler::handleIdentMessage(const net::ServerCommand &cmd)
 		return;
 	}
 
-	const RegisteredUser userAccount =
-		m_config->getUserAccount(username, password);
+	RegisteredUser userAccount = m_config->lookupUserAccount(username);
 	if(userAccount.status != RegisteredUser::NotFound) {
 		if(cmd.kwargs.contains("extauth")) {
 			// This should never happen. If it does, it means there's a bug in
@@ -561,6 +574,26 @@ void LoginHandler::handleIdentMessage(const net::ServerCommand &cmd)
 			QByteArray::fromBase64(cmd.kwargs["avatar"].toString().toUtf8()));
 	}
 
+	if(userAccount.status == RegisteredUser::Ok) {
+		checkPassword(
+			password, userAccount.passwordHash,
+			[this, cmd, username, password, intent,
+			 userAccount](bool match) mutable {
+				if(!match) {
+					userAccount.status = RegisteredUser::BadPass;
+				}
+				finishIdent(cmd, username, password, intent, userAccount);
+			});
+	} else {
+		finishIdent(cmd, username, password, intent, userAccount);
+	}
+}
+
+void LoginHandler::finishIdent(
+	const net::ServerCommand &cmd, const QString &username,
+	const QString &password, IdentIntent intent,
+	const RegisteredUser &userAccount)
+{
 	switch(userAccount.status) {
 	case RegisteredUser::NotFound: {
 		// Account not found in internal user list. Allow guest login (if
@@ -1227,54 +1260,92 @@ void LoginHandler::handleJoinMessage(const net::ServerCommand &cmd)
 		return;
 	}
 
-	if(!m_client->isModerator()) {
-		// Non-moderators have to obey access restrictions
-		int banId = history->banlist().isBanned(
-			m_client->username(), m_client->peerAddress(), m_client->authId(),
-			m_client->sid());
-		if(banId != 0) {
-			session->log(
-				Log()
-					.about(Log::Level::Info, Log::Topic::Ban)
-					.user(
-						m_client->id(), m_client->peerAddress(),
-						m_client->username())
-					.message(
-						QStringLiteral("Join prevented by ban %1").arg(banId)));
-			sendError(
-				"banned", QStringLiteral(
-							  "You have been banned from this session (ban %1)")
-							  .arg(banId));
-			return;
-		}
-		if(!invite && session->isClosed()) {
-			sendError("closed", "This session is closed");
-			return;
-		}
-		if(!invite && history->hasFlag(SessionHistory::AuthOnly) &&
-		   !m_client->isAuthenticated()) {
-			sendError("authOnly", "This session does not allow guest logins");
-			return;
-		}
+	if(!checkSessionAccess(session, invite != nullptr)) {
+		return;
+	}
 
-		if(!invite && !history->checkPassword(password)) {
-			++m_sessionPasswordAttempts;
-			m_client->log(
-				Log()
-					.about(Log::Level::Warn, Log::Topic::RuleBreak)
-					.message(
-						QStringLiteral(
-							"Incorrect password for session %1 (attempt %2/%3)")
-							.arg(session->id())
-							.arg(m_sessionPasswordAttempts)
-							.arg(MAX_PASSWORD_ATTEMPTS)));
-			sendError(
-				"badPassword", "Incorrect password",
-				m_sessionPasswordAttempts >= MAX_PASSWORD_ATTEMPTS);
-			return;
-		}
+	if(!invite && !m_client->isModerator()) {
+		QPointer<Session> sessionPointer = session;
+		QByteArray passwordHash = history->passwordHash();
+		checkPassword(
+			password, passwordHash,
+			[this, sessionPointer, passwordHash, cmd](bool match) {
+				// The session may have changed while the password was being
+				// checked, so its restrictions have to be checked again.
+				if(!sessionPointer) {
+					sendError("notFound", "Session not found!");
+				} else if(!checkSessionAccess(sessionPointer, false)) {
+					// Error was already sent.
+				} else if(
+					sessionPointer->history()->passwordHash() !=
+					passwordHash) {
+					sendError(
+						"badPassword",
+						"Session password changed, please try again");
+				} else if(match) {
+					joinSession(sessionPointer, nullptr, cmd);
+				} else {
+					++m_sessionPasswordAttempts;
+					m_client->log(
+						Log()
+							.about(Log::Level::Warn, Log::Topic::RuleBreak)
+							.message(QStringLiteral(
+										 "Incorrect password for session "
+										 "%1 (attempt %2/%3)")
+										 .arg(sessionPointer->id())
+										 .arg(m_sessionPasswordAttempts)
+										 .arg(MAX_PASSWORD_ATTEMPTS)));
+					sendError(
+						"badPassword", "Incorrect password",
+						m_sessionPasswordAttempts >= MAX_PASSWORD_ATTEMPTS);
+				}
+			});
+		return;
+	}
+
+	joinSession(session, invite, cmd);
+}
+
+bool LoginHandler::checkSessionAccess(Session *session, bool invited)
+{
+	if(m_client->isModerator()) {
+		return true;
+	}
+
+	// Non-moderators have to obey access restrictions
+	SessionHistory *history = session->history();
+	int banId = history->banlist().isBanned(
+		m_client->username(), m_client->peerAddress(), m_client->authId(),
+		m_client->sid());
+	if(banId != 0) {
+		session->log(
+			Log()
+				.about(Log::Level::Info, Log::Topic::Ban)
+				.user(
+					m_client->id(), m_client->peerAddress(),
+					m_client->username())
+				.message(QStringLiteral("Join prevented by ban %1").arg(banId)));
+		sendError(
+			"banned",
+			QStringLiteral("You have been banned from this session (ban %1)")
+				.arg(banId));
+		return false;
+	}
+	if(!invited && session->isClosed()) {
+		sendError("closed", "This session is closed");
+		return false;
+	}
+	if(!invited && history->hasFlag(SessionHistory::AuthOnly) &&
+	   !m_client->isAuthenticated()) {
+		sendError("authOnly", "This session does not allow guest logins");
+		return false;
 	}
+	return true;
+}
 
+void LoginHandler::joinSession(
+	Session *session, Invite *invite, const net::ServerCommand &cmd)
+{
 	Client *existingClient = session->getClientByUsername(m_client->username());
 	if(existingClient) {
 		bool shouldReplace =
@@ -1441,6 +1512,41 @@ bool LoginHandler::send(const net::Message &msg)
 	return true;
 }
 
+void LoginHandler::checkPassword(
+	const QString &password, const QByteArray &hash,
+	const std::function<void(bool)> &callback)
+{
+	// Hashing an empty password gives an empty hash, so there's nothing
+	// expensive to do if either of them is empty.
+	if(password.isEmpty() || hash.isEmpty()) {
+		callback(password.isEmpty() && hash.isEmpty());
+		return;
+	}
+
+	State previousState = m_state;
+	m_state = State::WaitForPassword;
+	bool started = PasswordCheck::start(
+		m_client->peerAddress(), password, hash, this,
+		[this, previousState, callback](bool match) {
+			// If the client misbehaved in the meantime, it's getting
+			// disconnected and the result doesn't matter anymore.
+			if(m_state == State::WaitForPassword) {
+				m_state = previousState;
+				callback(match);
+			}
+		});
+
+	if(!started) {
+		m_client->log(Log()
+						  .about(Log::Level::Warn, Log::Topic::RuleBreak)
+						  .message(QStringLiteral(
+							  "Too many password checks in progress")));
+		sendError(
+			QStringLiteral("loginBusy"),
+			QStringLiteral("Too many login attempts, try again later"));
+	}
+}
+
 void LoginHandler::sendError(
 	const QString &code, const QString &message, bool disconnect)
 {
@@ -8,6 +8,7 @@
 #include <QObject>
 #include <QSet>
 #include <QStringList>
+#include <functional>
 
 namespace net {
 struct ServerCommand;
@@ -18,6 +19,8 @@ namespace server {
 
 class Client;
 class Session;
+struct Invite;
+struct RegisteredUser;
 class Sessions;
 class ServerConfig;
 
@@ -88,6 +91,7 @@ private:
 		WaitForLookup,
 		WaitForIdent,
 		WaitForLogin,
+		WaitForPassword,
 		Ignore,
 	};
 	enum class IdentIntent { Invalid, Unknown, Guest, Auth, ExtAuth };
@@ -100,8 +104,15 @@ private:
 	void handleClientInfoMessage(const net::ServerCommand &cmd);
 	void handleLookupMessage(const net::ServerCommand &cmd);
 	void handleIdentMessage(const net::ServerCommand &cmd);
+	void finishIdent(
+		const net::ServerCommand &cmd, const QString &username,
+		const QString &password, IdentIntent intent,
+		const RegisteredUser &userAccount);
 	void handleHostMessage(const net::ServerCommand &cmd);
 	void handleJoinMessage(const net::ServerCommand &cmd);
+	bool checkSessionAccess(Session *session, bool invited);
+	void joinSession(
+		Session *session, Invite *invite, const net::ServerCommand &cmd);
 	void checkClientCapabilities(const net::ServerCommand &cmd);
 	QJsonObject
 	extractClientInfo(const QJsonObject &o, bool checkAuthenticated);
@@ -118,6 +129,9 @@ private:
 		const QStringList &flags, const QByteArray &avatar, bool allowMod,
 		bool allowHost, bool allowGhost, bool allowBanExempt, bool allowWeb,
 		bool allowWebHost, bool allowWebSession, bool allowPersist);
+	void checkPassword(
+		const QString &password, const QByteArray &hash,
+		const std::function<void(bool)> &callback);
 	bool send(const net::Message &msg);
 	void sendError(
 		const QString &code, const QString &message, bool disconnect = true);
@@ -0,0 +1,159 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include "libserver/metrics.h"
+#include <QLocale>
+#include <cmath>
+
+namespace server {
+
+namespace {
+
+QByteArray formatValue(double value)
+{
+	if(std::isnan(value)) {
+		return QByteArrayLiteral("NaN");
+	} else if(std::isinf(value)) {
+		return value < 0.0 ? QByteArrayLiteral("-Inf")
+						   : QByteArrayLiteral("+Inf");
+	} else {
+		return QString::number(value, 'g', QLocale::FloatingPointShortest)
+			.toLatin1();
+	}
+}
+
+QByteArray escapeLabelValue(const QString &value)
+{
+	QByteArray utf8 = value.toUtf8();
+	QByteArray escaped;
+	escaped.reserve(utf8.size());
+	for(char c : utf8) {
+		switch(c) {
+		case '\\':
+			escaped.append("\\\\");
+			break;
+		case '"':
+			escaped.append("\\\"");
+			break;
+		case '\n':
+			escaped.append("\\n");
+			break;
+		default:
+			escaped.append(c);
+			break;
+		}
+	}
+	return escaped;
+}
+
+}
+
+MetricsHistogram::MetricsHistogram(std::initializer_list<double> bounds)
+	: m_bounds(bounds)
+	, m_counts(m_bounds.size() + 1, quint64(0))
+{
+}
+
+void MetricsHistogram::observe(double value)
+{
+	int bucketCount = m_bounds.size();
+	int i = 0;
+	while(i < bucketCount && value > m_bounds[i]) {
+		++i;
+	}
+	++m_counts[i];
+	m_sum += value;
+	++m_count;
+}
+
+void MetricsWriter::counter(
+	const char *name, const char *help, const MetricLabels &labels,
+	double value)
+{
+	appendSample(family(name, "counter", help), name, labels, value);
+}
+
+void MetricsWriter::gauge(
+	const char *name, const char *help, const MetricLabels &labels,
+	double value)
+{
+	appendSample(family(name, "gauge", help), name, labels, value);
+}
+
+void MetricsWriter::histogram(
+	const char *name, const char *help, const MetricLabels &labels,
+	const MetricsHistogram &histogram)
+{
+	QByteArray &text = family(name, "histogram", help);
+	QByteArray bucketName = QByteArray(name) + QByteArrayLiteral("_bucket");
+	MetricLabels bucketLabels = labels;
+	bucketLabels.append({QByteArrayLiteral("le"), QString()});
+
+	const QVector<double> &bounds = histogram.bounds();
+	const QVector<quint64> &counts = histogram.counts();
+	quint64 cumulative = 0;
+	for(int i = 0, count = counts.size(); i < count; ++i) {
+		cumulative += counts[i];
+		bucketLabels.last().second = QString::fromUtf8(
+			i < bounds.size() ? formatValue(bounds[i])
+							  : QByteArrayLiteral("+Inf"));
+		appendSample(text, bucketName, bucketLabels, double(cumulative));
+	}
+
+	appendSample(
+		text, QByteArray(name) + QByteArrayLiteral("_sum"), labels,
+		histogram.sum());
+	appendSample(
+		text, QByteArray(name) + QByteArrayLiteral("_count"), labels,
+		double(histogram.count()));
+}
+
+QByteArray MetricsWriter::toText() const
+{
+	QByteArray text;
+	for(const Family &f : m_families) {
+		text.append(f.text);
+	}
+	return text;
+}
+
+QByteArray &
+MetricsWriter::family(const char *name, const char *type, const char *help)
+{
+	for(Family &f : m_families) {
+		if(f.name == name) {
+			return f.text;
+		}
+	}
+	QByteArray text = QByteArrayLiteral("# HELP ") + name + ' ' + help +
+					  QByteArrayLiteral("\n# TYPE ") + name + ' ' + type +
+					  '\n';
+	m_families.append({QByteArray(name), text});
+	return m_families.last().text;
+}
+
+void MetricsWriter::appendSample(
+	QByteArray &text, const QByteArray &name, const MetricLabels &labels,
+	double value)
+{
+	text.append(name);
+	if(!labels.isEmpty()) {
+		text.append('{');
+		bool first = true;
+		for(const QPair<QByteArray, QString> &label : labels) {
+			if(first) {
+				first = false;
+			} else {
+				text.append(',');
+			}
+			text.append(label.first);
+			text.append("=\"");
+			text.append(escapeLabelValue(label.second));
+			text.append('"');
+		}
+		text.append('}');
+	}
+	text.append(' ');
+	text.append(formatValue(value));
+	text.append('\n');
+}
+
+}
@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#ifndef DP_SERVER_METRICS_H
+#define DP_SERVER_METRICS_H
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QPair>
+#include <QString>
+#include <QVector>
+#include <initializer_list>
+
+namespace server {
+
+typedef QVector<QPair<QByteArray, QString>> MetricLabels;
+
+/**
+ * @brief A histogram with fixed bucket bounds, as Prometheus understands it
+ *
+ * Observing a value only walks over a handful of bounds, so it's cheap
+ * enough to do for every message.
+ */
+class MetricsHistogram {
+public:
+	explicit MetricsHistogram(std::initializer_list<double> bounds);
+
+	void observe(double value);
+
+	const QVector<double> &bounds() const { return m_bounds; }
+
+	//! Count of values in each bucket, the last one is for values beyond all
+	//! bounds. These are not cumulative.
+	const QVector<quint64> &counts() const { return m_counts; }
+
+	double sum() const { return m_sum; }
+	quint64 count() const { return m_count; }
+
+private:
+	QVector<double> m_bounds;
+	QVector<quint64> m_counts;
+	double m_sum = 0.0;
+	quint64 m_count = 0;
+};
+
+/**
+ * @brief Adds the time spent in a scope to a nanosecond counter
+ */
+class MetricsScopedTimer {
+public:
+	explicit MetricsScopedTimer(qint64 &nsecs)
+		: m_nsecs(nsecs)
+	{
+		m_timer.start();
+	}
+
+	~MetricsScopedTimer() { m_nsecs += m_timer.nsecsElapsed(); }
+
+	MetricsScopedTimer(const MetricsScopedTimer &) = delete;
+	MetricsScopedTimer &operator=(const MetricsScopedTimer &) = delete;
+
+private:
+	qint64 &m_nsecs;
+	QElapsedTimer m_timer;
+};
+
+/**
+ * @brief Collects metrics into the Prometheus text exposition format
+ *
+ * Samples can be added in any order, they get grouped by metric name.
+ */
+class MetricsWriter {
+public:
+	void counter(
+		const char *name, const char *help, const MetricLabels &labels,
+		double value);
+
+	void gauge(
+		const char *name, const char *help, const MetricLabels &labels,
+		double value);
+
+	void histogram(
+		const char *name, const char *help, const MetricLabels &labels,
+		const MetricsHistogram &histogram);
+
+	QByteArray toText() const;
+
+	static constexpr char CONTENT_TYPE[] = "text/plain; version=0.0.4";
+
+private:
+	struct Family {
+		QByteArray name;
+		QByteArray text;
+	};
+
+	QByteArray &family(const char *name, const char *type, const char *help);
+
+	static void appendSample(
+		QByteArray &text, const QByteArray &name, const MetricLabels &labels,
+		double value);
+
+	QVector<Family> m_families;
+};
+
+struct ClientMetrics {
+	quint64 messagesReceived = 0;
+	quint64 bytesReceived = 0;
+	quint64 bytesSent = 0;
+};
+
+/**
+ * @brief Running totals for a session
+ *
+ * Traffic of clients is added here too, so that it still counts after they
+ * leave the session.
+ */
+struct SessionMetrics {
+	quint64 messagesReceived = 0;
+	quint64 bytesReceived = 0;
+	quint64 bytesSent = 0;
+	quint64 bytesFiltered = 0;
+	qint64 handleNsecs = 0;
+	MetricsHistogram catchupSeconds{
+		0.1, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, 60.0, 120.0, 300.0};
+};
+
+}
+
+#endif
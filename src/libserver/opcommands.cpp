@@ -1,11 +1,11 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #include "libserver/opcommands.h"
 #include "libserver/client.h"
+#include "libserver/passwordcheck.h"
 #include "libserver/serverconfig.h"
 #include "libserver/serverlog.h"
 #include "libserver/session.h"
 #include "libshared/net/servercmd.h"
-#include "libshared/util/passwordhash.h"
 #include <QJsonArray>
 #include <QList>
 #include <QRegularExpression>
@@ -37,6 +37,13 @@ public:
 		return CmdResult(false, QString(), std::forward<net::Message>(reply));
 	}
 
+	// The command finishes asynchronously and reports its own result later
+	// through sendCmdResult.
+	static CmdResult pending()
+	{
+		return CmdResult(true, QString(), net::Message::null());
+	}
+
 	bool success() const { return m_success; }
 
 	net::Message getReply(const QString &command) const
@@ -61,6 +68,14 @@ private:
 	net::Message m_reply;
 };
 
+void sendCmdResult(
+	Client *client, const QString &command, const CmdResult &result)
+{
+	if(!result.success()) {
+		client->sendDirectMessage(result.getReply(command));
+	}
+}
+
 typedef CmdResult (*SrvCommandFn)(
 	Client *, const QJsonArray &, const QJsonObject &);
 
@@ -195,6 +210,24 @@ sessionConf(Client *client, const QJsonArray &args, const QJsonObject &kwargs)
 	return CmdResult::ok();
 }
 
+CmdResult
+opWordChecked(Client *client, const QByteArray &opwordHash, bool match)
+{
+	// The client may have left or the opword may have changed while the
+	// password was being checked.
+	Session *session = client->session();
+	if(!session) {
+		return CmdResult::err("Session not found");
+	} else if(session->history()->opwordHash() != opwordHash) {
+		return CmdResult::err("Opword changed, try again");
+	} else if(match) {
+		session->changeOpStatus(client->id(), true, "password");
+		return CmdResult::ok();
+	} else {
+		return CmdResult::err("Incorrect password");
+	}
+}
+
 CmdResult
 opWord(Client *client, const QJsonArray &args, const QJsonObject &kwargs)
 {
@@ -206,12 +239,18 @@ opWord(Client *client, const QJsonArray &args, const QJsonObject &kwargs)
 	if(opwordHash.isEmpty())
 		return CmdResult::err("No opword set");
 
-	if(passwordhash::check(args.at(0).toString(), opwordHash)) {
-		client->session()->changeOpStatus(client->id(), true, "password");
-		return CmdResult::ok();
+	bool started = PasswordCheck::start(
+		client->peerAddress(), args.at(0).toString(), opwordHash, client,
+		[client, opwordHash](bool match) {
+			sendCmdResult(
+				client, QStringLiteral("gain-op"),
+				opWordChecked(client, opwordHash, match));
+		});
 
+	if(started) {
+		return CmdResult::pending();
 	} else {
-		return CmdResult::err("Incorrect password");
+		return CmdResult::err("Too many password attempts, try again later");
 	}
 }
 
@@ -942,6 +981,42 @@ removeInvite(Client *client, const QJsonArray &args, const QJsonObject &kwargs)
 	return CmdResult::ok();
 }
 
+CmdResult
+setInterest(Client *client, const QJsonArray &args, const QJsonObject &kwargs)
+{
+	Q_UNUSED(args);
+	EphemeralFilter &filter = client->ephemeralFilter();
+
+	if(kwargs.contains(QStringLiteral("ephemeral"))) {
+		EphemeralFilter::Interests interests = EphemeralFilter::Interest::None;
+		for(const QJsonValue &value :
+			kwargs[QStringLiteral("ephemeral")].toArray()) {
+			if(value == QStringLiteral("cursors")) {
+				interests.setFlag(EphemeralFilter::Interest::Cursors);
+			} else if(value == QStringLiteral("lasers")) {
+				interests.setFlag(EphemeralFilter::Interest::Lasers);
+			}
+		}
+		filter.setInterests(interests);
+	}
+
+	if(kwargs.contains(QStringLiteral("viewport"))) {
+		QJsonArray viewport = kwargs[QStringLiteral("viewport")].toArray();
+		if(viewport.isEmpty()) {
+			filter.setViewport(QRect());
+		} else if(viewport.size() == 4) {
+			filter.setViewport(QRect(
+				viewport[0].toInt(), viewport[1].toInt(), viewport[2].toInt(),
+				viewport[3].toInt()));
+		} else {
+			return CmdResult::err(
+				QStringLiteral("Viewport expected four values: x, y, w, h"));
+		}
+	}
+
+	return CmdResult::ok();
+}
+
 SrvCommandSet::SrvCommandSet()
 {
 	commands << SrvCommand("ready-to-autoreset", readyToAutoReset)
@@ -965,7 +1040,8 @@ SrvCommandSet::SrvCommandSet()
 			 << SrvCommand("stream-reset-abort", streamResetAbort)
 			 << SrvCommand("stream-reset-finish", streamResetFinish)
 			 << SrvCommand("invite-create", createInvite)
-			 << SrvCommand("invite-remove", removeInvite);
+			 << SrvCommand("invite-remove", removeInvite)
+			 << SrvCommand("interest", setInterest, SrvCommand::NONOP);
 }
 
 } // end of anonymous namespace
@@ -993,10 +1069,7 @@ void handleClientServerCommand(
 				return;
 			}
 
-			CmdResult result = c.call(client, args, kwargs);
-			if(!result.success()) {
-				client->sendDirectMessage(result.getReply(command));
-			}
+			sendCmdResult(client, command, c.call(client, args, kwargs));
 			return;
 		}
 	}
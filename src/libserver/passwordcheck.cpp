@@ -0,0 +1,92 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include "libserver/passwordcheck.h"
+#include "libshared/util/passwordhash.h"
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadPool>
+
+namespace server {
+
+namespace {
+
+struct PendingChecks {
+	QMutex mutex;
+	QHash<QHostAddress, int> byAddress;
+	int total = 0;
+};
+
+PendingChecks &pendingChecks()
+{
+	static PendingChecks pending;
+	return pending;
+}
+
+QThreadPool *passwordCheckPool()
+{
+	// Kept apart from the global pool so that hashing can't crowd out other
+	// background work, and limited to a few threads so that it can't take
+	// over the whole machine either.
+	static QThreadPool *pool = [] {
+		QThreadPool *tp = new QThreadPool;
+		tp->setMaxThreadCount(qBound(1, QThread::idealThreadCount() / 2, 4));
+		return tp;
+	}();
+	return pool;
+}
+
+}
+
+bool PasswordCheck::start(
+	const QHostAddress &address, const QString &password,
+	const QByteArray &hash, QObject *context,
+	const std::function<void(bool)> &callback)
+{
+	{
+		PendingChecks &pending = pendingChecks();
+		QMutexLocker locker(&pending.mutex);
+		int count = pending.byAddress.value(address);
+		if(pending.total >= MAX_PENDING || count >= MAX_PENDING_PER_ADDRESS) {
+			return false;
+		}
+		pending.byAddress.insert(address, count + 1);
+		++pending.total;
+	}
+
+	PasswordCheck *check = new PasswordCheck(address, password, hash);
+	connect(
+		check, &PasswordCheck::finished, context, callback,
+		Qt::QueuedConnection);
+	passwordCheckPool()->start(check);
+	return true;
+}
+
+void PasswordCheck::run()
+{
+	bool match = passwordhash::check(m_password, m_hash);
+
+	{
+		PendingChecks &pending = pendingChecks();
+		QMutexLocker locker(&pending.mutex);
+		QHash<QHostAddress, int>::iterator it =
+			pending.byAddress.find(m_address);
+		if(it != pending.byAddress.end() && --it.value() <= 0) {
+			pending.byAddress.erase(it);
+		}
+		--pending.total;
+	}
+
+	emit finished(match);
+}
+
+PasswordCheck::PasswordCheck(
+	const QHostAddress &address, const QString &password,
+	const QByteArray &hash)
+	: m_address(address)
+	, m_password(password)
+	, m_hash(hash)
+{
+}
+
+}
@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#ifndef DP_SERVER_PASSWORDCHECK_H
+#define DP_SERVER_PASSWORDCHECK_H
+#include <QByteArray>
+#include <QHostAddress>
+#include <QObject>
+#include <QRunnable>
+#include <QString>
+#include <functional>
+
+namespace server {
+
+/**
+ * @brief Checks a password against its hash on a background thread
+ *
+ * Password hashes are slow to verify on purpose, doing that on the main
+ * thread would stall every session on the server for the duration. Checks
+ * run on a small dedicated thread pool instead. The number of checks that
+ * can be pending at once is limited, both in total and per address, so that
+ * a flood of login attempts gets turned away rather than piling up.
+ */
+class PasswordCheck final : public QObject, public QRunnable {
+	Q_OBJECT
+public:
+	static constexpr int MAX_PENDING = 64;
+	static constexpr int MAX_PENDING_PER_ADDRESS = 2;
+
+	/**
+	 * @brief Start checking a password
+	 *
+	 * The callback is called on the context object's thread with whether the
+	 * password matched. It isn't called if the context is gone by then.
+	 *
+	 * @return false if too many checks are pending already, in which case
+	 * the callback will never be called
+	 */
+	static bool start(
+		const QHostAddress &address, const QString &password,
+		const QByteArray &hash, QObject *context,
+		const std::function<void(bool)> &callback);
+
+	void run() override;
+
+signals:
+	void finished(bool match);
+
+private:
+	PasswordCheck(
+		const QHostAddress &address, const QString &password,
+		const QByteArray &hash);
+
+	const QHostAddress m_address;
+	const QString m_password;
+	const QByteArray m_hash;
+};
+
+}
+
+#endif
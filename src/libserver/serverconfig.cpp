@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #include "libserver/serverconfig.h"
 #include "libserver/serverlog.h"
+#include "libshared/util/passwordhash.h"
 #include <QJsonObject>
 #include <QRegularExpression>
 
@@ -215,9 +216,21 @@ BanResult ServerConfig::isUserBanned(long long userId) const
 RegisteredUser ServerConfig::getUserAccount(
 	const QString &username, const QString &password) const
 {
-	Q_UNUSED(password);
+	RegisteredUser user = lookupUserAccount(username);
+	if(user.status == RegisteredUser::Ok &&
+	   !passwordhash::check(password, user.passwordHash)) {
+		return RegisteredUser{
+			RegisteredUser::BadPass, user.username, QStringList(), user.userId,
+			QByteArray()};
+	}
+	return user;
+}
+
+RegisteredUser ServerConfig::lookupUserAccount(const QString &username) const
+{
 	return RegisteredUser{
-		RegisteredUser::NotFound, username, QStringList(), nullptr};
+		RegisteredUser::NotFound, username, QStringList(), QString(),
+		QByteArray()};
 }
 
 bool ServerConfig::hasAnyUserAccounts() const
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #ifndef LIBSERVER_SERVERCONFIG_H
 #define LIBSERVER_SERVERCONFIG_H
+#include <QByteArray>
 #include <QDateTime>
 #include <QHash>
 #include <QHostAddress>
@@ -171,7 +172,15 @@ static const ConfigKey
 	// What sessions to set the Unlisted session history flag on when they are
 	// hosted. "WEB" will set it on sessions, hosted via web browser, "ALL" will
 	// set it on all sessions, any other value sets it on no session.
-	UnlistedHostPolicy(53, "unlistedHostPolicy", "", ConfigKey::STRING);
+	UnlistedHostPolicy(53, "unlistedHostPolicy", "", ConfigKey::STRING),
+	// Keep a headless canvas for each session and generate autoreset images
+	// on the server instead of asking a client to do it. Costs memory and CPU
+	// time, but joining users get a compact snapshot.
+	ServerSideReset(54, "serverSideReset", "false", ConfigKey::BOOL),
+	// When a client's upload queue grows beyond this size, pointer movements
+	// that have been superseded by a newer one from the same user are dropped
+	// instead of being sent. Zero disables this.
+	TransientWatermark(55, "transientWatermark", "256kb", ConfigKey::SIZE);
 }
 
 //! Settings that are not adjustable after the server has started
@@ -221,6 +230,7 @@ struct RegisteredUser {
 	QString username;
 	QStringList flags;
 	QString userId;
+	QByteArray passwordHash;
 };
 
 enum class BanReaction {
@@ -337,11 +347,22 @@ public:
 	/**
 	 * @brief See if there is a registered user with the given credentials
 	 *
-	 * The default implementation always returns NotFound
+	 * This checks the password right away, which is slow. The login process
+	 * uses lookupUserAccount and checks the password on a background thread.
 	 */
-	virtual RegisteredUser
+	RegisteredUser
 	getUserAccount(const QString &username, const QString &password) const;
 
+	/**
+	 * @brief Look up a registered user without checking their password
+	 *
+	 * A status of Ok means that the user exists and isn't banned, it's up to
+	 * the caller to check the password against the returned hash.
+	 *
+	 * The default implementation always returns NotFound
+	 */
+	virtual RegisteredUser lookupUserAccount(const QString &username) const;
+
 	virtual bool hasAnyUserAccounts() const;
 
 	virtual bool supportsAdminSectionLocks() const;
@@ -456,8 +477,7 @@ private:
 // https://gcc.gnu.org/bugzilla/show_bug.cgi?id=69210
 namespace diagnostic_marker_private {
 class [[maybe_unused]] AbstractServerConfigMarker : ServerConfig {
-	inline RegisteredUser
-	getUserAccount(const QString &, const QString &) const override
+	inline RegisteredUser lookupUserAccount(const QString &) const override
 	{
 		return RegisteredUser();
 	}
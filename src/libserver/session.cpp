@@ -12,7 +12,6 @@ extern "C" {
 #include "libshared/net/servercmd.h"
 #include "libshared/util/filename.h"
 #include "libshared/util/networkaccess.h"
-#include "libshared/util/passwordhash.h"
 #include "libshared/util/qtcompat.h"
 #include <QNetworkReply>
 #include <QNetworkRequest>
@@ -1382,6 +1381,9 @@ void Session::sendUpdatedInviteList()
 
 void Session::handleClientMessage(Client &client, const net::Message &msg)
 {
+	++m_metrics.messagesReceived;
+	MetricsScopedTimer timer(m_metrics.handleNsecs);
+
 	// Filter away server-to-client-only messages
 	switch(msg.type()) {
 	case DP_MSG_JOIN:
@@ -1721,7 +1723,9 @@ void Session::killSession(const QString &message, bool terminate, bool quiet)
 void Session::directToAll(const net::Message &msg)
 {
 	for(Client *c : m_clients) {
-		c->sendDirectMessage(msg);
+		if(c->acceptsEphemeralMessage(msg)) {
+			c->sendDirectMessage(msg);
+		}
 	}
 }
 
@@ -2386,11 +2390,8 @@ JsonApiResult Session::callAuthJsonApi(
 
 		if(head == "op") {
 			if(request.contains("password")) {
-				bool status = passwordhash::check(
+				return JsonApiPasswordCheckResult(
 					request["password"].toString(), m_history->opwordHash());
-				return JsonApiResult{
-					JsonApiResult::Ok,
-					QJsonDocument(QJsonObject{{"status", status}})};
 			}
 		}
 
@@ -2398,9 +2399,8 @@ JsonApiResult Session::callAuthJsonApi(
 	}
 
 	if(request.contains("password")) {
-		bool status = m_history->checkPassword(request["password"].toString());
-		return JsonApiResult{
-			JsonApiResult::Ok, QJsonDocument(QJsonObject{{"status", status}})};
+		return JsonApiPasswordCheckResult(
+			request["password"].toString(), m_history->passwordHash());
 	}
 
 	return JsonApiNotFound();
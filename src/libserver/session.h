@@ -3,6 +3,7 @@
 #define LIBSHARED_SERVER_SESSION_H
 #include "libserver/announcable.h"
 #include "libserver/jsonapi.h"
+#include "libserver/metrics.h"
 #include "libserver/sessionhistory.h"
 #include "libshared/net/message.h"
 #include <QDateTime>
@@ -221,6 +222,10 @@ public:
 	const SessionHistory *history() const { return m_history; }
 	SessionHistory *history() { return m_history; }
 
+	//! Running totals of traffic and processing time, for the metrics export
+	const SessionMetrics &metrics() const { return m_metrics; }
+	SessionMetrics &metrics() { return m_metrics; }
+
 	/**
 	 * @brief Process a message received from a client
 	 * @param client
@@ -562,6 +567,7 @@ private:
 	uint m_resetstreamsize = 0;
 
 	QElapsedTimer m_lastEventTime;
+	SessionMetrics m_metrics;
 
 	bool m_closed = false;
 };
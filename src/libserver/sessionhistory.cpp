@@ -6,6 +6,7 @@ extern "C" {
 #include "libserver/sessionhistory.h"
 #include "libshared/net/servercmd.h"
 #include "libshared/util/ulid.h"
+#include <QElapsedTimer>
 #include <QJsonObject>
 
 namespace server {
@@ -159,8 +160,12 @@ bool SessionHistory::addEmergencyMessage(const net::Message &msg)
 void SessionHistory::addMessageInternal(const net::Message &msg, size_t bytes)
 {
 	m_sizeInBytes += bytes;
+	m_bytesAdded += bytes;
 	++m_lastIndex;
+	QElapsedTimer timer;
+	timer.start();
 	historyAdd(msg);
+	m_storeSeconds.observe(double(timer.nsecsElapsed()) / 1e9);
 }
 
 bool SessionHistory::reset(const net::MessageList &newHistory)
@@ -289,6 +294,27 @@ SessionHistory::addStreamResetMessage(uint8_t ctxId, const net::Message &msg)
 	return StreamResetAddResult::Ok;
 }
 
+StreamResetAddResult
+SessionHistory::addServerStreamResetMessage(const net::Message &msg)
+{
+	if(m_resetStreamState != ResetStreamState::Streaming) {
+		return StreamResetAddResult::NotActive;
+	}
+
+	if(m_resetStreamCtxId != 0) {
+		return StreamResetAddResult::InvalidUser;
+	}
+
+	net::Message message = msg;
+	m_resetStreamAddError = StreamResetAddResult::ConsumerError;
+	if(receiveResetStreamMessage(message)) {
+		return StreamResetAddResult::Ok;
+	} else {
+		Q_ASSERT(m_resetStreamAddError != StreamResetAddResult::Ok);
+		return m_resetStreamAddError;
+	}
+}
+
 StreamResetAbortResult SessionHistory::abortStreamedReset(int ctxId)
 {
 	if(m_resetStreamState == ResetStreamState::Streaming) {
@@ -315,7 +341,9 @@ SessionHistory::prepareStreamedReset(uint8_t ctxId, int expectedMessageCount)
 	}
 
 	m_resetStreamAddError = StreamResetAddResult::ConsumerError;
-	bool freeOk = DP_reset_stream_consumer_free_finish(m_resetStreamConsumer);
+	// Server-generated reset images don't go through a consumer at all.
+	bool freeOk = !m_resetStreamConsumer ||
+				  DP_reset_stream_consumer_free_finish(m_resetStreamConsumer);
 	m_resetStreamConsumer = nullptr;
 	if(!freeOk) {
 		switch(m_resetStreamAddError) {
@@ -2,6 +2,7 @@
 #ifndef LIBSERVER_SESSION_HISTORY_H
 #define LIBSERVER_SESSION_HISTORY_H
 #include "libserver/idqueue.h"
+#include "libserver/metrics.h"
 #include "libserver/sessionban.h"
 #include "libshared/net/message.h"
 #include "libshared/util/passwordhash.h"
@@ -268,6 +269,15 @@ public:
 	StreamResetAddResult
 	addStreamResetMessage(uint8_t ctxId, const net::Message &msg);
 
+	/**
+	 * @brief Add an uncompressed message to a streamed reset
+	 *
+	 * This is for reset images generated by the server itself, which started
+	 * the stream with context id 0. Such messages don't need to go through
+	 * the reset stream compression.
+	 */
+	StreamResetAddResult addServerStreamResetMessage(const net::Message &msg);
+
 	/**
 	 * @brief Cancel a streaming history reset in progress
 	 *
@@ -366,6 +376,17 @@ public:
 	 */
 	size_t sizeInBytes() const { return m_sizeInBytes; }
 
+	/**
+	 * @brief Get the total number of bytes ever added to the history
+	 *
+	 * Unlike sizeInBytes(), this doesn't go down when the session is reset,
+	 * so its rate of change is how fast the history grows.
+	 */
+	quint64 bytesAdded() const { return m_bytesAdded; }
+
+	//! Time taken to store each message added to the history
+	const MetricsHistogram &storeSeconds() const { return m_storeSeconds; }
+
 	bool hasRegularSpaceFor(size_t bytes) const
 	{
 		return hasSpaceFor(bytes, 0);
@@ -569,6 +590,9 @@ private:
 	size_t m_autoResetBaseSize;
 	long long m_firstIndex;
 	long long m_lastIndex;
+	quint64 m_bytesAdded = 0;
+	MetricsHistogram m_storeSeconds{
+		0.00001, 0.00005, 0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05};
 
 	ResetStreamState m_resetStreamState = ResetStreamState::None;
 	uint8_t m_resetStreamCtxId = 0;
@@ -4,6 +4,7 @@
 #include "libserver/filedhistory.h"
 #include "libserver/inmemoryhistory.h"
 #include "libserver/loginhandler.h"
+#include "libserver/metrics.h"
 #include "libserver/serverconfig.h"
 #include "libserver/serverlog.h"
 #include "libserver/templateloader.h"
@@ -323,6 +324,8 @@ void SessionServer::addClient(ThinServerClient *client)
 	client->setParent(this);
 	client->setConnectionTimeout(
 		m_config->getConfigTime(config::ClientTimeout) * 1000);
+	client->setTransientWatermark(
+		m_config->getConfigSize(config::TransientWatermark));
 
 	m_clients.append(client);
 	connect(
@@ -517,6 +520,95 @@ JsonApiResult SessionServer::callUserJsonApi(
 	}
 }
 
+void SessionServer::writeMetrics(MetricsWriter &writer) const
+{
+	writer.gauge(
+		"drawpile_sessions", "Number of active sessions.", {},
+		m_sessions.size());
+	writer.gauge(
+		"drawpile_clients", "Number of connected clients.", {},
+		m_clients.size());
+
+	for(const Session *s : m_sessions) {
+		const MetricLabels labels = {{QByteArrayLiteral("session"), s->id()}};
+		const SessionMetrics &sm = s->metrics();
+		const SessionHistory *hist = s->history();
+		writer.gauge(
+			"drawpile_session_users", "Number of users in the session.",
+			labels, s->clients().size());
+		writer.counter(
+			"drawpile_session_messages_received_total",
+			"Messages received from users in the session.", labels,
+			sm.messagesReceived);
+		writer.counter(
+			"drawpile_session_received_bytes_total",
+			"Bytes received from users in the session.", labels,
+			sm.bytesReceived);
+		writer.counter(
+			"drawpile_session_sent_bytes_total",
+			"Bytes sent to users in the session.", labels, sm.bytesSent);
+		writer.counter(
+			"drawpile_session_filtered_bytes_total",
+			"Bytes of cursor and laser messages not sent to users who don't "
+			"want them.",
+			labels, sm.bytesFiltered);
+		writer.counter(
+			"drawpile_session_handle_seconds_total",
+			"Time spent handling messages received in the session.", labels,
+			double(sm.handleNsecs) / 1e9);
+		writer.gauge(
+			"drawpile_session_history_bytes",
+			"Current size of the session history.", labels,
+			hist->sizeInBytes());
+		writer.gauge(
+			"drawpile_session_history_messages",
+			"Current number of messages in the session history.", labels,
+			hist->lastIndex() - hist->firstIndex());
+		writer.counter(
+			"drawpile_session_history_added_bytes_total",
+			"Bytes added to the session history, including before resets.",
+			labels, hist->bytesAdded());
+		writer.histogram(
+			"drawpile_session_history_store_seconds",
+			"Time taken to store a message in the session history.", labels,
+			hist->storeSeconds());
+		writer.histogram(
+			"drawpile_session_catchup_seconds",
+			"Time taken to send the session history to joining users.", labels,
+			sm.catchupSeconds);
+	}
+
+	for(ThinServerClient *c : m_clients) {
+		Session *s = c->session();
+		const MetricLabels labels = {
+			{QByteArrayLiteral("session"), s ? s->id() : QString()},
+			{QByteArrayLiteral("uid"), c->uid()},
+		};
+		const ClientMetrics &cm = c->metrics();
+		writer.counter(
+			"drawpile_client_messages_received_total",
+			"Messages received from the client.", labels,
+			cm.messagesReceived);
+		writer.counter(
+			"drawpile_client_received_bytes_total",
+			"Bytes received from the client.", labels, cm.bytesReceived);
+		writer.counter(
+			"drawpile_client_sent_bytes_total", "Bytes sent to the client.",
+			labels, cm.bytesSent);
+		writer.gauge(
+			"drawpile_client_upload_queue_bytes",
+			"Bytes waiting to be sent to the client.", labels,
+			c->uploadQueueBytes());
+		if(s) {
+			writer.gauge(
+				"drawpile_client_history_lag_messages",
+				"Session history messages not yet queued for the client.",
+				labels,
+				qMax(0LL, s->history()->lastIndex() - c->historyPosition()));
+		}
+	}
+}
+
 ThinServerClient *SessionServer::searchClientByPathUid(const QString &uid)
 {
 	for(ThinServerClient *c : m_clients) {
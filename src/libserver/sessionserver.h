@@ -12,6 +12,7 @@ class Announcements;
 
 namespace server {
 
+class MetricsWriter;
 class Session;
 class SessionHistory;
 class ThinServerClient;
@@ -142,6 +143,14 @@ public:
 		JsonApiMethod method, const QStringList &path,
 		const QJsonObject &request, bool sectionLocked);
 
+	/**
+	 * @brief Write traffic and load metrics of all sessions and clients
+	 *
+	 * These are all kept up to date as things happen, so this just reads
+	 * them out.
+	 */
+	void writeMetrics(MetricsWriter &writer) const;
+
 signals:
 	/**
 	 * @brief A session was just created
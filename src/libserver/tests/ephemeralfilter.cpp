@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "libserver/ephemeralfilter.h"
+#include "libshared/net/message.h"
+
+#include <QtTest/QtTest>
+
+using server::EphemeralFilter;
+
+static net::Message movePointer(uint8_t contextId, int x, int y)
+{
+	return net::Message::noinc(
+		DP_msg_move_pointer_new(contextId, x * 4, y * 4));
+}
+
+static net::Message laserTrail(uint8_t contextId, uint8_t persistence)
+{
+	return net::Message::noinc(
+		DP_msg_laser_trail_new(contextId, 0xffff0000u, persistence));
+}
+
+class TestEphemeralFilter final : public QObject
+{
+	Q_OBJECT
+private slots:
+	void testAcceptsAllByDefault()
+	{
+		EphemeralFilter filter;
+		QVERIFY(!filter.isActive());
+		QVERIFY(filter.accept(movePointer(1, 10, 10)));
+		QVERIFY(filter.accept(laserTrail(1, 10)));
+		QVERIFY(filter.accept(movePointer(1, 10, 10)));
+	}
+
+	void testCursorsOnly()
+	{
+		EphemeralFilter filter;
+		filter.setInterests(EphemeralFilter::Interest::Cursors);
+		QVERIFY(filter.isActive());
+		QVERIFY(filter.accept(movePointer(1, 10, 10)));
+		QVERIFY(!filter.accept(laserTrail(1, 10)));
+		QVERIFY(!filter.accept(movePointer(1, 10, 10)));
+		QVERIFY(filter.accept(movePointer(2, 10, 10)));
+		QVERIFY(!filter.accept(laserTrail(1, 0)));
+		QVERIFY(filter.accept(movePointer(1, 10, 10)));
+	}
+
+	void testLasersOnly()
+	{
+		EphemeralFilter filter;
+		filter.setInterests(EphemeralFilter::Interest::Lasers);
+		QVERIFY(!filter.accept(movePointer(1, 10, 10)));
+		QVERIFY(filter.accept(laserTrail(1, 10)));
+		QVERIFY(filter.accept(movePointer(1, 10, 10)));
+		QVERIFY(!filter.accept(movePointer(2, 10, 10)));
+		QVERIFY(filter.accept(laserTrail(1, 0)));
+		QVERIFY(!filter.accept(movePointer(1, 10, 10)));
+	}
+
+	void testLeaveEndsLaserTrail()
+	{
+		EphemeralFilter filter;
+		filter.setInterests(EphemeralFilter::Interest::Lasers);
+		QVERIFY(filter.accept(laserTrail(1, 10)));
+		QVERIFY(filter.accept(net::makeLeaveMessage(1)));
+		QVERIFY(!filter.accept(movePointer(1, 10, 10)));
+	}
+
+	void testViewport()
+	{
+		EphemeralFilter filter;
+		filter.setViewport(QRect(100, 100, 50, 50));
+		QVERIFY(filter.isActive());
+		QVERIFY(filter.accept(movePointer(1, 120, 120)));
+		QVERIFY(!filter.accept(movePointer(1, 10, 120)));
+		QVERIFY(!filter.accept(movePointer(1, 120, 200)));
+		// Laser trails aren't limited to the viewport.
+		QVERIFY(filter.accept(laserTrail(1, 10)));
+		QVERIFY(filter.accept(movePointer(1, 10, 10)));
+		filter.setViewport(QRect());
+		QVERIFY(!filter.isActive());
+	}
+};
+
+
+QTEST_MAIN(TestEphemeralFilter)
+#include "ephemeralfilter.moc"
@@ -364,6 +364,113 @@ private slots:
 		}
 	}
 
+	// Closed blocks are loaded from the index in the journal instead of
+	// being scanned, make sure that doesn't lose anything
+	void testIndexedLoad()
+	{
+		auto id = Ulid::make().toString();
+		{
+			std::unique_ptr<FiledHistory> fh{FiledHistory::startNew(
+				m_dir, id, QString(), protocol::ProtocolVersion::current(),
+				"test")};
+
+			fh->addMessage(
+				net::makeJoinMessage(1, 0, QStringLiteral("u1"), QByteArray()));
+			fh->addMessage(
+				net::makeJoinMessage(2, 0, QStringLiteral("u2"), QByteArray()));
+			fh->addMessage(
+				net::makeChatMessage(1, 0, 0, QStringLiteral("test1")));
+			fh->addMessage(net::makeLeaveMessage(1));
+			fh->addMessage(net::makeLeaveMessage(2));
+			fh->closeBlock();
+			fh->addMessage(
+				net::makeJoinMessage(3, 0, QStringLiteral("u3"), QByteArray()));
+			fh->addMessage(
+				net::makeChatMessage(3, 0, 0, QStringLiteral("test2")));
+		}
+		{
+			std::unique_ptr<FiledHistory> fh{FiledHistory::load(
+				m_dir.absoluteFilePath(FiledHistory::journalFilename(id)))};
+			QVERIFY(fh.get());
+
+			net::MessageList msgs;
+			int lastIdx;
+			std::tie(msgs, lastIdx) = fh->getBatch(-1);
+			QCOMPARE(msgs.size(), 5);
+			QCOMPARE(lastIdx, 4);
+			QCOMPARE(getChatMessage(msgs.at(2)), QString("test1"));
+			QCOMPARE(msgs.last().type(), DP_MSG_LEAVE);
+
+			// Remaining user gets a leave message appended
+			std::tie(msgs, lastIdx) = fh->getBatch(lastIdx);
+			QCOMPARE(msgs.size(), 3);
+			QCOMPARE(lastIdx, 7);
+			QCOMPARE(getChatMessage(msgs.at(1)), QString("test2"));
+			QCOMPARE(msgs.last().type(), DP_MSG_LEAVE);
+			QCOMPARE(msgs.last().contextId(), uint8_t(3));
+
+			// Users that left in the indexed block must have had their ids
+			// reserved, same as the one that left in the scanned part
+			QCOMPARE(fh->idQueue().nextId(), uint8_t(4));
+		}
+	}
+
+	// Loaded blocks should get released when over the memory limit
+	void testLoadedBlockEviction()
+	{
+		QString file = makeTestRecording();
+		std::unique_ptr<FiledHistory> fh{
+			FiledHistory::load(m_dir.absoluteFilePath(file))};
+
+		fh->closeBlock();
+		fh->addMessage(net::makeChatMessage(1, 0, 0, QStringLiteral("test4")));
+		fh->addMessage(net::makeChatMessage(1, 0, 0, QStringLiteral("test5")));
+		fh->addMessage(net::makeChatMessage(1, 0, 0, QStringLiteral("test6")));
+		fh->closeBlock();
+		fh->addMessage(net::makeChatMessage(1, 0, 0, QStringLiteral("test7")));
+		fh->addMessage(net::makeChatMessage(1, 0, 0, QStringLiteral("test8")));
+		fh->addMessage(net::makeChatMessage(1, 0, 0, QStringLiteral("test9")));
+
+		// Only allow a single block to be loaded at a time
+		fh->setMaxLoadedBlockBytes(1);
+		QCOMPARE(fh->loadedBlockBytes(), qint64(0));
+
+		net::MessageList msgs;
+		int lastIdx;
+		std::tie(msgs, lastIdx) = fh->getBatch(-1);
+		QCOMPARE(msgs.size(), 3);
+		QCOMPARE(lastIdx, 2);
+		const qint64 blockBytes = fh->loadedBlockBytes();
+		QVERIFY(blockBytes > 0);
+
+		std::tie(msgs, lastIdx) = fh->getBatch(lastIdx);
+		QCOMPARE(msgs.size(), 3);
+		QCOMPARE(lastIdx, 5);
+		QCOMPARE(getChatMessage(msgs.first()), QString("test4"));
+		QCOMPARE(fh->loadedBlockBytes(), blockBytes);
+
+		std::tie(msgs, lastIdx) = fh->getBatch(lastIdx);
+		QCOMPARE(msgs.size(), 3);
+		QCOMPARE(lastIdx, 8);
+		QCOMPARE(fh->loadedBlockBytes(), blockBytes);
+
+		// Appending to the loaded last block must count towards the limit
+		fh->addMessage(net::makeChatMessage(1, 0, 0, QStringLiteral("testA")));
+		QCOMPARE(fh->loadedBlockBytes(), blockBytes + blockBytes / 3);
+
+		// Released blocks get reloaded from disk
+		std::tie(msgs, lastIdx) = fh->getBatch(-1);
+		QCOMPARE(msgs.size(), 3);
+		QCOMPARE(lastIdx, 2);
+		QCOMPARE(getChatMessage(msgs.first()), QString("test1"));
+		QCOMPARE(fh->loadedBlockBytes(), blockBytes);
+
+		std::tie(msgs, lastIdx) = fh->getBatch(8);
+		QCOMPARE(msgs.size(), 1);
+		QCOMPARE(lastIdx, 9);
+		QCOMPARE(getChatMessage(msgs.first()), QString("testA"));
+	}
+
 private:
 	// Generate a test recording containing three messages.
 	QString makeTestRecording()
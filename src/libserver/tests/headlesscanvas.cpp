@@ -0,0 +1,234 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+extern "C" {
+#include <dpengine/canvas_history.h>
+#include <dpengine/canvas_state.h>
+#include <dpengine/draw_context.h>
+#include <dpengine/image.h>
+#include <dpmsg/blend_mode.h>
+}
+#include "libserver/headlesscanvas.h"
+#include "libshared/net/message.h"
+#include <QtTest/QtTest>
+
+using server::HeadlessCanvas;
+
+static constexpr uint32_t LAYER_ID = 0x0101;
+
+static net::Message fillRect(int x, int y, int w, int h, uint32_t color)
+{
+	return net::Message::noinc(DP_msg_fill_rect_new(
+		1, LAYER_ID, DP_BLEND_MODE_NORMAL, uint32_t(x), uint32_t(y),
+		uint32_t(w), uint32_t(h), color));
+}
+
+// What a session history looks like to the server: the user joins and gets
+// made operator before drawing anything.
+static net::MessageList makeSession()
+{
+	return {
+		net::makeJoinMessage(1, 0, QStringLiteral("alice"), QByteArray()),
+		net::makeSessionOwnerMessage(0, {1}),
+		net::Message::noinc(DP_msg_canvas_resize_new(1, 0, 200, 150, 0)),
+		net::Message::noinc(
+			DP_msg_layer_tree_create_new(1, LAYER_ID, 0, 0, 0, 0, "", 0)),
+		net::Message::noinc(DP_msg_undo_point_new(1)),
+		fillRect(10, 10, 80, 60, 0xffff0000u),
+		net::Message::noinc(DP_msg_undo_point_new(1)),
+		fillRect(50, 40, 120, 90, 0x8000ff00u),
+		net::makeChatMessage(
+			1, 0, DP_MSG_CHAT_OFLAGS_PIN, QStringLiteral("pinned")),
+		net::Message::noinc(DP_msg_undo_depth_new(1, 45)),
+		net::Message::noinc(DP_msg_default_layer_new(1, LAYER_ID)),
+	};
+}
+
+// Replays the canvas-affecting messages like a client receiving them would.
+static DP_CanvasState *replay(const net::MessageList &msgs)
+{
+	DP_CanvasHistory *ch =
+		DP_canvas_history_new(nullptr, nullptr, false, nullptr);
+	DP_DrawContext *dc = DP_draw_context_new();
+	for(const net::Message &msg : msgs) {
+		if(DP_message_type_command(msg.type())) {
+			DP_canvas_history_handle(ch, dc, msg.get());
+		}
+	}
+	DP_CanvasState *cs = DP_canvas_history_get(ch);
+	DP_draw_context_free(dc);
+	DP_canvas_history_free(ch);
+	return cs;
+}
+
+static QByteArray flatten(DP_CanvasState *cs)
+{
+	DP_Image *img = DP_canvas_state_to_flat_image(
+		cs, DP_FLAT_IMAGE_RENDER_FLAGS, nullptr, nullptr);
+	if(!img) {
+		return QByteArray();
+	}
+	QByteArray pixels(
+		reinterpret_cast<const char *>(DP_image_pixels(img)),
+		DP_image_width(img) * DP_image_height(img) * 4);
+	DP_image_free(img);
+	return pixels;
+}
+
+struct ResetImage {
+	net::MessageList msgs;
+	int finished = 0;
+	int count = -1;
+};
+
+class TestHeadlessCanvas final : public QObject {
+	Q_OBJECT
+private slots:
+	void testResetImageMatchesCanvas()
+	{
+		net::MessageList session = makeSession();
+		HeadlessCanvas hc(-1LL, false);
+		handleMessages(hc, session, session.size() - 1LL);
+		QCOMPARE(hc.historyPosition(), session.size() - 1LL);
+
+		ResetImage ri;
+		generateResetImage(hc, ri);
+		QCOMPARE(ri.finished, 1);
+		QCOMPARE(ri.count, int(ri.msgs.size()));
+
+		// Pinned message and undo depth go first, the default layer comes after
+		// the canvas, along with the permissions.
+		QVERIFY(ri.msgs.size() > 3);
+		QCOMPARE(ri.msgs.first().type(), DP_MSG_CHAT);
+		QCOMPARE(ri.msgs.first().contextId(), 0u);
+		QCOMPARE(ri.msgs[1].type(), DP_MSG_UNDO_DEPTH);
+		QCOMPARE(
+			int(DP_msg_undo_depth_depth(static_cast<DP_MsgUndoDepth *>(
+				DP_message_internal(ri.msgs[1].get())))),
+			45);
+		int defaultLayers = 0;
+		for(const net::Message &msg : ri.msgs) {
+			QVERIFY(msg.isAllowedInResetImage());
+			if(msg.type() == DP_MSG_DEFAULT_LAYER) {
+				++defaultLayers;
+				QCOMPARE(
+					DP_msg_default_layer_id(msg.toDefaultLayer()), LAYER_ID);
+			}
+		}
+		QCOMPARE(defaultLayers, 1);
+
+		compareCanvases(ri.msgs, session);
+	}
+
+	void testResetImageIgnoresLaterMessages()
+	{
+		net::MessageList session = makeSession();
+		HeadlessCanvas hc(-1LL, false);
+		handleMessages(hc, session, session.size() - 1LL);
+
+		// Queued right after the reset image was requested, so it's handled
+		// while the image is being built, but mustn't show up in it.
+		ResetImage ri;
+		int handled = 0;
+		connect(&hc, &HeadlessCanvas::messagesHandled, this, [&handled] {
+			++handled;
+		});
+		listenForResetImage(hc, ri);
+		hc.generateResetImage(QStringLiteral("test"));
+		net::MessageList later = {
+			net::Message::noinc(DP_msg_undo_point_new(1)),
+			fillRect(0, 0, 200, 150, 0xff0000ffu),
+		};
+		hc.handleMessages(later, session.size() + later.size() - 1LL);
+		QTRY_COMPARE(ri.finished, 1);
+		QTRY_COMPARE(handled, 1);
+
+		compareCanvases(ri.msgs, session);
+
+		DP_CanvasState *imageCs = replay(ri.msgs);
+		DP_CanvasState *laterCs = replay(session + later);
+		QVERIFY(flatten(imageCs) != flatten(laterCs));
+		DP_canvas_state_decref(laterCs);
+		DP_canvas_state_decref(imageCs);
+	}
+
+	void testResetDiscardsCanvas()
+	{
+		net::MessageList session = makeSession();
+		HeadlessCanvas hc(-1LL, false);
+		handleMessages(hc, session, session.size() - 1LL);
+		hc.reset(100LL);
+		QCOMPARE(hc.historyPosition(), 100LL);
+
+		ResetImage ri;
+		generateResetImage(hc, ri);
+		QCOMPARE(ri.finished, 1);
+		QCOMPARE(ri.count, int(ri.msgs.size()));
+		// No more pinned message or default layer.
+		QCOMPARE(ri.msgs.first().type(), DP_MSG_UNDO_DEPTH);
+		for(const net::Message &msg : ri.msgs) {
+			QVERIFY(msg.type() != DP_MSG_DEFAULT_LAYER);
+		}
+
+		DP_CanvasState *cs = replay(ri.msgs);
+		QCOMPARE(DP_canvas_state_width(cs), 0);
+		QCOMPARE(DP_canvas_state_height(cs), 0);
+		DP_canvas_state_decref(cs);
+	}
+
+private:
+	void handleMessages(
+		HeadlessCanvas &hc, const net::MessageList &msgs, long long lastIndex)
+	{
+		int handled = 0;
+		QMetaObject::Connection connection =
+			connect(&hc, &HeadlessCanvas::messagesHandled, this, [&handled] {
+				++handled;
+			});
+		hc.handleMessages(msgs, lastIndex);
+		QVERIFY(hc.isBusy());
+		QTRY_COMPARE(handled, 1);
+		QVERIFY(!hc.isBusy());
+		disconnect(connection);
+	}
+
+	void listenForResetImage(HeadlessCanvas &hc, ResetImage &ri)
+	{
+		connect(
+			&hc, &HeadlessCanvas::resetImageMessagesGenerated, this,
+			[&ri](const QString &correlator, const net::MessageList &msgs) {
+				QCOMPARE(correlator, QStringLiteral("test"));
+				ri.msgs.append(msgs);
+			});
+		connect(
+			&hc, &HeadlessCanvas::resetImageFinished, this,
+			[&ri](const QString &correlator, int messageCount) {
+				QCOMPARE(correlator, QStringLiteral("test"));
+				++ri.finished;
+				ri.count = messageCount;
+			});
+	}
+
+	void generateResetImage(HeadlessCanvas &hc, ResetImage &ri)
+	{
+		listenForResetImage(hc, ri);
+		hc.generateResetImage(QStringLiteral("test"));
+		QTRY_COMPARE(ri.finished, 1);
+	}
+
+	void compareCanvases(
+		const net::MessageList &resetImage, const net::MessageList &session)
+	{
+		DP_CanvasState *imageCs = replay(resetImage);
+		DP_CanvasState *sessionCs = replay(session);
+		QCOMPARE(DP_canvas_state_width(imageCs), 200);
+		QCOMPARE(DP_canvas_state_height(imageCs), 150);
+		QByteArray imagePixels = flatten(imageCs);
+		QVERIFY(!imagePixels.isEmpty());
+		QVERIFY(imagePixels == flatten(sessionCs));
+		DP_canvas_state_decref(sessionCs);
+		DP_canvas_state_decref(imageCs);
+	}
+};
+
+
+QTEST_MAIN(TestHeadlessCanvas)
+#include "headlesscanvas.moc"
@@ -0,0 +1,78 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "libserver/metrics.h"
+
+#include <QtTest/QtTest>
+
+using server::MetricLabels;
+using server::MetricsHistogram;
+using server::MetricsWriter;
+
+class TestMetrics final : public QObject
+{
+	Q_OBJECT
+private slots:
+	void testHistogram()
+	{
+		MetricsHistogram h{1.0, 2.0, 5.0};
+		h.observe(0.5);
+		h.observe(1.0);
+		h.observe(3.0);
+		h.observe(10.0);
+		QCOMPARE(h.counts(), (QVector<quint64>{2, 0, 1, 1}));
+		QCOMPARE(h.count(), quint64(4));
+		QCOMPARE(h.sum(), 14.5);
+	}
+
+	void testWriterGroupsFamilies()
+	{
+		MetricsWriter writer;
+		writer.counter(
+			"test_total", "A counter.", {{QByteArrayLiteral("s"), "a"}}, 1);
+		writer.gauge("test_gauge", "A gauge.", {}, 2.5);
+		writer.counter(
+			"test_total", "A counter.", {{QByteArrayLiteral("s"), "b"}}, 3);
+		QCOMPARE(
+			writer.toText(), QByteArrayLiteral("# HELP test_total A counter.\n"
+											   "# TYPE test_total counter\n"
+											   "test_total{s=\"a\"} 1\n"
+											   "test_total{s=\"b\"} 3\n"
+											   "# HELP test_gauge A gauge.\n"
+											   "# TYPE test_gauge gauge\n"
+											   "test_gauge 2.5\n"));
+	}
+
+	void testWriterHistogram()
+	{
+		MetricsHistogram h{0.5, 1.0};
+		h.observe(0.25);
+		h.observe(0.75);
+		h.observe(2.0);
+		MetricsWriter writer;
+		writer.histogram(
+			"test_seconds", "A histogram.", {{QByteArrayLiteral("s"), "a"}},
+			h);
+		QCOMPARE(
+			writer.toText(),
+			QByteArrayLiteral("# HELP test_seconds A histogram.\n"
+							  "# TYPE test_seconds histogram\n"
+							  "test_seconds_bucket{s=\"a\",le=\"0.5\"} 1\n"
+							  "test_seconds_bucket{s=\"a\",le=\"1\"} 2\n"
+							  "test_seconds_bucket{s=\"a\",le=\"+Inf\"} 3\n"
+							  "test_seconds_sum{s=\"a\"} 3\n"
+							  "test_seconds_count{s=\"a\"} 3\n"));
+	}
+
+	void testWriterEscapesLabels()
+	{
+		MetricsWriter writer;
+		writer.gauge(
+			"test_gauge", "A gauge.",
+			{{QByteArrayLiteral("s"), QStringLiteral("a\"b\\c\nd")}}, 1);
+		QVERIFY(writer.toText().contains("test_gauge{s=\"a\\\"b\\\\c\\nd\"} 1\n"));
+	}
+};
+
+
+QTEST_MAIN(TestMetrics)
+#include "metrics.moc"
@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+#include "libserver/jsonapi.h"
+#include "libserver/passwordcheck.h"
+#include "libshared/util/passwordhash.h"
+#include <QHostAddress>
+#include <QJsonObject>
+#include <QThread>
+#include <QtTest/QtTest>
+#include <memory>
+
+using server::PasswordCheck;
+
+class TestPasswordCheck final : public QObject {
+	Q_OBJECT
+private slots:
+	void testMatch_data()
+	{
+		QTest::addColumn<QString>("password");
+		QTest::addColumn<bool>("expected");
+		QTest::newRow("correct") << QStringLiteral("hunter2") << true;
+		QTest::newRow("incorrect") << QStringLiteral("hunter3") << false;
+	}
+
+	void testMatch()
+	{
+		QFETCH(QString, password);
+		QFETCH(bool, expected);
+		QByteArray hash = passwordhash::hash(QStringLiteral("hunter2"));
+
+		QObject context;
+		int calls = 0;
+		bool result = !expected;
+		QThread *callbackThread = nullptr;
+		QVERIFY(PasswordCheck::start(
+			QHostAddress(QStringLiteral("192.168.0.1")), password, hash,
+			&context, [&](bool match) {
+				++calls;
+				result = match;
+				callbackThread = QThread::currentThread();
+			}));
+
+		// The result is only delivered through the event loop.
+		QCOMPARE(calls, 0);
+		QTRY_COMPARE(calls, 1);
+		QCOMPARE(result, expected);
+		QCOMPARE(callbackThread, context.thread());
+	}
+
+	void testContextGone()
+	{
+		QByteArray hash = passwordhash::hash(QStringLiteral("hunter2"));
+		bool called = false;
+		{
+			std::unique_ptr<QObject> context(new QObject);
+			QVERIFY(PasswordCheck::start(
+				QHostAddress(QStringLiteral("192.168.0.2")),
+				QStringLiteral("hunter2"), hash, context.get(),
+				[&](bool) {
+					called = true;
+				}));
+		}
+
+		// Wait on a second check so that the first one has had time to finish.
+		QObject context;
+		bool finished = false;
+		QVERIFY(PasswordCheck::start(
+			QHostAddress(QStringLiteral("192.168.0.2")),
+			QStringLiteral("hunter2"), hash, &context, [&](bool) {
+				finished = true;
+			}));
+		QTRY_VERIFY(finished);
+		QVERIFY(!called);
+	}
+
+	void testJsonApiResult()
+	{
+		QByteArray hash = passwordhash::hash(QStringLiteral("hunter2"));
+		server::JsonApiResult deferred = server::JsonApiPasswordCheckResult(
+			QStringLiteral("hunter2"), hash);
+		QVERIFY(deferred.isDeferred());
+		QVERIFY(deferred.body.isNull());
+
+		QObject context;
+		int calls = 0;
+		server::JsonApiResult result = server::JsonApiNotFound();
+		server::JsonApiResolveResult(
+			deferred, QHostAddress(QStringLiteral("192.168.0.3")), &context,
+			[&](const server::JsonApiResult &resolved) {
+				++calls;
+				result = resolved;
+			});
+		QCOMPARE(calls, 0);
+		QTRY_COMPARE(calls, 1);
+		QCOMPARE(result.status, server::JsonApiResult::Ok);
+		QVERIFY(!result.isDeferred());
+		QCOMPARE(
+			result.body.object(), QJsonObject({{QStringLiteral("status"), true}}));
+
+		// Results that aren't deferred are passed through immediately.
+		server::JsonApiResolveResult(
+			server::JsonApiNotFound(), QHostAddress(), &context,
+			[&](const server::JsonApiResult &resolved) {
+				++calls;
+				result = resolved;
+			});
+		QCOMPARE(calls, 2);
+		QCOMPARE(result.status, server::JsonApiResult::NotFound);
+	}
+};
+
+
+QTEST_MAIN(TestPasswordCheck)
+#include "passwordcheck.moc"
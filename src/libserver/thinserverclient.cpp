@@ -42,16 +42,42 @@ void ThinServerClient::sendNextHistoryBatch()
 		// history position of all clients, so don't touch it before this point!
 		s->resolvePendingStreamedReset(QStringLiteral("batch"));
 
+		// If the client filtered out everything, move on to the next batch,
+		// since there won't be an allSent signal for an empty one.
+		SessionHistory *history = s->history();
 		net::MessageList batch;
 		long long batchLast;
-		std::tie(batch, batchLast) = s->history()->getBatch(m_historyPosition);
-		m_historyPosition = batchLast;
+		do {
+			std::tie(batch, batchLast) = history->getBatch(m_historyPosition);
+			m_historyPosition = batchLast;
+			filterEphemeralMessages(batch);
+		} while(batch.isEmpty() && m_historyPosition < history->lastIndex());
 		mq->sendMultiple(batch.size(), batch.constData());
 
+		if(m_catchupIndex >= 0LL && m_historyPosition >= m_catchupIndex) {
+			s->metrics().catchupSeconds.observe(
+				double(m_catchupTimer.nsecsElapsed()) / 1e9);
+			m_catchupIndex = -1LL;
+		}
+
 		s->cleanupHistoryCache();
 	}
 }
 
+void ThinServerClient::addToHistoryPosition(long long offset)
+{
+	m_historyPosition += offset;
+	if(m_catchupIndex >= 0LL) {
+		m_catchupIndex += offset;
+	}
+}
+
+void ThinServerClient::startCatchup(long long index)
+{
+	m_catchupIndex = index;
+	m_catchupTimer.start();
+}
+
 void ThinServerClient::connectSendNextHistoryBatch()
 {
 	connect(
@@ -3,6 +3,7 @@
 #define THINSERVERCLIENT_H
 #include "libserver/client.h"
 #include "libserver/serverconfig.h"
+#include <QElapsedTimer>
 
 class QHostAddress;
 
@@ -29,7 +30,15 @@ public:
 
 	void setHistoryPosition(long long pos) { m_historyPosition = pos; }
 
-	void addToHistoryPosition(long long offset) { m_historyPosition += offset; }
+	void addToHistoryPosition(long long offset);
+
+	/**
+	 * @brief Start timing how long it takes to catch up
+	 *
+	 * The time is recorded in the session's metrics once the history up to
+	 * the given index has been queued for uploading.
+	 */
+	void startCatchup(long long index);
 
 signals:
 	void thinServerClientDestroyed(ThinServerClient *thisClient);
@@ -41,6 +50,8 @@ private:
 	void connectSendNextHistoryBatch();
 
 	long long m_historyPosition;
+	long long m_catchupIndex = -1LL;
+	QElapsedTimer m_catchupTimer;
 };
 
 }
@@ -1,9 +1,11 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #include "libserver/thinsession.h"
+#include "libserver/headlesscanvas.h"
 #include "libserver/serverconfig.h"
 #include "libserver/serverlog.h"
 #include "libserver/thinserverclient.h"
 #include "libshared/net/message.h"
+#include "libshared/net/protover.h"
 #include "libshared/net/servercmd.h"
 #include <QRandomGenerator>
 #include <QTimer>
@@ -27,6 +29,25 @@ ThinSession::ThinSession(
 	connect(
 		m_autoResetTimer, &QTimer::timeout, this,
 		&ThinSession::triggerAutoReset);
+
+	if(config->getConfigBool(config::ServerSideReset)) {
+		m_headlessCanvas = new HeadlessCanvas(
+			history->firstIndex() - 1LL,
+			history->protocolVersion().isPastCompatible(), this);
+		connect(
+			history, &SessionHistory::newMessagesAvailable, this,
+			&ThinSession::feedHeadlessCanvas);
+		connect(
+			m_headlessCanvas, &HeadlessCanvas::messagesHandled, this,
+			&ThinSession::feedHeadlessCanvas);
+		connect(
+			m_headlessCanvas, &HeadlessCanvas::resetImageMessagesGenerated,
+			this, &ThinSession::addServerSideResetImageMessages);
+		connect(
+			m_headlessCanvas, &HeadlessCanvas::resetImageFinished, this,
+			&ThinSession::finishServerSideResetImage);
+		feedHeadlessCanvas();
+	}
 }
 
 void ThinSession::addToHistory(const net::Message &msg)
@@ -92,6 +113,9 @@ void ThinSession::cleanupHistoryCache()
 			static_cast<const ThinServerClient *>(c)->historyPosition(),
 			minIdx);
 	}
+	if(m_headlessCanvas) {
+		minIdx = qMin(m_headlessCanvas->historyPosition(), minIdx);
+	}
 	history()->cleanupBatches(minIdx);
 }
 
@@ -137,10 +161,16 @@ QJsonObject ThinSession::getDescription(bool full, bool invite) const
 			{QStringLiteral("historyFirstIndex"), double(hist->firstIndex())},
 			{QStringLiteral("historyLastIndex"), double(hist->lastIndex())},
 			{QStringLiteral("requestStatus"), autoresetRequestStatus},
+			{QStringLiteral("serverSide"), m_serverSideReset},
 			{QStringLiteral("sessionState"), sessionState},
 			{QStringLiteral("stream"), hist->getStreamedResetDescription()},
 		});
 
+		if(m_headlessCanvas) {
+			a[QStringLiteral("headlessCanvasPosition")] =
+				double(m_headlessCanvas->historyPosition());
+		}
+
 		if(m_autoResetTimer->isActive()) {
 			a[QStringLiteral("timer")] = m_autoResetTimer->remainingTime();
 		}
@@ -507,6 +537,9 @@ void ThinSession::resolvePendingStreamedReset(const QString &cause)
 				ThinServerClient *tsc = static_cast<ThinServerClient *>(c);
 				tsc->addToHistoryPosition(offset);
 			}
+			if(m_headlessCanvas) {
+				m_headlessCanvas->addToHistoryPosition(offset);
+			}
 			clearAutoReset();
 			sendStatusUpdate();
 			sendUpdatedSessionProperties();
@@ -530,6 +563,9 @@ void ThinSession::onSessionInitialized()
 void ThinSession::onSessionReset()
 {
 	clearAutoReset();
+	if(m_headlessCanvas) {
+		m_headlessCanvas->reset(history()->firstIndex() - 1LL);
+	}
 	directToAll(net::ServerReply::makeCatchup(
 		history()->lastIndex() - history()->firstIndex(), 0));
 	sendStatusUpdate();
@@ -550,6 +586,10 @@ void ThinSession::onClientJoin(Client *client, bool host)
 		int catchupKey = history()->nextCatchupKey();
 		bool caughtUpAdded =
 			history()->addMessage(net::ServerReply::makeCaughtUp(catchupKey));
+		if(caughtUpAdded) {
+			static_cast<ThinServerClient *>(client)->startCatchup(
+				history()->lastIndex());
+		}
 		client->sendDirectMessage(net::ServerReply::makeCatchup(
 			history()->lastIndex() - history()->firstIndex(),
 			caughtUpAdded ? catchupKey : -1));
@@ -697,6 +737,17 @@ void ThinSession::checkAutoResetQuery()
 	directToAll(net::ServerReply::makeSizeLimitWarning(
 		int(history()->sizeInBytes()), int(autoResetThreshold)));
 
+	// If we have our own canvas, we can generate the reset image ourselves.
+	// If that failed last time, give the clients a shot instead.
+	if(m_headlessCanvas) {
+		if(m_serverSideResetFailed) {
+			m_serverSideResetFailed = false;
+		} else {
+			startServerSideReset();
+			return;
+		}
+	}
+
 	// New style for Drawpile 2.1.0 and newer
 	// Autoreset request: send an autoreset query to each logged in
 	// operator. The user that responds first gets to perform the reset.
@@ -875,6 +926,8 @@ void ThinSession::clearAutoReset(int retryDelay)
 	}
 
 	m_autoResetRequestStatus = AutoResetState::NotSent;
+	m_serverSideReset = false;
+	m_headlessCanvasResetIndex = -1LL;
 	for(Client *c : clients()) {
 		c->setResetFlags(Client::ResetFlag::None);
 	}
@@ -897,6 +950,27 @@ bool ThinSession::checkStreamedResetStart(const QString &cause)
 	}
 
 	long long resetStreamStartIndex = hist->resetStreamStartIndex();
+	// The headless canvas may sit right at the stream start message, since
+	// that's where server-side reset images get generated from.
+	if(m_headlessCanvas &&
+	   m_headlessCanvas->historyPosition() < resetStreamStartIndex - 1LL) {
+		if(m_lastAutoResetWarning.hasExpired()) {
+			m_lastAutoResetWarning.setRemainingTime(
+				AUTORESET_RESOLVE_LOG_MSECS);
+			log(Log()
+					.about(Log::Level::Warn, Log::Topic::Status)
+					.message(QStringLiteral(
+								 "Streamed reset after %1 blocked by headless "
+								 "canvas at position %2 before reset start %3")
+								 .arg(
+									 cause,
+									 QString::number(
+										 m_headlessCanvas->historyPosition()),
+									 QString::number(resetStreamStartIndex))));
+		}
+		return false;
+	}
+
 	for(Client *c : clients()) {
 		ThinServerClient *tsc = static_cast<ThinServerClient *>(c);
 		long long historyPosition = tsc->historyPosition();
@@ -936,4 +1010,145 @@ bool ThinSession::checkStreamedResetStart(const QString &cause)
 	return true;
 }
 
+void ThinSession::feedHeadlessCanvas()
+{
+	if(!m_headlessCanvas || m_headlessCanvas->isBusy() ||
+	   state() == State::Shutdown) {
+		return;
+	}
+
+	// Same as with clients, a pending streamed reset shifts history positions.
+	resolvePendingStreamedReset(QStringLiteral("headless canvas"));
+	if(m_headlessCanvas->isBusy()) {
+		return; // Resolving the reset fed it already.
+	}
+
+	SessionHistory *hist = history();
+	long long position = m_headlessCanvas->historyPosition();
+	long long resetIndex = m_headlessCanvasResetIndex;
+	if(resetIndex < 0LL || position < resetIndex) {
+		net::MessageList batch;
+		long long batchLast;
+		std::tie(batch, batchLast) = hist->getBatch(position);
+		// When a server-side reset is pending, stop right at the point where
+		// the stream was started, the reset image must be generated there.
+		if(resetIndex >= 0LL && batchLast > resetIndex) {
+			long long first = qMax(position + 1LL, hist->firstIndex());
+			batch.resize(int(resetIndex - first + 1LL));
+			batchLast = resetIndex;
+		}
+		if(!batch.isEmpty()) {
+			m_headlessCanvas->handleMessages(batch, batchLast);
+		}
+	}
+
+	if(resetIndex >= 0LL && m_headlessCanvas->historyPosition() >= resetIndex) {
+		m_headlessCanvasResetIndex = -1LL;
+		m_headlessCanvas->generateResetImage(m_autoResetPayload);
+	}
+
+	cleanupHistoryCache();
+}
+
+void ThinSession::startServerSideReset()
+{
+	m_autoResetPayload = generateAutoResetPayload();
+	m_autoResetCandidates.clear();
+	for(Client *c : clients()) {
+		c->setResetFlags(Client::ResetFlag::None);
+	}
+	m_autoResetRequestStatus = AutoResetState::Requested;
+	m_serverSideReset = true;
+
+	SessionHistory *hist = history();
+	StreamResetStartResult result = hist->startStreamedReset(
+		0, m_autoResetPayload, serverSideStateMessages());
+	if(result != StreamResetStartResult::Ok) {
+		failServerSideReset(
+			QStringLiteral("starting the stream failed with error %1")
+				.arg(int(result)));
+		return;
+	}
+
+	log(Log()
+			.about(Log::Level::Info, Log::Topic::Status)
+			.message(QStringLiteral("Started server-side reset (fork pos %1, "
+									"stream pos %2)")
+						 .arg(hist->resetStreamForkPos())
+						 .arg(hist->resetStreamHeaderPos())));
+
+	// The stream start message is the last one the reset image includes.
+	m_headlessCanvasResetIndex = hist->resetStreamStartIndex() - 1LL;
+	feedHeadlessCanvas();
+}
+
+void ThinSession::addServerSideResetImageMessages(
+	const QString &correlator, const net::MessageList &msgs)
+{
+	if(!isServerSideResetActive(correlator)) {
+		return;
+	}
+
+	SessionHistory *hist = history();
+	for(const net::Message &msg : msgs) {
+		StreamResetAddResult result = hist->addServerStreamResetMessage(msg);
+		if(result != StreamResetAddResult::Ok) {
+			failServerSideReset(
+				result == StreamResetAddResult::OutOfSpace
+					? QStringLiteral("the session is out of space")
+					: QStringLiteral("adding %1 failed with error %2")
+						  .arg(msg.typeName())
+						  .arg(int(result)));
+			return;
+		}
+	}
+}
+
+void ThinSession::finishServerSideResetImage(
+	const QString &correlator, int messageCount)
+{
+	if(!isServerSideResetActive(correlator)) {
+		return;
+	}
+
+	if(messageCount <= 0) {
+		failServerSideReset(QStringLiteral("generating the image failed"));
+		return;
+	}
+
+	StreamResetPrepareResult result =
+		history()->prepareStreamedReset(0, messageCount);
+	if(result == StreamResetPrepareResult::Ok) {
+		log(Log()
+				.about(Log::Level::Info, Log::Topic::Status)
+				.message(QStringLiteral("Prepared server-side reset with %1 "
+										"messages")
+							 .arg(messageCount)));
+		resolvePendingStreamedReset(QStringLiteral("prepare"));
+	} else {
+		failServerSideReset(
+			result == StreamResetPrepareResult::OutOfSpace
+				? QStringLiteral("the reset image is too large")
+				: QStringLiteral("preparing failed with error %1")
+					  .arg(int(result)));
+	}
+}
+
+bool ThinSession::isServerSideResetActive(const QString &correlator) const
+{
+	return m_serverSideReset &&
+		   m_autoResetRequestStatus == AutoResetState::Requested &&
+		   correlator == m_autoResetPayload;
+}
+
+void ThinSession::failServerSideReset(const QString &error)
+{
+	log(Log()
+			.about(Log::Level::Warn, Log::Topic::Status)
+			.message(
+				QStringLiteral("Server-side reset failed: %1").arg(error)));
+	m_serverSideResetFailed = true;
+	clearAutoReset(AUTORESET_FAILURE_RETRY_MSECS);
+}
+
 }
@@ -8,6 +8,8 @@ class QTimer;
 
 namespace server {
 
+class HeadlessCanvas;
+
 /**
  * The (thin) serverside session state.
  */
@@ -83,6 +85,14 @@ private:
 
 	bool checkStreamedResetStart(const QString &cause);
 
+	void feedHeadlessCanvas();
+	void startServerSideReset();
+	void addServerSideResetImageMessages(
+		const QString &correlator, const net::MessageList &msgs);
+	void finishServerSideResetImage(const QString &correlator, int messageCount);
+	bool isServerSideResetActive(const QString &correlator) const;
+	void failServerSideReset(const QString &error);
+
 	QDeadlineTimer m_lastStatusUpdate;
 	QDeadlineTimer m_lastSizeWarning;
 	QDeadlineTimer m_autoResetDelay;
@@ -91,6 +101,10 @@ private:
 	QTimer *m_autoResetTimer;
 	QString m_autoResetPayload;
 	QVector<AutoResetCandidate> m_autoResetCandidates;
+	HeadlessCanvas *m_headlessCanvas = nullptr;
+	long long m_headlessCanvasResetIndex = -1LL;
+	bool m_serverSideReset = false;
+	bool m_serverSideResetFailed = false;
 };
 
 }
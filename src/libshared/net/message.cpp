@@ -254,6 +254,12 @@ DP_MsgFillRect *Message::toFillRect() const
 	return static_cast<DP_MsgFillRect *>(DP_message_internal(m_data));
 }
 
+DP_MsgLaserTrail *Message::toLaserTrail() const
+{
+	Q_ASSERT(type() == DP_MSG_LASER_TRAIL);
+	return static_cast<DP_MsgLaserTrail *>(DP_message_internal(m_data));
+}
+
 DP_MsgLayerAttributes *Message::toLayerAttributes() const
 {
 	Q_ASSERT(type() == DP_MSG_LAYER_ATTRIBUTES);
@@ -266,6 +272,12 @@ DP_MsgLayerTreeCreate *Message::toLayerTreeCreate() const
 	return static_cast<DP_MsgLayerTreeCreate *>(DP_message_internal(m_data));
 }
 
+DP_MsgMovePointer *Message::toMovePointer() const
+{
+	Q_ASSERT(type() == DP_MSG_MOVE_POINTER);
+	return static_cast<DP_MsgMovePointer *>(DP_message_internal(m_data));
+}
+
 DP_MsgPrivateChat *Message::toPrivateChat() const
 {
 	Q_ASSERT(type() == DP_MSG_PRIVATE_CHAT);
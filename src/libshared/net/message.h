@@ -79,8 +79,10 @@ public:
 	DP_MsgDrawDabsPixel *toDrawDabsPixel() const;
 	DP_MsgFeatureAccessLevels *toFeatureAccessLevels() const;
 	DP_MsgFillRect *toFillRect() const;
+	DP_MsgLaserTrail *toLaserTrail() const;
 	DP_MsgLayerAttributes *toLayerAttributes() const;
 	DP_MsgLayerTreeCreate *toLayerTreeCreate() const;
+	DP_MsgMovePointer *toMovePointer() const;
 	DP_MsgPrivateChat *toPrivateChat() const;
 	DP_MsgPutImage *toPutImage() const;
 	DP_MsgResetStream *toResetStream() const;
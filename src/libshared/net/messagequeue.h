@@ -118,6 +118,21 @@ public:
 		m_compatibilityMode = compatibilityMode;
 	}
 
+	/**
+	 * @brief Set the upload queue size above which transient messages coalesce
+	 *
+	 * When the upload queue is larger than this many bytes, pointer movements
+	 * that have been superseded by a newer one from the same user are dropped
+	 * instead of being sent out. Zero disables coalescing.
+	 */
+	void setTransientWatermark(int bytes) { m_transientWatermark = bytes; }
+
+	//! Number of transient messages that were coalesced away
+	long long coalescedMessages() const { return m_coalescedMessages; }
+
+	//! Number of bytes saved by coalescing transient messages
+	long long coalescedBytes() const { return m_coalescedBytes; }
+
 public slots:
 	/**
 	 * @brief Send a Ping message
@@ -198,6 +213,23 @@ protected:
 
 	bool compatibilityMode() const { return m_compatibilityMode; }
 
+	static bool isTransient(const net::Message &msg)
+	{
+		return !msg.isNull() && msg.type() == DP_MSG_MOVE_POINTER;
+	}
+
+	bool isAboveTransientWatermark() const
+	{
+		return m_transientWatermark > 0 &&
+			   uploadQueueBytes() > m_transientWatermark;
+	}
+
+	void addCoalesced(const net::Message &msg)
+	{
+		++m_coalescedMessages;
+		m_coalescedBytes += msg.length();
+	}
+
 	bool m_decodeOpaque;
 	net::MessageList m_inbox; // received (complete) messages
 	bool m_gracefullyDisconnecting;
@@ -246,6 +278,9 @@ private:
 	QVector<net::Message> m_artificialLagMessages;
 	QTimer *m_artificialLagTimer;
 	bool m_compatibilityMode = false;
+	int m_transientWatermark = 0;
+	long long m_coalescedMessages = 0LL;
+	long long m_coalescedBytes = 0LL;
 };
 
 }
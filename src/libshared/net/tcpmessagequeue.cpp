@@ -1,10 +1,10 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #include "libshared/net/tcpmessagequeue.h"
-#include "libshared/util/qtcompat.h"
 #include <QDateTime>
 #include <QTcpSocket>
 #include <QTimer>
 #include <QtEndian>
+#include <algorithm>
 
 namespace net {
 
@@ -16,6 +16,10 @@ TcpMessageQueue::TcpMessageQueue(
 	m_recvbuffer = new char[MAX_BUF_LEN];
 	m_recvbytes = 0;
 	m_sentbytes = 0;
+	m_outboxBytes = 0;
+	m_dequeuedCount = 0;
+	std::fill(
+		std::begin(m_lastTransientSeqs), std::end(m_lastTransientSeqs), -1);
 
 	connect(socket, &QTcpSocket::readyRead, this, &TcpMessageQueue::readData);
 	connect(
@@ -33,10 +37,8 @@ TcpMessageQueue::~TcpMessageQueue()
 
 int TcpMessageQueue::uploadQueueBytes() const
 {
-	int total = m_socket->bytesToWrite() + m_sendbuffer.length() - m_sentbytes;
-	for(const net::Message &msg : m_outbox) {
-		total += compat::castSize(msg.length());
-	}
+	int total = m_socket->bytesToWrite() + m_sendbuffer.length() -
+				m_sentbytes + int(m_outboxBytes);
 	total +=
 		m_pings.size() * (DP_MESSAGE_HEADER_LENGTH + DP_MSG_PING_STATIC_LENGTH);
 	return total;
@@ -50,7 +52,10 @@ bool TcpMessageQueue::isUploading() const
 void TcpMessageQueue::enqueueMessages(int count, const net::Message *msgs)
 {
 	for(int i = 0; i < count; ++i) {
-		m_outbox.enqueue(msgs[i]);
+		const net::Message &msg = msgs[i];
+		if(!isTransient(msg) || !coalesceTransient(msg)) {
+			enqueueToOutbox(msg);
+		}
 	}
 	if(m_sendbuffer.isEmpty()) {
 		writeData();
@@ -136,7 +141,7 @@ void TcpMessageQueue::readData()
 				// Just keep echoing everything that has a client effect.
 				if(type == MSG_TYPE_CHAT || type == MSG_TYPE_PRIVATE_CHAT ||
 				   type >= MSG_TYPE_CLIENT_META) {
-					m_outbox.enqueue(Message::noinc(DP_message_new_opaque(
+					enqueueToOutbox(Message::noinc(DP_message_new_opaque(
 						DP_MessageType(type), m_recvbuffer[3],
 						reinterpret_cast<const unsigned char *>(
 							m_recvbuffer + DP_MESSAGE_HEADER_LENGTH),
@@ -339,13 +344,42 @@ bool TcpMessageQueue::messagesInOutbox() const
 	return !m_outbox.isEmpty() || !m_pings.isEmpty();
 }
 
+void TcpMessageQueue::enqueueToOutbox(const net::Message &msg)
+{
+	m_outbox.enqueue(msg);
+	m_outboxBytes += msg.isNull() ? 0 : qint64(msg.length());
+}
+
 net::Message TcpMessageQueue::dequeueFromOutbox()
 {
 	if(m_pings.isEmpty()) {
-		return m_outbox.dequeue();
+		net::Message msg = m_outbox.dequeue();
+		m_outboxBytes -= msg.isNull() ? 0 : qint64(msg.length());
+		++m_dequeuedCount;
+		return msg;
 	} else {
 		return net::makePingMessage(0, m_pings.dequeue());
 	}
 }
 
+bool TcpMessageQueue::coalesceTransient(const net::Message &msg)
+{
+	// If the client is lagging behind and there's still an unsent transient
+	// message from the same user in the outbox, replace it with this one.
+	qint64 &seq = m_lastTransientSeqs[msg.contextId() & 0xffu];
+	qint64 index = seq - m_dequeuedCount;
+	if(index >= 0 && isAboveTransientWatermark()) {
+		net::Message &prev = m_outbox[int(index)];
+		Q_ASSERT(prev.type() == msg.type());
+		Q_ASSERT(prev.contextId() == msg.contextId());
+		addCoalesced(prev);
+		m_outboxBytes += qint64(msg.length()) - qint64(prev.length());
+		prev = msg;
+		return true;
+	} else {
+		seq = m_dequeuedCount + m_outbox.size();
+		return false;
+	}
+}
+
 }
@@ -43,7 +43,9 @@ private:
 	net::Message deserializeMessage();
 
 	bool messagesInOutbox() const;
+	void enqueueToOutbox(const net::Message &msg);
 	net::Message dequeueFromOutbox();
+	bool coalesceTransient(const net::Message &msg);
 
 	QTcpSocket *m_socket;
 	char *m_recvbuffer;		 // raw message reception buffer
@@ -52,6 +54,11 @@ private:
 	int m_sentbytes;		 // number of bytes in upload buffer already sent
 	QQueue<net::Message> m_outbox; // messages to be sent
 	QQueue<bool> m_pings;		   // pings and pongs to be sent
+	qint64 m_outboxBytes;		   // total length of messages in the outbox
+	qint64 m_dequeuedCount;		   // messages taken out of the outbox so far
+	// Outbox sequence number of the last transient message per context id, a
+	// sequence number minus m_dequeuedCount is its index in the outbox.
+	qint64 m_lastTransientSeqs[256];
 };
 
 }
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 #include "libshared/net/websocketmessagequeue.h"
 #include "libshared/util/qtcompat.h"
+#include <QBitArray>
 #include <QDateTime>
 #include <QDebug>
 #include <QTimer>
@@ -43,9 +44,19 @@ bool WebSocketMessageQueue::isUploading() const
 
 void WebSocketMessageQueue::enqueueMessages(int count, const net::Message *msgs)
 {
+	// Messages get serialized straight into the socket, so there's no outbox
+	// to coalesce into. If the client is lagging behind, pointer movements
+	// superseded by a later one in the same batch get dropped instead.
+	QBitArray superseded;
+	if(isAboveTransientWatermark()) {
+		superseded = findSupersededTransients(count, msgs);
+	}
+
 	for(int i = 0; i < count; ++i) {
 		const net::Message &msg = msgs[i];
-		if(!msg.isNull()) {
+		if(!superseded.isEmpty() && superseded.testBit(i)) {
+			addCoalesced(msg);
+		} else if(!msg.isNull()) {
 			if(serializeMessage(msg)) {
 				qint64 sent =
 					m_socket->sendBinaryMessage(m_serializationBuffer);
@@ -60,6 +71,25 @@ void WebSocketMessageQueue::enqueueMessages(int count, const net::Message *msgs)
 	}
 }
 
+QBitArray WebSocketMessageQueue::findSupersededTransients(
+	int count, const net::Message *msgs)
+{
+	QBitArray superseded(count);
+	QBitArray seenContexts(256);
+	for(int i = count - 1; i >= 0; --i) {
+		const net::Message &msg = msgs[i];
+		if(isTransient(msg)) {
+			int contextId = msg.contextId();
+			if(seenContexts.testBit(contextId)) {
+				superseded.setBit(i);
+			} else {
+				seenContexts.setBit(contextId);
+			}
+		}
+	}
+	return superseded;
+}
+
 void WebSocketMessageQueue::enqueuePing(bool pong)
 {
 	net::Message msg = net::makePingMessage(0, pong);
@@ -3,6 +3,7 @@
 #define LIBSHARED_NET_WEBSOCKETMESSSAGEQUEUE_H
 #include "libshared/net/messagequeue.h"
 
+class QBitArray;
 class QWebSocket;
 
 namespace net {
@@ -31,6 +32,9 @@ private slots:
 private:
 	void afterDisconnectSent() override;
 
+	static QBitArray
+	findSupersededTransients(int count, const net::Message *msgs);
+
 	bool serializeMessage(const net::Message &msg);
 	net::Message deserializeMessage(const unsigned char *buf, size_t bufsize);
 
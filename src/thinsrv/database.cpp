@@ -505,8 +505,7 @@ ServerLog *Database::logger() const
 	}
 }
 
-RegisteredUser
-Database::getUserAccount(const QString &username, const QString &password) const
+RegisteredUser Database::lookupUserAccount(const QString &username) const
 {
 	drawdance::Query query = d->db.queryWithoutLock();
 	if(query.exec(
@@ -522,19 +521,17 @@ Database::getUserAccount(const QString &username, const QString &password) const
 
 		if(locked) {
 			return RegisteredUser{
-				RegisteredUser::Banned, username, QStringList(), QString()};
-		}
-
-		if(!passwordhash::check(password, passwordHash)) {
-			return RegisteredUser{
-				RegisteredUser::BadPass, username, QStringList(), QString()};
+				RegisteredUser::Banned, username, QStringList(), QString(),
+				QByteArray()};
 		}
 
 		return RegisteredUser{
-			RegisteredUser::Ok, username, flags, QString::number(rowid)};
+			RegisteredUser::Ok, username, flags, QString::number(rowid),
+			passwordHash};
 	} else {
 		return RegisteredUser{
-			RegisteredUser::NotFound, username, QStringList(), QString()};
+			RegisteredUser::NotFound, username, QStringList(), QString(),
+			QByteArray()};
 	}
 }
 
@@ -264,7 +264,7 @@ bool ConfigFile::isAllowedAnnouncementUrl(const QUrl &url) const
 	return m_announcewhitelist.contains(url);
 }
 
-RegisteredUser ConfigFile::getUserAccount(const QString &username, const QString &password) const
+RegisteredUser ConfigFile::lookupUserAccount(const QString &username) const
 {
 	if(m_users.contains(username)) {
 		const User &u = m_users[username];
@@ -273,22 +273,17 @@ RegisteredUser ConfigFile::getUserAccount(const QString &username, const QString
 				RegisteredUser::Banned,
 				username,
 				QStringList(),
-				username
-			};
-
-		} else if(!passwordhash::check(password, u.password)) {
-			return RegisteredUser {
-				RegisteredUser::BadPass,
 				username,
-				QStringList(),
-				username
+				QByteArray()
 			};
+
 		} else {
 			return RegisteredUser {
 				RegisteredUser::Ok,
 				username,
 				u.flags,
-				username
+				username,
+				u.password
 			};
 		}
 
@@ -297,7 +292,8 @@ RegisteredUser ConfigFile::getUserAccount(const QString &username, const QString
 			RegisteredUser::NotFound,
 			username,
 			QStringList(),
-			QString()
+			QString(),
+			QByteArray()
 		};
 	}
 }
@@ -1,7 +1,11 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
+extern "C" {
+#include <dpmsg/message.h>
+}
 #include "thinsrv/multiserver.h"
 #include "cmake-config/config.h"
 #include "libserver/jsonapi.h"
+#include "libserver/metrics.h"
 #include "libserver/serverconfig.h"
 #include "libserver/serverlog.h"
 #include "libserver/session.h"
@@ -40,6 +44,11 @@ MultiServer::MultiServer(ServerConfig *config, QObject *parent)
 	, m_autoStop(false)
 	, m_port(0)
 {
+	// Sessions keep their entire history in memory unless they're file
+	// backed, so messages live for a long time and pooling them would just
+	// pin the memory. See setSessionDirectory for the other case.
+	DP_message_pool_enabled_set(false);
+
 	m_config->setParent(this);
 	m_sessions = new SessionServer(config, this);
 	m_started = QDateTime::currentDateTimeUtc();
@@ -92,6 +101,9 @@ void MultiServer::setRecordingPath(const QString &path)
 void MultiServer::setSessionDirectory(const QDir &path)
 {
 	m_sessions->setSessionDir(path);
+	// File backed sessions only keep recent history loaded, messages come and
+	// go there, which is what the pool is good at.
+	DP_message_pool_enabled_set(true);
 }
 
 void MultiServer::setTemplateDirectory(const QDir &dir)
@@ -514,8 +526,21 @@ void MultiServer::callJsonApiAsync(
 	const QString &requestId, JsonApiMethod method, const QStringList &path,
 	const QJsonObject &request)
 {
-	JsonApiResult result = callJsonApi(method, path, request);
-	emit jsonApiResult(requestId, result);
+	JsonApiResolveResult(
+		callJsonApi(method, path, request), QHostAddress(QHostAddress::LocalHost),
+		this, [this, requestId](const JsonApiResult &result) {
+			emit jsonApiResult(requestId, result);
+		});
+}
+
+QByteArray MultiServer::metricsText() const
+{
+	MetricsWriter writer;
+	writer.gauge(
+		"drawpile_uptime_seconds", "Time since the server was started.", {},
+		double(m_started.msecsTo(QDateTime::currentDateTimeUtc())) / 1000.0);
+	m_sessions->writeMetrics(writer);
+	return writer.toText();
 }
 
 JsonApiResult MultiServer::callJsonApiCheckLock(
@@ -552,6 +577,8 @@ JsonApiResult MultiServer::serverJsonApi(
 		config::ClientTimeout,
 		config::SessionSizeLimit,
 		config::AutoresetThreshold,
+		config::ServerSideReset,
+		config::TransientWatermark,
 		config::SessionCountLimit,
 		config::EnablePersistence,
 		config::ArchiveMode,
@@ -93,6 +93,13 @@ public slots:
 		const QString &requestId, JsonApiMethod method, const QStringList &path,
 		const QJsonObject &request);
 
+	/**
+	 * @brief Get traffic and load metrics in the Prometheus text format
+	 *
+	 * This is used by the HTTP admin API.
+	 */
+	QByteArray metricsText() const;
+
 private slots:
 	void newTcpClient();
 #ifdef HAVE_WEBSOCKETS
@@ -180,6 +180,8 @@ MHD_Result request_handler(void *cls, MHD_Connection *connection, const char *ur
 		RequestContext *ctx = new RequestContext(request, reqhandler);
 		*con_cls = ctx;
 
+		ctx->request.setPeerAddress(QHostAddress(MHD_get_connection_info(connection, MHD_CONNECTION_INFO_CLIENT_ADDRESS)->client_addr));
+
 		// Get HTTP headers
 		QHash<QString,QString> headers;
 		MHD_get_connection_values(connection, MHD_HEADER_KIND, &assign_to_hash, &headers);
@@ -104,6 +104,10 @@ public:
 	//! Request body
 	const QByteArray body() const { return _body; }
 
+	//! Address of the client that made the request
+	const QHostAddress &peerAddress() const { return _peerAddress; }
+
+	void setPeerAddress(const QHostAddress &address) { _peerAddress = address; }
 	void setUrlMatch(const QRegularExpressionMatch &match) { _match = match; }
 	void setHeaders(const QHash<QString,QString> &data);
 	void setPostData(const QHash<QString,QString> &data) { _postdata = data; }
@@ -120,6 +124,7 @@ private:
 	QHash<QString, QString> _postdata;
 	QHash<QString, QString> _getdata;
 	QByteArray _body;
+	QHostAddress _peerAddress;
 };
 
 class HttpResponse {
@@ -5,15 +5,20 @@
 #include "thinsrv/multiserver.h"
 
 #include "libserver/jsonapi.h"
+#include "libserver/metrics.h"
 #include "libshared/util/qtcompat.h"
 
 #include <QJsonObject>
 #include <QMetaObject>
 #include <QDir>
+#include <QSemaphore>
 #include <QtGlobal>
+#include <memory>
 
 namespace server {
 
+static constexpr int DEFERRED_TIMEOUT_MSEC = 60000;
+
 Webadmin::Webadmin(QObject *parent)
 	: QObject(parent), m_server(new MicroHttpd(this)), m_mode(NOTSTARTED)
 {
@@ -67,6 +72,17 @@ void Webadmin::setSessions(MultiServer *server)
 
 		const QStringList path = req.pathMatch().captured(1).split('/', compat::SkipEmptyParts);
 
+		// Metrics are plain text for Prometheus to scrape, not JSON
+		if(m == JsonApiMethod::Get && path == QStringList{QStringLiteral("metrics")}) {
+			QByteArray text;
+			QMetaObject::invokeMethod(
+				server, "metricsText", Qt::BlockingQueuedConnection,
+				Q_RETURN_ARG(QByteArray, text));
+			HttpResponse r(200, text);
+			r.setHeader("Content-Type", MetricsWriter::CONTENT_TYPE);
+			return r;
+		}
+
 		QJsonDocument reqBodyDoc;
 		if(m == JsonApiMethod::Get || m ==JsonApiMethod::Delete) {
 			QJsonObject params;
@@ -99,6 +115,27 @@ void Webadmin::setSessions(MultiServer *server)
 			Q_ARG(QJsonObject, reqBodyDoc.object())
 			);
 
+		// Password checks run on a background thread, so the main thread
+		// doesn't stall while this one waits for the result. The state is
+		// shared in case the check only finishes after we've timed out.
+		if(result.isDeferred()) {
+			struct Deferred {
+				QSemaphore done;
+				JsonApiResult result;
+			};
+			std::shared_ptr<Deferred> deferred = std::make_shared<Deferred>();
+			JsonApiResolveResult(
+				result, req.peerAddress(), server,
+				[deferred](const JsonApiResult &resolved) {
+					deferred->result = resolved;
+					deferred->done.release();
+				});
+			if(!deferred->done.tryAcquire(1, DEFERRED_TIMEOUT_MSEC)) {
+				return HttpResponse::JsonErrorResponse("Timed out", 503);
+			}
+			result = deferred->result;
+		}
+
 		return HttpResponse::JsonResponse(result.body, result.status);
 	});
 }
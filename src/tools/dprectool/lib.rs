@@ -7,10 +7,10 @@ use drawdance::{
     msg::{InternalMessage, Message},
     DP_MessageType, DP_PlayerPass, DP_PlayerType, DP_RecorderType, DP_MSG_DRAW_DABS_CLASSIC,
     DP_MSG_DRAW_DABS_MYPAINT, DP_MSG_DRAW_DABS_PIXEL, DP_MSG_DRAW_DABS_PIXEL_SQUARE,
-    DP_MSG_FILL_RECT, DP_MSG_PUT_IMAGE, DP_PLAYER_COMPATIBLE, DP_PLAYER_MINOR_INCOMPATIBILITY,
-    DP_PLAYER_PASS_ALL, DP_PLAYER_PASS_CLIENT_PLAYBACK, DP_PLAYER_PASS_FEATURE_ACCESS,
-    DP_PLAYER_TYPE_BINARY, DP_PLAYER_TYPE_GUESS, DP_PLAYER_TYPE_TEXT, DP_PROTOCOL_VERSION,
-    DP_RECORDER_TYPE_BINARY, DP_RECORDER_TYPE_TEXT,
+    DP_MSG_FILL_GRADIENT, DP_MSG_FILL_RECT, DP_MSG_PUT_IMAGE, DP_PLAYER_COMPATIBLE,
+    DP_PLAYER_MINOR_INCOMPATIBILITY, DP_PLAYER_PASS_ALL, DP_PLAYER_PASS_CLIENT_PLAYBACK,
+    DP_PLAYER_PASS_FEATURE_ACCESS, DP_PLAYER_TYPE_BINARY, DP_PLAYER_TYPE_GUESS,
+    DP_PLAYER_TYPE_TEXT, DP_PROTOCOL_VERSION, DP_RECORDER_TYPE_BINARY, DP_RECORDER_TYPE_TEXT,
 };
 use std::{
     collections::{HashMap, HashSet},
@@ -498,6 +498,7 @@ fn should_include(msg: &Message, include_context_ids: &HashSet<c_uint>) -> bool
             msg.message_type(),
             DP_MSG_PUT_IMAGE
                 | DP_MSG_FILL_RECT
+                | DP_MSG_FILL_GRADIENT
                 | DP_MSG_DRAW_DABS_CLASSIC
                 | DP_MSG_DRAW_DABS_PIXEL
                 | DP_MSG_DRAW_DABS_PIXEL_SQUARE